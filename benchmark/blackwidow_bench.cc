@@ -3,12 +3,17 @@
 //  LICENSE file in the root directory of this source tree. An additional grant
 //  of patent rights can be found in the PATENTS file in the same directory.
 
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
 #include <iostream>
+#include <new>
 #include <vector>
 #include <thread>
 #include <functional>
 
 #include "blackwidow/blackwidow.h"
+#include "rocksdb/statistics.h"
 
 const int KEYLENGTH = 1024 * 10;
 const int VALUELENGTH = 1024 * 10;
@@ -21,6 +26,22 @@ using namespace std::chrono;
 static const std::string key(KEYLENGTH, 'a');
 static const std::string value(VALUELENGTH, 'a');
 
+// Every heap allocation of the process, see BenchEncodeAllocations
+static std::atomic<uint64_t> allocation_count(0);
+
+void* operator new(size_t size) {
+  allocation_count++;
+  void* ptr = malloc(size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
 void BenchSet() {
   printf("====== Set ======\n");
   blackwidow::Options options;
@@ -168,6 +189,124 @@ void BenchHGetall() {
   cost = duration_cast<milliseconds>(elapsed_seconds).count();
   std::cout << "Test case 3, HGetall " << fvs_out.size()
     << " Field HashTable Cost: "<< cost << "ms" << std::endl;
+
+  // 1. The HGetall of case 3 stepped over the deleted fields, which queued
+  //    a compaction of the hash in the background
+  // 2. HGetall the hash table 10000 field again (statistics cost time)
+  std::this_thread::sleep_for(std::chrono::seconds(10));
+  fvs_out.clear();
+  start = system_clock::now();
+  db.HGetall("HGETALL_KEY3", &fvs_out);
+  end = system_clock::now();
+  elapsed_seconds = end - start;
+  cost = duration_cast<milliseconds>(elapsed_seconds).count();
+  std::cout << "Test case 4, HGetall " << fvs_out.size()
+    << " Field HashTable after the key compaction Cost: "<< cost << "ms"
+    << std::endl;
+}
+
+// Many HGetall of small hashes, which are dominated by setting up the scan
+void BenchHGetallSmallHashes() {
+  printf("====== HGetall small hashes ======\n");
+  blackwidow::Options options;
+  options.create_if_missing = true;
+  blackwidow::BlackWidow db;
+  blackwidow::Status s = db.Open(options, "./db");
+
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+
+  const size_t hash_num = 10000;
+  const size_t ops_per_thread = 100000;
+  for (size_t i = 0; i < hash_num; ++i) {
+    std::vector<FieldValue> fvs;
+    for (size_t j = 0; j < 5; ++j) {
+      fvs.push_back({"field_" + std::to_string(j),
+                     "value_" + std::to_string(j)});
+    }
+    db.HMSet("HGETALL_SMALL_" + std::to_string(i), fvs);
+  }
+
+  std::vector<std::thread> jobs;
+  std::atomic<uint64_t> fields(0);
+  auto start = system_clock::now();
+  for (size_t i = 0; i < THREADNUM; ++i) {
+    jobs.emplace_back([&db, &fields, hash_num, ops_per_thread](size_t seed) {
+      std::vector<FieldValue> fvs;
+      uint64_t read = 0;
+      for (size_t j = 0; j < ops_per_thread; ++j) {
+        fvs.clear();
+        db.HGetall("HGETALL_SMALL_" + std::to_string((seed + j) % hash_num),
+                   &fvs);
+        read += fvs.size();
+      }
+      fields += read;
+    }, i * 997);
+  }
+
+  for (auto& job : jobs) {
+    job.join();
+  }
+  auto end = system_clock::now();
+  auto cost = duration_cast<microseconds>(end - start).count();
+  std::cout << "Test case 1, HGetall " << THREADNUM * ops_per_thread
+    << " hashes of 5 fields, " << fields << " fields, Cost: "
+    << cost / 1000 << "ms QPS: "
+    << THREADNUM * ops_per_thread * 1000000 / std::max<int64_t>(cost, 1)
+    << std::endl;
+
+  // The same reads while other threads keep writing, so that every pooled
+  // iterator has to be refreshed
+  const size_t writer_num = 4;
+  std::atomic<bool> reading(true);
+  std::atomic<uint64_t> writes(0);
+  std::vector<std::thread> writers;
+  for (size_t i = 0; i < writer_num; ++i) {
+    writers.emplace_back([&db, &reading, &writes, hash_num](size_t seed) {
+      int32_t ret;
+      uint64_t written = 0;
+      while (reading) {
+        db.HSet("HGETALL_SMALL_" + std::to_string((seed + written) % hash_num),
+                "field_" + std::to_string(written % 5), "new_value", &ret);
+        written++;
+      }
+      writes += written;
+    }, i * 7919);
+  }
+
+  jobs.clear();
+  fields = 0;
+  start = system_clock::now();
+  for (size_t i = 0; i < THREADNUM; ++i) {
+    jobs.emplace_back([&db, &fields, hash_num, ops_per_thread](size_t seed) {
+      std::vector<FieldValue> fvs;
+      uint64_t read = 0;
+      for (size_t j = 0; j < ops_per_thread; ++j) {
+        fvs.clear();
+        db.HGetall("HGETALL_SMALL_" + std::to_string((seed + j) % hash_num),
+                   &fvs);
+        read += fvs.size();
+      }
+      fields += read;
+    }, i * 997);
+  }
+
+  for (auto& job : jobs) {
+    job.join();
+  }
+  end = system_clock::now();
+  reading = false;
+  for (auto& writer : writers) {
+    writer.join();
+  }
+  cost = duration_cast<microseconds>(end - start).count();
+  std::cout << "Test case 2, HGetall " << THREADNUM * ops_per_thread
+    << " hashes of 5 fields with " << writer_num << " writers, "
+    << writes << " HSet, Cost: " << cost / 1000 << "ms QPS: "
+    << THREADNUM * ops_per_thread * 1000000 / std::max<int64_t>(cost, 1)
+    << std::endl;
 }
 
 void BenchScan() {
@@ -225,14 +364,585 @@ void BenchScan() {
     << cost << "s" << std::endl;
 }
 
+void BenchPfCount() {
+  printf("====== PfCount ======\n");
+  blackwidow::Options options;
+  options.create_if_missing = true;
+  blackwidow::BlackWidow db;
+  blackwidow::Status s = db.Open(options, "./db");
+
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+
+  // 250 dense HyperLogLog keys with 20000 distinct values each
+  bool update;
+  std::vector<std::string> hll_keys;
+  for (size_t i = 0; i < 250; ++i) {
+    std::string hll_key = "PFCOUNT_KEY" + std::to_string(i);
+    for (size_t j = 0; j < 20000; j += 100) {
+      std::vector<std::string> values;
+      for (size_t k = j; k < j + 100; ++k) {
+        values.push_back(hll_key + "_" + std::to_string(k));
+      }
+      db.PfAdd(hll_key, values, &update);
+    }
+    hll_keys.push_back(hll_key);
+  }
+
+  size_t count_num = 100;
+  std::vector<size_t> key_nums {2, 10, 50, 100, 250};
+  for (size_t key_num : key_nums) {
+    std::vector<std::string> keys(hll_keys.begin(),
+                                  hll_keys.begin() + key_num);
+    int64_t result;
+    auto start = system_clock::now();
+    for (size_t i = 0; i < count_num; ++i) {
+      db.PfCount(keys, &result);
+    }
+    auto end = system_clock::now();
+    auto cost = duration_cast<microseconds>(end - start).count();
+    std::cout << "PfCount " << key_num << " keys, " << count_num
+      << " times Cost: " << cost / 1000 << "ms Avg: "
+      << cost / count_num << "us Result: " << result << std::endl;
+  }
+}
+
+void BenchPfMerge() {
+  printf("====== PfMerge ======\n");
+  blackwidow::Options options;
+  options.create_if_missing = true;
+  blackwidow::BlackWidow db;
+  blackwidow::Status s = db.Open(options, "./db");
+
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+
+  bool update;
+  std::vector<std::string> hll_keys;
+  for (size_t i = 0; i < 250; ++i) {
+    std::string hll_key = "PFMERGE_KEY" + std::to_string(i);
+    for (size_t j = 0; j < 20000; j += 100) {
+      std::vector<std::string> values;
+      for (size_t k = j; k < j + 100; ++k) {
+        values.push_back(hll_key + "_" + std::to_string(k));
+      }
+      db.PfAdd(hll_key, values, &update);
+    }
+    hll_keys.push_back(hll_key);
+  }
+
+  size_t merge_num = 100;
+  std::vector<size_t> key_nums {2, 10, 50, 100, 250};
+  for (size_t key_num : key_nums) {
+    std::vector<std::string> keys {"PFMERGE_DEST"};
+    keys.insert(keys.end(), hll_keys.begin(), hll_keys.begin() + key_num - 1);
+    auto start = system_clock::now();
+    for (size_t i = 0; i < merge_num; ++i) {
+      db.PfMerge(keys);
+    }
+    auto end = system_clock::now();
+    auto cost = duration_cast<microseconds>(end - start).count();
+    std::cout << "PfMerge " << key_num << " keys, " << merge_num
+      << " times Cost: " << cost / 1000 << "ms Avg: "
+      << cost / merge_num << "us" << std::endl;
+  }
+}
+
+// Byte at a time bit count, the comparison baseline of the bit kernels
+static int64_t ReferenceBitCount(const std::string& value) {
+  static const uint8_t bits_in_byte[256] = {
+#define B2(n) n, n + 1, n + 1, n + 2
+#define B4(n) B2(n), B2(n + 1), B2(n + 1), B2(n + 2)
+#define B6(n) B4(n), B4(n + 1), B4(n + 1), B4(n + 2)
+    B6(0), B6(1), B6(1), B6(2)
+#undef B6
+#undef B4
+#undef B2
+  };
+  int64_t count = 0;
+  for (size_t i = 0; i < value.size(); ++i) {
+    count += bits_in_byte[static_cast<uint8_t>(value[i])];
+  }
+  return count;
+}
+
+void BenchBitOps() {
+  printf("====== BitCount / BitPos / BitOp ======\n");
+  blackwidow::Options options;
+  options.create_if_missing = true;
+  blackwidow::BlackWidow db;
+  blackwidow::Status s = db.Open(options, "./db");
+
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+
+  std::vector<size_t> sizes {1 << 10, 64 << 10, 1 << 20, 16 << 20, 64 << 20};
+  for (size_t size : sizes) {
+    std::string bitmap(size, 0);
+    for (size_t i = 0; i < size; ++i) {
+      bitmap[i] = static_cast<char>(rand());
+    }
+    db.Set("BITOPS_KEY1", bitmap);
+    std::reverse(bitmap.begin(), bitmap.end());
+    db.Set("BITOPS_KEY2", bitmap);
+    // BitPos has to scan the whole value to find no clear bit
+    db.Set("BITOPS_ONES", std::string(size, '\xff'));
+
+    size_t times = std::max(static_cast<size_t>(1),
+                            (static_cast<size_t>(256) << 20) / size);
+    double mbytes = static_cast<double>(size) * times / (1 << 20);
+    std::cout << "Value size " << size << " bytes, " << times
+      << " times" << std::endl;
+
+    int32_t count;
+    auto start = system_clock::now();
+    for (size_t i = 0; i < times; ++i) {
+      db.BitCount("BITOPS_KEY1", 0, 0, &count, false);
+    }
+    auto end = system_clock::now();
+    auto cost = duration_cast<microseconds>(end - start).count();
+    std::cout << "  BitCount Cost: " << cost / 1000 << "ms "
+      << mbytes * 1000000 / std::max(cost, 1L) << "MB/s" << std::endl;
+
+    std::string get_value;
+    int64_t reference_count = 0;
+    start = system_clock::now();
+    for (size_t i = 0; i < times; ++i) {
+      db.Get("BITOPS_KEY1", &get_value);
+      reference_count += ReferenceBitCount(get_value);
+    }
+    end = system_clock::now();
+    cost = duration_cast<microseconds>(end - start).count();
+    std::cout << "  Get + bytewise count Cost: " << cost / 1000 << "ms "
+      << mbytes * 1000000 / std::max(cost, 1L) << "MB/s" << std::endl;
+    if (reference_count != static_cast<int64_t>(count * times)) {
+      std::cout << "  BitCount mismatch" << std::endl;
+    }
+
+    int64_t pos;
+    start = system_clock::now();
+    for (size_t i = 0; i < times; ++i) {
+      db.BitPos("BITOPS_ONES", 0, &pos);
+    }
+    end = system_clock::now();
+    cost = duration_cast<microseconds>(end - start).count();
+    std::cout << "  BitPos Cost: " << cost / 1000 << "ms "
+      << mbytes * 1000000 / std::max(cost, 1L) << "MB/s" << std::endl;
+
+    int64_t ret;
+    size_t op_times = std::max(static_cast<size_t>(1), times / 16);
+    std::vector<std::string> src_keys {"BITOPS_KEY1", "BITOPS_KEY2"};
+    start = system_clock::now();
+    for (size_t i = 0; i < op_times; ++i) {
+      db.BitOp(kBitOpAnd, "BITOPS_DEST", src_keys, &ret);
+    }
+    end = system_clock::now();
+    cost = duration_cast<microseconds>(end - start).count();
+    std::cout << "  BitOp AND Cost: " << cost / 1000 << "ms "
+      << mbytes / times * op_times * 1000000 / std::max(cost, 1L)
+      << "MB/s" << std::endl;
+  }
+}
+
+void BenchBmBitOp() {
+  printf("====== BmBitOp ======\n");
+  blackwidow::Options options;
+  options.create_if_missing = true;
+  blackwidow::BlackWidow db;
+  blackwidow::Status s = db.Open(options, "./db");
+
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+
+  // Sparse bitmaps over the whole 2^32 offsets, as strings bitmaps and as
+  // compressed bitmaps
+  int32_t ret;
+  int64_t count;
+  std::vector<size_t> bit_nums {1000, 10000, 100000};
+  for (size_t bit_num : bit_nums) {
+    std::vector<std::string> keys {"BMBITOP_KEY1", "BMBITOP_KEY2"};
+    std::vector<std::string> strings_keys {"BITOP_STRINGS_KEY1",
+                                           "BITOP_STRINGS_KEY2"};
+    std::map<DataType, Status> type_status;
+    db.Del(keys, &type_status);
+    db.Del(strings_keys, &type_status);
+
+    auto start = system_clock::now();
+    for (size_t i = 0; i < bit_num; ++i) {
+      int64_t offset = (static_cast<int64_t>(rand()) << 16 ^ rand())
+        & 0xffffffff;
+      db.BmSetBit(keys[i % 2], offset, 1, &ret);
+    }
+    auto end = system_clock::now();
+    auto cost = duration_cast<microseconds>(end - start).count();
+    std::cout << "BmSetBit " << bit_num << " bits Cost: " << cost / 1000
+      << "ms Avg: " << cost / bit_num << "us" << std::endl;
+
+    size_t op_num = 10;
+    start = system_clock::now();
+    for (size_t i = 0; i < op_num; ++i) {
+      db.BmBitOp(kBitOpOr, "BMBITOP_DEST", keys, &count);
+    }
+    end = system_clock::now();
+    cost = duration_cast<microseconds>(end - start).count();
+    std::cout << "BmBitOp OR " << bit_num << " bits Avg: "
+      << cost / op_num << "us" << std::endl;
+
+    if (bit_num > 10000) {
+      continue;
+    }
+    for (size_t i = 0; i < bit_num; ++i) {
+      int64_t offset = (static_cast<int64_t>(rand()) << 16 ^ rand())
+        & 0xffffffff;
+      db.SetBit(strings_keys[i % 2], offset, 1, &ret);
+    }
+    int64_t len;
+    start = system_clock::now();
+    db.BitOp(kBitOpOr, "BITOP_STRINGS_DEST", strings_keys, &len);
+    end = system_clock::now();
+    cost = duration_cast<microseconds>(end - start).count();
+    std::cout << "BitOp OR " << bit_num << " bits of strings Cost: "
+      << cost << "us" << std::endl;
+  }
+}
+
+void BenchGeoRadius() {
+  printf("====== GeoRadius ======\n");
+  blackwidow::Options options;
+  options.create_if_missing = true;
+  blackwidow::BlackWidow db;
+  blackwidow::Status s = db.Open(options, "./db");
+
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+
+  std::map<DataType, Status> type_status;
+  db.Del({"GEO_KEY"}, &type_status);
+
+  // Points spread over a 10 x 10 degrees area
+  int32_t ret;
+  size_t point_num = 1000000;
+  size_t batch_size = 1000;
+  auto start = system_clock::now();
+  for (size_t i = 0; i < point_num; i += batch_size) {
+    std::vector<GeoMember> members;
+    for (size_t j = i; j < i + batch_size; ++j) {
+      members.push_back({rand() % 1000000 / 100000.0,
+                         rand() % 1000000 / 100000.0,
+                         "member" + std::to_string(j)});
+    }
+    db.GeoAdd("GEO_KEY", members, &ret);
+  }
+  auto end = system_clock::now();
+  auto cost = duration_cast<microseconds>(end - start).count();
+  std::cout << "GeoAdd " << point_num << " points Cost: " << cost / 1000
+    << "ms" << std::endl;
+
+  size_t op_num = 1000;
+  std::vector<GeoNeighbour> neighbours;
+  for (double radius : {1000.0, 10000.0, 50000.0}) {
+    size_t found = 0;
+    start = system_clock::now();
+    for (size_t i = 0; i < op_num; ++i) {
+      db.GeoRadius("GEO_KEY", 1 + rand() % 800000 / 100000.0,
+                   1 + rand() % 800000 / 100000.0, radius, 0, &neighbours);
+      found += neighbours.size();
+    }
+    end = system_clock::now();
+    cost = duration_cast<microseconds>(end - start).count();
+    std::cout << "GeoRadius " << radius / 1000 << "km found " << found / op_num
+      << " points Avg: " << cost / op_num << "us" << std::endl;
+  }
+}
+
+void BenchStreams() {
+  printf("====== Streams ======\n");
+  blackwidow::Options options;
+  options.create_if_missing = true;
+  blackwidow::BlackWidow db;
+  blackwidow::Status s = db.Open(options, "./db");
+
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+
+  std::map<DataType, Status> type_status;
+  db.Del({"XADD_KEY"}, &type_status);
+
+  size_t entry_num = 100000;
+  std::vector<StreamID> ids;
+  auto start = system_clock::now();
+  for (size_t i = 0; i < entry_num; ++i) {
+    StreamID id;
+    db.XAdd("XADD_KEY", {{"field", "value"}}, &id);
+    ids.push_back(id);
+  }
+  auto end = system_clock::now();
+  auto cost = duration_cast<microseconds>(end - start).count();
+  std::cout << "XAdd " << entry_num << " entries Cost: " << cost / 1000
+    << "ms Avg: " << cost / entry_num << "us" << std::endl;
+
+  // Reads are a seek and a scan of the entries returned
+  size_t op_num = 10000;
+  std::vector<StreamEntry> entries;
+  StreamID max_id(UINT64_MAX, UINT64_MAX);
+  start = system_clock::now();
+  for (size_t i = 0; i < op_num; ++i) {
+    db.XRange("XADD_KEY", ids[rand() % entry_num], max_id, 10, &entries);
+  }
+  end = system_clock::now();
+  cost = duration_cast<microseconds>(end - start).count();
+  std::cout << "XRange 10 entries Avg: " << cost / op_num << "us"
+    << std::endl;
+
+  int32_t ret;
+  start = system_clock::now();
+  db.XTrim("XADD_KEY", entry_num / 10, &ret);
+  end = system_clock::now();
+  cost = duration_cast<microseconds>(end - start).count();
+  std::cout << "XTrim " << ret << " entries Cost: " << cost / 1000 << "ms"
+    << std::endl;
+
+  start = system_clock::now();
+  for (size_t i = 0; i < op_num; ++i) {
+    db.XRange("XADD_KEY", StreamID(), max_id, 10, &entries);
+  }
+  end = system_clock::now();
+  cost = duration_cast<microseconds>(end - start).count();
+  std::cout << "XRange 10 entries after XTrim Avg: " << cost / op_num << "us"
+    << std::endl;
+}
+
+void BenchFilters() {
+  printf("====== Filters ======\n");
+  blackwidow::Options options;
+  options.create_if_missing = true;
+  blackwidow::BlackWidow db;
+  blackwidow::Status s = db.Open(options, "./db");
+
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+
+  std::map<DataType, Status> type_status;
+  db.Del({"SEEN_SET_KEY", "SEEN_BF_KEY"}, &type_status);
+
+  // The same ids in a set and in a bloom filter, in batches of batch_size
+  size_t id_num = 1000000;
+  size_t batch_size = 100;
+  std::vector<std::string> ids;
+  for (size_t i = 0; i < id_num; ++i) {
+    ids.push_back("id_" + std::to_string(i));
+  }
+
+  int32_t ret;
+  auto start = system_clock::now();
+  for (size_t i = 0; i < id_num; i += batch_size) {
+    std::vector<std::string> batch(ids.begin() + i,
+                                   ids.begin() + i + batch_size);
+    db.SAdd("SEEN_SET_KEY", batch, &ret);
+  }
+  auto end = system_clock::now();
+  auto cost = duration_cast<microseconds>(end - start).count();
+  std::cout << "SAdd " << id_num << " ids Cost: " << cost / 1000
+    << "ms" << std::endl;
+
+  db.BFReserve("SEEN_BF_KEY", 0.01, id_num);
+  std::vector<bool> flags;
+  start = system_clock::now();
+  for (size_t i = 0; i < id_num; i += batch_size) {
+    std::vector<std::string> batch(ids.begin() + i,
+                                   ids.begin() + i + batch_size);
+    db.BFAdd("SEEN_BF_KEY", batch, &flags);
+  }
+  end = system_clock::now();
+  cost = duration_cast<microseconds>(end - start).count();
+  std::cout << "BFAdd " << id_num << " ids Cost: " << cost / 1000
+    << "ms" << std::endl;
+
+  FilterInfo info;
+  db.BFInfo("SEEN_BF_KEY", &info);
+  std::cout << "Bloom filter " << info.bytes / 1024 << "KB, "
+    << static_cast<double>(info.bytes) / id_num << " bytes per id"
+    << std::endl;
+
+  // A check of batch_size ids is one lookup per id for the set and one
+  // MultiGet for the filter
+  size_t op_num = 1000;
+  start = system_clock::now();
+  for (size_t i = 0; i < op_num; ++i) {
+    size_t first = rand() % (id_num - batch_size);
+    for (size_t j = first; j < first + batch_size; ++j) {
+      db.SIsmember("SEEN_SET_KEY", ids[j], &ret);
+    }
+  }
+  end = system_clock::now();
+  cost = duration_cast<microseconds>(end - start).count();
+  std::cout << "SIsmember " << batch_size << " ids Avg: " << cost / op_num
+    << "us" << std::endl;
+
+  start = system_clock::now();
+  for (size_t i = 0; i < op_num; ++i) {
+    size_t first = rand() % (id_num - batch_size);
+    std::vector<std::string> batch(ids.begin() + first,
+                                   ids.begin() + first + batch_size);
+    db.BFExists("SEEN_BF_KEY", batch, &flags);
+  }
+  end = system_clock::now();
+  cost = duration_cast<microseconds>(end - start).count();
+  std::cout << "BFExists " << batch_size << " ids Avg: " << cost / op_num
+    << "us" << std::endl;
+}
+
+void BenchBlobFiles() {
+  printf("====== Blob files ======\n");
+  // Overwrite a fixed set of keys and fields with VALUELENGTH values, then
+  // compact everything, with the values inline and in blob files
+  size_t key_num = 2000;
+  size_t op_num = 20000;
+  std::vector<uint64_t> min_blob_sizes {0, 4096};
+  for (uint64_t min_blob_size : min_blob_sizes) {
+    std::string db_path = min_blob_size ? "./db_blob" : "./db_inline";
+    blackwidow::BlackwidowOptions bw_options;
+    bw_options.options.create_if_missing = true;
+    bw_options.options.statistics = rocksdb::CreateDBStatistics();
+    bw_options.strings_min_blob_size = min_blob_size;
+    bw_options.hashes_min_blob_size = min_blob_size;
+    blackwidow::BlackWidow db;
+    blackwidow::Status s = db.Open(bw_options, db_path);
+
+    if (!s.ok()) {
+      printf("Open db failed, error: %s\n", s.ToString().c_str());
+      return;
+    }
+
+    auto start = system_clock::now();
+    for (size_t i = 0; i < op_num; ++i) {
+      db.Set("BLOB_KEY_" + std::to_string(i % key_num), value);
+    }
+    auto end = system_clock::now();
+    auto cost = duration_cast<milliseconds>(end - start).count();
+    std::cout << db_path << " Set " << op_num << " Cost: " << cost
+      << "ms QPS: " << op_num * 1000 / std::max<int64_t>(cost, 1)
+      << std::endl;
+
+    int32_t ret;
+    start = system_clock::now();
+    for (size_t i = 0; i < op_num; ++i) {
+      db.HSet("BLOB_HASH_KEY", "FIELD_" + std::to_string(i % key_num),
+              value, &ret);
+    }
+    end = system_clock::now();
+    cost = duration_cast<milliseconds>(end - start).count();
+    std::cout << db_path << " HSet " << op_num << " Cost: " << cost
+      << "ms QPS: " << op_num * 1000 / std::max<int64_t>(cost, 1)
+      << std::endl;
+
+    start = system_clock::now();
+    db.Compact(kAll, true);
+    end = system_clock::now();
+    cost = duration_cast<milliseconds>(end - start).count();
+    const rocksdb::Statistics* stats = bw_options.options.statistics.get();
+    uint64_t user_bytes = 2 * op_num * VALUELENGTH;
+    uint64_t compact_bytes = stats->getTickerCount(rocksdb::COMPACT_READ_BYTES)
+      + stats->getTickerCount(rocksdb::COMPACT_WRITE_BYTES);
+    std::cout << db_path << " Compact Cost: " << cost << "ms"
+      << " compaction io: " << compact_bytes / 1024 / 1024 << "MB"
+      << " (" << static_cast<double>(compact_bytes) / user_bytes
+      << "x the written values)" << std::endl;
+  }
+}
+
+void BenchEncodeAllocations() {
+  printf("====== Encode allocations ======\n");
+  blackwidow::Options options;
+  options.create_if_missing = true;
+  blackwidow::BlackWidow db;
+  blackwidow::Status s = db.Open(options, "./db");
+
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+
+  // Keys longer than the inline buffers of the encoders, the data keys
+  // and the values are encoded in the thread local arena
+  int32_t ret;
+  uint64_t len;
+  std::string long_key(1024, 'k');
+  std::vector<std::string> members {"MEMBER"};
+  db.HSet(long_key, "FIELD", "VALUE", &ret);
+  db.SAdd(long_key, members, &ret);
+  db.RPush(long_key, members, &len);
+
+  size_t op_num = 100000;
+  std::vector<std::pair<std::string, std::function<void()>>> cases {
+    {"Set", [&]() { db.Set(long_key, "VALUE"); }},
+    {"HGet", [&]() {
+      blackwidow::PinnableValue pinned;
+      db.HGet(long_key, "FIELD", &pinned);
+    }},
+    {"SIsmember", [&]() { db.SIsmember(long_key, "MEMBER", &ret); }},
+    {"LIndex", [&]() {
+      blackwidow::PinnableValue pinned;
+      db.LIndex(long_key, 0, &pinned);
+    }},
+  };
+  for (auto& c : cases) {
+    // Warm up the arena first
+    c.second();
+    uint64_t before = allocation_count;
+    auto start = system_clock::now();
+    for (size_t i = 0; i < op_num; ++i) {
+      c.second();
+    }
+    auto end = system_clock::now();
+    auto cost = duration_cast<microseconds>(end - start).count();
+    std::cout << c.first << " " << op_num << " ops, allocations per op: "
+      << static_cast<double>(allocation_count - before) / op_num
+      << " Avg: " << static_cast<double>(cost) / op_num << "us" << std::endl;
+  }
+}
 
 int main(int argc, char** argv) {
   // keys
   BenchSet();
+  BenchBlobFiles();
+  BenchEncodeAllocations();
 
   // hashes
   BenchHGetall();
+  BenchHGetallSmallHashes();
 
   // Iterator
   BenchScan();
+
+  // hyperloglog
+  BenchPfCount();
+  BenchPfMerge();
+
+  // bitmap
+  BenchBitOps();
+  BenchBmBitOp();
+
+  // geo
+  BenchGeoRadius();
+
+  // streams
+  BenchStreams();
+
+  // filters
+  BenchFilters();
 }
@@ -11,6 +11,7 @@
 #include <list>
 #include <queue>
 #include <vector>
+#include <functional>
 #include <unistd.h>
 
 #include "rocksdb/status.h"
@@ -39,19 +40,120 @@ const std::string HASHES_DB = "hashes";
 const std::string LISTS_DB = "lists";
 const std::string ZSETS_DB = "zsets";
 const std::string SETS_DB = "sets";
+const std::string BITMAPS_DB = "bitmaps";
+const std::string STREAMS_DB = "streams";
+const std::string FILTERS_DB = "filters";
 
 using Options = rocksdb::Options;
 using Status = rocksdb::Status;
 using Slice = rocksdb::Slice;
 
+class Redis;
 class RedisStrings;
 class RedisHashes;
 class RedisSets;
 class RedisLists;
 class RedisZSets;
+class RedisBitmaps;
+class RedisStreams;
+class RedisFilters;
 class HyperLogLog;
+class GeoShape;
 class MutexFactory;
 class Mutex;
+class WatchTable;
+class ListWaiters;
+class CompactKeyTracker;
+class BGTaskScheduler;
+class BGTaskProgress;
+
+// A window of the day in local time, in minutes since midnight. A window
+// whose end comes before its start spans midnight.
+struct TimeWindow {
+  int start_minute;
+  int end_minute;
+};
+
+struct BlackwidowOptions {
+  rocksdb::Options options;
+
+  // Capacity in bytes of the row cache of every data type, which keeps the
+  // strings values and the meta values of the hottest keys, 0 disables it
+  size_t row_cache_size;
+
+  // Values of at least this many bytes are written to blob files next to
+  // the SSTs, so that compactions move a small reference instead of the
+  // value, 0 keeps every value inline. The strings threshold applies to the
+  // strings values and segments, the hashes one to the field values.
+  uint64_t strings_min_blob_size;
+  uint64_t hashes_min_blob_size;
+
+  // A hash or set whose reads have stepped over this many tombstones and
+  // stale versions, or a collection which has had this many elements
+  // removed by deletes, pops and trims, gets the range of its data
+  // compacted in the background. 0 leaves them to the regular compactions.
+  uint64_t compact_key_skipped_threshold;
+  uint64_t compact_key_churn_threshold;
+
+  // Number of threads running the background tasks, with more than one
+  // the key compactions keep a thread free from the full compactions
+  size_t bg_task_threads;
+
+  // Bytes per second written by the flushes and compactions of all the
+  // data types together, the flushes being served first. The key scans of
+  // Keys() and GetKeyNum() get a budget of their own. 0 leaves them
+  // unthrottled, a rate_limiter already set in options is kept.
+  int64_t compaction_bytes_per_sec;
+  int64_t scan_bytes_per_sec;
+
+  // The full compactions only start within these windows, and wait for
+  // the next one otherwise, the key compactions run at any time. Empty
+  // allows any time.
+  std::vector<TimeWindow> bg_task_windows;
+
+  BlackwidowOptions() : row_cache_size(0),
+    strings_min_blob_size(0), hashes_min_blob_size(0),
+    compact_key_skipped_threshold(100000),
+    compact_key_churn_threshold(10000), bg_task_threads(2),
+    compaction_bytes_per_sec(0), scan_bytes_per_sec(0) {}
+};
+
+struct RowCacheStatistics {
+  uint64_t hits;
+  uint64_t misses;
+  // Inserts refused by the admission policy
+  uint64_t rejects;
+  uint64_t usage;
+};
+
+// A value read without copying it, value() points straight into the block
+// cache or the memtable and stays valid until the handle is reset, reused
+// or destroyed. Values which have to be assembled, like segmented strings
+// or row cache hits, are held by the handle itself.
+class PinnableValue {
+ public:
+  PinnableValue() = default;
+  PinnableValue(const PinnableValue&) = delete;
+  PinnableValue& operator=(const PinnableValue&) = delete;
+
+  const Slice& value() const { return value_; }
+  const char* data() const { return value_.data(); }
+  size_t size() const { return value_.size(); }
+  std::string ToString() const { return value_.ToString(); }
+  void Reset() {
+    pinnable_.Reset();
+    value_.clear();
+  }
+
+ private:
+  friend class RedisStrings;
+  friend class RedisHashes;
+  friend class RedisLists;
+
+  rocksdb::PinnableSlice pinnable_;
+  // The user value within pinnable_, without the internal suffix
+  Slice value_;
+};
 
 struct KeyValue {
   std::string key;
@@ -80,6 +182,14 @@ struct KeyVersion {
   }
 };
 
+struct KeyEpoch {
+  std::string key;
+  uint64_t epoch;
+  bool operator == (const KeyEpoch& ke) const {
+    return (ke.key == key && ke.epoch == epoch);
+  }
+};
+
 struct ScoreMember {
   double score;
   std::string member;
@@ -88,6 +198,66 @@ struct ScoreMember {
   }
 };
 
+struct GeoMember {
+  double longitude;
+  double latitude;
+  std::string member;
+};
+
+// A member found by a geo search, distance is in meters from the center of
+// the search
+struct GeoNeighbour {
+  std::string member;
+  double longitude;
+  double latitude;
+  double distance;
+};
+
+// The id of a stream entry, the milliseconds time of the entry and a
+// sequence number among the entries of the same millisecond
+struct StreamID {
+  uint64_t ms;
+  uint64_t seq;
+  StreamID(uint64_t _ms = 0, uint64_t _seq = 0) : ms(_ms), seq(_seq) {}
+  bool operator == (const StreamID& id) const {
+    return (id.ms == ms && id.seq == seq);
+  }
+  bool operator < (const StreamID& id) const {
+    return ms < id.ms || (ms == id.ms && seq < id.seq);
+  }
+};
+
+struct StreamEntry {
+  StreamID id;
+  std::vector<FieldValue> field_values;
+  bool operator == (const StreamEntry& entry) const {
+    return (entry.id == id && entry.field_values == field_values);
+  }
+};
+
+// An entry delivered to a consumer of a group and not acknowledged yet
+struct StreamPendingEntry {
+  StreamID id;
+  std::string consumer;
+  uint64_t delivery_time_ms;
+  uint64_t delivery_count;
+};
+
+// The state of a bloom or cuckoo filter
+struct FilterInfo {
+  // The number of items the filter holds at its error rate
+  uint64_t capacity;
+  uint64_t items;
+  // The size of all its segments
+  uint64_t bytes;
+  // The layers of a bloom filter, 1 for a cuckoo filter
+  int32_t filters;
+  // The parameters of the first layer of a bloom filter, a cuckoo filter
+  // does not grow and its error rate is bound by its fingerprints
+  int32_t expansion;
+  double error_rate;
+};
+
 enum BeforeOrAfter {
   Before,
   After
@@ -99,7 +269,10 @@ enum DataType {
   kHashes,
   kLists,
   kZSets,
-  kSets
+  kSets,
+  kBitmaps,
+  kStreams,
+  kFilters
 };
 
 enum AGGREGATE {
@@ -124,7 +297,10 @@ enum Operation {
   kCleanZSets,
   kCleanSets,
   kCleanLists,
-  kCompactKey
+  kCompactKey,
+  kCleanBitmaps,
+  kCleanStreams,
+  kCleanFilters
 };
 
 struct BGTask {
@@ -137,6 +313,16 @@ struct BGTask {
          const std::string& _argv = "") : type(_type), operation(_opeation), argv(_argv) {}
 };
 
+struct BGTaskStatus {
+  BGTask task;
+  bool running;
+  // Fraction of the task done so far, and the estimated time left from the
+  // pace of that fraction, both are 0 until the task has made progress
+  double progress;
+  uint64_t elapsed_us;
+  uint64_t eta_us;
+};
+
 class BlackWidow {
  public:
   BlackWidow();
@@ -144,6 +330,8 @@ class BlackWidow {
 
   Status Open(const Options& options, const std::string& db_path);
 
+  Status Open(const BlackwidowOptions& bw_options, const std::string& db_path);
+
   Status GetStartKey(int64_t cursor, std::string* start_key);
 
   int64_t StoreAndGetCursor(int64_t cursor, const std::string& next_key);
@@ -169,6 +357,9 @@ class BlackWidow {
   // the special value nil is returned
   Status Get(const Slice& key, std::string* value);
 
+  // Same as Get, without copying the value, see PinnableValue
+  Status Get(const Slice& key, PinnableValue* value);
+
   // Atomically sets key to value and returns the old value stored at key
   // Returns an error when key exists but does not hold a string value.
   Status GetSet(const Slice& key, const Slice& value, std::string* old_value);
@@ -270,6 +461,9 @@ class BlackWidow {
   // hash or key does not exist.
   Status HGet(const Slice& key, const Slice& field, std::string* value);
 
+  // Same as HGet, without copying the value, see PinnableValue
+  Status HGet(const Slice& key, const Slice& field, PinnableValue* value);
+
   // Sets the specified fields to their respective values in the hash stored at
   // key. This command overwrites any specified fields already existing in the
   // hash. If key does not exist, a new key holding a hash is created.
@@ -430,6 +624,11 @@ class BlackWidow {
   // Removes and returns one random elements from the set value store at key.
   Status SPop(const Slice& key, std::string* member);
 
+  // Removes and returns up to count distinct random elements from the set
+  // value store at key, in one write.
+  Status SPop(const Slice& key, int32_t count,
+              std::vector<std::string>* members);
+
   // When called with just the key argument, return a random element from the
   // set value stored at key.
   // when called with the additional count argument, return an array of count
@@ -524,6 +723,9 @@ class BlackWidow {
   // forth.
   Status LIndex(const Slice& key, int64_t index, std::string* element);
 
+  // Same as LIndex, without copying the element, see PinnableValue
+  Status LIndex(const Slice& key, int64_t index, PinnableValue* element);
+
   // Inserts value in the list stored at key either before or after the
   // reference value pivot.
   // When key does not exist, it is considered an empty list and no operation is
@@ -579,6 +781,21 @@ class BlackWidow {
                    const Slice& destination,
                    std::string* element);
 
+  // Blocking versions of LPop and RPop, the element is popped from the first
+  // non empty list of keys. When they are all empty, waits until an element
+  // is pushed to one of them, the clients blocked first being served first.
+  // A timeout_ms of 0 waits for ever, otherwise Status::TimedOut() is
+  // returned once it is over. Inside ExecIfUnchanged() they don't wait and
+  // return Status::TimedOut() right away, as in a redis MULTI.
+  Status BLPop(const std::vector<std::string>& keys, int64_t timeout_ms,
+               std::string* key, std::string* element);
+  Status BRPop(const std::vector<std::string>& keys, int64_t timeout_ms,
+               std::string* key, std::string* element);
+
+  // Blocking version of RPoplpush, waits for an element like BRPop
+  Status BRPoplpush(const Slice& source, const Slice& destination,
+                    int64_t timeout_ms, std::string* element);
+
   // Zsets Commands
 
   // Adds all the specified members with the specified scores to the sorted set
@@ -725,6 +942,27 @@ class BlackWidow {
               std::vector<std::string> members,
               int32_t* ret);
 
+  // Removes and returns up to count members with the lowest scores in the
+  // sorted set stored at key, the lowest first. Members of equal score are
+  // popped in lexicographical order.
+  Status ZPopMin(const Slice& key,
+                 int32_t count,
+                 std::vector<ScoreMember>* score_members);
+
+  // Same as ZPopMin for the members with the highest scores, the highest
+  // first
+  Status ZPopMax(const Slice& key,
+                 int32_t count,
+                 std::vector<ScoreMember>* score_members);
+
+  // Blocking versions of ZPopMin and ZPopMax, the member is popped from the
+  // first non empty sorted set of keys. When they are all empty, waits until
+  // a member is added to one of them, like BLPop does for the lists.
+  Status BZPopMin(const std::vector<std::string>& keys, int64_t timeout_ms,
+                  std::string* key, ScoreMember* score_member);
+  Status BZPopMax(const std::vector<std::string>& keys, int64_t timeout_ms,
+                  std::string* key, ScoreMember* score_member);
+
   // Removes all elements in the sorted set stored at key with rank between
   // start and stop. Both start and stop are 0 -based indexes with 0 being the
   // element with the lowest score. These indexes can be negative numbers, where
@@ -893,6 +1131,174 @@ class BlackWidow {
   Status ZScan(const Slice& key, int64_t cursor, const std::string& pattern,
                int64_t count, std::vector<ScoreMember>* score_members, int64_t* next_cursor);
 
+  // Geo Commands
+
+  // Points are stored in sorted sets scored by their 52 bits geohash, like
+  // redis does, so the other sorted set commands work on them. Distances
+  // are in meters.
+
+  // Adds the points to the sorted set stored at key, or updates their
+  // position. ret is the number of new members. The longitudes must be
+  // within [-180, 180] and the latitudes within [-85.05112878, 85.05112878].
+  Status GeoAdd(const Slice& key, const std::vector<GeoMember>& members,
+                int32_t* ret);
+
+  // The distance between two members, Status::NotFound() if one of them is
+  // missing
+  Status GeoDist(const Slice& key, const Slice& member1,
+                 const Slice& member2, double* distance);
+
+  // Returns the members within radius meters of the point, or of the member,
+  // the nearest first. The geohash cells around the point are read with one
+  // seek per contiguous score range, and the members outside of the radius
+  // are filtered out while reading. Up to count members are returned unless
+  // count is not positive.
+  Status GeoRadius(const Slice& key, double longitude, double latitude,
+                   double radius, int32_t count,
+                   std::vector<GeoNeighbour>* neighbours);
+  Status GeoRadiusByMember(const Slice& key, const Slice& member,
+                           double radius, int32_t count,
+                           std::vector<GeoNeighbour>* neighbours);
+
+  // Same as GeoRadius for a box of width x height meters centered on the
+  // point
+  Status GeoSearchBox(const Slice& key, double longitude, double latitude,
+                      double width, double height, int32_t count,
+                      std::vector<GeoNeighbour>* neighbours);
+
+  // Bitmaps Commands
+
+  // Compressed bitmaps over the offsets [0, 2^32), a separate data type from
+  // the strings bitmaps, whose storage and BmBitOp cost grow with the bits
+  // set instead of with the highest offset
+
+  // Sets or clears the bit at offset in the bitmap stored at key, ret is the
+  // original bit value
+  Status BmSetBit(const Slice& key, int64_t offset, int32_t value,
+                  int32_t* ret);
+
+  // Returns the bit value at offset in the bitmap stored at key, 0 if the key
+  // does not exist
+  Status BmGetBit(const Slice& key, int64_t offset, int32_t* ret);
+
+  // Count the number of set bits in the bitmap, or only between the bit
+  // offsets start_offset and end_offset (inclusive) when have_range is set,
+  // unlike BITCOUNT the range is in bits
+  Status BmBitCount(const Slice& key, int64_t start_offset, int64_t end_offset,
+                    int64_t* ret, bool have_range);
+
+  // Perform AND, OR or XOR between the bitmaps and store the result in
+  // dest_key, kBitOpNot stands for the difference, the bits of the first
+  // bitmap set in none of the others. ret is the number of bits set in the
+  // result, an empty result removes dest_key
+  Status BmBitOp(BitOpType op, const std::string& dest_key,
+                 const std::vector<std::string>& src_keys, int64_t* ret);
+
+  // Streams Commands
+
+  // Append-only logs of field value entries, sorted by their StreamID
+
+  // Appends an entry to the stream stored at key, creating it if needed.
+  // An id of 0-0 is replaced by a generated one, the current time in
+  // milliseconds or the next id of the last entry if it is not older.
+  // Otherwise the id must be greater than the ids of the stream.
+  Status XAdd(const Slice& key, const std::vector<FieldValue>& field_values,
+              StreamID* id);
+
+  // Returns the number of entries of the stream stored at key
+  Status XLen(const Slice& key, int32_t* len);
+
+  // Returns the entries with an id between start and end (inclusive), from
+  // the oldest for XRange and from the newest for XRevRange, up to count
+  // of them unless count is negative
+  Status XRange(const Slice& key, const StreamID& start, const StreamID& end,
+                int32_t count, std::vector<StreamEntry>* entries);
+  Status XRevRange(const Slice& key, const StreamID& end,
+                   const StreamID& start, int32_t count,
+                   std::vector<StreamEntry>* entries);
+
+  // Removes the entries of ids from the stream, ret is the number of
+  // entries found
+  Status XDel(const Slice& key, const std::vector<StreamID>& ids,
+              int32_t* ret);
+
+  // Removes the oldest entries until at most maxlen are left, or the
+  // entries older than min_id, with a single range deletion. ret is the
+  // number of entries removed
+  Status XTrim(const Slice& key, int32_t maxlen, int32_t* ret);
+  Status XTrimMinID(const Slice& key, const StreamID& min_id, int32_t* ret);
+
+  // Creates the consumer group group of the stream, the entries after id
+  // are delivered to it
+  Status XGroupCreate(const Slice& key, const Slice& group,
+                      const StreamID& id);
+
+  // Removes the consumer group and its pending entries
+  Status XGroupDestroy(const Slice& key, const Slice& group);
+
+  // Delivers up to count entries of the stream which were not delivered to
+  // the group yet to consumer, they stay pending until acknowledged by
+  // XAck. Status::NotFound() is returned when the group does not exist.
+  Status XReadGroup(const Slice& key, const Slice& group,
+                    const Slice& consumer, int32_t count,
+                    std::vector<StreamEntry>* entries);
+
+  // Acknowledges the pending entries of ids, ret is the number of entries
+  // which were pending
+  Status XAck(const Slice& key, const Slice& group,
+              const std::vector<StreamID>& ids, int32_t* ret);
+
+  // Returns up to count of the oldest pending entries of the group
+  Status XPending(const Slice& key, const Slice& group, int32_t count,
+                  std::vector<StreamPendingEntry>* entries);
+
+  // Filters Commands
+
+  // Bloom and cuckoo filters answer whether an item was added with false
+  // positives but no false negatives, at about 1.2 bytes per item for a
+  // bloom filter with an error rate of 1%. A filter is split in segments
+  // of at most 4KB, a batch of items reads the segments it touches with a
+  // single MultiGet.
+
+  // Creates an empty scalable bloom filter at key, whose first layer holds
+  // capacity items at error_rate. Every further layer is expansion times
+  // larger and halves the error rate. Fails if key holds a filter already
+  Status BFReserve(const Slice& key, double error_rate, uint64_t capacity,
+                   int32_t expansion = 2);
+
+  // Adds the items to the bloom filter at key, creating it with an error
+  // rate of 1% and a capacity of 100 if needed. added tells, for every
+  // item, whether it was missing from the filter
+  Status BFAdd(const Slice& key, const std::vector<std::string>& items,
+               std::vector<bool>* added);
+
+  // exists tells, for every item, whether it may have been added
+  Status BFExists(const Slice& key, const std::vector<std::string>& items,
+                  std::vector<bool>* exists);
+
+  Status BFInfo(const Slice& key, FilterInfo* info);
+
+  // Creates an empty cuckoo filter at key holding capacity items. Unlike a
+  // bloom filter it supports deletions, but it does not grow and its error
+  // rate is about 3%
+  Status CFReserve(const Slice& key, uint64_t capacity);
+
+  // Adds the items missing from the cuckoo filter at key, creating it with
+  // a capacity of 1024 if needed. Status::Incomplete() is returned when
+  // some of them find no room, added tells which items were added
+  Status CFAdd(const Slice& key, const std::vector<std::string>& items,
+               std::vector<bool>* added);
+
+  Status CFExists(const Slice& key, const std::vector<std::string>& items,
+                  std::vector<bool>* exists);
+
+  // Removes the items from the cuckoo filter, ret is the number of items
+  // found. Removing an item which was not added may remove another one
+  Status CFDel(const Slice& key, const std::vector<std::string>& items,
+               int32_t* ret);
+
+  Status CFInfo(const Slice& key, FilterInfo* info);
+
   // Keys Commands
 
   // Note:
@@ -967,10 +1373,27 @@ class BlackWidow {
   // Iterate through all the data in the database.
   void ScanDatabase(const DataType& type);
 
-  // HyperLogLog
+  // Transactions Commands
+
+  // Marks the given keys to be watched for conditional execution of a
+  // transaction, the state observed is stored in watched and has to be
+  // handed back to ExecIfUnchanged()
+  Status Watch(const std::vector<std::string>& keys,
+               std::vector<KeyEpoch>* watched);
+
+  // Runs ops only if none of the watched keys has been written since
+  // Watch() was called. If any of them has, ops is not run and
+  // Status::Busy() is returned, the caller may Watch() again and retry.
+  // Writes issued by ops must go through this BlackWidow. The writers of
+  // the watched keys and the other transactions are held off until ops
+  // returns, so keep it short, blocking pops don't block inside it
+  Status ExecIfUnchanged(const std::vector<KeyEpoch>& watched,
+                         const std::function<Status()>& ops);
+
+  // HyperLogLog, new values get 2^kPrecision registers
   enum {
     kMaxKeys = 255,
-    kPrecision = 17,
+    kPrecision = 14,
   };
   // Adds all the element arguments to the HyperLogLog data structure stored
   // at the variable name specified as first argument.
@@ -988,9 +1411,17 @@ class BlackWidow {
   Status PfMerge(const std::vector<std::string>& keys);
 
   // Admin Commands
-  Status StartBGThread();
-  Status RunBGTask();
+  // Starts the background task threads, Open() does it
+  Status StartBGThread(size_t threads = 1);
+  // A task identical to one still pending is dropped
   Status AddBGTask(const BGTask& bg_task);
+  // Removes a pending task, returns Status::NotFound() if no identical
+  // task is pending, a running task cannot be cancelled
+  Status CancelBGTask(const BGTask& bg_task);
+  // The running tasks with their progress, then the pending ones
+  Status GetBGTasks(std::vector<BGTaskStatus>* tasks);
+  // Replaces bg_task_windows, the full compactions already running go on
+  Status SetBGTaskWindows(const std::vector<TimeWindow>& windows);
 
   Status Compact(const DataType& type, bool sync = false);
   Status DoCompact(const DataType& type);
@@ -998,6 +1429,12 @@ class BlackWidow {
 
   std::string GetCurrentTaskType();
   Status GetUsage(const std::string& type, uint64_t *result);
+  Status GetRowCacheStatistics(const DataType& type,
+                               RowCacheStatistics* stats);
+  // Share of the entries in the SSTs of type which the next compactions
+  // would drop, as counted when each SST was written. The memtables, the
+  // keys expired since and the data of the deleted keys are left out.
+  Status GetStaleRatio(const DataType& type, double* ratio);
   uint64_t GetProperty(const std::string &property);
 
   Status GetKeyNum(std::vector<uint64_t>* nums);
@@ -1011,24 +1448,38 @@ class BlackWidow {
   RedisSets* sets_db_;
   RedisZSets* zsets_db_;
   RedisLists* lists_db_;
+  RedisBitmaps* bitmaps_db_;
+  RedisStreams* streams_db_;
+  RedisFilters* filters_db_;
 
   MutexFactory* mutex_factory_;
 
+  WatchTable* watch_table_;
+
+  // The blocked list pops, woken by the pushes
+  ListWaiters* list_waiters_;
+  // The blocked sorted set pops, woken by the adds
+  ListWaiters* zset_waiters_;
+
+  CompactKeyTracker* compact_key_tracker_;
+
   LRU<int64_t, std::string> cursors_store_;
   std::shared_ptr<Mutex> cursors_mutex_;
 
-  // Blackwidow start the background thread for compaction task
-  pthread_t bg_tasks_thread_id_;
-  slash::Mutex bg_tasks_mutex_;
-  slash::CondVar bg_tasks_cond_var_;
-  std::queue<BGTask> bg_tasks_queue_;
+  // Runs the compaction tasks in the background
+  BGTaskScheduler* bg_task_scheduler_;
 
   std::atomic<int> current_task_type_;
-  std::atomic<bool> bg_tasks_should_exit_;
 
   // For scan keys in data base
   std::atomic<bool> scan_keynum_exit_;
 
+  void RunBGTask(const BGTask& task, BGTaskProgress* progress);
+  Status DoCompact(const DataType& type, BGTaskProgress* progress);
+  std::vector<Redis*> GetDBsByType(const DataType& type);
+  int64_t BlockingTimeout(int64_t timeout_ms) const;
+  Status GeoSearch(const Slice& key, const GeoShape& shape, int32_t count,
+                   std::vector<GeoNeighbour>* neighbours);
 };
 
 }  //  namespace blackwidow
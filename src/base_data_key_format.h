@@ -6,35 +6,23 @@
 #ifndef SRC_BASE_DATA_KEY_FORMAT_H_
 #define SRC_BASE_DATA_KEY_FORMAT_H_
 
+#include "src/encode_arena.h"
+
 namespace blackwidow {
 class BaseDataKey {
   public:
-    BaseDataKey(const Slice& key, int32_t version, const Slice& data) :
-      start_(nullptr), key_(key), version_(version), data_(data) {
-    }
+    // The key size and the version
+    static const size_t kFixedLength = sizeof(int32_t) * 2;
 
-    ~BaseDataKey() {
-      if (start_ != space_) {
-        delete[] start_;
-      }
+    BaseDataKey(const Slice& key, int32_t version, const Slice& data) :
+      key_(key), version_(version), data_(data) {
     }
 
   const Slice Encode() {
     size_t usize = key_.size() + data_.size();
-    size_t needed = usize + sizeof(int32_t) * 2;
-    char* dst;
-    if (needed <= sizeof(space_)) {
-      dst = space_;
-    } else {
-      dst = new char[needed];
-
-      // Need to allocate space, delete previous space
-      if (start_ != space_) {
-        delete[] start_;
-      }
-    }
-
-    start_ = dst;
+    size_t needed = usize + kFixedLength;
+    char* dst = buffer_.Reserve(needed);
+    char* start = dst;
     EncodeFixed32(dst, key_.size());
     dst += sizeof(int32_t);
     memcpy(dst, key_.data(), key_.size());
@@ -42,12 +30,11 @@ class BaseDataKey {
     EncodeFixed32(dst, version_);
     dst += sizeof(int32_t);
     memcpy(dst, data_.data(), data_.size());
-    return Slice(start_, needed);
+    return Slice(start, needed);
   }
 
   private:
-    char space_[200];
-    char* start_;
+    EncodeBuffer<200> buffer_;
     Slice key_;
     int32_t version_;
     Slice data_;
@@ -63,7 +50,7 @@ class ParsedBaseDataKey {
       ptr += key_len;
       version_ = DecodeFixed32(ptr);
       ptr += sizeof(int32_t);
-      data_ = Slice(ptr, key->size() - key_len - sizeof(int32_t) * 2);
+      data_ = Slice(ptr, key->size() - key_len - BaseDataKey::kFixedLength);
     }
 
     explicit ParsedBaseDataKey(const Slice& key) {
@@ -74,7 +61,7 @@ class ParsedBaseDataKey {
       ptr += key_len;
       version_ = DecodeFixed32(ptr);
       ptr += sizeof(int32_t);
-      data_ = Slice(ptr, key.size() - key_len - sizeof(int32_t) * 2);
+      data_ = Slice(ptr, key.size() - key_len - BaseDataKey::kFixedLength);
     }
 
     virtual ~ParsedBaseDataKey() = default;
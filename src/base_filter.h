@@ -86,8 +86,10 @@ class BaseDataFilter : public rocksdb::CompactionFilter {
             parsed_base_data_key.data().ToString().c_str(),
             parsed_base_data_key.version());
 
-      if (parsed_base_data_key.key().ToString() != cur_key_) {
-        cur_key_ = parsed_base_data_key.key().ToString();
+      // Compared in place, the key is only copied when it changes
+      Slice user_key = parsed_base_data_key.key();
+      if (user_key != cur_key_) {
+        cur_key_.assign(user_key.data(), user_key.size());
         std::string meta_value;
         // destroyed when close the database, Reserve Current key value
         if (cf_handles_ptr_->size() == 0) {
@@ -129,6 +131,15 @@ class BaseDataFilter : public rocksdb::CompactionFilter {
         return false;
       }
     }
+    // The decision only depends on the key, so the values stored in blob
+    // files are not read back just to be dropped
+    virtual Decision FilterBlobByKey(int level, const Slice& key,
+                                     std::string* new_value,
+                                     std::string* skip_until) const override {
+      bool value_changed = false;
+      return Filter(level, key, Slice(), new_value, &value_changed) ?
+        Decision::kRemove : Decision::kKeep;
+    }
     virtual const char* Name() const override { return "BaseDataFilter"; }
 
   private:
@@ -176,5 +187,20 @@ typedef BaseMetaFilterFactory ZSetsMetaFilterFactory;
 typedef BaseDataFilter ZSetsDataFilter;
 typedef BaseDataFilterFactory ZSetsDataFilterFactory;
 
+typedef BaseMetaFilter BitmapsMetaFilter;
+typedef BaseMetaFilterFactory BitmapsMetaFilterFactory;
+typedef BaseDataFilter BitmapsDataFilter;
+typedef BaseDataFilterFactory BitmapsDataFilterFactory;
+
+typedef BaseMetaFilter StreamsMetaFilter;
+typedef BaseMetaFilterFactory StreamsMetaFilterFactory;
+typedef BaseDataFilter StreamsDataFilter;
+typedef BaseDataFilterFactory StreamsDataFilterFactory;
+
+typedef BaseMetaFilter FiltersMetaFilter;
+typedef BaseMetaFilterFactory FiltersMetaFilterFactory;
+typedef BaseDataFilter FiltersDataFilter;
+typedef BaseDataFilterFactory FiltersDataFilterFactory;
+
 }  //  namespace blackwidow
 #endif  // SRC_BASE_FILTER_H_
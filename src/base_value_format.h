@@ -9,6 +9,7 @@
 #include <string>
 
 #include "src/coding.h"
+#include "src/encode_arena.h"
 #include "rocksdb/env.h"
 #include "rocksdb/slice.h"
 
@@ -22,11 +23,7 @@ class InternalValue {
     version_(0),
     timestamp_(0) {
   }
-  virtual ~InternalValue() {
-    if (start_ != space_) {
-      delete[] start_;
-    }
-  }
+  virtual ~InternalValue() = default;
   void set_timestamp(int32_t timestamp = 0) {
     timestamp_ = timestamp;
   }
@@ -38,29 +35,24 @@ class InternalValue {
   void set_version(int32_t version = 0) {
     version_ = version;
   }
+  const Slice& user_value() const {
+    return user_value_;
+  }
+  int32_t timestamp() const {
+    return timestamp_;
+  }
   static const size_t kDefaultValueSuffixLength = sizeof(int32_t) * 2;
   virtual const Slice Encode() {
     size_t usize = user_value_.size();
     size_t needed = usize + kDefaultValueSuffixLength;
-    char* dst;
-    if (needed <= sizeof(space_)) {
-      dst = space_;
-    } else {
-      dst = new char[needed];
-
-      // Need to allocate space, delete previous space
-      if (start_ != space_) {
-        delete[] start_;
-      }
-    }
-    start_ = dst;
+    start_ = buffer_.Reserve(needed);
     size_t len = AppendTimestampAndVersion();
     return Slice(start_, len);
   }
   virtual size_t AppendTimestampAndVersion() = 0;
 
  protected:
-  char space_[200];
+  EncodeBuffer<200> buffer_;
   char* start_;
   Slice user_value_;
   int32_t version_;
@@ -0,0 +1,208 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/bg_task_scheduler.h"
+
+#include <time.h>
+
+#include "slash/include/env.h"
+
+namespace blackwidow {
+
+BGTaskScheduler::BGTaskScheduler(const Runner& runner)
+  : runner_(runner),
+    cond_var_(&mutex_),
+    running_low_(0),
+    max_running_low_(1),
+    should_exit_(false) {
+}
+
+BGTaskScheduler::~BGTaskScheduler() {
+  Stop();
+}
+
+Status BGTaskScheduler::Start(size_t threads) {
+  slash::MutexLock l(&mutex_);
+  if (!workers_.empty()) {
+    return Status::OK();
+  }
+  if (threads == 0) {
+    threads = 1;
+  }
+  max_running_low_ = threads > 1 ? threads - 1 : 1;
+  for (size_t i = 0; i < threads; i++) {
+    workers_.emplace_back(&BGTaskScheduler::Work, this);
+  }
+  return Status::OK();
+}
+
+void BGTaskScheduler::Stop() {
+  {
+    slash::MutexLock l(&mutex_);
+    should_exit_ = true;
+    high_pending_.clear();
+    low_pending_.clear();
+    pending_keys_.clear();
+    cond_var_.SignalAll();
+  }
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+}
+
+std::string BGTaskScheduler::TaskKey(const BGTask& task) {
+  std::string key;
+  key.push_back(static_cast<char>(task.type));
+  key.push_back(static_cast<char>(task.operation));
+  key.append(task.argv);
+  return key;
+}
+
+bool BGTaskScheduler::IsHighPriority(const BGTask& task) {
+  return task.operation == kCompactKey;
+}
+
+void BGTaskScheduler::SetWindows(const std::vector<TimeWindow>& windows) {
+  slash::MutexLock l(&mutex_);
+  windows_ = windows;
+  cond_var_.SignalAll();
+}
+
+// With the mutex held. Otherwise sets how long to wait before checking
+// again, the windows are in minutes
+bool BGTaskScheduler::InWindow(uint32_t* wait_ms) {
+  if (windows_.empty()) {
+    return true;
+  }
+  time_t now = time(nullptr);
+  struct tm local;
+  localtime_r(&now, &local);
+  int minute = local.tm_hour * 60 + local.tm_min;
+  for (const auto& window : windows_) {
+    if (window.start_minute <= window.end_minute ?
+        minute >= window.start_minute && minute < window.end_minute :
+        minute >= window.start_minute || minute < window.end_minute) {
+      return true;
+    }
+  }
+  *wait_ms = (60 - local.tm_sec) * 1000;
+  return false;
+}
+
+bool BGTaskScheduler::Schedule(const BGTask& task) {
+  slash::MutexLock l(&mutex_);
+  if (should_exit_ || !pending_keys_.insert(TaskKey(task)).second) {
+    return false;
+  }
+  if (IsHighPriority(task)) {
+    high_pending_.push_back(task);
+  } else {
+    low_pending_.push_back(task);
+  }
+  cond_var_.Signal();
+  return true;
+}
+
+bool BGTaskScheduler::Cancel(const BGTask& task) {
+  slash::MutexLock l(&mutex_);
+  std::string key = TaskKey(task);
+  if (pending_keys_.erase(key) == 0) {
+    return false;
+  }
+  std::deque<BGTask>* pending =
+    IsHighPriority(task) ? &high_pending_ : &low_pending_;
+  for (auto iter = pending->begin(); iter != pending->end(); ++iter) {
+    if (TaskKey(*iter) == key) {
+      pending->erase(iter);
+      break;
+    }
+  }
+  return true;
+}
+
+void BGTaskScheduler::GetTasks(std::vector<BGTaskStatus>* tasks) {
+  tasks->clear();
+  uint64_t now_us = slash::NowMicros();
+  slash::MutexLock l(&mutex_);
+  for (const auto& running : running_) {
+    BGTaskStatus status;
+    status.task = running->task;
+    status.running = true;
+    status.elapsed_us = now_us - running->start_us;
+    status.progress = 0;
+    status.eta_us = 0;
+    uint64_t total = running->progress.total();
+    uint64_t done = running->progress.done();
+    if (total > 0 && done > 0) {
+      status.progress = static_cast<double>(done) / total;
+      status.eta_us = done < total ?
+        status.elapsed_us * (total - done) / done : 0;
+    }
+    tasks->push_back(status);
+  }
+  for (const auto* pending : {&high_pending_, &low_pending_}) {
+    for (const auto& task : *pending) {
+      BGTaskStatus status;
+      status.task = task;
+      status.running = false;
+      status.progress = 0;
+      status.elapsed_us = 0;
+      status.eta_us = 0;
+      tasks->push_back(status);
+    }
+  }
+}
+
+// With the mutex held, wait_ms is left as is unless a full compaction
+// waits for a window
+bool BGTaskScheduler::PopTask(BGTask* task, uint32_t* wait_ms) {
+  if (!high_pending_.empty()) {
+    *task = high_pending_.front();
+    high_pending_.pop_front();
+  } else if (!low_pending_.empty() && running_low_ < max_running_low_
+    && InWindow(wait_ms)) {
+    *task = low_pending_.front();
+    low_pending_.pop_front();
+    running_low_++;
+  } else {
+    return false;
+  }
+  pending_keys_.erase(TaskKey(*task));
+  return true;
+}
+
+void BGTaskScheduler::Work() {
+  BGTask task;
+  slash::MutexLock l(&mutex_);
+  while (!should_exit_) {
+    uint32_t wait_ms = 0;
+    if (!PopTask(&task, &wait_ms)) {
+      if (wait_ms > 0) {
+        cond_var_.TimedWait(wait_ms);
+      } else {
+        cond_var_.Wait();
+      }
+      continue;
+    }
+    std::shared_ptr<RunningTask> running = std::make_shared<RunningTask>();
+    running->task = task;
+    running->start_us = slash::NowMicros();
+    auto iter = running_.insert(running_.end(), running);
+
+    mutex_.Unlock();
+    runner_(task, &running->progress);
+    mutex_.Lock();
+
+    running_.erase(iter);
+    if (!IsHighPriority(task)) {
+      running_low_--;
+      // A full compaction may have been waiting for this slot
+      cond_var_.Signal();
+    }
+  }
+}
+
+}  //  namespace blackwidow
@@ -0,0 +1,104 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_BG_TASK_SCHEDULER_H_
+#define SRC_BG_TASK_SCHEDULER_H_
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "slash/include/slash_mutex.h"
+#include "blackwidow/blackwidow.h"
+
+namespace blackwidow {
+
+// Progress of a running task, as a number of steps done out of a total
+// which the task sets when it starts, the compactions count column
+// families or data types
+class BGTaskProgress {
+ public:
+  BGTaskProgress() : total_(0), done_(0) {}
+
+  void SetTotal(uint64_t total) { total_ = total; }
+  void Advance() { done_++; }
+
+  uint64_t total() const { return total_; }
+  uint64_t done() const { return done_; }
+
+ private:
+  std::atomic<uint64_t> total_;
+  std::atomic<uint64_t> done_;
+};
+
+// Runs the background tasks of a BlackWidow on a pool of worker threads.
+//
+// Key compactions go ahead of the full compactions, and when there is more
+// than one worker the full compactions never occupy all of them, so a
+// CompactKey does not wait behind hours of Compact(kAll). A task identical
+// to a pending one is dropped, and pending tasks can be cancelled, a
+// running task always runs to its end. Given time windows, the full
+// compactions wait for one of them to start.
+class BGTaskScheduler {
+ public:
+  typedef std::function<void(const BGTask&, BGTaskProgress*)> Runner;
+
+  explicit BGTaskScheduler(const Runner& runner);
+  ~BGTaskScheduler();
+
+  Status Start(size_t threads);
+  // Drops the pending tasks and waits for the running ones
+  void Stop();
+
+  // Empty windows let the full compactions start at any time
+  void SetWindows(const std::vector<TimeWindow>& windows);
+
+  // Returns false if an identical task was pending already
+  bool Schedule(const BGTask& task);
+  // Returns false if no identical task was pending
+  bool Cancel(const BGTask& task);
+
+  // The running tasks first, then the pending ones in the order they
+  // will run
+  void GetTasks(std::vector<BGTaskStatus>* tasks);
+
+ private:
+  struct RunningTask {
+    BGTask task;
+    uint64_t start_us;
+    BGTaskProgress progress;
+  };
+
+  static std::string TaskKey(const BGTask& task);
+  static bool IsHighPriority(const BGTask& task);
+
+  bool InWindow(uint32_t* wait_ms);
+  bool PopTask(BGTask* task, uint32_t* wait_ms);
+  void Work();
+
+  const Runner runner_;
+
+  slash::Mutex mutex_;
+  slash::CondVar cond_var_;
+  std::deque<BGTask> high_pending_;
+  std::deque<BGTask> low_pending_;
+  std::unordered_set<std::string> pending_keys_;
+  std::list<std::shared_ptr<RunningTask>> running_;
+  size_t running_low_;
+  size_t max_running_low_;
+  std::vector<TimeWindow> windows_;
+  bool should_exit_;
+
+  std::vector<std::thread> workers_;
+};
+
+}  //  namespace blackwidow
+#endif  //  SRC_BG_TASK_SCHEDULER_H_
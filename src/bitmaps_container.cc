@@ -0,0 +1,402 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/bitmaps_container.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "src/coding.h"
+#include "src/strings_bitops.h"
+
+namespace blackwidow {
+
+static void EncodeFixed16(char* buf, uint16_t value) {
+  buf[0] = static_cast<char>(value & 0xff);
+  buf[1] = static_cast<char>(value >> 8);
+}
+
+static uint16_t DecodeFixed16(const char* ptr) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(ptr);
+  return static_cast<uint16_t>(p[0] | p[1] << 8);
+}
+
+static uint32_t BitsetCount(const std::vector<uint64_t>& bitset) {
+  return static_cast<uint32_t>(GetBitCount(
+      reinterpret_cast<const unsigned char*>(bitset.data()),
+      BitmapContainer::kBitsetBytes));
+}
+
+static void BitsetSetRange(std::vector<uint64_t>* bitset,
+                           uint32_t first, uint32_t last) {
+  uint32_t first_word = first >> 6, last_word = last >> 6;
+  uint64_t first_mask = ~0ULL << (first & 63);
+  uint64_t last_mask = ~0ULL >> (63 - (last & 63));
+  if (first_word == last_word) {
+    (*bitset)[first_word] |= first_mask & last_mask;
+    return;
+  }
+  (*bitset)[first_word] |= first_mask;
+  for (uint32_t i = first_word + 1; i < last_word; i++) {
+    (*bitset)[i] = ~0ULL;
+  }
+  (*bitset)[last_word] |= last_mask;
+}
+
+// Call f with every bit set, in order
+template <typename F>
+static void ForEachBit(bool is_bitset, const std::vector<uint16_t>& array,
+                       const std::vector<uint64_t>& bitset, F f) {
+  if (!is_bitset) {
+    for (uint16_t low : array) {
+      f(low);
+    }
+    return;
+  }
+  for (uint32_t i = 0; i < bitset.size(); i++) {
+    uint64_t word = bitset[i];
+    while (word) {
+      f(static_cast<uint16_t>(i * 64 + __builtin_ctzll(word)));
+      word &= word - 1;
+    }
+  }
+}
+
+bool BitmapContainer::Decode(const Slice& value) {
+  cardinality_ = 0;
+  is_bitset_ = false;
+  array_.clear();
+  bitset_.clear();
+  if (value.size() < 1) {
+    return false;
+  }
+
+  const char* ptr = value.data() + 1;
+  size_t size = value.size() - 1;
+  switch (value[0]) {
+    case kArray:
+      if (size % 2 != 0 || size / 2 > kMaxArraySize) {
+        return false;
+      }
+      array_.resize(size / 2);
+      for (size_t i = 0; i < array_.size(); i++) {
+        array_[i] = DecodeFixed16(ptr + i * 2);
+      }
+      cardinality_ = array_.size();
+      return true;
+    case kBitset:
+      if (size != kBitsetBytes) {
+        return false;
+      }
+      is_bitset_ = true;
+      bitset_.resize(kBitsetWords);
+      for (size_t i = 0; i < kBitsetWords; i++) {
+        bitset_[i] = DecodeFixed64(ptr + i * 8);
+      }
+      cardinality_ = BitsetCount(bitset_);
+      return true;
+    case kRun: {
+      if (size % 4 != 0) {
+        return false;
+      }
+      size_t run_num = size / 4;
+      uint32_t total = 0;
+      for (size_t i = 0; i < run_num; i++) {
+        uint32_t start = DecodeFixed16(ptr + i * 4);
+        uint32_t length = DecodeFixed16(ptr + i * 4 + 2) + 1;
+        if (start + length > kChunkBits) {
+          return false;
+        }
+        total += length;
+      }
+      if (total > kMaxArraySize) {
+        is_bitset_ = true;
+        bitset_.assign(kBitsetWords, 0);
+      }
+      for (size_t i = 0; i < run_num; i++) {
+        uint32_t start = DecodeFixed16(ptr + i * 4);
+        uint32_t last = start + DecodeFixed16(ptr + i * 4 + 2);
+        if (is_bitset_) {
+          BitsetSetRange(&bitset_, start, last);
+        } else {
+          for (uint32_t low = start; low <= last; low++) {
+            array_.push_back(static_cast<uint16_t>(low));
+          }
+        }
+      }
+      cardinality_ = is_bitset_ ? BitsetCount(bitset_) : array_.size();
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+void BitmapContainer::Encode(std::string* dst) const {
+  dst->clear();
+  size_t run_bytes = RunCount() * 4;
+  size_t array_bytes = cardinality_ <= kMaxArraySize
+    ? cardinality_ * 2 : kBitsetBytes + 1;
+
+  if (run_bytes < std::min(array_bytes, static_cast<size_t>(kBitsetBytes))) {
+    dst->reserve(run_bytes + 1);
+    dst->push_back(static_cast<char>(kRun));
+    char buf[4];
+    int32_t start = -1, prev = -1;
+    auto append_run = [&]() {
+      EncodeFixed16(buf, static_cast<uint16_t>(start));
+      EncodeFixed16(buf + 2, static_cast<uint16_t>(prev - start));
+      dst->append(buf, sizeof(buf));
+    };
+    ForEachBit(is_bitset_, array_, bitset_, [&](uint16_t low) {
+      if (start != -1 && low != prev + 1) {
+        append_run();
+        start = -1;
+      }
+      if (start == -1) {
+        start = low;
+      }
+      prev = low;
+    });
+    if (start != -1) {
+      append_run();
+    }
+  } else if (array_bytes <= kBitsetBytes) {
+    dst->reserve(array_bytes + 1);
+    dst->push_back(static_cast<char>(kArray));
+    char buf[2];
+    ForEachBit(is_bitset_, array_, bitset_, [&](uint16_t low) {
+      EncodeFixed16(buf, low);
+      dst->append(buf, sizeof(buf));
+    });
+  } else {
+    dst->resize(kBitsetBytes + 1);
+    (*dst)[0] = static_cast<char>(kBitset);
+    char* ptr = &(*dst)[1];
+    for (size_t i = 0; i < kBitsetWords; i++) {
+      EncodeFixed64(ptr + i * 8, bitset_[i]);
+    }
+  }
+}
+
+bool BitmapContainer::Contains(uint16_t low) const {
+  if (is_bitset_) {
+    return (bitset_[low >> 6] >> (low & 63)) & 1;
+  }
+  return std::binary_search(array_.begin(), array_.end(), low);
+}
+
+bool BitmapContainer::Add(uint16_t low) {
+  if (!is_bitset_) {
+    auto iter = std::lower_bound(array_.begin(), array_.end(), low);
+    if (iter != array_.end() && *iter == low) {
+      return false;
+    }
+    if (array_.size() < kMaxArraySize) {
+      array_.insert(iter, low);
+      cardinality_++;
+      return true;
+    }
+    ToBitset();
+  }
+  uint64_t mask = 1ULL << (low & 63);
+  if (bitset_[low >> 6] & mask) {
+    return false;
+  }
+  bitset_[low >> 6] |= mask;
+  cardinality_++;
+  return true;
+}
+
+bool BitmapContainer::Remove(uint16_t low) {
+  if (!is_bitset_) {
+    auto iter = std::lower_bound(array_.begin(), array_.end(), low);
+    if (iter == array_.end() || *iter != low) {
+      return false;
+    }
+    array_.erase(iter);
+    cardinality_--;
+    return true;
+  }
+  uint64_t mask = 1ULL << (low & 63);
+  if (!(bitset_[low >> 6] & mask)) {
+    return false;
+  }
+  bitset_[low >> 6] &= ~mask;
+  cardinality_--;
+  Shrink();
+  return true;
+}
+
+uint32_t BitmapContainer::RangeCardinality(uint16_t first,
+                                           uint16_t last) const {
+  if (first > last) {
+    return 0;
+  }
+  if (!is_bitset_) {
+    return std::upper_bound(array_.begin(), array_.end(), last)
+      - std::lower_bound(array_.begin(), array_.end(), first);
+  }
+  uint32_t first_word = first >> 6, last_word = last >> 6;
+  uint64_t first_mask = ~0ULL << (first & 63);
+  uint64_t last_mask = ~0ULL >> (63 - (last & 63));
+  if (first_word == last_word) {
+    return __builtin_popcountll(bitset_[first_word] & first_mask & last_mask);
+  }
+  uint32_t count = __builtin_popcountll(bitset_[first_word] & first_mask);
+  for (uint32_t i = first_word + 1; i < last_word; i++) {
+    count += __builtin_popcountll(bitset_[i]);
+  }
+  return count + __builtin_popcountll(bitset_[last_word] & last_mask);
+}
+
+void BitmapContainer::And(const BitmapContainer& other) {
+  if (!is_bitset_ || !other.is_bitset_) {
+    // Probe the array side into the other one
+    const BitmapContainer& probe = is_bitset_ ? other : *this;
+    const BitmapContainer& target = is_bitset_ ? *this : other;
+    std::vector<uint16_t> result;
+    for (uint16_t low : probe.array_) {
+      if (target.Contains(low)) {
+        result.push_back(low);
+      }
+    }
+    array_.swap(result);
+    bitset_.clear();
+    is_bitset_ = false;
+    cardinality_ = array_.size();
+    return;
+  }
+  BitOpApply(kBitOpAnd, reinterpret_cast<unsigned char*>(bitset_.data()),
+             reinterpret_cast<const unsigned char*>(other.bitset_.data()),
+             kBitsetBytes, kBitsetBytes);
+  cardinality_ = BitsetCount(bitset_);
+  Shrink();
+}
+
+void BitmapContainer::Or(const BitmapContainer& other) {
+  if (!is_bitset_ && !other.is_bitset_
+    && cardinality_ + other.cardinality_ <= kMaxArraySize) {
+    std::vector<uint16_t> result;
+    std::set_union(array_.begin(), array_.end(),
+                   other.array_.begin(), other.array_.end(),
+                   std::back_inserter(result));
+    array_.swap(result);
+    cardinality_ = array_.size();
+    return;
+  }
+  ToBitset();
+  if (other.is_bitset_) {
+    BitOpApply(kBitOpOr, reinterpret_cast<unsigned char*>(bitset_.data()),
+               reinterpret_cast<const unsigned char*>(other.bitset_.data()),
+               kBitsetBytes, kBitsetBytes);
+  } else {
+    for (uint16_t low : other.array_) {
+      bitset_[low >> 6] |= 1ULL << (low & 63);
+    }
+  }
+  cardinality_ = BitsetCount(bitset_);
+  Shrink();
+}
+
+void BitmapContainer::Xor(const BitmapContainer& other) {
+  if (!is_bitset_ && !other.is_bitset_) {
+    std::vector<uint16_t> result;
+    std::set_symmetric_difference(array_.begin(), array_.end(),
+                                  other.array_.begin(), other.array_.end(),
+                                  std::back_inserter(result));
+    array_.swap(result);
+    cardinality_ = array_.size();
+    if (cardinality_ > kMaxArraySize) {
+      ToBitset();
+    }
+    return;
+  }
+  ToBitset();
+  if (other.is_bitset_) {
+    BitOpApply(kBitOpXor, reinterpret_cast<unsigned char*>(bitset_.data()),
+               reinterpret_cast<const unsigned char*>(other.bitset_.data()),
+               kBitsetBytes, kBitsetBytes);
+  } else {
+    for (uint16_t low : other.array_) {
+      bitset_[low >> 6] ^= 1ULL << (low & 63);
+    }
+  }
+  cardinality_ = BitsetCount(bitset_);
+  Shrink();
+}
+
+void BitmapContainer::AndNot(const BitmapContainer& other) {
+  if (!is_bitset_) {
+    std::vector<uint16_t> result;
+    for (uint16_t low : array_) {
+      if (!other.Contains(low)) {
+        result.push_back(low);
+      }
+    }
+    array_.swap(result);
+    cardinality_ = array_.size();
+    return;
+  }
+  if (other.is_bitset_) {
+    for (size_t i = 0; i < kBitsetWords; i++) {
+      bitset_[i] &= ~other.bitset_[i];
+    }
+  } else {
+    for (uint16_t low : other.array_) {
+      bitset_[low >> 6] &= ~(1ULL << (low & 63));
+    }
+  }
+  cardinality_ = BitsetCount(bitset_);
+  Shrink();
+}
+
+void BitmapContainer::ToBitset() {
+  if (is_bitset_) {
+    return;
+  }
+  bitset_.assign(kBitsetWords, 0);
+  for (uint16_t low : array_) {
+    bitset_[low >> 6] |= 1ULL << (low & 63);
+  }
+  array_.clear();
+  is_bitset_ = true;
+}
+
+void BitmapContainer::Shrink() {
+  if (!is_bitset_ || cardinality_ > kMaxArraySize) {
+    return;
+  }
+  std::vector<uint16_t> array;
+  array.reserve(cardinality_);
+  ForEachBit(true, array_, bitset_, [&](uint16_t low) {
+    array.push_back(low);
+  });
+  array_.swap(array);
+  bitset_.clear();
+  is_bitset_ = false;
+}
+
+uint32_t BitmapContainer::RunCount() const {
+  uint32_t count = 0;
+  if (!is_bitset_) {
+    for (size_t i = 0; i < array_.size(); i++) {
+      if (i == 0 || array_[i] != array_[i - 1] + 1) {
+        count++;
+      }
+    }
+    return count;
+  }
+  uint64_t carry = 0;
+  for (size_t i = 0; i < kBitsetWords; i++) {
+    uint64_t word = bitset_[i];
+    // The bits starting a run
+    count += __builtin_popcountll(word & ~((word << 1) | carry));
+    carry = word >> 63;
+  }
+  return count;
+}
+
+}  //  namespace blackwidow
@@ -0,0 +1,84 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_BITMAPS_CONTAINER_H_
+#define SRC_BITMAPS_CONTAINER_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "rocksdb/slice.h"
+
+namespace blackwidow {
+
+using Slice = rocksdb::Slice;
+
+// A compressed bitmap is split in chunks of 2^16 bits, the bits set in a
+// chunk are kept in a container, the same way as roaring bitmaps:
+//
+// | type | payload |
+//  1 Byte
+//
+// kArray:  the sorted offsets of the bits set, 2 bytes each
+// kBitset: the 2^16 bits, 8192 bytes
+// kRun:    the sorted runs of bits set, as 2 bytes start, 2 bytes length - 1
+//
+// Encode() always picks the smallest of them, in memory a container is
+// either an array or a bitset, runs are expanded when decoded.
+class BitmapContainer {
+ public:
+  enum Type {
+    kArray = 1,
+    kBitset = 2,
+    kRun = 3
+  };
+
+  enum {
+    kChunkBits = 1 << 16,
+    kBitsetWords = kChunkBits / 64,
+    kBitsetBytes = kChunkBits / 8,
+    // An array holding more offsets takes more room than a bitset
+    kMaxArraySize = 4096
+  };
+
+  BitmapContainer() : cardinality_(0), is_bitset_(false) {}
+
+  // Return false if value is not a valid container
+  bool Decode(const Slice& value);
+  void Encode(std::string* dst) const;
+
+  uint32_t cardinality() const { return cardinality_; }
+  bool Empty() const { return cardinality_ == 0; }
+
+  bool Contains(uint16_t low) const;
+  // Return true if the bit changed
+  bool Add(uint16_t low);
+  bool Remove(uint16_t low);
+
+  // The bits set in [first, last]
+  uint32_t RangeCardinality(uint16_t first, uint16_t last) const;
+
+  // this = this op other
+  void And(const BitmapContainer& other);
+  void Or(const BitmapContainer& other);
+  void Xor(const BitmapContainer& other);
+  void AndNot(const BitmapContainer& other);
+
+ private:
+  void ToBitset();
+  // Go back to an array once small enough
+  void Shrink();
+  uint32_t RunCount() const;
+
+  uint32_t cardinality_;
+  bool is_bitset_;
+  std::vector<uint16_t> array_;
+  std::vector<uint64_t> bitset_;
+};
+
+}  //  namespace blackwidow
+#endif  //  SRC_BITMAPS_CONTAINER_H_
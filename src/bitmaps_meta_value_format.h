@@ -0,0 +1,114 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_BITMAPS_META_VALUE_FORMAT_H_
+#define SRC_BITMAPS_META_VALUE_FORMAT_H_
+
+#include <string>
+
+#include "src/base_meta_value_format.h"
+#include "src/base_data_key_format.h"
+
+namespace blackwidow {
+
+// The meta value of a compressed bitmap:
+//
+// | container count | cardinality | version | timestamp |
+//       4 Bytes         8 Bytes      4 Bytes   4 Bytes
+//
+// Every container is stored in the data column family under the BaseDataKey
+// of the bitmap, with the big endian chunk index as data so that the
+// containers are sorted by their position.
+class BitmapsMetaValue : public BaseMetaValue {
+ public:
+  static const size_t kUserValueLength = sizeof(int32_t) + sizeof(uint64_t);
+
+  BitmapsMetaValue(int32_t count, uint64_t cardinality) :
+    BaseMetaValue(Slice(buf_, kUserValueLength)) {
+    EncodeFixed32(buf_, count);
+    EncodeFixed64(buf_ + sizeof(int32_t), cardinality);
+  }
+
+ private:
+  char buf_[kUserValueLength];
+};
+
+class ParsedBitmapsMetaValue : public ParsedBaseMetaValue {
+ public:
+  // Use this constructor after rocksdb::DB::Get();
+  explicit ParsedBitmapsMetaValue(std::string* internal_value_str) :
+    ParsedBaseMetaValue(internal_value_str), cardinality_(0) {
+    if (user_value_.size() >= BitmapsMetaValue::kUserValueLength) {
+      cardinality_ = DecodeFixed64(user_value_.data() + sizeof(int32_t));
+    }
+  }
+
+  // Use this constructor in rocksdb::CompactionFilter::Filter();
+  explicit ParsedBitmapsMetaValue(const Slice& internal_value_slice) :
+    ParsedBaseMetaValue(internal_value_slice), cardinality_(0) {
+    if (user_value_.size() >= BitmapsMetaValue::kUserValueLength) {
+      cardinality_ = DecodeFixed64(user_value_.data() + sizeof(int32_t));
+    }
+  }
+
+  int32_t InitialMetaValue() {
+    set_cardinality(0);
+    return ParsedBaseMetaValue::InitialMetaValue();
+  }
+
+  uint64_t cardinality() {
+    return cardinality_;
+  }
+
+  void set_cardinality(uint64_t cardinality) {
+    cardinality_ = cardinality;
+    if (value_ != nullptr
+      && user_value_.size() >= BitmapsMetaValue::kUserValueLength) {
+      char* dst = const_cast<char*>(value_->data()) + sizeof(int32_t);
+      EncodeFixed64(dst, cardinality_);
+    }
+  }
+
+  void ModifyCardinality(int64_t delta) {
+    set_cardinality(cardinality_ + delta);
+  }
+
+ private:
+  uint64_t cardinality_;
+};
+
+class BitmapsDataKey : public BaseDataKey {
+ public:
+  BitmapsDataKey(const Slice& key, int32_t version, uint16_t chunk) :
+    BaseDataKey(key, version, Slice(buf_, sizeof(buf_))) {
+    buf_[0] = static_cast<char>(chunk >> 8);
+    buf_[1] = static_cast<char>(chunk & 0xff);
+  }
+
+  // The prefix of every container key of the bitmap
+  static std::string EncodePrefix(const Slice& key, int32_t version) {
+    BaseDataKey data_key(key, version, Slice());
+    return data_key.Encode().ToString();
+  }
+
+ private:
+  char buf_[sizeof(uint16_t)];
+};
+
+class ParsedBitmapsDataKey : public ParsedBaseDataKey {
+ public:
+  explicit ParsedBitmapsDataKey(const std::string* key)
+            : ParsedBaseDataKey(key) {}
+  explicit ParsedBitmapsDataKey(const Slice& key)
+            : ParsedBaseDataKey(key) {}
+  uint16_t chunk() {
+    const unsigned char* ptr =
+      reinterpret_cast<const unsigned char*>(data_.data());
+    return static_cast<uint16_t>(ptr[0] << 8 | ptr[1]);
+  }
+};
+
+}  //  namespace blackwidow
+#endif  //  SRC_BITMAPS_META_VALUE_FORMAT_H_
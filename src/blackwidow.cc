@@ -6,13 +6,25 @@
 #include "blackwidow/blackwidow.h"
 #include "blackwidow/util.h"
 
+#include <algorithm>
+#include <thread>
+
 #include "src/mutex_impl.h"
 #include "src/redis_strings.h"
 #include "src/redis_hashes.h"
 #include "src/redis_sets.h"
 #include "src/redis_lists.h"
 #include "src/redis_zsets.h"
+#include "src/redis_bitmaps.h"
+#include "src/redis_streams.h"
+#include "src/redis_filters.h"
 #include "src/redis_hyperloglog.h"
+#include "src/geohash.h"
+#include "src/compact_key_tracker.h"
+#include "src/bg_task_scheduler.h"
+#include "src/watch_table.h"
+#include "src/list_waiters.h"
+#include "rocksdb/rate_limiter.h"
 
 namespace blackwidow {
 
@@ -22,38 +34,46 @@ BlackWidow::BlackWidow() :
   sets_db_(nullptr),
   zsets_db_(nullptr),
   lists_db_(nullptr),
+  bitmaps_db_(nullptr),
+  streams_db_(nullptr),
+  filters_db_(nullptr),
   mutex_factory_(new MutexFactoryImpl),
-  bg_tasks_cond_var_(&bg_tasks_mutex_),
+  watch_table_(new WatchTable),
+  list_waiters_(new ListWaiters),
+  zset_waiters_(new ListWaiters),
+  compact_key_tracker_(nullptr),
+  bg_task_scheduler_(nullptr),
   current_task_type_(0),
-  bg_tasks_should_exit_(false),
   scan_keynum_exit_(false) {
 
   cursors_store_.max_size_ = 5000;
   cursors_mutex_ = mutex_factory_->AllocateMutex();
 
-  Status s = StartBGThread();
-  if (!s.ok()) {
-    fprintf (stderr, "[FATAL] start bg thread failed, %s\n", s.ToString().c_str());
-    exit(-1);
-  }
+  bg_task_scheduler_ = new BGTaskScheduler(
+      [this](const BGTask& task, BGTaskProgress* progress) {
+        RunBGTask(task, progress);
+      });
 }
 
 BlackWidow::~BlackWidow() {
-
-  bg_tasks_should_exit_ = true;
-  bg_tasks_cond_var_.Signal();
-
-  int ret = 0;
-  if ((ret = pthread_join(bg_tasks_thread_id_, NULL)) != 0) {
-    fprintf (stderr, "pthread_join failed with bgtask thread error %d\n", ret);
-  }
+  list_waiters_->Shutdown();
+  zset_waiters_->Shutdown();
+  bg_task_scheduler_->Stop();
+  delete bg_task_scheduler_;
 
   delete strings_db_;
   delete hashes_db_;
   delete sets_db_;
   delete lists_db_;
   delete zsets_db_;
+  delete bitmaps_db_;
+  delete streams_db_;
+  delete filters_db_;
   delete mutex_factory_;
+  delete watch_table_;
+  delete list_waiters_;
+  delete zset_waiters_;
+  delete compact_key_tracker_;
 }
 
 static std::string AppendSubDirectory(const std::string& db_path,
@@ -67,17 +87,48 @@ static std::string AppendSubDirectory(const std::string& db_path,
 
 Status BlackWidow::Open(const rocksdb::Options& options,
                         const std::string& db_path) {
+  BlackwidowOptions bw_options;
+  bw_options.options = options;
+  return Open(bw_options, db_path);
+}
+
+// Separate the values of at least min_blob_size bytes in blob files, the
+// blobs whose keys were dropped by the compaction filters are reclaimed by
+// the blob garbage collection of the compactions
+static rocksdb::Options BlobOptions(const rocksdb::Options& options,
+                                    uint64_t min_blob_size) {
+  rocksdb::Options ops(options);
+  if (min_blob_size > 0) {
+    ops.enable_blob_files = true;
+    ops.min_blob_size = min_blob_size;
+    ops.enable_blob_garbage_collection = true;
+  }
+  return ops;
+}
+
+Status BlackWidow::Open(const BlackwidowOptions& bw_options,
+                        const std::string& db_path) {
+  rocksdb::Options options(bw_options.options);
+  // The flushes and compactions of every db share the same limiter
+  if (bw_options.compaction_bytes_per_sec > 0
+    && options.rate_limiter == nullptr) {
+    options.rate_limiter.reset(rocksdb::NewGenericRateLimiter(
+          bw_options.compaction_bytes_per_sec));
+  }
   mkpath(db_path.c_str(), 0755);
 
   strings_db_ = new RedisStrings();
-  Status s = strings_db_->Open(options, AppendSubDirectory(db_path, "strings"));
+  Status s = strings_db_->Open(
+      BlobOptions(options, bw_options.strings_min_blob_size),
+      AppendSubDirectory(db_path, "strings"));
   if (!s.ok()) {
     fprintf (stderr, "[FATAL] open kv db failed, %s\n", s.ToString().c_str());
     exit(-1);
   }
 
   hashes_db_ = new RedisHashes();
-  s = hashes_db_->Open(options, AppendSubDirectory(db_path, "hashes"));
+  s = hashes_db_->Open(BlobOptions(options, bw_options.hashes_min_blob_size),
+                       AppendSubDirectory(db_path, "hashes"));
   if (!s.ok()) {
     fprintf (stderr, "[FATAL] open hashes db failed, %s\n", s.ToString().c_str());
     exit(-1);
@@ -103,6 +154,59 @@ Status BlackWidow::Open(const rocksdb::Options& options,
     fprintf (stderr, "[FATAL] open zset db failed, %s\n", s.ToString().c_str());
     exit(-1);
   }
+
+  bitmaps_db_ = new RedisBitmaps();
+  s = bitmaps_db_->Open(options, AppendSubDirectory(db_path, "bitmaps"));
+  if (!s.ok()) {
+    fprintf (stderr, "[FATAL] open bitmap db failed, %s\n", s.ToString().c_str());
+    exit(-1);
+  }
+
+  streams_db_ = new RedisStreams();
+  s = streams_db_->Open(options, AppendSubDirectory(db_path, "streams"));
+  if (!s.ok()) {
+    fprintf (stderr, "[FATAL] open stream db failed, %s\n", s.ToString().c_str());
+    exit(-1);
+  }
+
+  filters_db_ = new RedisFilters();
+  s = filters_db_->Open(options, AppendSubDirectory(db_path, "filters"));
+  if (!s.ok()) {
+    fprintf (stderr, "[FATAL] open filter db failed, %s\n", s.ToString().c_str());
+    exit(-1);
+  }
+
+  if (bw_options.row_cache_size > 0) {
+    strings_db_->EnableRowCache(bw_options.row_cache_size);
+    hashes_db_->EnableRowCache(bw_options.row_cache_size);
+    sets_db_->EnableRowCache(bw_options.row_cache_size);
+    lists_db_->EnableRowCache(bw_options.row_cache_size);
+    zsets_db_->EnableRowCache(bw_options.row_cache_size);
+    bitmaps_db_->EnableRowCache(bw_options.row_cache_size);
+    streams_db_->EnableRowCache(bw_options.row_cache_size);
+    filters_db_->EnableRowCache(bw_options.row_cache_size);
+  }
+  if (bw_options.scan_bytes_per_sec > 0) {
+    std::shared_ptr<rocksdb::RateLimiter> scan_rate_limiter(
+        rocksdb::NewGenericRateLimiter(bw_options.scan_bytes_per_sec,
+          100 * 1000, 10, rocksdb::RateLimiter::Mode::kReadsOnly));
+    for (const auto& db : GetDBsByType(kAll)) {
+      db->SetScanRateLimiter(scan_rate_limiter);
+    }
+  }
+  compact_key_tracker_ = new CompactKeyTracker(
+      this, bw_options.compact_key_skipped_threshold,
+      bw_options.compact_key_churn_threshold);
+
+  s = SetBGTaskWindows(bw_options.bg_task_windows);
+  if (!s.ok()) {
+    return s;
+  }
+  s = StartBGThread(bw_options.bg_task_threads);
+  if (!s.ok()) {
+    fprintf (stderr, "[FATAL] start bg thread failed, %s\n", s.ToString().c_str());
+    exit(-1);
+  }
   return Status::OK();
 }
 
@@ -139,10 +243,12 @@ int64_t BlackWidow::StoreAndGetCursor(int64_t cursor,
 
 // Strings Commands
 Status BlackWidow::Set(const Slice& key, const Slice& value, const int32_t ttl) {
+  ScopeWatchWrite sww(watch_table_, key);
   return strings_db_->Set(key, value, ttl);
 }
 
 Status BlackWidow::Setxx(const Slice& key, const Slice& value, int32_t* ret, const int32_t ttl) {
+  ScopeWatchWrite sww(watch_table_, key);
   return strings_db_->Setxx(key, value, ret, ttl);
 }
 
@@ -150,13 +256,19 @@ Status BlackWidow::Get(const Slice& key, std::string* value) {
   return strings_db_->Get(key, value);
 }
 
+Status BlackWidow::Get(const Slice& key, PinnableValue* value) {
+  return strings_db_->Get(key, value);
+}
+
 Status BlackWidow::GetSet(const Slice& key, const Slice& value,
                           std::string* old_value) {
+  ScopeWatchWrite sww(watch_table_, key);
   return strings_db_->GetSet(key, value, old_value);
 }
 
 Status BlackWidow::SetBit(const Slice& key, int64_t offset,
                           int32_t value, int32_t* ret) {
+  ScopeWatchWrite sww(watch_table_, key);
   return strings_db_->SetBit(key, offset, value, ret);
 }
 
@@ -165,6 +277,11 @@ Status BlackWidow::GetBit(const Slice& key, int64_t offset, int32_t* ret) {
 }
 
 Status BlackWidow::MSet(const std::vector<KeyValue>& kvs) {
+  std::vector<std::string> keys;
+  for (const auto& kv : kvs) {
+    keys.push_back(kv.key);
+  }
+  ScopeWatchWrite sww(watch_table_, keys);
   return strings_db_->MSet(kvs);
 }
 
@@ -174,16 +291,23 @@ Status BlackWidow::MGet(const std::vector<std::string>& keys,
 }
 
 Status BlackWidow::Setnx(const Slice& key, const Slice& value, int32_t* ret, const int32_t ttl) {
+  ScopeWatchWrite sww(watch_table_, key);
   return strings_db_->Setnx(key, value, ret, ttl);
 }
 
 Status BlackWidow::MSetnx(const std::vector<KeyValue>& kvs,
                           int32_t* ret) {
+  std::vector<std::string> keys;
+  for (const auto& kv : kvs) {
+    keys.push_back(kv.key);
+  }
+  ScopeWatchWrite sww(watch_table_, keys);
   return strings_db_->MSetnx(kvs, ret);
 }
 
 Status BlackWidow::Setrange(const Slice& key, int64_t start_offset,
                             const Slice& value, int32_t* ret) {
+  ScopeWatchWrite sww(watch_table_, key);
   return strings_db_->Setrange(key, start_offset, value, ret);
 }
 
@@ -193,6 +317,7 @@ Status BlackWidow::Getrange(const Slice& key, int64_t start_offset,
 }
 
 Status BlackWidow::Append(const Slice& key, const Slice& value, int32_t* ret) {
+  ScopeWatchWrite sww(watch_table_, key);
   return strings_db_->Append(key, value, ret);
 }
 
@@ -204,6 +329,7 @@ Status BlackWidow::BitCount(const Slice& key, int64_t start_offset,
 Status BlackWidow::BitOp(BitOpType op, const std::string& dest_key,
                          const std::vector<std::string>& src_keys,
                          int64_t* ret) {
+  ScopeWatchWrite sww(watch_table_, dest_key);
   return strings_db_->BitOp(op, dest_key, src_keys, ret);
 }
 
@@ -224,19 +350,23 @@ Status BlackWidow::BitPos(const Slice& key, int32_t bit,
 }
 
 Status BlackWidow::Decrby(const Slice& key, int64_t value, int64_t* ret) {
+  ScopeWatchWrite sww(watch_table_, key);
   return strings_db_->Decrby(key, value, ret);
 }
 
 Status BlackWidow::Incrby(const Slice& key, int64_t value, int64_t* ret) {
+  ScopeWatchWrite sww(watch_table_, key);
   return strings_db_->Incrby(key, value, ret);
 }
 
 Status BlackWidow::Incrbyfloat(const Slice& key, const Slice& value,
                                std::string* ret) {
+  ScopeWatchWrite sww(watch_table_, key);
   return strings_db_->Incrbyfloat(key, value, ret);
 }
 
 Status BlackWidow::Setex(const Slice& key, const Slice& value, int32_t ttl) {
+  ScopeWatchWrite sww(watch_table_, key);
   return strings_db_->Setex(key, value, ttl);
 }
 
@@ -247,6 +377,7 @@ Status BlackWidow::Strlen(const Slice& key, int32_t* len) {
 // Hashes Commands
 Status BlackWidow::HSet(const Slice& key, const Slice& field,
     const Slice& value, int32_t* res) {
+  ScopeWatchWrite sww(watch_table_, key);
   return hashes_db_->HSet(key, field, value, res);
 }
 
@@ -255,8 +386,14 @@ Status BlackWidow::HGet(const Slice& key, const Slice& field,
   return hashes_db_->HGet(key, field, value);
 }
 
+Status BlackWidow::HGet(const Slice& key, const Slice& field,
+    PinnableValue* value) {
+  return hashes_db_->HGet(key, field, value);
+}
+
 Status BlackWidow::HMSet(const Slice& key,
                          const std::vector<FieldValue>& fvs) {
+  ScopeWatchWrite sww(watch_table_, key);
   return hashes_db_->HMSet(key, fvs);
 }
 
@@ -268,21 +405,25 @@ Status BlackWidow::HMGet(const Slice& key,
 
 Status BlackWidow::HGetall(const Slice& key,
                            std::vector<FieldValue>* fvs) {
+  ScopeSkippedKeys sk(compact_key_tracker_, kHashes, key);
   return hashes_db_->HGetall(key, fvs);
 }
 
 Status BlackWidow::HKeys(const Slice& key,
                          std::vector<std::string>* fields) {
+  ScopeSkippedKeys sk(compact_key_tracker_, kHashes, key);
   return hashes_db_->HKeys(key, fields);
 }
 
 Status BlackWidow::HVals(const Slice& key,
                          std::vector<std::string>* values) {
+  ScopeSkippedKeys sk(compact_key_tracker_, kHashes, key);
   return hashes_db_->HVals(key, values);
 }
 
 Status BlackWidow::HSetnx(const Slice& key, const Slice& field,
                           const Slice& value, int32_t* ret) {
+  ScopeWatchWrite sww(watch_table_, key);
   return hashes_db_->HSetnx(key, field, value, ret);
 }
 
@@ -300,23 +441,31 @@ Status BlackWidow::HExists(const Slice& key, const Slice& field) {
 
 Status BlackWidow::HIncrby(const Slice& key, const Slice& field, int64_t value,
                            int64_t* ret) {
+  ScopeWatchWrite sww(watch_table_, key);
   return hashes_db_->HIncrby(key, field, value, ret);
 }
 
 Status BlackWidow::HIncrbyfloat(const Slice& key, const Slice& field,
                                 const Slice& by, std::string* new_value) {
+  ScopeWatchWrite sww(watch_table_, key);
   return hashes_db_->HIncrbyfloat(key, field, by, new_value);
 }
 
 Status BlackWidow::HDel(const Slice& key,
                         const std::vector<std::string>& fields,
                         int32_t* ret) {
-  return hashes_db_->HDel(key, fields, ret);
+  ScopeWatchWrite sww(watch_table_, key);
+  Status s = hashes_db_->HDel(key, fields, ret);
+  if (s.ok()) {
+    compact_key_tracker_->AddChurn(kHashes, key, *ret);
+  }
+  return s;
 }
 
 // See SCAN for HSCAN documentation.
 Status BlackWidow::HScan(const Slice& key, int64_t cursor, const std::string& pattern,
                          int64_t count, std::vector<FieldValue>* field_values, int64_t* next_cursor) {
+  ScopeSkippedKeys sk(compact_key_tracker_, kHashes, key);
   return hashes_db_->HScan(key, cursor, pattern, count, field_values, next_cursor);
 }
 
@@ -324,6 +473,7 @@ Status BlackWidow::HScan(const Slice& key, int64_t cursor, const std::string& pa
 Status BlackWidow::SAdd(const Slice& key,
                         const std::vector<std::string>& members,
                         int32_t* ret) {
+  ScopeWatchWrite sww(watch_table_, key);
   return sets_db_->SAdd(key, members, ret);
 }
 
@@ -340,6 +490,7 @@ Status BlackWidow::SDiff(const std::vector<std::string>& keys,
 Status BlackWidow::SDiffstore(const Slice& destination,
                               const std::vector<std::string>& keys,
                               int32_t* ret) {
+  ScopeWatchWrite sww(watch_table_, destination);
   return sets_db_->SDiffstore(destination, keys, ret);
 }
 
@@ -351,6 +502,7 @@ Status BlackWidow::SInter(const std::vector<std::string>& keys,
 Status BlackWidow::SInterstore(const Slice& destination,
                                const std::vector<std::string>& keys,
                                int32_t* ret) {
+  ScopeWatchWrite sww(watch_table_, destination);
   return sets_db_->SInterstore(destination, keys, ret);
 }
 
@@ -361,17 +513,36 @@ Status BlackWidow::SIsmember(const Slice& key, const Slice& member,
 
 Status BlackWidow::SMembers(const Slice& key,
                             std::vector<std::string>* members) {
+  ScopeSkippedKeys sk(compact_key_tracker_, kSets, key);
   return sets_db_->SMembers(key, members);
 }
 
 Status BlackWidow::SMove(const Slice& source, const Slice& destination,
                          const Slice& member, int32_t* ret) {
-  return sets_db_->SMove(source, destination, member, ret);
+  std::vector<std::string> keys = {source.ToString(), destination.ToString()};
+  ScopeWatchWrite sww(watch_table_, keys);
+  Status s = sets_db_->SMove(source, destination, member, ret);
+  if (s.ok()) {
+    compact_key_tracker_->AddChurn(kSets, source, *ret);
+  }
+  return s;
 }
 
 Status BlackWidow::SPop(const Slice& key, std::string* member) {
+  std::vector<std::string> members;
+  Status s = SPop(key, 1, &members);
+  if (s.ok() && !members.empty()) {
+    *member = members[0];
+  }
+  return s;
+}
+
+Status BlackWidow::SPop(const Slice& key, int32_t count,
+                        std::vector<std::string>* members) {
+  ScopeWatchWrite sww(watch_table_, key);
+  ScopeSkippedKeys sk(compact_key_tracker_, kSets, key);
   bool need_compact = false;
-  Status status = sets_db_->SPop(key, member, &need_compact);
+  Status status = sets_db_->SPop(key, count, members, &need_compact);
   if (need_compact) {
     AddBGTask({kSets, kCompactKey, key.ToString()});
   }
@@ -386,7 +557,12 @@ Status BlackWidow::SRandmember(const Slice& key, int32_t count,
 Status BlackWidow::SRem(const Slice& key,
                         const std::vector<std::string>& members,
                         int32_t* ret) {
-  return sets_db_->SRem(key, members, ret);
+  ScopeWatchWrite sww(watch_table_, key);
+  Status s = sets_db_->SRem(key, members, ret);
+  if (s.ok()) {
+    compact_key_tracker_->AddChurn(kSets, key, *ret);
+  }
+  return s;
 }
 
 Status BlackWidow::SUnion(const std::vector<std::string>& keys,
@@ -397,24 +573,42 @@ Status BlackWidow::SUnion(const std::vector<std::string>& keys,
 Status BlackWidow::SUnionstore(const Slice& destination,
                                const std::vector<std::string>& keys,
                                int32_t* ret) {
+  ScopeWatchWrite sww(watch_table_, destination);
   return sets_db_->SUnionstore(destination, keys, ret);
 }
 
 Status BlackWidow::SScan(const Slice& key, int64_t cursor, const std::string& pattern,
                          int64_t count, std::vector<std::string>* members, int64_t* next_cursor) {
+  ScopeSkippedKeys sk(compact_key_tracker_, kSets, key);
   return sets_db_->SScan(key, cursor, pattern, count, members, next_cursor);
 }
 
 Status BlackWidow::LPush(const Slice& key,
                          const std::vector<std::string>& values,
                          uint64_t* ret) {
-  return lists_db_->LPush(key, values, ret);
+  Status s;
+  {
+    ScopeWatchWrite sww(watch_table_, key);
+    s = lists_db_->LPush(key, values, ret);
+  }
+  if (s.ok()) {
+    list_waiters_->Signal(key, values.size());
+  }
+  return s;
 }
 
 Status BlackWidow::RPush(const Slice& key,
                          const std::vector<std::string>& values,
                          uint64_t* ret) {
-  return lists_db_->RPush(key, values, ret);
+  Status s;
+  {
+    ScopeWatchWrite sww(watch_table_, key);
+    s = lists_db_->RPush(key, values, ret);
+  }
+  if (s.ok()) {
+    list_waiters_->Signal(key, values.size());
+  }
+  return s;
 }
 
 Status BlackWidow::LRange(const Slice& key, int64_t start, int64_t stop,
@@ -423,7 +617,13 @@ Status BlackWidow::LRange(const Slice& key, int64_t start, int64_t stop,
 }
 
 Status BlackWidow::LTrim(const Slice& key, int64_t start, int64_t stop) {
-  return lists_db_->LTrim(key, start, stop);
+  ScopeWatchWrite sww(watch_table_, key);
+  uint64_t trimmed = 0;
+  Status s = lists_db_->LTrim(key, start, stop, &trimmed);
+  if (s.ok()) {
+    compact_key_tracker_->AddChurn(kLists, key, trimmed);
+  }
+  return s;
 }
 
 Status BlackWidow::LLen(const Slice& key, uint64_t* len) {
@@ -431,11 +631,21 @@ Status BlackWidow::LLen(const Slice& key, uint64_t* len) {
 }
 
 Status BlackWidow::LPop(const Slice& key, std::string* element) {
-  return lists_db_->LPop(key, element);
+  ScopeWatchWrite sww(watch_table_, key);
+  Status s = lists_db_->LPop(key, element);
+  if (s.ok()) {
+    compact_key_tracker_->AddChurn(kLists, key, 1);
+  }
+  return s;
 }
 
 Status BlackWidow::RPop(const Slice& key, std::string* element) {
-  return lists_db_->RPop(key, element);
+  ScopeWatchWrite sww(watch_table_, key);
+  Status s = lists_db_->RPop(key, element);
+  if (s.ok()) {
+    compact_key_tracker_->AddChurn(kLists, key, 1);
+  }
+  return s;
 }
 
 Status BlackWidow::LIndex(const Slice& key,
@@ -444,40 +654,135 @@ Status BlackWidow::LIndex(const Slice& key,
   return lists_db_->LIndex(key, index, element);
 }
 
+Status BlackWidow::LIndex(const Slice& key,
+                          int64_t index,
+                          PinnableValue* element) {
+  return lists_db_->LIndex(key, index, element);
+}
+
 Status BlackWidow::LInsert(const Slice& key,
                            const BeforeOrAfter& before_or_after,
                            const std::string& pivot,
                            const std::string& value,
                            int64_t* ret) {
-  return lists_db_->LInsert(key, before_or_after, pivot, value, ret);
+  Status s;
+  {
+    ScopeWatchWrite sww(watch_table_, key);
+    s = lists_db_->LInsert(key, before_or_after, pivot, value, ret);
+  }
+  if (s.ok() && *ret > 0) {
+    list_waiters_->Signal(key, 1);
+  }
+  return s;
 }
 
 Status BlackWidow::LPushx(const Slice& key, const Slice& value, uint64_t* len) {
-  return lists_db_->LPushx(key, value, len);
+  Status s;
+  {
+    ScopeWatchWrite sww(watch_table_, key);
+    s = lists_db_->LPushx(key, value, len);
+  }
+  if (s.ok()) {
+    list_waiters_->Signal(key, 1);
+  }
+  return s;
 }
 
 Status BlackWidow::RPushx(const Slice& key, const Slice& value, uint64_t* len) {
-  return lists_db_->RPushx(key, value, len);
+  Status s;
+  {
+    ScopeWatchWrite sww(watch_table_, key);
+    s = lists_db_->RPushx(key, value, len);
+  }
+  if (s.ok()) {
+    list_waiters_->Signal(key, 1);
+  }
+  return s;
 }
 
 Status BlackWidow::LRem(const Slice& key, int64_t count, const Slice& value, uint64_t* ret) {
-  return lists_db_->LRem(key, count, value, ret);
+  ScopeWatchWrite sww(watch_table_, key);
+  Status s = lists_db_->LRem(key, count, value, ret);
+  if (s.ok()) {
+    compact_key_tracker_->AddChurn(kLists, key, *ret);
+  }
+  return s;
 }
 
 Status BlackWidow::LSet(const Slice& key, int64_t index, const Slice& value) {
+  ScopeWatchWrite sww(watch_table_, key);
   return lists_db_->LSet(key, index, value);
 }
 
 Status BlackWidow::RPoplpush(const Slice& source,
                              const Slice& destination,
                              std::string* element) {
-  return lists_db_->RPoplpush(source, destination, element);
+  std::vector<std::string> keys = {source.ToString(), destination.ToString()};
+  Status s;
+  {
+    ScopeWatchWrite sww(watch_table_, keys);
+    s = lists_db_->RPoplpush(source, destination, element);
+  }
+  if (s.ok()) {
+    compact_key_tracker_->AddChurn(kLists, source, 1);
+    list_waiters_->Signal(destination, 1);
+  }
+  return s;
+}
+
+// A transaction holds its watched keys until it returns, so the blocking
+// pops it issues don't wait for pushes
+int64_t BlackWidow::BlockingTimeout(int64_t timeout_ms) const {
+  return watch_table_->InTransaction() ? ListWaiters::kNoWait : timeout_ms;
+}
+
+Status BlackWidow::BLPop(const std::vector<std::string>& keys,
+                         int64_t timeout_ms, std::string* key,
+                         std::string* element) {
+  if (timeout_ms < 0) {
+    return Status::InvalidArgument("timeout is negative");
+  }
+  return list_waiters_->Wait(keys, BlockingTimeout(timeout_ms),
+      [this, element](const std::string& k) { return LPop(k, element); },
+      key);
+}
+
+Status BlackWidow::BRPop(const std::vector<std::string>& keys,
+                         int64_t timeout_ms, std::string* key,
+                         std::string* element) {
+  if (timeout_ms < 0) {
+    return Status::InvalidArgument("timeout is negative");
+  }
+  return list_waiters_->Wait(keys, BlockingTimeout(timeout_ms),
+      [this, element](const std::string& k) { return RPop(k, element); },
+      key);
+}
+
+Status BlackWidow::BRPoplpush(const Slice& source, const Slice& destination,
+                              int64_t timeout_ms, std::string* element) {
+  if (timeout_ms < 0) {
+    return Status::InvalidArgument("timeout is negative");
+  }
+  std::string key;
+  return list_waiters_->Wait({source.ToString()},
+                             BlockingTimeout(timeout_ms),
+      [this, &destination, element](const std::string& k) {
+        return RPoplpush(k, destination, element);
+      }, &key);
 }
 
 Status BlackWidow::ZAdd(const Slice& key,
                         const std::vector<ScoreMember>& score_members,
                         int32_t* ret) {
-  return zsets_db_->ZAdd(key, score_members, ret);
+  Status s;
+  {
+    ScopeWatchWrite sww(watch_table_, key);
+    s = zsets_db_->ZAdd(key, score_members, ret);
+  }
+  if (s.ok()) {
+    zset_waiters_->Signal(key, score_members.size());
+  }
+  return s;
 }
 
 Status BlackWidow::ZCard(const Slice& key,
@@ -498,7 +803,15 @@ Status BlackWidow::ZIncrby(const Slice& key,
                            const Slice& member,
                            double increment,
                            double* ret) {
-  return zsets_db_->ZIncrby(key, member, increment, ret);
+  Status s;
+  {
+    ScopeWatchWrite sww(watch_table_, key);
+    s = zsets_db_->ZIncrby(key, member, increment, ret);
+  }
+  if (s.ok()) {
+    zset_waiters_->Signal(key, 1);
+  }
+  return s;
 }
 
 Status BlackWidow::ZRange(const Slice& key,
@@ -526,14 +839,84 @@ Status BlackWidow::ZRank(const Slice& key,
 Status BlackWidow::ZRem(const Slice& key,
                         std::vector<std::string> members,
                         int32_t* ret) {
-  return zsets_db_->ZRem(key, members, ret);
+  ScopeWatchWrite sww(watch_table_, key);
+  Status s = zsets_db_->ZRem(key, members, ret);
+  if (s.ok()) {
+    compact_key_tracker_->AddChurn(kZSets, key, *ret);
+  }
+  return s;
+}
+
+Status BlackWidow::ZPopMin(const Slice& key,
+                           int32_t count,
+                           std::vector<ScoreMember>* score_members) {
+  ScopeWatchWrite sww(watch_table_, key);
+  Status s = zsets_db_->ZPopMin(key, count, score_members);
+  if (s.ok()) {
+    compact_key_tracker_->AddChurn(kZSets, key, score_members->size());
+  }
+  return s;
+}
+
+Status BlackWidow::ZPopMax(const Slice& key,
+                           int32_t count,
+                           std::vector<ScoreMember>* score_members) {
+  ScopeWatchWrite sww(watch_table_, key);
+  Status s = zsets_db_->ZPopMax(key, count, score_members);
+  if (s.ok()) {
+    compact_key_tracker_->AddChurn(kZSets, key, score_members->size());
+  }
+  return s;
+}
+
+Status BlackWidow::BZPopMin(const std::vector<std::string>& keys,
+                            int64_t timeout_ms, std::string* key,
+                            ScoreMember* score_member) {
+  if (timeout_ms < 0) {
+    return Status::InvalidArgument("timeout is negative");
+  }
+  return zset_waiters_->Wait(keys, BlockingTimeout(timeout_ms),
+      [this, score_member](const std::string& k) {
+        std::vector<ScoreMember> score_members;
+        Status s = ZPopMin(k, 1, &score_members);
+        if (s.ok() && !score_members.empty()) {
+          *score_member = score_members.front();
+        } else if (s.ok()) {
+          s = Status::NotFound();
+        }
+        return s;
+      }, key);
+}
+
+Status BlackWidow::BZPopMax(const std::vector<std::string>& keys,
+                            int64_t timeout_ms, std::string* key,
+                            ScoreMember* score_member) {
+  if (timeout_ms < 0) {
+    return Status::InvalidArgument("timeout is negative");
+  }
+  return zset_waiters_->Wait(keys, BlockingTimeout(timeout_ms),
+      [this, score_member](const std::string& k) {
+        std::vector<ScoreMember> score_members;
+        Status s = ZPopMax(k, 1, &score_members);
+        if (s.ok() && !score_members.empty()) {
+          *score_member = score_members.front();
+        } else if (s.ok()) {
+          s = Status::NotFound();
+        }
+        return s;
+      }, key);
 }
 
 Status BlackWidow::ZRemrangebyrank(const Slice& key,
                                    int32_t start,
                                    int32_t stop,
                                    int32_t* ret) {
-  return zsets_db_->ZRemrangebyrank(key, start, stop, ret);
+  ScopeWatchWrite sww(watch_table_, key);
+  Status s = zsets_db_->ZRemrangebyrank(key, start, stop, ret);
+  if (s.ok()) {
+    compact_key_tracker_->AddChurn(kZSets, key, *ret);
+  }
+  return s;
 }
 
 Status BlackWidow::ZRemrangebyscore(const Slice& key,
@@ -542,7 +925,12 @@ Status BlackWidow::ZRemrangebyscore(const Slice& key,
                                     bool left_close,
                                     bool right_close,
                                     int32_t* ret) {
-  return zsets_db_->ZRemrangebyscore(key, min, max, left_close, right_close, ret);
+  ScopeWatchWrite sww(watch_table_, key);
+  Status s = zsets_db_->ZRemrangebyscore(key, min, max, left_close, right_close, ret);
+  if (s.ok()) {
+    compact_key_tracker_->AddChurn(kZSets, key, *ret);
+  }
+  return s;
 }
 
 Status BlackWidow::ZRevrange(const Slice& key,
@@ -578,7 +966,15 @@ Status BlackWidow::ZUnionstore(const Slice& destination,
                                const std::vector<double>& weights,
                                const AGGREGATE agg,
                                int32_t* ret) {
-  return zsets_db_->ZUnionstore(destination, keys, weights, agg, ret);
+  Status s;
+  {
+    ScopeWatchWrite sww(watch_table_, destination);
+    s = zsets_db_->ZUnionstore(destination, keys, weights, agg, ret);
+  }
+  if (s.ok()) {
+    zset_waiters_->Signal(destination, *ret);
+  }
+  return s;
 }
 
 Status BlackWidow::ZInterstore(const Slice& destination,
@@ -586,7 +982,15 @@ Status BlackWidow::ZInterstore(const Slice& destination,
                                const std::vector<double>& weights,
                                const AGGREGATE agg,
                                int32_t* ret) {
-  return zsets_db_->ZInterstore(destination, keys, weights, agg, ret);
+  Status s;
+  {
+    ScopeWatchWrite sww(watch_table_, destination);
+    s = zsets_db_->ZInterstore(destination, keys, weights, agg, ret);
+  }
+  if (s.ok()) {
+    zset_waiters_->Signal(destination, *ret);
+  }
+  return s;
 }
 
 Status BlackWidow::ZRangebylex(const Slice& key,
@@ -613,7 +1017,12 @@ Status BlackWidow::ZRemrangebylex(const Slice& key,
                                   bool left_close,
                                   bool right_close,
                                   int32_t* ret) {
-  return zsets_db_->ZRemrangebylex(key, min, max, left_close, right_close, ret);
+  ScopeWatchWrite sww(watch_table_, key);
+  Status s = zsets_db_->ZRemrangebylex(key, min, max, left_close, right_close, ret);
+  if (s.ok()) {
+    compact_key_tracker_->AddChurn(kZSets, key, *ret);
+  }
+  return s;
 }
 
 Status BlackWidow::ZScan(const Slice& key, int64_t cursor, const std::string& pattern,
@@ -621,10 +1030,287 @@ Status BlackWidow::ZScan(const Slice& key, int64_t cursor, const std::string& pa
   return zsets_db_->ZScan(key, cursor, pattern, count, score_members, next_cursor);
 }
 
+// Geo Commands
+Status BlackWidow::GeoAdd(const Slice& key,
+                          const std::vector<GeoMember>& members,
+                          int32_t* ret) {
+  std::vector<ScoreMember> score_members;
+  for (const auto& geo_member : members) {
+    if (!GeoValidCoordinates(geo_member.longitude, geo_member.latitude)) {
+      return Status::InvalidArgument("invalid longitude,latitude pair");
+    }
+    score_members.push_back({GeohashEncode(geo_member.longitude,
+                                           geo_member.latitude),
+                             geo_member.member});
+  }
+  return ZAdd(key, score_members, ret);
+}
+
+Status BlackWidow::GeoDist(const Slice& key, const Slice& member1,
+                           const Slice& member2, double* distance) {
+  double score1, score2;
+  double longitude1, latitude1, longitude2, latitude2;
+  Status s = zsets_db_->ZScore(key, member1, &score1);
+  if (s.ok()) {
+    s = zsets_db_->ZScore(key, member2, &score2);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  if (!GeohashDecode(score1, &longitude1, &latitude1)
+    || !GeohashDecode(score2, &longitude2, &latitude2)) {
+    return Status::InvalidArgument("the score is not a valid geohash");
+  }
+  *distance = GeoDistance(longitude1, latitude1, longitude2, latitude2);
+  return Status::OK();
+}
+
+Status BlackWidow::GeoRadius(const Slice& key, double longitude,
+                             double latitude, double radius, int32_t count,
+                             std::vector<GeoNeighbour>* neighbours) {
+  neighbours->clear();
+  if (!GeoValidCoordinates(longitude, latitude)) {
+    return Status::InvalidArgument("invalid longitude,latitude pair");
+  } else if (!(radius >= 0)) {
+    return Status::InvalidArgument("radius cannot be negative");
+  }
+  return GeoSearch(key, GeoShape(longitude, latitude, radius), count,
+                   neighbours);
+}
+
+Status BlackWidow::GeoRadiusByMember(const Slice& key, const Slice& member,
+                                     double radius, int32_t count,
+                                     std::vector<GeoNeighbour>* neighbours) {
+  neighbours->clear();
+  double score, longitude, latitude;
+  Status s = zsets_db_->ZScore(key, member, &score);
+  if (!s.ok()) {
+    return s;
+  } else if (!GeohashDecode(score, &longitude, &latitude)) {
+    return Status::InvalidArgument("the score is not a valid geohash");
+  }
+  return GeoRadius(key, longitude, latitude, radius, count, neighbours);
+}
+
+Status BlackWidow::GeoSearchBox(const Slice& key, double longitude,
+                                double latitude, double width, double height,
+                                int32_t count,
+                                std::vector<GeoNeighbour>* neighbours) {
+  neighbours->clear();
+  if (!GeoValidCoordinates(longitude, latitude)) {
+    return Status::InvalidArgument("invalid longitude,latitude pair");
+  } else if (!(width >= 0 && height >= 0)) {
+    return Status::InvalidArgument("width and height cannot be negative");
+  }
+  return GeoSearch(key, GeoShape(longitude, latitude, width, height), count,
+                   neighbours);
+}
+
+// Reads the cells around the center of shape and keeps the members within
+// it in the same pass, the nearest count of them are returned
+Status BlackWidow::GeoSearch(const Slice& key, const GeoShape& shape,
+                             int32_t count,
+                             std::vector<GeoNeighbour>* neighbours) {
+  std::vector<std::pair<double, double>> ranges;
+  shape.ScoreRanges(&ranges);
+  GeoNeighbour neighbour;
+  Status s = zsets_db_->ZScanScoreRanges(key, ranges,
+      [&](double score, const Slice& member) {
+        GeohashDecode(score, &neighbour.longitude, &neighbour.latitude);
+        if (shape.Contains(neighbour.longitude, neighbour.latitude,
+                           &neighbour.distance)) {
+          neighbour.member.assign(member.data(), member.size());
+          neighbours->push_back(neighbour);
+        }
+      });
+  if (!s.ok()) {
+    neighbours->clear();
+    return s;
+  }
+
+  auto nearer = [](const GeoNeighbour& a, const GeoNeighbour& b) {
+    return a.distance < b.distance;
+  };
+  if (count > 0 && static_cast<size_t>(count) < neighbours->size()) {
+    std::partial_sort(neighbours->begin(), neighbours->begin() + count,
+                      neighbours->end(), nearer);
+    neighbours->resize(count);
+  } else {
+    std::sort(neighbours->begin(), neighbours->end(), nearer);
+  }
+  return s;
+}
+
+// Bitmaps Commands
+Status BlackWidow::BmSetBit(const Slice& key, int64_t offset, int32_t value,
+                            int32_t* ret) {
+  ScopeWatchWrite sww(watch_table_, key);
+  return bitmaps_db_->BmSetBit(key, offset, value, ret);
+}
+
+Status BlackWidow::BmGetBit(const Slice& key, int64_t offset, int32_t* ret) {
+  return bitmaps_db_->BmGetBit(key, offset, ret);
+}
+
+Status BlackWidow::BmBitCount(const Slice& key, int64_t start_offset,
+                              int64_t end_offset, int64_t* ret,
+                              bool have_range) {
+  return bitmaps_db_->BmBitCount(key, start_offset, end_offset,
+                                 ret, have_range);
+}
+
+Status BlackWidow::BmBitOp(BitOpType op, const std::string& dest_key,
+                           const std::vector<std::string>& src_keys,
+                           int64_t* ret) {
+  ScopeWatchWrite sww(watch_table_, dest_key);
+  return bitmaps_db_->BmBitOp(op, dest_key, src_keys, ret);
+}
+
+// Streams Commands
+Status BlackWidow::XAdd(const Slice& key,
+                        const std::vector<FieldValue>& field_values,
+                        StreamID* id) {
+  ScopeWatchWrite sww(watch_table_, key);
+  return streams_db_->XAdd(key, field_values, id);
+}
+
+Status BlackWidow::XLen(const Slice& key, int32_t* len) {
+  return streams_db_->XLen(key, len);
+}
+
+Status BlackWidow::XRange(const Slice& key, const StreamID& start,
+                          const StreamID& end, int32_t count,
+                          std::vector<StreamEntry>* entries) {
+  return streams_db_->XRange(key, start, end, count, entries);
+}
+
+Status BlackWidow::XRevRange(const Slice& key, const StreamID& end,
+                             const StreamID& start, int32_t count,
+                             std::vector<StreamEntry>* entries) {
+  return streams_db_->XRevRange(key, end, start, count, entries);
+}
+
+Status BlackWidow::XDel(const Slice& key, const std::vector<StreamID>& ids,
+                        int32_t* ret) {
+  ScopeWatchWrite sww(watch_table_, key);
+  Status s = streams_db_->XDel(key, ids, ret);
+  if (s.ok()) {
+    compact_key_tracker_->AddChurn(kStreams, key, *ret);
+  }
+  return s;
+}
+
+Status BlackWidow::XTrim(const Slice& key, int32_t maxlen, int32_t* ret) {
+  ScopeWatchWrite sww(watch_table_, key);
+  Status s = streams_db_->XTrim(key, maxlen, ret);
+  if (s.ok()) {
+    compact_key_tracker_->AddChurn(kStreams, key, *ret);
+  }
+  return s;
+}
+
+Status BlackWidow::XTrimMinID(const Slice& key, const StreamID& min_id,
+                              int32_t* ret) {
+  ScopeWatchWrite sww(watch_table_, key);
+  Status s = streams_db_->XTrimMinID(key, min_id, ret);
+  if (s.ok()) {
+    compact_key_tracker_->AddChurn(kStreams, key, *ret);
+  }
+  return s;
+}
+
+Status BlackWidow::XGroupCreate(const Slice& key, const Slice& group,
+                                const StreamID& id) {
+  ScopeWatchWrite sww(watch_table_, key);
+  return streams_db_->XGroupCreate(key, group, id);
+}
+
+Status BlackWidow::XGroupDestroy(const Slice& key, const Slice& group) {
+  ScopeWatchWrite sww(watch_table_, key);
+  return streams_db_->XGroupDestroy(key, group);
+}
+
+Status BlackWidow::XReadGroup(const Slice& key, const Slice& group,
+                              const Slice& consumer, int32_t count,
+                              std::vector<StreamEntry>* entries) {
+  ScopeWatchWrite sww(watch_table_, key);
+  return streams_db_->XReadGroup(key, group, consumer, count, entries);
+}
+
+Status BlackWidow::XAck(const Slice& key, const Slice& group,
+                        const std::vector<StreamID>& ids, int32_t* ret) {
+  ScopeWatchWrite sww(watch_table_, key);
+  Status s = streams_db_->XAck(key, group, ids, ret);
+  if (s.ok()) {
+    compact_key_tracker_->AddChurn(kStreams, key, *ret);
+  }
+  return s;
+}
+
+Status BlackWidow::XPending(const Slice& key, const Slice& group,
+                            int32_t count,
+                            std::vector<StreamPendingEntry>* entries) {
+  return streams_db_->XPending(key, group, count, entries);
+}
+
+// Filters Commands
+Status BlackWidow::BFReserve(const Slice& key, double error_rate,
+                             uint64_t capacity, int32_t expansion) {
+  ScopeWatchWrite sww(watch_table_, key);
+  return filters_db_->BFReserve(key, error_rate, capacity, expansion);
+}
+
+Status BlackWidow::BFAdd(const Slice& key,
+                         const std::vector<std::string>& items,
+                         std::vector<bool>* added) {
+  ScopeWatchWrite sww(watch_table_, key);
+  return filters_db_->BFAdd(key, items, added);
+}
+
+Status BlackWidow::BFExists(const Slice& key,
+                            const std::vector<std::string>& items,
+                            std::vector<bool>* exists) {
+  return filters_db_->BFExists(key, items, exists);
+}
+
+Status BlackWidow::BFInfo(const Slice& key, FilterInfo* info) {
+  return filters_db_->BFInfo(key, info);
+}
+
+Status BlackWidow::CFReserve(const Slice& key, uint64_t capacity) {
+  ScopeWatchWrite sww(watch_table_, key);
+  return filters_db_->CFReserve(key, capacity);
+}
+
+Status BlackWidow::CFAdd(const Slice& key,
+                         const std::vector<std::string>& items,
+                         std::vector<bool>* added) {
+  ScopeWatchWrite sww(watch_table_, key);
+  return filters_db_->CFAdd(key, items, added);
+}
+
+Status BlackWidow::CFExists(const Slice& key,
+                            const std::vector<std::string>& items,
+                            std::vector<bool>* exists) {
+  return filters_db_->CFExists(key, items, exists);
+}
+
+Status BlackWidow::CFDel(const Slice& key,
+                         const std::vector<std::string>& items,
+                         int32_t* ret) {
+  ScopeWatchWrite sww(watch_table_, key);
+  return filters_db_->CFDel(key, items, ret);
+}
+
+Status BlackWidow::CFInfo(const Slice& key, FilterInfo* info) {
+  return filters_db_->CFInfo(key, info);
+}
+
 
 // Keys Commands
 int32_t BlackWidow::Expire(const Slice& key, int32_t ttl,
                            std::map<DataType, Status>* type_status) {
+  ScopeWatchWrite sww(watch_table_, key);
   int32_t ret = 0;
   bool is_corruption = false;
 
@@ -673,6 +1359,33 @@ int32_t BlackWidow::Expire(const Slice& key, int32_t ttl,
     (*type_status)[DataType::kZSets] = s;
   }
 
+  // Bitmaps
+  s = bitmaps_db_->Expire(key, ttl);
+  if (s.ok()) {
+    ret++;
+  } else if (!s.IsNotFound()) {
+    is_corruption = true;
+    (*type_status)[DataType::kBitmaps] = s;
+  }
+
+  // Streams
+  s = streams_db_->Expire(key, ttl);
+  if (s.ok()) {
+    ret++;
+  } else if (!s.IsNotFound()) {
+    is_corruption = true;
+    (*type_status)[DataType::kStreams] = s;
+  }
+
+  // Filters
+  s = filters_db_->Expire(key, ttl);
+  if (s.ok()) {
+    ret++;
+  } else if (!s.IsNotFound()) {
+    is_corruption = true;
+    (*type_status)[DataType::kFilters] = s;
+  }
+
   if (is_corruption) {
     return -1;
   } else {
@@ -682,6 +1395,7 @@ int32_t BlackWidow::Expire(const Slice& key, int32_t ttl,
 
 int64_t BlackWidow::Del(const std::vector<std::string>& keys,
                         std::map<DataType, Status>* type_status) {
+  ScopeWatchWrite sww(watch_table_, keys);
   Status s;
   int64_t count = 0;
   bool is_corruption = false;
@@ -731,6 +1445,33 @@ int64_t BlackWidow::Del(const std::vector<std::string>& keys,
       is_corruption = true;
       (*type_status)[DataType::kZSets] = s;
     }
+
+    // Bitmaps
+    s = bitmaps_db_->Del(key);
+    if (s.ok()) {
+      count++;
+    } else if (!s.IsNotFound()) {
+      is_corruption = true;
+      (*type_status)[DataType::kBitmaps] = s;
+    }
+
+    // Streams
+    s = streams_db_->Del(key);
+    if (s.ok()) {
+      count++;
+    } else if (!s.IsNotFound()) {
+      is_corruption = true;
+      (*type_status)[DataType::kStreams] = s;
+    }
+
+    // Filters
+    s = filters_db_->Del(key);
+    if (s.ok()) {
+      count++;
+    } else if (!s.IsNotFound()) {
+      is_corruption = true;
+      (*type_status)[DataType::kFilters] = s;
+    }
   }
 
   if (is_corruption) {
@@ -742,6 +1483,7 @@ int64_t BlackWidow::Del(const std::vector<std::string>& keys,
 
 int64_t BlackWidow::DelByType(const std::vector<std::string>& keys,
                               DataType type) {
+  ScopeWatchWrite sww(watch_table_, keys);
   Status s;
   int64_t count = 0;
   bool is_corruption = false;
@@ -762,7 +1504,40 @@ int64_t BlackWidow::DelByType(const std::vector<std::string>& keys,
       // Hashes
       case DataType::kHashes:
       {
-        s = hashes_db_->Del(key);
+        s = hashes_db_->Del(key);
+        if (s.ok()) {
+          count++;
+        } else if (!s.IsNotFound()) {
+          is_corruption = true;
+        }
+        break;
+      }
+      // Sets
+      case DataType::kSets:
+      {
+        s = sets_db_->Del(key);
+        if (s.ok()) {
+          count++;
+        } else if (!s.IsNotFound()) {
+          is_corruption = true;
+        }
+        break;
+      }
+      // Lists
+      case DataType::kLists:
+      {
+        s = lists_db_->Del(key);
+        if (s.ok()) {
+          count++;
+        } else if (!s.IsNotFound()) {
+          is_corruption = true;
+        }
+        break;
+      }
+      // ZSets
+      case DataType::kZSets:
+      {
+        s = zsets_db_->Del(key);
         if (s.ok()) {
           count++;
         } else if (!s.IsNotFound()) {
@@ -770,10 +1545,10 @@ int64_t BlackWidow::DelByType(const std::vector<std::string>& keys,
         }
         break;
       }
-      // Sets
-      case DataType::kSets:
+      // Bitmaps
+      case DataType::kBitmaps:
       {
-        s = sets_db_->Del(key);
+        s = bitmaps_db_->Del(key);
         if (s.ok()) {
           count++;
         } else if (!s.IsNotFound()) {
@@ -781,10 +1556,10 @@ int64_t BlackWidow::DelByType(const std::vector<std::string>& keys,
         }
         break;
       }
-      // Lists
-      case DataType::kLists:
+      // Streams
+      case DataType::kStreams:
       {
-        s = lists_db_->Del(key);
+        s = streams_db_->Del(key);
         if (s.ok()) {
           count++;
         } else if (!s.IsNotFound()) {
@@ -792,10 +1567,10 @@ int64_t BlackWidow::DelByType(const std::vector<std::string>& keys,
         }
         break;
       }
-      // ZSets
-      case DataType::kZSets:
+      // Filters
+      case DataType::kFilters:
       {
-        s = zsets_db_->Del(key);
+        s = filters_db_->Del(key);
         if (s.ok()) {
           count++;
         } else if (!s.IsNotFound()) {
@@ -823,6 +1598,8 @@ int64_t BlackWidow::Exists(const std::vector<std::string>& keys,
   int64_t count = 0;
   int32_t ret;
   uint64_t llen;
+  int64_t cardinality;
+  uint64_t items;
   std::string value;
   Status s;
   bool is_corruption = false;
@@ -867,6 +1644,30 @@ int64_t BlackWidow::Exists(const std::vector<std::string>& keys,
       is_corruption = true;
       (*type_status)[DataType::kZSets] = s;
     }
+
+    s = bitmaps_db_->BmBitCount(key, 0, 0, &cardinality, false);
+    if (s.ok()) {
+      count++;
+    } else if (!s.IsNotFound()) {
+      is_corruption = true;
+      (*type_status)[DataType::kBitmaps] = s;
+    }
+
+    s = streams_db_->XLen(key, &ret);
+    if (s.ok()) {
+      count++;
+    } else if (!s.IsNotFound()) {
+      is_corruption = true;
+      (*type_status)[DataType::kStreams] = s;
+    }
+
+    s = filters_db_->Card(key, &items);
+    if (s.ok()) {
+      count++;
+    } else if (!s.IsNotFound()) {
+      is_corruption = true;
+      (*type_status)[DataType::kFilters] = s;
+    }
   }
 
   if (is_corruption) {
@@ -943,11 +1744,44 @@ int64_t BlackWidow::Scan(int64_t cursor, const std::string& pattern,
     case 'z':
       is_finish = zsets_db_->Scan(start_key, pattern, keys,
                                   &count, &next_key);
+      if (count == 0 && is_finish) {
+        cursor_ret = StoreAndGetCursor(cursor + step_length, std::string("b"));
+        break;
+      } else if (count == 0 && !is_finish) {
+        cursor_ret = StoreAndGetCursor(cursor + step_length, std::string("z") + next_key);
+        break;
+      }
+      start_key = "";
+    case 'b':
+      is_finish = bitmaps_db_->Scan(start_key, pattern, keys,
+                                    &count, &next_key);
+      if (count == 0 && is_finish) {
+        cursor_ret = StoreAndGetCursor(cursor + step_length, std::string("x"));
+        break;
+      } else if (count == 0 && !is_finish) {
+        cursor_ret = StoreAndGetCursor(cursor + step_length, std::string("b") + next_key);
+        break;
+      }
+      start_key = "";
+    case 'x':
+      is_finish = streams_db_->Scan(start_key, pattern, keys,
+                                    &count, &next_key);
+      if (count == 0 && is_finish) {
+        cursor_ret = StoreAndGetCursor(cursor + step_length, std::string("f"));
+        break;
+      } else if (count == 0 && !is_finish) {
+        cursor_ret = StoreAndGetCursor(cursor + step_length, std::string("x") + next_key);
+        break;
+      }
+      start_key = "";
+    case 'f':
+      is_finish = filters_db_->Scan(start_key, pattern, keys,
+                                    &count, &next_key);
       if (is_finish) {
         cursor_ret = 0;
         break;
       } else if (count == 0 && !is_finish) {
-        cursor_ret = StoreAndGetCursor(cursor + step_length, std::string("z") + next_key);
+        cursor_ret = StoreAndGetCursor(cursor + step_length, std::string("f") + next_key);
         break;
       }
   }
@@ -957,6 +1791,7 @@ int64_t BlackWidow::Scan(int64_t cursor, const std::string& pattern,
 
 int32_t BlackWidow::Expireat(const Slice& key, int32_t timestamp,
                              std::map<DataType, Status>* type_status) {
+  ScopeWatchWrite sww(watch_table_, key);
   Status s;
   int32_t count = 0;
   bool is_corruption = false;
@@ -1001,6 +1836,30 @@ int32_t BlackWidow::Expireat(const Slice& key, int32_t timestamp,
     (*type_status)[DataType::kLists] = s;
   }
 
+  s = bitmaps_db_->Expireat(key, timestamp);
+  if (s.ok()) {
+    count++;
+  } else if (!s.IsNotFound()) {
+    is_corruption = true;
+    (*type_status)[DataType::kBitmaps] = s;
+  }
+
+  s = streams_db_->Expireat(key, timestamp);
+  if (s.ok()) {
+    count++;
+  } else if (!s.IsNotFound()) {
+    is_corruption = true;
+    (*type_status)[DataType::kStreams] = s;
+  }
+
+  s = filters_db_->Expireat(key, timestamp);
+  if (s.ok()) {
+    count++;
+  } else if (!s.IsNotFound()) {
+    is_corruption = true;
+    (*type_status)[DataType::kFilters] = s;
+  }
+
   if (is_corruption) {
     return -1;
   } else {
@@ -1010,6 +1869,7 @@ int32_t BlackWidow::Expireat(const Slice& key, int32_t timestamp,
 
 int32_t BlackWidow::Persist(const Slice& key,
                             std::map<DataType, Status>* type_status) {
+  ScopeWatchWrite sww(watch_table_, key);
   Status s;
   int32_t count = 0;
   bool is_corruption = false;
@@ -1054,6 +1914,30 @@ int32_t BlackWidow::Persist(const Slice& key,
     (*type_status)[DataType::kLists] = s;
   }
 
+  s = bitmaps_db_->Persist(key);
+  if (s.ok()) {
+    count++;
+  } else if (!s.IsNotFound()) {
+    is_corruption = true;
+    (*type_status)[DataType::kBitmaps] = s;
+  }
+
+  s = streams_db_->Persist(key);
+  if (s.ok()) {
+    count++;
+  } else if (!s.IsNotFound()) {
+    is_corruption = true;
+    (*type_status)[DataType::kStreams] = s;
+  }
+
+  s = filters_db_->Persist(key);
+  if (s.ok()) {
+    count++;
+  } else if (!s.IsNotFound()) {
+    is_corruption = true;
+    (*type_status)[DataType::kFilters] = s;
+  }
+
   if (is_corruption) {
     return -1;
   } else {
@@ -1106,10 +1990,34 @@ std::map<DataType, int64_t> BlackWidow::TTL(const Slice& key,
     ret[DataType::kZSets] = -3;
     (*type_status)[DataType::kZSets] = s;
   }
+
+  s = bitmaps_db_->TTL(key, &timestamp);
+  if (s.ok() || s.IsNotFound()) {
+    ret[DataType::kBitmaps] = timestamp;
+  } else if (!s.IsNotFound()) {
+    ret[DataType::kBitmaps] = -3;
+    (*type_status)[DataType::kBitmaps] = s;
+  }
+
+  s = streams_db_->TTL(key, &timestamp);
+  if (s.ok() || s.IsNotFound()) {
+    ret[DataType::kStreams] = timestamp;
+  } else if (!s.IsNotFound()) {
+    ret[DataType::kStreams] = -3;
+    (*type_status)[DataType::kStreams] = s;
+  }
+
+  s = filters_db_->TTL(key, &timestamp);
+  if (s.ok() || s.IsNotFound()) {
+    ret[DataType::kFilters] = timestamp;
+  } else if (!s.IsNotFound()) {
+    ret[DataType::kFilters] = -3;
+    (*type_status)[DataType::kFilters] = s;
+  }
   return ret;
 }
 
-//the sequence is kv, hash, list, zset, set
+//the sequence is kv, hash, list, zset, set, bitmap, stream, filter
 Status BlackWidow::Type(const std::string &key, std::string* type) {
   type->clear();
 
@@ -1159,6 +2067,33 @@ Status BlackWidow::Type(const std::string &key, std::string* type) {
     return s;
   }
 
+  int64_t bitmaps_cardinality = 0;
+  s = bitmaps_db_->BmBitCount(key, 0, 0, &bitmaps_cardinality, false);
+  if (s.ok()) {
+    *type = "bitmap";
+    return s;
+  } else if (!s.IsNotFound()) {
+    return s;
+  }
+
+  int32_t streams_len = 0;
+  s = streams_db_->XLen(key, &streams_len);
+  if (s.ok()) {
+    *type = "stream";
+    return s;
+  } else if (!s.IsNotFound()) {
+    return s;
+  }
+
+  uint64_t filters_items = 0;
+  s = filters_db_->Card(key, &filters_items);
+  if (s.ok()) {
+    *type = "filter";
+    return s;
+  } else if (!s.IsNotFound()) {
+    return s;
+  }
+
   *type = "none";
   return Status::OK();
 }
@@ -1182,6 +2117,15 @@ Status BlackWidow::Keys(const std::string& type,
   } else if (type == "list") {
     s = lists_db_->ScanKeys(pattern, keys);
     if (!s.ok()) return s;
+  } else if (type == "bitmap") {
+    s = bitmaps_db_->ScanKeys(pattern, keys);
+    if (!s.ok()) return s;
+  } else if (type == "stream") {
+    s = streams_db_->ScanKeys(pattern, keys);
+    if (!s.ok()) return s;
+  } else if (type == "filter") {
+    s = filters_db_->ScanKeys(pattern, keys);
+    if (!s.ok()) return s;
   } else {
     s = strings_db_->ScanKeys(pattern, keys);
     if (!s.ok()) return s;
@@ -1193,6 +2137,12 @@ Status BlackWidow::Keys(const std::string& type,
     if (!s.ok()) return s;
     s = lists_db_->ScanKeys(pattern, keys);
     if (!s.ok()) return s;
+    s = bitmaps_db_->ScanKeys(pattern, keys);
+    if (!s.ok()) return s;
+    s = streams_db_->ScanKeys(pattern, keys);
+    if (!s.ok()) return s;
+    s = filters_db_->ScanKeys(pattern, keys);
+    if (!s.ok()) return s;
   }
   return s;
 }
@@ -1215,45 +2165,97 @@ void BlackWidow::ScanDatabase(const DataType& type) {
     case kLists:
         lists_db_->ScanDatabase();
         break;
+    case kBitmaps:
+        bitmaps_db_->ScanDatabase();
+        break;
+    case kStreams:
+        streams_db_->ScanDatabase();
+        break;
+    case kFilters:
+        filters_db_->ScanDatabase();
+        break;
     case kAll:
         strings_db_->ScanDatabase();
         hashes_db_->ScanDatabase();
         sets_db_->ScanDatabase();
         zsets_db_->ScanDatabase();
         lists_db_->ScanDatabase();
+        bitmaps_db_->ScanDatabase();
+        streams_db_->ScanDatabase();
+        filters_db_->ScanDatabase();
         break;
   }
 }
 
+// Transactions Commands
+Status BlackWidow::Watch(const std::vector<std::string>& keys,
+                         std::vector<KeyEpoch>* watched) {
+  watched->clear();
+  for (const auto& key : keys) {
+    watched->push_back({key, watch_table_->Epoch(key)});
+  }
+  return Status::OK();
+}
+
+Status BlackWidow::ExecIfUnchanged(const std::vector<KeyEpoch>& watched,
+                                   const std::function<Status()>& ops) {
+  if (watch_table_->InTransaction()) {
+    return Status::NotSupported("Nested transaction");
+  }
+
+  std::vector<std::string> keys;
+  for (const auto& key_epoch : watched) {
+    keys.push_back(key_epoch.key);
+  }
+  std::vector<uint32_t> stripes;
+  watch_table_->BeginTransaction();
+  watch_table_->Lock(keys, &stripes);
+  Status s;
+  for (const auto& key_epoch : watched) {
+    if (watch_table_->Epoch(key_epoch.key) != key_epoch.epoch) {
+      s = Status::Busy("Watched key modified");
+      break;
+    }
+  }
+  if (s.ok()) {
+    s = ops();
+  }
+  watch_table_->Unlock(stripes);
+  watch_table_->EndTransaction();
+  return s;
+}
+
 // HyperLogLog
 Status BlackWidow::PfAdd(const Slice& key,
                          const std::vector<std::string>& values, bool* update) {
+  ScopeWatchWrite sww(watch_table_, key);
   *update = false;
   if (values.size() >= kMaxKeys) {
     return Status::InvalidArgument("Invalid the number of key");
   }
 
-  std::string value, registers, result = "";
-  Status s = strings_db_->Get(key, &value);
-  if (s.ok()) {
-    registers = value;
-  } else if (s.IsNotFound()) {
+  std::string registers;
+  Status s = strings_db_->Get(key, &registers);
+  if (s.IsNotFound()) {
     registers = "";
-  } else {
+  } else if (!s.ok()) {
     return s;
   }
   HyperLogLog log(kPrecision, registers);
-  int32_t previous = static_cast<int32_t>(log.Estimate());
+  if (!log.Valid()) {
+    return Status::InvalidArgument("Invalid HyperLogLog value");
+  }
+  bool changed = false;
   for (size_t i = 0; i < values.size(); ++i) {
-    result = log.Add(values[i].data(), values[i].size());
+    if (log.Add(values[i].data(), values[i].size())) {
+      changed = true;
+    }
   }
-  HyperLogLog update_log(kPrecision, result);
-  int32_t now = static_cast<int32_t>(update_log.Estimate());
-  if (previous != now || (s.IsNotFound() && values.size() == 0)) {
-    *update = true;
+  if (!changed && !s.IsNotFound()) {
+    return Status::OK();
   }
-  s = strings_db_->Set(key, result);
-  return s;
+  *update = true;
+  return strings_db_->Set(key, log.Encode());
 }
 
 Status BlackWidow::PfCount(const std::vector<std::string>& keys,
@@ -1262,29 +2264,48 @@ Status BlackWidow::PfCount(const std::vector<std::string>& keys,
     return Status::InvalidArgument("Invalid the number of key");
   }
 
-  std::string value, first_registers;
-  Status s = strings_db_->Get(keys[0], &value);
-  if (s.ok()) {
-    first_registers = std::string(value.data(), value.size());
-  } else if (s.IsNotFound()) {
-    first_registers = "";
+  if (keys.size() == 1) {
+    std::string registers;
+    Status s = strings_db_->Get(keys[0], &registers);
+    if (s.IsNotFound()) {
+      *result = 0;
+      return Status::OK();
+    } else if (!s.ok()) {
+      return s;
+    }
+    if (HyperLogLog::CachedCount(registers, result)) {
+      return Status::OK();
+    }
+    HyperLogLog log(kPrecision, registers);
+    if (!log.Valid()) {
+      return Status::InvalidArgument("Invalid HyperLogLog value");
+    }
+    *result = log.Count();
+    // Cache the cardinality unless the value changed in the meantime,
+    // legacy values have no room for it
+    std::string new_registers = log.Encode();
+    if (new_registers != registers) {
+      int32_t ret;
+      strings_db_->Setvx(keys[0], registers, new_registers, &ret);
+    }
+    return Status::OK();
   }
 
-  HyperLogLog first_log(kPrecision, first_registers);
-  for (size_t i = 1; i < keys.size(); ++i) {
-    std::string value, registers;
-    s = strings_db_->Get(keys[i], &value);
-    if (s.ok()) {
-      registers = value;
-    } else if (s.IsNotFound()) {
+  std::vector<std::string> values;
+  Status s = strings_db_->MGet(keys, &values);
+  if (!s.ok()) {
+    return s;
+  }
+  HyperLogLog log(kPrecision, "");
+  for (const auto& value : values) {
+    if (value.empty()) {
       continue;
-    } else {
-      return s;
     }
-    HyperLogLog log(kPrecision, registers);
-    first_log.Merge(log);
+    if (!log.Merge(value.data(), value.size())) {
+      return Status::InvalidArgument("Invalid HyperLogLog value");
+    }
   }
-  *result = static_cast<int32_t>(first_log.Estimate());
+  *result = static_cast<int64_t>(log.Estimate());
   return Status::OK();
 }
 
@@ -1293,86 +2314,78 @@ Status BlackWidow::PfMerge(const std::vector<std::string>& keys) {
     return Status::InvalidArgument("Invalid the number of key");
   }
 
-  Status s;
-  std::string value, first_registers, result;
-  s = strings_db_->Get(keys[0], &value);
-  if (s.ok()) {
-    first_registers = std::string(value.data(), value.size());
-  } else if (s.IsNotFound()) {
+  ScopeWatchWrite sww(watch_table_, keys[0]);
+  std::string first_registers;
+  Status s = strings_db_->Get(keys[0], &first_registers);
+  if (s.IsNotFound()) {
     first_registers = "";
+  } else if (!s.ok()) {
+    return s;
   }
 
-  result = first_registers;
   HyperLogLog first_log(kPrecision, first_registers);
-  for (size_t i = 1; i < keys.size(); ++i) {
-    std::string value, registers;
-    s = strings_db_->Get(keys[i], &value);
-    if (s.ok()) {
-      registers = std::string(value.data(), value.size());
-    } else if (s.IsNotFound()) {
+  if (!first_log.Valid()) {
+    return Status::InvalidArgument("Invalid HyperLogLog value");
+  }
+  std::vector<std::string> source_keys(keys.begin() + 1, keys.end());
+  std::vector<std::string> values;
+  s = strings_db_->MGet(source_keys, &values);
+  if (!s.ok()) {
+    return s;
+  }
+  for (const auto& value : values) {
+    if (value.empty()) {
       continue;
-    } else {
-      return s;
     }
-    HyperLogLog log(kPrecision, registers);
-    result = first_log.Merge(log);
+    if (!first_log.Merge(value.data(), value.size())) {
+      return Status::InvalidArgument("Invalid HyperLogLog value");
+    }
   }
-  s = strings_db_->Set(keys[0], result);
-  return s;
+  return strings_db_->Set(keys[0], first_log.Encode());
 }
 
-static void* StartBGThreadWrapper(void* arg) {
-  BlackWidow* bw = reinterpret_cast<BlackWidow*>(arg);
-  bw->RunBGTask();
-  return NULL;
+Status BlackWidow::StartBGThread(size_t threads) {
+  return bg_task_scheduler_->Start(threads);
 }
 
-Status BlackWidow::StartBGThread() {
-  int result = pthread_create(&bg_tasks_thread_id_, NULL, StartBGThreadWrapper, this);
-  if (result != 0) {
-    char msg[128];
-    snprintf (msg, 128, "pthread create: %s", strerror(result));
-    return Status::Corruption(msg);
-  }
+Status BlackWidow::AddBGTask(const BGTask& bg_task) {
+  bg_task_scheduler_->Schedule(bg_task);
   return Status::OK();
 }
 
-Status BlackWidow::AddBGTask(const BGTask& bg_task) {
-  bg_tasks_mutex_.Lock();
-  bg_tasks_queue_.push(bg_task);
-  bg_tasks_cond_var_.Signal();
-  bg_tasks_mutex_.Unlock();
+Status BlackWidow::CancelBGTask(const BGTask& bg_task) {
+  if (!bg_task_scheduler_->Cancel(bg_task)) {
+    return Status::NotFound();
+  }
   return Status::OK();
 }
 
-Status BlackWidow::RunBGTask() {
-  BGTask task;
-  while (!bg_tasks_should_exit_) {
-
-    bg_tasks_mutex_.Lock();
-    while (bg_tasks_queue_.empty() && !bg_tasks_should_exit_) {
-      bg_tasks_cond_var_.Wait();
-    }
-
-    if (!bg_tasks_queue_.empty()) {
-      task = bg_tasks_queue_.front();
-      bg_tasks_queue_.pop();
-    }
-    bg_tasks_mutex_.Unlock();
-
-    if (bg_tasks_should_exit_) {
-      return Status::Incomplete("bgtask return with bg_tasks_should_exit_ true");
-    }
+Status BlackWidow::GetBGTasks(std::vector<BGTaskStatus>* tasks) {
+  bg_task_scheduler_->GetTasks(tasks);
+  return Status::OK();
+}
 
-    if (task.operation == kCleanAll) {
-      DoCompact(task.type);
-    } else if (task.operation == kCompactKey) {
-      CompactKey(task.type, task.argv);
+Status BlackWidow::SetBGTaskWindows(const std::vector<TimeWindow>& windows) {
+  for (const auto& window : windows) {
+    if (window.start_minute < 0 || window.start_minute >= 24 * 60
+      || window.end_minute < 0 || window.end_minute > 24 * 60) {
+      return Status::InvalidArgument("Invalid time window");
     }
   }
+  bg_task_scheduler_->SetWindows(windows);
   return Status::OK();
 }
 
+void BlackWidow::RunBGTask(const BGTask& task, BGTaskProgress* progress) {
+  if (task.operation == kCleanAll) {
+    DoCompact(task.type, progress);
+  } else if (task.operation == kCompactKey) {
+    progress->SetTotal(1);
+    CompactKey(task.type, task.argv);
+    progress->Advance();
+  }
+}
+
 Status BlackWidow::Compact(const DataType& type, bool sync) {
   if (sync) {
     return DoCompact(type);
@@ -1383,56 +2396,139 @@ Status BlackWidow::Compact(const DataType& type, bool sync) {
 }
 
 Status BlackWidow::DoCompact(const DataType& type) {
-  if (type != kAll
-    && type != kStrings
-    && type != kHashes
-    && type != kSets
-    && type != kZSets
-    && type != kLists) {
-    return Status::InvalidArgument("");
+  BGTaskProgress progress;
+  return DoCompact(type, &progress);
+}
+
+Status BlackWidow::DoCompact(const DataType& type, BGTaskProgress* progress) {
+  std::vector<Redis*> dbs;
+  Operation task_type;
+  switch (type) {
+    case kStrings:
+      dbs.push_back(strings_db_);
+      task_type = Operation::kCleanStrings;
+      break;
+    case kHashes:
+      dbs.push_back(hashes_db_);
+      task_type = Operation::kCleanHashes;
+      break;
+    case kSets:
+      dbs.push_back(sets_db_);
+      task_type = Operation::kCleanSets;
+      break;
+    case kZSets:
+      dbs.push_back(zsets_db_);
+      task_type = Operation::kCleanZSets;
+      break;
+    case kLists:
+      dbs.push_back(lists_db_);
+      task_type = Operation::kCleanLists;
+      break;
+    case kBitmaps:
+      dbs.push_back(bitmaps_db_);
+      task_type = Operation::kCleanBitmaps;
+      break;
+    case kStreams:
+      dbs.push_back(streams_db_);
+      task_type = Operation::kCleanStreams;
+      break;
+    case kFilters:
+      dbs.push_back(filters_db_);
+      task_type = Operation::kCleanFilters;
+      break;
+    case kAll:
+      dbs = {strings_db_, hashes_db_, sets_db_, zsets_db_, lists_db_,
+             bitmaps_db_, streams_db_, filters_db_};
+      task_type = Operation::kCleanAll;
+      break;
+    default:
+      return Status::InvalidArgument("");
   }
 
-  Status s;
-  if (type == kStrings) {
-    current_task_type_ = Operation::kCleanStrings;
-    s = strings_db_->CompactRange(NULL, NULL);
-  } else if (type == kHashes) {
-    current_task_type_ = Operation::kCleanHashes;
-    s = hashes_db_->CompactRange(NULL, NULL);
-  } else if (type == kSets) {
-    current_task_type_ = Operation::kCleanSets;
-    s = sets_db_->CompactRange(NULL, NULL);
-  } else if (type == kZSets) {
-    current_task_type_ = Operation::kCleanZSets;
-    s = zsets_db_->CompactRange(NULL, NULL);
-  } else if (type == kLists) {
-    current_task_type_ = Operation::kCleanLists;
-    s = lists_db_->CompactRange(NULL, NULL);
-  } else {
-    current_task_type_ = Operation::kCleanAll;
-    s = strings_db_->CompactRange(NULL, NULL);
-    s = hashes_db_->CompactRange(NULL, NULL);
-    s = sets_db_->CompactRange(NULL, NULL);
-    s = zsets_db_->CompactRange(NULL, NULL);
-    s = lists_db_->CompactRange(NULL, NULL);
+  current_task_type_ = task_type;
+  progress->SetTotal(dbs.size());
+  // Every data type lives in its own db, so they are compacted side by side
+  std::vector<Status> statuses(dbs.size());
+  std::vector<std::thread> jobs;
+  for (size_t i = 0; i < dbs.size(); i++) {
+    jobs.emplace_back([&dbs, &statuses, progress, i]() {
+      statuses[i] = dbs[i]->CompactRange(NULL, NULL);
+      progress->Advance();
+    });
+  }
+  for (auto& job : jobs) {
+    job.join();
   }
   current_task_type_ = Operation::kNone;
-  return s;
+
+  for (const auto& s : statuses) {
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
+std::vector<Redis*> BlackWidow::GetDBsByType(const DataType& type) {
+  std::vector<Redis*> dbs;
+  switch (type) {
+    case kStrings:
+      dbs.push_back(strings_db_);
+      break;
+    case kHashes:
+      dbs.push_back(hashes_db_);
+      break;
+    case kSets:
+      dbs.push_back(sets_db_);
+      break;
+    case kZSets:
+      dbs.push_back(zsets_db_);
+      break;
+    case kLists:
+      dbs.push_back(lists_db_);
+      break;
+    case kBitmaps:
+      dbs.push_back(bitmaps_db_);
+      break;
+    case kStreams:
+      dbs.push_back(streams_db_);
+      break;
+    case kFilters:
+      dbs.push_back(filters_db_);
+      break;
+    case kAll:
+      dbs = {strings_db_, hashes_db_, sets_db_, zsets_db_, lists_db_,
+             bitmaps_db_, streams_db_, filters_db_};
+      break;
+  }
+  return dbs;
 }
 
 Status BlackWidow::CompactKey(const DataType& type, const std::string& key) {
+  std::vector<Redis*> dbs = GetDBsByType(type);
 
   Status s;
-  std::string start_key, end_key;
-  CalculateStartAndEndKey(key, &start_key, &end_key);
-  if (type == kSets) {
-    Slice slice_begin(start_key);
-    Slice slice_end(end_key);
-    s = sets_db_->CompactRange(&slice_begin, &slice_end);
+  for (const auto& db : dbs) {
+    Status db_s = db->CompactKey(key);
+    if (s.ok()) {
+      s = db_s;
+    }
   }
   return s;
 }
 
+Status BlackWidow::GetStaleRatio(const DataType& type, double* ratio) {
+  uint64_t stale = 0, total = 0;
+  for (const auto& db : GetDBsByType(type)) {
+    Status s = db->GetStaleEntries(&stale, &total);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  *ratio = total == 0 ? 0 : static_cast<double>(stale) / total;
+  return Status::OK();
+}
+
 std::string BlackWidow::GetCurrentTaskType() {
   int type = current_task_type_;
   switch (type) {
@@ -1448,6 +2544,12 @@ std::string BlackWidow::GetCurrentTaskType() {
       return "Set";
     case kCleanLists:
       return "List";
+    case kCleanBitmaps:
+      return "Bitmap";
+    case kCleanStreams:
+      return "Stream";
+    case kCleanFilters:
+      return "Filter";
     case kNone:
     default:
       return "No";
@@ -1464,6 +2566,30 @@ Status BlackWidow::GetUsage(const std::string& type, uint64_t *result) {
   }
   if (type == USAGE_TYPE_ALL || type == USAGE_TYPE_NEMO) {
     //*result += GetLockUsage();
+    RowCacheStatistics stats;
+    GetRowCacheStatistics(kAll, &stats);
+    *result += stats.usage;
+  }
+  return Status::OK();
+}
+
+Status BlackWidow::GetRowCacheStatistics(const DataType& type,
+                                         RowCacheStatistics* stats) {
+  std::vector<Redis*> dbs = GetDBsByType(type);
+
+  stats->hits = 0;
+  stats->misses = 0;
+  stats->rejects = 0;
+  stats->usage = 0;
+  for (const auto& db : dbs) {
+    RowCache* row_cache = db->row_cache();
+    if (row_cache == nullptr) {
+      continue;
+    }
+    stats->hits += row_cache->hits();
+    stats->misses += row_cache->misses();
+    stats->rejects += row_cache->rejects();
+    stats->usage += row_cache->GetUsage();
   }
   return Status::OK();
 }
@@ -1483,6 +2609,12 @@ uint64_t BlackWidow::GetProperty(const std::string &property) {
   result += std::strtoull(out.c_str(), &pEnd, 10);
   lists_db_->GetProperty(property, &out);
   result += std::strtoull(out.c_str(), &pEnd, 10);
+  bitmaps_db_->GetProperty(property, &out);
+  result += std::strtoull(out.c_str(), &pEnd, 10);
+  streams_db_->GetProperty(property, &out);
+  result += std::strtoull(out.c_str(), &pEnd, 10);
+  filters_db_->GetProperty(property, &out);
+  result += std::strtoull(out.c_str(), &pEnd, 10);
 
   //printf ("cur-size-all-mem-tables: (%s)\n", out.c_str());
   return result;
@@ -1515,6 +2647,21 @@ Status BlackWidow::GetKeyNum(std::vector<uint64_t>* nums) {
     nums->push_back(num);
   }
 
+  if (!scan_keynum_exit_) {
+    bitmaps_db_->ScanKeyNum(&num);
+    nums->push_back(num);
+  }
+
+  if (!scan_keynum_exit_) {
+    streams_db_->ScanKeyNum(&num);
+    nums->push_back(num);
+  }
+
+  if (!scan_keynum_exit_) {
+    filters_db_->ScanKeyNum(&num);
+    nums->push_back(num);
+  }
+
   if (scan_keynum_exit_) {
     scan_keynum_exit_ = false;
     return Status::Corruption("exit");
@@ -1539,6 +2686,12 @@ rocksdb::DB* BlackWidow::GetDBByType(const std::string& type) {
     return sets_db_->get_db();
   } else if (type == ZSETS_DB) {
     return zsets_db_->get_db();
+  } else if (type == BITMAPS_DB) {
+    return bitmaps_db_->get_db();
+  } else if (type == STREAMS_DB) {
+    return streams_db_->get_db();
+  } else if (type == FILTERS_DB) {
+    return filters_db_->get_db();
   } else {
     return NULL;
   }
@@ -77,7 +77,7 @@ inline uint32_t rotl32 ( uint32_t x, uint8_t r )
 //-----------------------------------------------------------------------------
 // Finalization mix - force all bits of a hash block to avalanche
 
-uint32_t fmix32( uint32_t h )
+inline uint32_t fmix32( uint32_t h )
 {
     h ^= h >> 16;
     h *= 0x85ebca6b;
@@ -95,7 +95,7 @@ extern "C"
 #else
 extern
 #endif
-void MurmurHash3_x86_32( const void * key, int len, uint32_t seed, void * out )
+inline void MurmurHash3_x86_32( const void * key, int len, uint32_t seed, void * out )
 {
     const uint8_t * data = (const uint8_t*)key;
     const int nblocks = len / 4;
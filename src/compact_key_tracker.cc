@@ -0,0 +1,107 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/compact_key_tracker.h"
+
+#include "slash/include/env.h"
+
+namespace blackwidow {
+
+const uint64_t CompactKeyTracker::kMinIntervalUs;
+const size_t CompactKeyTracker::kMaxTrackedKeys;
+
+static uint64_t SkippedCount() {
+  const rocksdb::PerfContext* perf_context = rocksdb::get_perf_context();
+  return perf_context->internal_key_skipped_count
+    + perf_context->internal_delete_skipped_count;
+}
+
+CompactKeyTracker::CompactKeyTracker(BlackWidow* bw,
+                                     uint64_t skipped_threshold,
+                                     uint64_t churn_threshold)
+  : bw_(bw),
+    skipped_(skipped_threshold),
+    churn_(churn_threshold),
+    last_queued_us_(0) {
+}
+
+std::string CompactKeyTracker::TrackedKey(const DataType& type,
+                                          const Slice& key) {
+  std::string tracked_key(1, static_cast<char>(type));
+  tracked_key.append(key.data(), key.size());
+  return tracked_key;
+}
+
+void CompactKeyTracker::AddSkipped(const DataType& type, const Slice& key,
+                                   uint64_t skipped) {
+  Add(&skipped_, type, key, skipped);
+}
+
+void CompactKeyTracker::AddChurn(const DataType& type, const Slice& key,
+                                 uint64_t removed) {
+  Add(&churn_, type, key, removed);
+}
+
+void CompactKeyTracker::Add(Counts* counts, const DataType& type,
+                            const Slice& key, uint64_t count) {
+  if (counts->threshold == 0 || count == 0) {
+    return;
+  }
+  std::string tracked_key = TrackedKey(type, key);
+  {
+    slash::MutexLock l(&mutex_);
+    if (count < counts->threshold) {
+      // The counts are only a hint, forget them all rather than keeping an
+      // LRU order up to date on every command
+      if (counts->map.size() >= kMaxTrackedKeys) {
+        counts->map.clear();
+      }
+      count += counts->map[tracked_key];
+      if (count < counts->threshold) {
+        counts->map[tracked_key] = count;
+        return;
+      }
+    }
+    uint64_t now_us = slash::NowMicros();
+    if (now_us < last_queued_us_ + kMinIntervalUs) {
+      // Try again on one of the next commands
+      counts->map[tracked_key] = count;
+      return;
+    }
+    last_queued_us_ = now_us;
+    skipped_.map.erase(tracked_key);
+    churn_.map.erase(tracked_key);
+  }
+  bw_->AddBGTask({type, kCompactKey, key.ToString()});
+}
+
+ScopeSkippedKeys::ScopeSkippedKeys(CompactKeyTracker* tracker,
+                                   const DataType& type, const Slice& key)
+  : tracker_(tracker),
+    type_(type),
+    key_(key),
+    perf_level_(rocksdb::GetPerfLevel()),
+    start_count_(0) {
+  if (tracker_->skipped_threshold() == 0) {
+    return;
+  }
+  if (perf_level_ < rocksdb::PerfLevel::kEnableCount) {
+    rocksdb::SetPerfLevel(rocksdb::PerfLevel::kEnableCount);
+  }
+  start_count_ = SkippedCount();
+}
+
+ScopeSkippedKeys::~ScopeSkippedKeys() {
+  if (tracker_->skipped_threshold() == 0) {
+    return;
+  }
+  uint64_t skipped = SkippedCount() - start_count_;
+  if (perf_level_ < rocksdb::PerfLevel::kEnableCount) {
+    rocksdb::SetPerfLevel(perf_level_);
+  }
+  tracker_->AddSkipped(type_, key_, skipped);
+}
+
+}  //  namespace blackwidow
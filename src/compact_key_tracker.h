@@ -0,0 +1,83 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_COMPACT_KEY_TRACKER_H_
+#define SRC_COMPACT_KEY_TRACKER_H_
+
+#include <string>
+#include <unordered_map>
+
+#include "rocksdb/perf_context.h"
+#include "rocksdb/slice.h"
+#include "slash/include/slash_mutex.h"
+#include "blackwidow/blackwidow.h"
+
+namespace blackwidow {
+
+// Picks the keys worth a compaction of their own range, so that a hash
+// emptied by millions of HDel, or a list used as a queue, does not stay
+// slow to scan until the next full compaction. Two counts are kept per
+// key, each with its own threshold:
+//  - the tombstones and stale versions its reads have stepped over
+//  - the elements removed from it by deletes, pops and trims
+//
+// Once a count crosses its threshold, a kCompactKey task is queued on the
+// background threads and the counts of the key start over. The scheduler
+// drops the task if one is pending for the key already, and the queued
+// compactions are spread at least kMinIntervalUs apart.
+class CompactKeyTracker {
+ public:
+  // A threshold of 0 disables that count
+  CompactKeyTracker(BlackWidow* bw, uint64_t skipped_threshold,
+                    uint64_t churn_threshold);
+
+  uint64_t skipped_threshold() const { return skipped_.threshold; }
+
+  void AddSkipped(const DataType& type, const Slice& key, uint64_t skipped);
+  void AddChurn(const DataType& type, const Slice& key, uint64_t removed);
+
+ private:
+  static const uint64_t kMinIntervalUs = 100000;
+  static const size_t kMaxTrackedKeys = 10000;
+
+  struct Counts {
+    explicit Counts(uint64_t _threshold) : threshold(_threshold) {}
+    const uint64_t threshold;
+    std::unordered_map<std::string, uint64_t> map;
+  };
+
+  static std::string TrackedKey(const DataType& type, const Slice& key);
+  void Add(Counts* counts, const DataType& type, const Slice& key,
+           uint64_t count);
+
+  BlackWidow* const bw_;
+
+  slash::Mutex mutex_;
+  Counts skipped_;
+  Counts churn_;
+  uint64_t last_queued_us_;
+};
+
+// Counts the internal keys skipped by the iterators of the calling thread
+// while in scope, and adds them to the tracker for key
+class ScopeSkippedKeys {
+ public:
+  ScopeSkippedKeys(CompactKeyTracker* tracker, const DataType& type,
+                   const Slice& key);
+  ~ScopeSkippedKeys();
+
+ private:
+  CompactKeyTracker* const tracker_;
+  const DataType type_;
+  const Slice key_;
+  rocksdb::PerfLevel perf_level_;
+  uint64_t start_count_;
+
+  ScopeSkippedKeys(const ScopeSkippedKeys&);
+  void operator=(const ScopeSkippedKeys&);
+};
+
+}  //  namespace blackwidow
+#endif  //  SRC_COMPACT_KEY_TRACKER_H_
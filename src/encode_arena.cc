@@ -0,0 +1,78 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/encode_arena.h"
+
+#include <algorithm>
+
+namespace blackwidow {
+
+const size_t EncodeArena::kMaxArenaSize;
+const size_t EncodeArena::kMaxKeptBlockSize;
+const size_t EncodeArena::kMinBlockSize;
+
+EncodeArena::EncodeArena()
+  : block_size_(0),
+    used_(0),
+    in_use_(0),
+    retired_size_(0),
+    live_(0),
+    block_allocations_(0) {
+}
+
+EncodeArena* EncodeArena::Current() {
+  static thread_local EncodeArena arena;
+  return &arena;
+}
+
+size_t EncodeArena::memory_usage() const {
+  return block_size_ + retired_size_;
+}
+
+char* EncodeArena::Allocate(size_t bytes) {
+  bytes = Align(bytes);
+  if (in_use_ + bytes > kMaxArenaSize) {
+    return nullptr;
+  }
+  if (used_ + bytes > block_size_) {
+    if (live_ > 0) {
+      retired_.push_back(std::move(block_));
+      retired_size_ += block_size_;
+    }
+    // Large enough for everything in use, so that the next round fits
+    block_size_ = std::min(kMaxArenaSize,
+                           std::max(kMinBlockSize, 2 * (in_use_ + bytes)));
+    block_.reset(new char[block_size_]);
+    block_allocations_++;
+    used_ = 0;
+  }
+  char* result = block_.get() + used_;
+  used_ += bytes;
+  in_use_ += bytes;
+  live_++;
+  return result;
+}
+
+void EncodeArena::Release(char* data, size_t bytes) {
+  bytes = Align(bytes);
+  // The encoders are released in the reverse order of their allocations
+  // unless one outlives a few others, the last allocation is reused at once
+  if (used_ >= bytes && data == block_.get() + used_ - bytes) {
+    used_ -= bytes;
+    in_use_ -= bytes;
+  }
+  if (--live_ == 0) {
+    retired_.clear();
+    retired_size_ = 0;
+    used_ = 0;
+    in_use_ = 0;
+    if (block_size_ > kMaxKeptBlockSize) {
+      block_.reset();
+      block_size_ = 0;
+    }
+  }
+}
+
+}  //  namespace blackwidow
@@ -0,0 +1,114 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_ENCODE_ARENA_H_
+#define SRC_ENCODE_ARENA_H_
+
+#include <memory>
+#include <vector>
+
+namespace blackwidow {
+
+// Scratch memory for the keys and values which do not fit in the inline
+// buffer of their encoder. Encoders live on the stack of a single command,
+// so the memory is handed out by bumping a pointer, the last allocation
+// gives its bytes back when released and the whole arena is reused once
+// every allocation has been given back.
+//
+// At most kMaxArenaSize bytes are handed out at once, beyond that Allocate
+// returns nullptr and the encoder uses the heap. The arena keeps a block of
+// up to kMaxKeptBlockSize bytes when it empties, so once warmed up the
+// usual encodings do not touch the heap any more.
+class EncodeArena {
+ public:
+  EncodeArena();
+
+  // The arena of the calling thread
+  static EncodeArena* Current();
+
+  char* Allocate(size_t bytes);
+  // Give back one allocation, of the given bytes
+  void Release(char* data, size_t bytes);
+
+  // Number of blocks allocated from the heap so far
+  size_t block_allocations() const { return block_allocations_; }
+  // Bytes of the blocks held, the current one and the outgrown ones
+  size_t memory_usage() const;
+
+  static const size_t kMaxArenaSize = 1 << 20;
+  static const size_t kMaxKeptBlockSize = 256 << 10;
+
+ private:
+  static const size_t kMinBlockSize = 4096;
+
+  static size_t Align(size_t bytes) {
+    // Keep the allocations aligned for the fixed size fields
+    return (bytes + 7) & ~static_cast<size_t>(7);
+  }
+
+  std::unique_ptr<char[]> block_;
+  size_t block_size_;
+  size_t used_;
+  // Bytes handed out since the arena was last empty, over all blocks
+  size_t in_use_;
+  // Blocks outgrown while allocations still point into them, and their sizes
+  std::vector<std::unique_ptr<char[]>> retired_;
+  size_t retired_size_;
+  size_t live_;
+  size_t block_allocations_;
+};
+
+// The output buffer of an encoder, encodings of up to kInlineSize bytes are
+// written inline and the larger ones to the arena of the calling thread, or
+// to the heap once the arena is full
+template <size_t kInlineSize>
+class EncodeBuffer {
+ public:
+  EncodeBuffer() : start_(space_), size_(0), arena_(nullptr) {}
+  ~EncodeBuffer() {
+    Release();
+  }
+  EncodeBuffer(const EncodeBuffer&) = delete;
+  EncodeBuffer& operator=(const EncodeBuffer&) = delete;
+
+  // Returns needed bytes to encode to, the previous encoding is dropped
+  char* Reserve(size_t needed) {
+    Release();
+    if (needed <= kInlineSize) {
+      start_ = space_;
+      return start_;
+    }
+    arena_ = EncodeArena::Current();
+    start_ = arena_->Allocate(needed);
+    if (start_ != nullptr) {
+      size_ = needed;
+    } else {
+      arena_ = nullptr;
+      heap_.reset(new char[needed]);
+      start_ = heap_.get();
+    }
+    return start_;
+  }
+
+  char* data() const { return start_; }
+
+ private:
+  void Release() {
+    if (arena_ != nullptr) {
+      arena_->Release(start_, size_);
+      arena_ = nullptr;
+    }
+    heap_.reset();
+  }
+
+  char space_[kInlineSize];
+  char* start_;
+  size_t size_;
+  EncodeArena* arena_;
+  std::unique_ptr<char[]> heap_;
+};
+
+}  //  namespace blackwidow
+#endif  //  SRC_ENCODE_ARENA_H_
@@ -0,0 +1,183 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_FILTERS_META_VALUE_FORMAT_H_
+#define SRC_FILTERS_META_VALUE_FORMAT_H_
+
+#include <string.h>
+
+#include <string>
+
+#include "src/base_meta_value_format.h"
+#include "src/base_data_key_format.h"
+
+namespace blackwidow {
+
+enum FilterKind {
+  kBloomFilter = 'b',
+  kCuckooFilter = 'c'
+};
+
+// The meta value of a filter:
+//
+// | sub filter count | kind | capacity | error rate | expansion | items | version | timestamp |
+//       4 Bytes       1 Byte  8 Bytes     8 Bytes     4 Bytes   8 Bytes  4 Bytes   4 Bytes
+//
+// The sub filter count is the number of layers of a scalable bloom filter
+// and 1 for a cuckoo filter, the capacity, error rate and expansion are
+// the parameters of the first layer. Every filter is split in fixed size
+// segments stored in the data column family under the BaseDataKey of the
+// filter, see FiltersDataKey. A segment never written reads as zeros, so
+// reserving a large filter writes nothing but the meta value.
+class FiltersMetaValue : public BaseMetaValue {
+ public:
+  static const size_t kCapacityOffset = sizeof(int32_t) + 1;
+  static const size_t kErrorRateOffset = kCapacityOffset + sizeof(uint64_t);
+  static const size_t kExpansionOffset = kErrorRateOffset + sizeof(uint64_t);
+  static const size_t kItemsOffset = kExpansionOffset + sizeof(int32_t);
+  static const size_t kUserValueLength = kItemsOffset + sizeof(uint64_t);
+
+  FiltersMetaValue(FilterKind kind, uint64_t capacity, double error_rate,
+                   int32_t expansion) :
+    BaseMetaValue(Slice(buf_, kUserValueLength)) {
+    uint64_t error_rate_bits;
+    memcpy(&error_rate_bits, &error_rate, sizeof(uint64_t));
+    EncodeFixed32(buf_, 1);
+    buf_[sizeof(int32_t)] = static_cast<char>(kind);
+    EncodeFixed64(buf_ + kCapacityOffset, capacity);
+    EncodeFixed64(buf_ + kErrorRateOffset, error_rate_bits);
+    EncodeFixed32(buf_ + kExpansionOffset, expansion);
+    EncodeFixed64(buf_ + kItemsOffset, 0);
+  }
+
+ private:
+  char buf_[kUserValueLength];
+};
+
+class ParsedFiltersMetaValue : public ParsedBaseMetaValue {
+ public:
+  // Use this constructor after rocksdb::DB::Get();
+  explicit ParsedFiltersMetaValue(std::string* internal_value_str) :
+    ParsedBaseMetaValue(internal_value_str) {
+    DecodeParameters();
+  }
+
+  // Use this constructor in rocksdb::CompactionFilter::Filter();
+  explicit ParsedFiltersMetaValue(const Slice& internal_value_slice) :
+    ParsedBaseMetaValue(internal_value_slice) {
+    DecodeParameters();
+  }
+
+  int32_t InitialMetaValue() {
+    set_items(0);
+    return ParsedBaseMetaValue::InitialMetaValue();
+  }
+
+  char kind() {
+    return kind_;
+  }
+
+  uint64_t capacity() {
+    return capacity_;
+  }
+
+  double error_rate() {
+    return error_rate_;
+  }
+
+  int32_t expansion() {
+    return expansion_;
+  }
+
+  uint64_t items() {
+    return items_;
+  }
+
+  void set_items(uint64_t items) {
+    items_ = items;
+    if (value_ != nullptr
+      && user_value_.size() >= FiltersMetaValue::kUserValueLength) {
+      char* dst = const_cast<char*>(value_->data())
+        + FiltersMetaValue::kItemsOffset;
+      EncodeFixed64(dst, items_);
+    }
+  }
+
+  void ModifyItems(int64_t delta) {
+    set_items(items_ + delta);
+  }
+
+ private:
+  void DecodeParameters() {
+    kind_ = 0;
+    capacity_ = 0;
+    error_rate_ = 0;
+    expansion_ = 0;
+    items_ = 0;
+    if (user_value_.size() >= FiltersMetaValue::kUserValueLength) {
+      const char* ptr = user_value_.data();
+      uint64_t error_rate_bits =
+        DecodeFixed64(ptr + FiltersMetaValue::kErrorRateOffset);
+      kind_ = ptr[sizeof(int32_t)];
+      capacity_ = DecodeFixed64(ptr + FiltersMetaValue::kCapacityOffset);
+      memcpy(&error_rate_, &error_rate_bits, sizeof(double));
+      expansion_ = DecodeFixed32(ptr + FiltersMetaValue::kExpansionOffset);
+      items_ = DecodeFixed64(ptr + FiltersMetaValue::kItemsOffset);
+    }
+  }
+
+  char kind_;
+  uint64_t capacity_;
+  double error_rate_;
+  int32_t expansion_;
+  uint64_t items_;
+};
+
+// The key of a segment, the big endian sub filter and segment indexes as
+// data of the BaseDataKey of the filter
+static const size_t kFilterSegmentIDLength = 2 * sizeof(uint32_t);
+
+class FiltersDataKey : public BaseDataKey {
+ public:
+  FiltersDataKey(const Slice& key, int32_t version, uint32_t sub_filter,
+                 uint32_t segment) :
+    BaseDataKey(key, version, Slice(buf_, kFilterSegmentIDLength)) {
+    for (size_t i = 0; i < sizeof(uint32_t); i++) {
+      buf_[i] = static_cast<char>(sub_filter >> (24 - 8 * i));
+      buf_[sizeof(uint32_t) + i] = static_cast<char>(segment >> (24 - 8 * i));
+    }
+  }
+
+ private:
+  char buf_[kFilterSegmentIDLength];
+};
+
+class ParsedFiltersDataKey : public ParsedBaseDataKey {
+ public:
+  explicit ParsedFiltersDataKey(const std::string* key)
+            : ParsedBaseDataKey(key) {}
+  explicit ParsedFiltersDataKey(const Slice& key)
+            : ParsedBaseDataKey(key) {}
+
+  uint32_t sub_filter() {
+    return DecodeBigEndian32(data_.data());
+  }
+
+  uint32_t segment() {
+    return DecodeBigEndian32(data_.data() + sizeof(uint32_t));
+  }
+
+ private:
+  static uint32_t DecodeBigEndian32(const char* ptr) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(ptr);
+    return (static_cast<uint32_t>(p[0]) << 24)
+      | (static_cast<uint32_t>(p[1]) << 16)
+      | (static_cast<uint32_t>(p[2]) << 8)
+      | static_cast<uint32_t>(p[3]);
+  }
+};
+
+}  //  namespace blackwidow
+#endif  //  SRC_FILTERS_META_VALUE_FORMAT_H_
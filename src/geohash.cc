@@ -0,0 +1,278 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/geohash.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace blackwidow {
+
+static const double kLongitudeMin = -180;
+static const double kLongitudeMax = 180;
+static const double kLatitudeMin = -85.05112878;
+static const double kLatitudeMax = 85.05112878;
+// Same earth radius as redis, so that the distances match
+static const double kEarthRadius = 6372797.560856;
+static const double kMercatorMax = 20037726.37;
+static const int kMaxStep = 26;
+
+struct GeoCell {
+  uint32_t ilongitude;
+  uint32_t ilatitude;
+  double min_longitude;
+  double max_longitude;
+  double min_latitude;
+  double max_latitude;
+};
+
+static inline double DegToRad(double deg) {
+  return deg * M_PI / 180.0;
+}
+
+static inline double RadToDeg(double rad) {
+  return rad * 180.0 / M_PI;
+}
+
+// Spreads the bits of x over the even bits of the result
+static uint64_t Spread(uint32_t x) {
+  uint64_t v = x;
+  v = (v | (v << 16)) & 0x0000FFFF0000FFFFULL;
+  v = (v | (v << 8)) & 0x00FF00FF00FF00FFULL;
+  v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  v = (v | (v << 2)) & 0x3333333333333333ULL;
+  v = (v | (v << 1)) & 0x5555555555555555ULL;
+  return v;
+}
+
+// The reverse of Spread(), the odd bits of v are ignored
+static uint32_t Squash(uint64_t v) {
+  v &= 0x5555555555555555ULL;
+  v = (v | (v >> 1)) & 0x3333333333333333ULL;
+  v = (v | (v >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+  v = (v | (v >> 4)) & 0x00FF00FF00FF00FFULL;
+  v = (v | (v >> 8)) & 0x0000FFFF0000FFFFULL;
+  v = (v | (v >> 16)) & 0x00000000FFFFFFFFULL;
+  return static_cast<uint32_t>(v);
+}
+
+static inline uint64_t Interleave(uint32_t ilongitude, uint32_t ilatitude) {
+  return Spread(ilatitude) | (Spread(ilongitude) << 1);
+}
+
+static uint32_t Quantize(double value, double min, double max, int step) {
+  uint32_t cells = 1U << step;
+  double offset = (value - min) / (max - min) * cells;
+  if (offset <= 0) {
+    return 0;
+  }
+  // The upper bound belongs to the last cell
+  return std::min(static_cast<uint32_t>(offset), cells - 1);
+}
+
+// The cell of step bits per coordinate holding the point
+static GeoCell CellOf(double longitude, double latitude, int step) {
+  GeoCell cell;
+  cell.ilongitude = Quantize(longitude, kLongitudeMin, kLongitudeMax, step);
+  cell.ilatitude = Quantize(latitude, kLatitudeMin, kLatitudeMax, step);
+  double longitude_size = (kLongitudeMax - kLongitudeMin) / (1U << step);
+  double latitude_size = (kLatitudeMax - kLatitudeMin) / (1U << step);
+  cell.min_longitude = kLongitudeMin + cell.ilongitude * longitude_size;
+  cell.max_longitude = cell.min_longitude + longitude_size;
+  cell.min_latitude = kLatitudeMin + cell.ilatitude * latitude_size;
+  cell.max_latitude = cell.min_latitude + latitude_size;
+  return cell;
+}
+
+// The step whose cells are about as large as range_meters, so that the
+// cells around the center cover the search area
+static int EstimateStep(double range_meters, double latitude) {
+  if (range_meters == 0) {
+    return kMaxStep;
+  }
+  int step = 1;
+  while (range_meters < kMercatorMax) {
+    range_meters *= 2;
+    step++;
+  }
+  step -= 2;
+  // The cells get narrower towards the poles
+  if (latitude > 66 || latitude < -66) {
+    step--;
+    if (latitude > 80 || latitude < -80) {
+      step--;
+    }
+  }
+  return std::max(1, std::min(step, kMaxStep));
+}
+
+static double LatitudeDistance(double latitude1, double latitude2) {
+  return kEarthRadius * fabs(DegToRad(latitude2) - DegToRad(latitude1));
+}
+
+bool GeoValidCoordinates(double longitude, double latitude) {
+  return longitude >= kLongitudeMin && longitude <= kLongitudeMax
+    && latitude >= kLatitudeMin && latitude <= kLatitudeMax;
+}
+
+double GeohashEncode(double longitude, double latitude) {
+  GeoCell cell = CellOf(longitude, latitude, kMaxStep);
+  return static_cast<double>(Interleave(cell.ilongitude, cell.ilatitude));
+}
+
+bool GeohashDecode(double score, double* longitude, double* latitude) {
+  if (!(score >= 0 && score < static_cast<double>(1ULL << (2 * kMaxStep)))) {
+    return false;
+  }
+  uint64_t bits = static_cast<uint64_t>(score);
+  double longitude_size = (kLongitudeMax - kLongitudeMin) / (1U << kMaxStep);
+  double latitude_size = (kLatitudeMax - kLatitudeMin) / (1U << kMaxStep);
+  *longitude = kLongitudeMin + (Squash(bits >> 1) + 0.5) * longitude_size;
+  *latitude = kLatitudeMin + (Squash(bits) + 0.5) * latitude_size;
+  *longitude = std::max(kLongitudeMin, std::min(*longitude, kLongitudeMax));
+  *latitude = std::max(kLatitudeMin, std::min(*latitude, kLatitudeMax));
+  return true;
+}
+
+double GeoDistance(double longitude1, double latitude1,
+                   double longitude2, double latitude2) {
+  double latitude1_rad = DegToRad(latitude1);
+  double latitude2_rad = DegToRad(latitude2);
+  double v = sin((DegToRad(longitude2) - DegToRad(longitude1)) / 2);
+  if (v == 0.0) {
+    return LatitudeDistance(latitude1, latitude2);
+  }
+  double u = sin((latitude2_rad - latitude1_rad) / 2);
+  double a = u * u + cos(latitude1_rad) * cos(latitude2_rad) * v * v;
+  return 2.0 * kEarthRadius * asin(sqrt(a));
+}
+
+GeoShape::GeoShape(double longitude, double latitude, double radius)
+  : longitude_(longitude),
+    latitude_(latitude),
+    is_box_(false),
+    radius_(radius),
+    width_(0),
+    height_(0) {
+}
+
+GeoShape::GeoShape(double longitude, double latitude,
+                   double width, double height)
+  : longitude_(longitude),
+    latitude_(latitude),
+    is_box_(true),
+    radius_(0),
+    width_(width),
+    height_(height) {
+}
+
+void GeoShape::BoundingBox(double* min_longitude, double* min_latitude,
+                           double* max_longitude, double* max_latitude) const {
+  double half_width = is_box_ ? width_ / 2 : radius_;
+  double half_height = is_box_ ? height_ / 2 : radius_;
+  double latitude_delta = RadToDeg(half_height / kEarthRadius);
+  *min_latitude = latitude_ - latitude_delta;
+  *max_latitude = latitude_ + latitude_delta;
+  // The box is widest on its side nearest to the pole
+  double widest_latitude = latitude_ >= 0 ? *max_latitude : *min_latitude;
+  double longitude_delta = 180;
+  if (fabs(widest_latitude) < 90) {
+    longitude_delta = std::min(longitude_delta, RadToDeg(
+          half_width / kEarthRadius / cos(DegToRad(widest_latitude))));
+  }
+  *min_longitude = longitude_ - longitude_delta;
+  *max_longitude = longitude_ + longitude_delta;
+}
+
+void GeoShape::ScoreRanges(
+    std::vector<std::pair<double, double>>* ranges) const {
+  ranges->clear();
+  double min_longitude, min_latitude, max_longitude, max_latitude;
+  BoundingBox(&min_longitude, &min_latitude, &max_longitude, &max_latitude);
+
+  double range_meters = is_box_ ? sqrt(width_ * width_ / 4
+                                       + height_ * height_ / 4) : radius_;
+  int step = EstimateStep(range_meters, latitude_);
+  GeoCell cell = CellOf(longitude_, latitude_, step);
+  // Near the sides of the center cell the neighbours may not reach the
+  // whole bounding box, larger cells are needed then
+  while (step > 1) {
+    double longitude_size = cell.max_longitude - cell.min_longitude;
+    double latitude_size = cell.max_latitude - cell.min_latitude;
+    if (cell.max_latitude + latitude_size >= std::min(max_latitude, kLatitudeMax)
+      && cell.min_latitude - latitude_size <= std::max(min_latitude, kLatitudeMin)
+      && cell.max_longitude + longitude_size >= max_longitude
+      && cell.min_longitude - longitude_size <= min_longitude) {
+      break;
+    }
+    step--;
+    cell = CellOf(longitude_, latitude_, step);
+  }
+
+  // The neighbours beyond the bounding box are skipped
+  int min_dx = -1, max_dx = 1, min_dy = -1, max_dy = 1;
+  if (step >= 2) {
+    if (cell.min_latitude < min_latitude) {
+      min_dy = 0;
+    }
+    if (cell.max_latitude > max_latitude) {
+      max_dy = 0;
+    }
+    if (cell.min_longitude < min_longitude) {
+      min_dx = 0;
+    }
+    if (cell.max_longitude > max_longitude) {
+      max_dx = 0;
+    }
+  }
+
+  int64_t cells = 1LL << step;
+  int shift = 2 * (kMaxStep - step);
+  std::vector<std::pair<uint64_t, uint64_t>> hash_ranges;
+  for (int dy = min_dy; dy <= max_dy; dy++) {
+    int64_t ilatitude = static_cast<int64_t>(cell.ilatitude) + dy;
+    if (ilatitude < 0 || ilatitude >= cells) {
+      continue;
+    }
+    for (int dx = min_dx; dx <= max_dx; dx++) {
+      // The longitude wraps around the antimeridian
+      int64_t ilongitude = (static_cast<int64_t>(cell.ilongitude) + dx
+                            + cells) % cells;
+      uint64_t hash = Interleave(static_cast<uint32_t>(ilongitude),
+                                 static_cast<uint32_t>(ilatitude));
+      hash_ranges.push_back(std::make_pair(hash << shift,
+                                           (hash + 1) << shift));
+    }
+  }
+
+  std::sort(hash_ranges.begin(), hash_ranges.end());
+  for (const auto& hash_range : hash_ranges) {
+    if (!ranges->empty() && ranges->back().second >= hash_range.first) {
+      ranges->back().second = std::max(ranges->back().second,
+                                       static_cast<double>(hash_range.second));
+    } else {
+      ranges->push_back(std::make_pair(static_cast<double>(hash_range.first),
+                                       static_cast<double>(hash_range.second)));
+    }
+  }
+}
+
+bool GeoShape::Contains(double longitude, double latitude,
+                        double* distance) const {
+  if (!is_box_) {
+    *distance = GeoDistance(longitude_, latitude_, longitude, latitude);
+    return *distance <= radius_;
+  }
+  // The latitude distance is the cheapest, it goes first
+  if (LatitudeDistance(latitude_, latitude) > height_ / 2
+    || GeoDistance(longitude_, latitude, longitude, latitude) > width_ / 2) {
+    return false;
+  }
+  *distance = GeoDistance(longitude_, latitude_, longitude, latitude);
+  return true;
+}
+
+}  //  namespace blackwidow
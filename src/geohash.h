@@ -0,0 +1,64 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_GEOHASH_H_
+#define SRC_GEOHASH_H_
+
+#include <stdint.h>
+
+#include <utility>
+#include <vector>
+
+namespace blackwidow {
+
+// Geo points are stored as sorted set members scored by their 52 bits
+// geohash, mostly borrowed from redis: the longitude in [-180, 180] and the
+// latitude in [-85.05112878, 85.05112878] are quantized to 26 bits each and
+// interleaved, the latitude bits in the even positions. The cells of a
+// coarser step are then contiguous score ranges.
+
+bool GeoValidCoordinates(double longitude, double latitude);
+
+// The score of a point, the point must have valid coordinates
+double GeohashEncode(double longitude, double latitude);
+
+// The center of the cell of score, false if score is not a geohash
+bool GeohashDecode(double score, double* longitude, double* latitude);
+
+// The great circle distance between two points, in meters
+double GeoDistance(double longitude1, double latitude1,
+                   double longitude2, double latitude2);
+
+// The area of a geo search around a point, distances are in meters
+class GeoShape {
+ public:
+  // A circle of radius meters
+  GeoShape(double longitude, double latitude, double radius);
+  // A box of width x height meters, its sides along the meridians and the
+  // parallels
+  GeoShape(double longitude, double latitude, double width, double height);
+
+  // The sorted, disjoint [min, max) score ranges covering the shape, at
+  // most the 9 cells around the center merged where they are contiguous
+  void ScoreRanges(std::vector<std::pair<double, double>>* ranges) const;
+
+  // Whether the point is within the shape, distance is then the distance
+  // of the point to the center
+  bool Contains(double longitude, double latitude, double* distance) const;
+
+ private:
+  void BoundingBox(double* min_longitude, double* min_latitude,
+                   double* max_longitude, double* max_latitude) const;
+
+  double longitude_;
+  double latitude_;
+  bool is_box_;
+  double radius_;
+  double width_;
+  double height_;
+};
+
+}  //  namespace blackwidow
+#endif  //  SRC_GEOHASH_H_
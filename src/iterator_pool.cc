@@ -0,0 +1,108 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/iterator_pool.h"
+
+#include <atomic>
+#include <utility>
+
+#include "slash/include/env.h"
+
+namespace blackwidow {
+
+const uint64_t IteratorPool::kMaxIdleUs;
+
+IteratorPool::~IteratorPool() {
+  Clear();
+}
+
+IteratorPool::Shard* IteratorPool::CurrentShard() {
+  static std::atomic<size_t> next_shard(0);
+  static thread_local size_t shard = next_shard++ % kShardNum;
+  return &shards_[shard];
+}
+
+rocksdb::Status IteratorPool::Acquire(
+    rocksdb::DB* db, rocksdb::ColumnFamilyHandle* meta_cf,
+    rocksdb::ColumnFamilyHandle* data_cf, const rocksdb::Snapshot* snapshot,
+    std::vector<rocksdb::Iterator*>* iters) {
+  iters->clear();
+  Shard* shard = CurrentShard();
+  {
+    slash::MutexLock l(&shard->mutex);
+    for (auto it = shard->idle.rbegin(); it != shard->idle.rend(); ++it) {
+      if (it->data_cf == data_cf) {
+        iters->swap(it->iters);
+        shard->idle.erase(std::next(it).base());
+        break;
+      }
+    }
+  }
+  if (!iters->empty()) {
+    if ((*iters)[0]->Refresh(snapshot).ok()
+      && (*iters)[1]->Refresh(snapshot).ok()) {
+      return rocksdb::Status::OK();
+    }
+    for (auto iter : *iters) {
+      delete iter;
+    }
+    iters->clear();
+  }
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+  return db->NewIterators(read_options, {meta_cf, data_cf}, iters);
+}
+
+void IteratorPool::Release(rocksdb::ColumnFamilyHandle* data_cf,
+                           std::vector<rocksdb::Iterator*>* iters) {
+  if (iters->size() == 2 && (*iters)[0]->status().ok()
+    && (*iters)[1]->status().ok()) {
+    Shard* shard = CurrentShard();
+    uint64_t now_us = slash::NowMicros();
+    slash::MutexLock l(&shard->mutex);
+    if (shard->idle.size() < kMaxIdlePerShard) {
+      shard->idle.push_back({data_cf, std::move(*iters), now_us});
+      iters->clear();
+      return;
+    }
+  }
+  for (auto iter : *iters) {
+    delete iter;
+  }
+  iters->clear();
+}
+
+void IteratorPool::Evict() {
+  uint64_t now_us = slash::NowMicros();
+  std::vector<rocksdb::Iterator*> evicted;
+  for (size_t i = 0; i < kShardNum; i++) {
+    slash::MutexLock l(&shards_[i].mutex);
+    auto& idle = shards_[i].idle;
+    // The pairs are released in order, the oldest come first
+    auto end = idle.begin();
+    while (end != idle.end() && end->release_us + kMaxIdleUs < now_us) {
+      evicted.insert(evicted.end(), end->iters.begin(), end->iters.end());
+      ++end;
+    }
+    idle.erase(idle.begin(), end);
+  }
+  for (auto iter : evicted) {
+    delete iter;
+  }
+}
+
+void IteratorPool::Clear() {
+  for (size_t i = 0; i < kShardNum; i++) {
+    slash::MutexLock l(&shards_[i].mutex);
+    for (auto& entry : shards_[i].idle) {
+      for (auto iter : entry.iters) {
+        delete iter;
+      }
+    }
+    shards_[i].idle.clear();
+  }
+}
+
+}  //  namespace blackwidow
@@ -0,0 +1,136 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_ITERATOR_POOL_H_
+#define SRC_ITERATOR_POOL_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rocksdb/db.h"
+#include "rocksdb/iterator.h"
+#include "rocksdb/listener.h"
+#include "slash/include/slash_mutex.h"
+
+namespace blackwidow {
+
+// Idle iterators kept for the short scans of a single collection, like
+// HGetall or ZRange. Creating iterators takes the db mutex and builds the
+// iterator trees, while a pooled iterator is brought to a new snapshot by
+// Iterator::Refresh(snapshot), which only rebuilds what changed since.
+//
+// Iterators are pooled by pairs over the meta column family and a data
+// column family. Both iterators of a pair are refreshed to the snapshot of
+// the caller, and the point lookups are made at the same snapshot, so the
+// meta value and the data agree whatever was written in between.
+//
+// The pool is split in shards which every thread maps to once, so threads
+// do not contend with each other. The idle iterators pin the memtables and
+// the files they were refreshed against. A pair in use is moved off them by
+// its next Refresh(), and IteratorPoolListener drops the pairs which have
+// been idle for more than kMaxIdleUs once a flush or a compaction replaced
+// them. Clear() must be called before the column families are dropped.
+class IteratorPool {
+ public:
+  IteratorPool() = default;
+  ~IteratorPool();
+
+  // Stores iterators over meta_cf and data_cf at snapshot in iters
+  rocksdb::Status Acquire(rocksdb::DB* db,
+                          rocksdb::ColumnFamilyHandle* meta_cf,
+                          rocksdb::ColumnFamilyHandle* data_cf,
+                          const rocksdb::Snapshot* snapshot,
+                          std::vector<rocksdb::Iterator*>* iters);
+  void Release(rocksdb::ColumnFamilyHandle* data_cf,
+               std::vector<rocksdb::Iterator*>* iters);
+  // Drops the pairs idle for more than kMaxIdleUs
+  void Evict();
+  void Clear();
+
+ private:
+  static const size_t kShardNum = 16;
+  static const size_t kMaxIdlePerShard = 8;
+  static const uint64_t kMaxIdleUs = 1000000;
+
+  struct IdleIterators {
+    rocksdb::ColumnFamilyHandle* data_cf;
+    std::vector<rocksdb::Iterator*> iters;
+    uint64_t release_us;
+  };
+
+  struct Shard {
+    slash::Mutex mutex;
+    std::vector<IdleIterators> idle;
+  };
+
+  Shard* CurrentShard();
+
+  Shard shards_[kShardNum];
+};
+
+class IteratorPoolListener : public rocksdb::EventListener {
+ public:
+  explicit IteratorPoolListener(IteratorPool* pool) : pool_(pool) {
+  }
+
+  void OnFlushCompleted(rocksdb::DB* db,
+                        const rocksdb::FlushJobInfo& info) override {
+    pool_->Evict();
+  }
+  void OnCompactionCompleted(rocksdb::DB* db,
+                             const rocksdb::CompactionJobInfo& info) override {
+    pool_->Evict();
+  }
+
+ private:
+  IteratorPool* const pool_;
+};
+
+// Pooled iterators over the meta column family and data_cf at a snapshot of
+// their own, index 0 is the meta iterator and index 1 the data one
+class ScopePooledIterators {
+ public:
+  ScopePooledIterators(IteratorPool* pool, rocksdb::DB* db,
+                       rocksdb::ColumnFamilyHandle* meta_cf,
+                       rocksdb::ColumnFamilyHandle* data_cf) :
+    pool_(pool), db_(db), cfs_{meta_cf, data_cf} {
+    read_options_.snapshot = db_->GetSnapshot();
+    status_ = pool_->Acquire(db_, meta_cf, data_cf, read_options_.snapshot,
+                             &iters_);
+  }
+  ~ScopePooledIterators() {
+    pool_->Release(cfs_[1], &iters_);
+    db_->ReleaseSnapshot(read_options_.snapshot);
+  }
+
+  rocksdb::Iterator* operator[](size_t index) const {
+    return iters_[index];
+  }
+
+  // Point lookup of key in the column family of the iterator at index, at
+  // the same snapshot
+  rocksdb::Status Get(size_t index, const rocksdb::Slice& key,
+                      std::string* value) const {
+    if (!status_.ok()) {
+      return status_;
+    }
+    return db_->Get(read_options_, cfs_[index], key, value);
+  }
+
+ private:
+  IteratorPool* const pool_;
+  rocksdb::DB* const db_;
+  rocksdb::ColumnFamilyHandle* const cfs_[2];
+  rocksdb::ReadOptions read_options_;
+  rocksdb::Status status_;
+  std::vector<rocksdb::Iterator*> iters_;
+
+  ScopePooledIterators(const ScopePooledIterators&);
+  void operator=(const ScopePooledIterators&);
+};
+
+}  //  namespace blackwidow
+#endif  //  SRC_ITERATOR_POOL_H_
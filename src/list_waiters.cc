@@ -0,0 +1,159 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/list_waiters.h"
+
+#include "slash/include/env.h"
+
+namespace blackwidow {
+
+ListWaiters::ListWaiters()
+  : shutdown_cond_var_(&mutex_),
+    waiting_(0),
+    shutdown_(false) {
+}
+
+ListWaiters::~ListWaiters() {
+  Shutdown();
+}
+
+Status ListWaiters::Wait(const std::vector<std::string>& keys,
+                         int64_t timeout_ms, const PopFunc& pop,
+                         std::string* popped_key) {
+  if (timeout_ms == kNoWait) {
+    for (const auto& key : keys) {
+      Status s = pop(key);
+      if (!s.IsNotFound()) {
+        *popped_key = key;
+        return s;
+      }
+    }
+    return Status::TimedOut();
+  }
+
+  Waiter waiter(&mutex_);
+  {
+    slash::MutexLock l(&mutex_);
+    if (shutdown_) {
+      return Status::Aborted("Shutting down");
+    }
+    // Queued before the first pops, so that a push in between is not missed
+    for (const auto& key : keys) {
+      waiters_[key].push_back(&waiter);
+    }
+    waiting_++;
+  }
+
+  uint64_t deadline_us = slash::NowMicros() + timeout_ms * 1000;
+  Status s;
+  bool popped = false;
+  // The key of the wakeup the current pops answer
+  std::string woken_key;
+  while (!popped) {
+    for (const auto& key : keys) {
+      s = pop(key);
+      if (!s.IsNotFound()) {
+        popped = true;
+        *popped_key = key;
+        break;
+      }
+    }
+    if (popped) {
+      break;
+    }
+
+    slash::MutexLock l(&mutex_);
+    woken_key.clear();
+    while (!waiter.signaled && !shutdown_) {
+      if (timeout_ms == 0) {
+        waiter.cond_var.Wait();
+        continue;
+      }
+      uint64_t now_us = slash::NowMicros();
+      if (now_us >= deadline_us) {
+        break;
+      }
+      waiter.cond_var.TimedWait(
+          static_cast<uint32_t>((deadline_us - now_us + 999) / 1000));
+    }
+    if (shutdown_) {
+      s = Status::Aborted("Shutting down");
+      break;
+    } else if (!waiter.signaled) {
+      s = Status::TimedOut();
+      break;
+    }
+    woken_key = waiter.signaled_key;
+    waiter.signaled = false;
+  }
+
+  slash::MutexLock l(&mutex_);
+  for (const auto& key : keys) {
+    auto iter = waiters_.find(key);
+    if (iter == waiters_.end()) {
+      continue;
+    }
+    iter->second.remove(&waiter);
+    if (iter->second.empty()) {
+      waiters_.erase(iter);
+    }
+  }
+  if (waiter.signaled && !shutdown_
+    && !(s.ok() && *popped_key == waiter.signaled_key)) {
+    SignalLocked(waiter.signaled_key, 1);
+  }
+  // Woken for a key but served by another one
+  if (!woken_key.empty() && !shutdown_
+    && !(s.ok() && *popped_key == woken_key)) {
+    SignalLocked(woken_key, 1);
+  }
+  waiting_--;
+  if (shutdown_ && waiting_ == 0) {
+    shutdown_cond_var_.SignalAll();
+  }
+  return s;
+}
+
+void ListWaiters::Signal(const Slice& key, uint64_t count) {
+  if (waiting_ == 0 || count == 0) {
+    return;
+  }
+  slash::MutexLock l(&mutex_);
+  SignalLocked(key.ToString(), count);
+}
+
+// With the mutex held
+void ListWaiters::SignalLocked(const std::string& key, uint64_t count) {
+  auto iter = waiters_.find(key);
+  if (iter == waiters_.end()) {
+    return;
+  }
+  for (auto waiter : iter->second) {
+    if (count == 0) {
+      break;
+    }
+    if (!waiter->signaled) {
+      waiter->signaled = true;
+      waiter->signaled_key = key;
+      waiter->cond_var.Signal();
+      count--;
+    }
+  }
+}
+
+void ListWaiters::Shutdown() {
+  slash::MutexLock l(&mutex_);
+  shutdown_ = true;
+  for (const auto& key_waiters : waiters_) {
+    for (auto waiter : key_waiters.second) {
+      waiter->cond_var.Signal();
+    }
+  }
+  while (waiting_ > 0) {
+    shutdown_cond_var_.Wait();
+  }
+}
+
+}  //  namespace blackwidow
@@ -0,0 +1,82 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_LIST_WAITERS_H_
+#define SRC_LIST_WAITERS_H_
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "rocksdb/status.h"
+#include "rocksdb/slice.h"
+#include "slash/include/slash_mutex.h"
+
+namespace blackwidow {
+
+using Status = rocksdb::Status;
+using Slice = rocksdb::Slice;
+
+// Registry of the blocking pops waiting for elements to be pushed to lists,
+// or added to sorted sets.
+//
+// A waiter is queued on every key it waits for, and a push to a key wakes
+// as many of its waiters as elements were pushed, oldest first. The waiter
+// then retries its pops, and goes back to sleep at the same place in the
+// queues if another client took the elements first. A wakeup which the
+// waiter could not use, because it got an element from another key or
+// timed out meanwhile, is handed over to the next waiter of that key.
+class ListWaiters {
+ public:
+  typedef std::function<Status(const std::string& key)> PopFunc;
+
+  enum {
+    kNoWait = -1
+  };
+
+  ListWaiters();
+  ~ListWaiters();
+
+  // Calls pop on keys in order until it returns anything but NotFound,
+  // waiting for pushes to keys in between. A timeout_ms of 0 waits for
+  // ever, otherwise Status::TimedOut() is returned once it is over.
+  // kNoWait calls pop on keys once.
+  Status Wait(const std::vector<std::string>& keys, int64_t timeout_ms,
+              const PopFunc& pop, std::string* popped_key);
+
+  // Called once count elements have been pushed to key
+  void Signal(const Slice& key, uint64_t count);
+
+  // Wakes all the waiters with Status::Aborted() and waits for them to be
+  // gone, new waits are refused
+  void Shutdown();
+
+ private:
+  struct Waiter {
+    explicit Waiter(slash::Mutex* mutex) : cond_var(mutex), signaled(false) {}
+    slash::CondVar cond_var;
+    bool signaled;
+    std::string signaled_key;
+  };
+
+  void SignalLocked(const std::string& key, uint64_t count);
+
+  slash::Mutex mutex_;
+  slash::CondVar shutdown_cond_var_;
+  std::unordered_map<std::string, std::list<Waiter*>> waiters_;
+  // Lets the pushes skip the mutex while nobody waits
+  std::atomic<uint64_t> waiting_;
+  bool shutdown_;
+
+  // No copying allowed
+  ListWaiters(const ListWaiters&);
+  void operator=(const ListWaiters&);
+};
+
+}  //  namespace blackwidow
+#endif  //  SRC_LIST_WAITERS_H_
@@ -8,34 +8,23 @@
 
 #include <string>
 
+#include "src/encode_arena.h"
+
 namespace blackwidow {
 class ListsDataKey {
  public:
-  ListsDataKey(const Slice& key, int32_t version, uint64_t index) :
-    start_(nullptr), key_(key), version_(version), index_(index) {
-  }
+  // The key size, the version and the index
+  static const size_t kFixedLength = sizeof(int32_t) * 2 + sizeof(uint64_t);
 
-  ~ListsDataKey() {
-    if (start_ != space_) {
-      delete[] start_;
-    }
+  ListsDataKey(const Slice& key, int32_t version, uint64_t index) :
+    key_(key), version_(version), index_(index) {
   }
 
   const Slice Encode() {
     size_t usize = key_.size();
-    size_t needed = usize + sizeof(int32_t) * 2 + sizeof(uint64_t);
-    char* dst;
-    if (needed <= sizeof(space_)) {
-      dst = space_;
-    } else {
-      dst = new char[needed];
-
-      // Need to allocate space, delete previous space
-      if (start_ != space_) {
-        delete[] start_;
-      }
-    }
-    start_ = dst;
+    size_t needed = usize + kFixedLength;
+    char* dst = buffer_.Reserve(needed);
+    char* start = dst;
     EncodeFixed32(dst, key_.size());
     dst += sizeof(int32_t);
     memcpy(dst, key_.data(), key_.size());
@@ -43,12 +32,11 @@ class ListsDataKey {
     EncodeFixed32(dst, version_);
     dst += sizeof(int32_t);
     EncodeFixed64(dst, index_);
-    return Slice(start_, needed);
+    return Slice(start, needed);
   }
 
  private:
-  char space_[200];
-  char* start_;
+  EncodeBuffer<200> buffer_;
   Slice key_;
   int32_t version_;
   uint64_t index_;
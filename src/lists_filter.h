@@ -82,8 +82,9 @@ class ListsDataFilter : public rocksdb::CompactionFilter {
             value.ToString().c_str(),
             parsed_lists_data_key.version());
 
-      if (parsed_lists_data_key.key().ToString() != cur_key_) {
-        cur_key_ = parsed_lists_data_key.key().ToString();
+      Slice user_key = parsed_lists_data_key.key();
+      if (user_key != cur_key_) {
+        cur_key_.assign(user_key.data(), user_key.size());
         std::string meta_value;
         // destroyed when close the database, Reserve Current key value
         if (cf_handles_ptr_->size() == 0) {
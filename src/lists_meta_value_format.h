@@ -49,13 +49,7 @@ class ListsMetaValue : public InternalValue {
   virtual const Slice Encode() override {
     size_t usize = user_value_.size();
     size_t needed = usize + kDefaultValueSuffixLength;
-    char* dst;
-    if (needed <= sizeof(space_)) {
-      dst = space_;
-    } else {
-      dst = new char[needed];
-    }
-    start_  = dst;
+    start_ = buffer_.Reserve(needed);
     size_t len = AppendTimestampAndVersion() + AppendIndex();
     return Slice(start_, len);
   }
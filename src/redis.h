@@ -6,15 +6,20 @@
 #ifndef SRC_REDIS_H_
 #define SRC_REDIS_H_
 
+#include <algorithm>
 #include <string>
 #include <memory>
 #include <vector>
 
 #include "rocksdb/db.h"
+#include "rocksdb/rate_limiter.h"
 #include "rocksdb/status.h"
 #include "rocksdb/slice.h"
+#include "blackwidow/util.h"
+#include "src/iterator_pool.h"
 #include "src/lock_mgr.h"
 #include "src/mutex_impl.h"
+#include "src/row_cache.h"
 
 namespace blackwidow {
 using Status = rocksdb::Status;
@@ -24,7 +29,8 @@ class Redis {
  public:
   Redis()
     : lock_mgr_(new LockMgr(1000, 10000, std::make_shared<MutexFactoryImpl>())),
-      db_(nullptr) {
+      db_(nullptr),
+      row_cache_(nullptr) {
     default_compact_range_options_.exclusive_manual_compaction = false;
     default_compact_range_options_.change_level = true;
   }
@@ -34,8 +40,27 @@ class Redis {
   }
 
   virtual ~Redis() {
+    iter_pool_.Clear();
     delete db_;
     delete lock_mgr_;
+    delete row_cache_;
+  }
+
+  void EnableRowCache(size_t capacity) {
+    if (row_cache_ == nullptr && capacity > 0) {
+      row_cache_ = new RowCache(capacity);
+    }
+  }
+
+  RowCache* row_cache() {
+    return row_cache_;
+  }
+
+  // Shared by the dbs of every type, so the key scans of all of them stay
+  // within one budget
+  void SetScanRateLimiter(
+      const std::shared_ptr<rocksdb::RateLimiter>& rate_limiter) {
+    scan_rate_limiter_ = rate_limiter;
   }
 
   // Common Commands
@@ -43,6 +68,11 @@ class Redis {
       const std::string& db_path) = 0;
   virtual Status CompactRange(const rocksdb::Slice* begin,
       const rocksdb::Slice* end) = 0;
+  // Compacts the meta value and the data of a single key
+  virtual Status CompactKey(const Slice& key) = 0;
+  // Adds the entries recorded as stale by the table properties collectors
+  // and the entries they have seen, over the SSTs of every column family
+  virtual Status GetStaleEntries(uint64_t* stale, uint64_t* total) = 0;
   virtual Status GetProperty(const std::string& property, std::string* out) = 0;
   virtual Status ScanKeyNum(uint64_t* num) = 0;
   virtual Status ScanKeys(const std::string& pattern,
@@ -62,8 +92,69 @@ class Redis {
   virtual Status TTL(const Slice& key, int64_t* timestamp) = 0;
 
  protected:
+  // Compacts the meta value of key and its data in data_cf, which must be
+  // in bytewise order with keys starting with the size and bytes of key
+  Status CompactKeyData(const Slice& key,
+                        rocksdb::ColumnFamilyHandle* data_cf) {
+    Status s = db_->CompactRange(default_compact_range_options_,
+        db_->DefaultColumnFamily(), &key, &key);
+    if (!s.ok()) {
+      return s;
+    }
+    std::string start_key, end_key;
+    CalculateStartAndEndKey(key.ToString(), &start_key, &end_key);
+    Slice begin(start_key), end(end_key);
+    return db_->CompactRange(default_compact_range_options_,
+        data_cf, &begin, &end);
+  }
+
+  // Charges the bytes read by ScanKeyNum() or ScanKeys() to the scan rate
+  // limiter, waiting for the budget to refill if needed
+  void ThrottleScan(size_t bytes) {
+    if (scan_rate_limiter_ != nullptr) {
+      int64_t burst = scan_rate_limiter_->GetSingleBurstBytes();
+      scan_rate_limiter_->Request(
+          std::min(static_cast<int64_t>(bytes), burst),
+          rocksdb::Env::IO_LOW, nullptr,
+          rocksdb::RateLimiter::OpType::kRead);
+    }
+  }
+
+  // Read the value of key in the default column family, that is the
+  // strings value or the meta value, through the row cache if it is
+  // enabled. The value is read at the latest sequence, never at a snapshot
+  Status GetCachedValue(const Slice& key, std::string* value) {
+    uint64_t token = 0;
+    if (row_cache_ != nullptr && row_cache_->Lookup(key, value, &token)) {
+      return Status::OK();
+    }
+    Status s = db_->Get(default_read_options_, key, value);
+    if (s.ok() && row_cache_ != nullptr) {
+      row_cache_->Insert(key, *value, token);
+    }
+    return s;
+  }
+
+  // Same as above without a copy when the row cache is disabled, the value
+  // is then pinned in the block cache or the memtable
+  Status GetCachedValue(const Slice& key, rocksdb::PinnableSlice* value) {
+    value->Reset();
+    if (row_cache_ != nullptr) {
+      Status s = GetCachedValue(key, value->GetSelf());
+      if (s.ok()) {
+        value->PinSelf();
+      }
+      return s;
+    }
+    return db_->Get(default_read_options_, db_->DefaultColumnFamily(),
+                    key, value);
+  }
+
   LockMgr* lock_mgr_;
   rocksdb::DB* db_;
+  RowCache* row_cache_;
+  IteratorPool iter_pool_;
+  std::shared_ptr<rocksdb::RateLimiter> scan_rate_limiter_;
   rocksdb::WriteOptions default_write_options_;
   rocksdb::ReadOptions default_read_options_;
   rocksdb::CompactRangeOptions default_compact_range_options_;
@@ -0,0 +1,710 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/redis_bitmaps.h"
+
+#include <memory>
+
+#include "blackwidow/util.h"
+#include "src/base_filter.h"
+#include "src/bitmaps_container.h"
+#include "src/bitmaps_meta_value_format.h"
+#include "src/scope_record_lock.h"
+#include "src/scope_iterators.h"
+#include "src/scope_snapshot.h"
+#include "src/stale_entries_collector.h"
+
+namespace blackwidow {
+
+static const int64_t kMaxBitmapOffset = (1LL << 32) - 1;
+
+RedisBitmaps::~RedisBitmaps() {
+  std::vector<rocksdb::ColumnFamilyHandle*> tmp_handles = handles_;
+  handles_.clear();
+  for (auto handle : tmp_handles) {
+    delete handle;
+  }
+}
+
+Status RedisBitmaps::Open(const rocksdb::Options& options,
+                          const std::string& db_path) {
+  rocksdb::Options ops(options);
+  Status s = rocksdb::DB::Open(ops, db_path, &db_);
+  if (s.ok()) {
+    // create column family
+    rocksdb::ColumnFamilyHandle* cf;
+    s = db_->CreateColumnFamily(rocksdb::ColumnFamilyOptions(),
+        "data_cf", &cf);
+    if (!s.ok()) {
+      return s;
+    }
+    // close DB
+    delete cf;
+    delete db_;
+  }
+
+  // Open
+  rocksdb::DBOptions db_ops(options);
+  rocksdb::ColumnFamilyOptions meta_cf_ops(options);
+  rocksdb::ColumnFamilyOptions data_cf_ops(options);
+  meta_cf_ops.compaction_filter_factory =
+    std::make_shared<BitmapsMetaFilterFactory>();
+  data_cf_ops.compaction_filter_factory =
+    std::make_shared<BitmapsDataFilterFactory>(&db_, &handles_);
+
+  meta_cf_ops.table_properties_collector_factories.push_back(
+    std::make_shared<StaleEntriesCollectorFactory>(kBaseMetaFormat));
+  data_cf_ops.table_properties_collector_factories.push_back(
+    std::make_shared<StaleEntriesCollectorFactory>(kVersionedKeyFormat));
+
+  //use the bloom filter policy to reduce disk reads
+  rocksdb::BlockBasedTableOptions table_options;
+  table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, true));
+  meta_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_options));
+  data_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_options));
+
+  std::vector<rocksdb::ColumnFamilyDescriptor> column_families;
+  // Meta CF
+  column_families.push_back(rocksdb::ColumnFamilyDescriptor(
+      rocksdb::kDefaultColumnFamilyName, meta_cf_ops));
+  // Container CF
+  column_families.push_back(rocksdb::ColumnFamilyDescriptor(
+      "data_cf", data_cf_ops));
+  return rocksdb::DB::Open(db_ops, db_path, column_families, &handles_, &db_);
+}
+
+Status RedisBitmaps::CompactRange(const rocksdb::Slice* begin,
+                                  const rocksdb::Slice* end) {
+  Status s = db_->CompactRange(default_compact_range_options_,
+      handles_[0], begin, end);
+  if (!s.ok()) {
+    return s;
+  }
+  return db_->CompactRange(default_compact_range_options_,
+      handles_[1], begin, end);
+}
+
+Status RedisBitmaps::CompactKey(const Slice& key) {
+  return CompactKeyData(key, handles_[1]);
+}
+
+Status RedisBitmaps::GetStaleEntries(uint64_t* stale, uint64_t* total) {
+  return SumStaleEntries(db_, handles_, stale, total);
+}
+
+Status RedisBitmaps::GetProperty(const std::string& property, std::string* out) {
+  db_->GetProperty(property, out);
+  return Status::OK();
+}
+
+Status RedisBitmaps::ScanKeyNum(uint64_t* num) {
+
+  uint64_t count = 0;
+  rocksdb::ReadOptions iterator_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  iterator_options.snapshot = snapshot;
+  iterator_options.fill_cache = false;
+
+  rocksdb::Iterator* iter = db_->NewIterator(iterator_options, handles_[0]);
+  for (iter->SeekToFirst();
+       iter->Valid();
+       iter->Next()) {
+    ThrottleScan(iter->key().size() + iter->value().size());
+    ParsedBitmapsMetaValue parsed_bitmaps_meta_value(iter->value());
+    if (!parsed_bitmaps_meta_value.IsStale()
+      && parsed_bitmaps_meta_value.count() != 0) {
+      count++;
+    }
+  }
+  *num = count;
+  delete iter;
+  return Status::OK();
+}
+
+Status RedisBitmaps::ScanKeys(const std::string& pattern,
+                              std::vector<std::string>* keys) {
+
+  std::string key;
+  rocksdb::ReadOptions iterator_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  iterator_options.snapshot = snapshot;
+  iterator_options.fill_cache = false;
+
+  rocksdb::Iterator* iter = db_->NewIterator(iterator_options, handles_[0]);
+  for (iter->SeekToFirst();
+       iter->Valid();
+       iter->Next()) {
+    ThrottleScan(iter->key().size() + iter->value().size());
+    ParsedBitmapsMetaValue parsed_bitmaps_meta_value(iter->value());
+    if (!parsed_bitmaps_meta_value.IsStale()
+      && parsed_bitmaps_meta_value.count() != 0) {
+      key = iter->key().ToString();
+      if (StringMatch(pattern.data(), pattern.size(), key.data(), key.size(), 0)) {
+        keys->push_back(key);
+      }
+    }
+  }
+  delete iter;
+  return Status::OK();
+}
+
+Status RedisBitmaps::BmSetBit(const Slice& key, int64_t offset,
+                              int32_t value, int32_t* ret) {
+  if (offset < 0 || offset > kMaxBitmapOffset) {
+    return Status::InvalidArgument("offset out of range");
+  }
+  if (value != 0 && value != 1) {
+    return Status::InvalidArgument("bit is not an integer or out of range");
+  }
+
+  rocksdb::WriteBatch batch;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+
+  uint16_t chunk = static_cast<uint16_t>(offset >> 16);
+  uint16_t low = static_cast<uint16_t>(offset & 0xffff);
+  BitmapContainer container;
+  std::string meta_value, data_value;
+  int32_t version = 0;
+  bool meta_found = false;
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    meta_found = true;
+    ParsedBitmapsMetaValue parsed_bitmaps_meta_value(&meta_value);
+    if (parsed_bitmaps_meta_value.IsStale()
+      || parsed_bitmaps_meta_value.count() == 0) {
+      version = parsed_bitmaps_meta_value.InitialMetaValue();
+    } else {
+      version = parsed_bitmaps_meta_value.version();
+      BitmapsDataKey data_key(key, version, chunk);
+      s = db_->Get(default_read_options_, handles_[1],
+                   data_key.Encode(), &data_value);
+      if (s.ok()) {
+        if (!container.Decode(data_value)) {
+          return Status::Corruption("Invalid bitmap container");
+        }
+      } else if (!s.IsNotFound()) {
+        return s;
+      }
+    }
+  } else if (!s.IsNotFound()) {
+    return s;
+  }
+
+  *ret = container.Contains(low) ? 1 : 0;
+  if (*ret == value) {
+    return Status::OK();
+  }
+
+  bool was_empty = container.Empty();
+  if (value) {
+    container.Add(low);
+  } else {
+    container.Remove(low);
+  }
+  if (meta_found) {
+    int32_t count_delta = was_empty ? 1 : (container.Empty() ? -1 : 0);
+    ParsedBitmapsMetaValue parsed_bitmaps_meta_value(&meta_value);
+    parsed_bitmaps_meta_value.ModifyCount(count_delta);
+    parsed_bitmaps_meta_value.ModifyCardinality(value ? 1 : -1);
+    batch.Put(handles_[0], key, meta_value);
+  } else {
+    BitmapsMetaValue bitmaps_meta_value(1, 1);
+    version = bitmaps_meta_value.UpdateVersion();
+    batch.Put(handles_[0], key, bitmaps_meta_value.Encode());
+  }
+
+  BitmapsDataKey data_key(key, version, chunk);
+  if (container.Empty()) {
+    batch.Delete(handles_[1], data_key.Encode());
+  } else {
+    container.Encode(&data_value);
+    batch.Put(handles_[1], data_key.Encode(), data_value);
+  }
+  return db_->Write(default_write_options_, &batch);
+}
+
+Status RedisBitmaps::BmGetBit(const Slice& key, int64_t offset,
+                              int32_t* ret) {
+  *ret = 0;
+  if (offset < 0 || offset > kMaxBitmapOffset) {
+    return Status::InvalidArgument("offset out of range");
+  }
+
+  std::string meta_value, data_value;
+  // The container is looked up under the version of the meta value, so
+  // there is no need to read both of them at the same snapshot
+  Status s = GetCachedValue(key, &meta_value);
+  if (s.ok()) {
+    ParsedBitmapsMetaValue parsed_bitmaps_meta_value(&meta_value);
+    if (parsed_bitmaps_meta_value.IsStale()
+      || parsed_bitmaps_meta_value.count() == 0) {
+      return Status::OK();
+    }
+    BitmapsDataKey data_key(key, parsed_bitmaps_meta_value.version(),
+                            static_cast<uint16_t>(offset >> 16));
+    s = db_->Get(default_read_options_, handles_[1],
+                 data_key.Encode(), &data_value);
+    if (s.ok()) {
+      BitmapContainer container;
+      if (!container.Decode(data_value)) {
+        return Status::Corruption("Invalid bitmap container");
+      }
+      *ret = container.Contains(static_cast<uint16_t>(offset & 0xffff));
+    } else if (!s.IsNotFound()) {
+      return s;
+    }
+  } else if (!s.IsNotFound()) {
+    return s;
+  }
+  return Status::OK();
+}
+
+Status RedisBitmaps::BmBitCount(const Slice& key, int64_t start_offset,
+                                int64_t end_offset, int64_t* ret,
+                                bool have_range) {
+  *ret = 0;
+
+  std::string meta_value;
+  ScopeIterators iters(db_, {handles_[0], handles_[1]});
+  Status s = iters.Get(0, key, &meta_value);
+  if (!s.ok()) {
+    return s;
+  }
+  ParsedBitmapsMetaValue parsed_bitmaps_meta_value(&meta_value);
+  if (parsed_bitmaps_meta_value.IsStale()) {
+    return Status::NotFound("Stale");
+  } else if (parsed_bitmaps_meta_value.count() == 0) {
+    return Status::NotFound();
+  }
+  if (!have_range) {
+    *ret = parsed_bitmaps_meta_value.cardinality();
+    return Status::OK();
+  }
+
+  start_offset = std::max(start_offset, static_cast<int64_t>(0));
+  end_offset = std::min(end_offset, kMaxBitmapOffset);
+  if (start_offset > end_offset) {
+    return Status::OK();
+  }
+
+  // Only the containers of the range are read
+  int32_t version = parsed_bitmaps_meta_value.version();
+  uint16_t start_chunk = static_cast<uint16_t>(start_offset >> 16);
+  uint16_t end_chunk = static_cast<uint16_t>(end_offset >> 16);
+  std::string prefix = BitmapsDataKey::EncodePrefix(key, version);
+  BitmapsDataKey start_key(key, version, start_chunk);
+  BitmapContainer container;
+  auto iter = iters[1];
+  for (iter->Seek(start_key.Encode());
+       iter->Valid() && iter->key().starts_with(prefix);
+       iter->Next()) {
+    ParsedBitmapsDataKey parsed_bitmaps_data_key(iter->key());
+    uint16_t chunk = parsed_bitmaps_data_key.chunk();
+    if (chunk > end_chunk) {
+      break;
+    }
+    if (!container.Decode(iter->value())) {
+      return Status::Corruption("Invalid bitmap container");
+    }
+    uint16_t first = chunk == start_chunk ? start_offset & 0xffff : 0;
+    uint16_t last = chunk == end_chunk ? end_offset & 0xffff : 0xffff;
+    if (first == 0 && last == 0xffff) {
+      *ret += container.cardinality();
+    } else {
+      *ret += container.RangeCardinality(first, last);
+    }
+  }
+  return Status::OK();
+}
+
+Status RedisBitmaps::BmBitOp(BitOpType op, const std::string& dest_key,
+                             const std::vector<std::string>& src_keys,
+                             int64_t* ret) {
+  *ret = 0;
+  if (op == kBitOpDefault || src_keys.empty()) {
+    return Status::InvalidArgument("BmBitOp invalid parameter");
+  }
+
+  rocksdb::WriteBatch batch;
+  rocksdb::ReadOptions read_options;
+  const rocksdb::Snapshot* snapshot;
+
+  std::string meta_value;
+  ScopeRecordLock l(lock_mgr_, dest_key);
+  ScopeRowCacheInvalidate ri(row_cache_, dest_key);
+  ScopeSnapshot ss(db_, &snapshot);
+  read_options.snapshot = snapshot;
+  Status s;
+
+  // A missing source empties the result of AND, so does a missing first
+  // source of the difference
+  bool empty_result = false;
+  std::vector<KeyVersion> valid_bitmaps;
+  for (size_t idx = 0; idx < src_keys.size(); ++idx) {
+    s = db_->Get(read_options, handles_[0], src_keys[idx], &meta_value);
+    if (s.ok()) {
+      ParsedBitmapsMetaValue parsed_bitmaps_meta_value(&meta_value);
+      if (!parsed_bitmaps_meta_value.IsStale()
+        && parsed_bitmaps_meta_value.count() != 0) {
+        valid_bitmaps.push_back({src_keys[idx],
+                                 parsed_bitmaps_meta_value.version()});
+        continue;
+      }
+    } else if (!s.IsNotFound()) {
+      return s;
+    }
+    if (op == kBitOpAnd || (op == kBitOpNot && idx == 0)) {
+      empty_result = true;
+    }
+  }
+  if (empty_result) {
+    valid_bitmaps.clear();
+  }
+
+  int32_t version = 0;
+  bool dest_found = false;
+  std::string dest_meta_value;
+  s = db_->Get(read_options, handles_[0], dest_key, &dest_meta_value);
+  if (s.ok()) {
+    dest_found = true;
+    ParsedBitmapsMetaValue parsed_bitmaps_meta_value(&dest_meta_value);
+    version = parsed_bitmaps_meta_value.InitialMetaValue();
+  } else if (s.IsNotFound()) {
+    BitmapsMetaValue bitmaps_meta_value(0, 0);
+    version = bitmaps_meta_value.UpdateVersion();
+  } else {
+    return s;
+  }
+
+  // Walk the containers of the sources side by side, only the chunks which
+  // can hold a bit of the result are read
+  std::vector<std::string> prefixes;
+  std::vector<std::unique_ptr<rocksdb::Iterator>> iters;
+  for (const auto& key_version : valid_bitmaps) {
+    prefixes.push_back(BitmapsDataKey::EncodePrefix(key_version.key,
+                                                    key_version.version));
+    iters.emplace_back(db_->NewIterator(read_options, handles_[1]));
+    iters.back()->Seek(prefixes.back());
+  }
+  auto valid = [&](size_t i) {
+    return iters[i]->Valid() && iters[i]->key().starts_with(prefixes[i]);
+  };
+  auto chunk_of = [&](size_t i) {
+    ParsedBitmapsDataKey parsed_bitmaps_data_key(iters[i]->key());
+    return parsed_bitmaps_data_key.chunk();
+  };
+  auto seek = [&](size_t i, uint16_t chunk) {
+    if (valid(i) && chunk_of(i) < chunk) {
+      BitmapsDataKey data_key(valid_bitmaps[i].key,
+                              valid_bitmaps[i].version, chunk);
+      iters[i]->Seek(data_key.Encode());
+    }
+  };
+
+  // Past the last chunk
+  const uint32_t kNoChunk = BitmapContainer::kChunkBits;
+  int32_t count = 0;
+  uint64_t cardinality = 0;
+  std::string data_value;
+  BitmapContainer result, container;
+  while (!iters.empty()) {
+    uint32_t target = 0;
+    if (op == kBitOpAnd) {
+      // Leapfrog until every source is on the same chunk
+      bool aligned = false;
+      while (!aligned) {
+        aligned = true;
+        for (size_t i = 0; i < iters.size(); i++) {
+          seek(i, static_cast<uint16_t>(target));
+          if (!valid(i)) {
+            target = kNoChunk;
+            break;
+          } else if (chunk_of(i) > target) {
+            target = chunk_of(i);
+            aligned = false;
+          }
+        }
+      }
+    } else if (op == kBitOpNot) {
+      target = valid(0) ? chunk_of(0) : kNoChunk;
+      for (size_t i = 1; i < iters.size()
+        && target != kNoChunk; i++) {
+        seek(i, static_cast<uint16_t>(target));
+      }
+    } else {
+      target = kNoChunk;
+      for (size_t i = 0; i < iters.size(); i++) {
+        if (valid(i) && chunk_of(i) < target) {
+          target = chunk_of(i);
+        }
+      }
+    }
+    if (target == kNoChunk) {
+      break;
+    }
+
+    bool first = true;
+    for (size_t i = 0; i < iters.size(); i++) {
+      if (!valid(i) || chunk_of(i) != target) {
+        continue;
+      }
+      BitmapContainer* dst = first ? &result : &container;
+      if (!dst->Decode(iters[i]->value())) {
+        return Status::Corruption("Invalid bitmap container");
+      }
+      iters[i]->Next();
+      if (first) {
+        first = false;
+        continue;
+      }
+      switch (op) {
+        case kBitOpAnd:
+          result.And(container);
+          break;
+        case kBitOpOr:
+          result.Or(container);
+          break;
+        case kBitOpXor:
+          result.Xor(container);
+          break;
+        default:
+          result.AndNot(container);
+          break;
+      }
+    }
+    if (!result.Empty()) {
+      result.Encode(&data_value);
+      BitmapsDataKey data_key(dest_key, version,
+                              static_cast<uint16_t>(target));
+      batch.Put(handles_[1], data_key.Encode(), data_value);
+      count++;
+      cardinality += result.cardinality();
+    }
+  }
+
+  if (dest_found) {
+    ParsedBitmapsMetaValue parsed_bitmaps_meta_value(&dest_meta_value);
+    parsed_bitmaps_meta_value.set_count(count);
+    parsed_bitmaps_meta_value.set_cardinality(cardinality);
+    batch.Put(handles_[0], dest_key, dest_meta_value);
+  } else if (count != 0) {
+    BitmapsMetaValue bitmaps_meta_value(count, cardinality);
+    bitmaps_meta_value.set_version(version);
+    batch.Put(handles_[0], dest_key, bitmaps_meta_value.Encode());
+  } else {
+    return Status::OK();
+  }
+  *ret = cardinality;
+  return db_->Write(default_write_options_, &batch);
+}
+
+Status RedisBitmaps::Expire(const Slice& key, int32_t ttl) {
+  std::string meta_value;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedBitmapsMetaValue parsed_bitmaps_meta_value(&meta_value);
+    if (parsed_bitmaps_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_bitmaps_meta_value.count() == 0) {
+      return Status::NotFound();
+    }
+    if (ttl > 0) {
+      parsed_bitmaps_meta_value.SetRelativeTimestamp(ttl);
+    } else {
+      parsed_bitmaps_meta_value.InitialMetaValue();
+    }
+    s = db_->Put(default_write_options_, handles_[0], key, meta_value);
+  }
+  return s;
+}
+
+Status RedisBitmaps::Del(const Slice& key) {
+  std::string meta_value;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedBitmapsMetaValue parsed_bitmaps_meta_value(&meta_value);
+    if (parsed_bitmaps_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_bitmaps_meta_value.count() == 0) {
+      return Status::NotFound();
+    } else {
+      parsed_bitmaps_meta_value.InitialMetaValue();
+      s = db_->Put(default_write_options_, handles_[0], key, meta_value);
+    }
+  }
+  return s;
+}
+
+bool RedisBitmaps::Scan(const std::string& start_key,
+                        const std::string& pattern,
+                        std::vector<std::string>* keys,
+                        int64_t* count,
+                        std::string* next_key) {
+  std::string meta_key;
+  bool is_finish = true;
+  rocksdb::ReadOptions iterator_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  iterator_options.snapshot = snapshot;
+  iterator_options.fill_cache = false;
+
+  rocksdb::Iterator* it = db_->NewIterator(iterator_options, handles_[0]);
+
+  it->Seek(start_key);
+  while (it->Valid() && (*count) > 0) {
+    ParsedBitmapsMetaValue parsed_meta_value(it->value());
+    if (parsed_meta_value.IsStale()
+      || parsed_meta_value.count() == 0) {
+      it->Next();
+      continue;
+    } else {
+      meta_key = it->key().ToString();
+      if (StringMatch(pattern.data(), pattern.size(),
+                         meta_key.data(), meta_key.size(), 0)) {
+        keys->push_back(meta_key);
+      }
+      (*count)--;
+      it->Next();
+    }
+  }
+
+  if (it->Valid()) {
+    *next_key = it->key().ToString();
+    is_finish = false;
+  } else {
+    *next_key = "";
+  }
+  delete it;
+  return is_finish;
+}
+
+Status RedisBitmaps::Expireat(const Slice& key, int32_t timestamp) {
+  std::string meta_value;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedBitmapsMetaValue parsed_bitmaps_meta_value(&meta_value);
+    if (parsed_bitmaps_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_bitmaps_meta_value.count() == 0) {
+      return Status::NotFound();
+    } else {
+      parsed_bitmaps_meta_value.set_timestamp(timestamp);
+      s = db_->Put(default_write_options_, handles_[0], key, meta_value);
+    }
+  }
+  return s;
+}
+
+Status RedisBitmaps::Persist(const Slice& key) {
+  std::string meta_value;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedBitmapsMetaValue parsed_bitmaps_meta_value(&meta_value);
+    if (parsed_bitmaps_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_bitmaps_meta_value.count() == 0) {
+      return Status::NotFound();
+    } else {
+      int32_t timestamp = parsed_bitmaps_meta_value.timestamp();
+      if (timestamp == 0) {
+        return Status::NotFound("Not have an associated timeout");
+      }  else {
+        parsed_bitmaps_meta_value.set_timestamp(0);
+        s = db_->Put(default_write_options_, handles_[0], key, meta_value);
+      }
+    }
+  }
+  return s;
+}
+
+Status RedisBitmaps::TTL(const Slice& key, int64_t* timestamp) {
+  std::string meta_value;
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedBitmapsMetaValue parsed_bitmaps_meta_value(&meta_value);
+    if (parsed_bitmaps_meta_value.IsStale()) {
+      *timestamp = -2;
+      return Status::NotFound("Stale");
+    } else if (parsed_bitmaps_meta_value.count() == 0) {
+      *timestamp = -2;
+      return Status::NotFound();
+    } else {
+      *timestamp = parsed_bitmaps_meta_value.timestamp();
+      if (*timestamp == 0) {
+        *timestamp = -1;
+      } else {
+        int64_t curtime;
+        rocksdb::Env::Default()->GetCurrentTime(&curtime);
+        *timestamp = *timestamp - curtime > 0 ? *timestamp - curtime : -1;
+      }
+    }
+  } else if (s.IsNotFound()) {
+    *timestamp = -2;
+  }
+  return s;
+}
+
+void RedisBitmaps::ScanDatabase() {
+
+  rocksdb::ReadOptions iterator_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  iterator_options.snapshot = snapshot;
+  iterator_options.fill_cache = false;
+  int32_t current_time = time(NULL);
+
+  printf("\n***************Bitmaps Meta Data***************\n");
+  auto meta_iter = db_->NewIterator(iterator_options, handles_[0]);
+  for (meta_iter->SeekToFirst();
+       meta_iter->Valid();
+       meta_iter->Next()) {
+    ParsedBitmapsMetaValue parsed_bitmaps_meta_value(meta_iter->value());
+    int32_t survival_time = 0;
+    if (parsed_bitmaps_meta_value.timestamp() != 0) {
+      survival_time = parsed_bitmaps_meta_value.timestamp() - current_time > 0 ?
+        parsed_bitmaps_meta_value.timestamp() - current_time : -1;
+    }
+
+    printf("[key : %-30s] [containers : %-10d] [cardinality : %-10lu] [timestamp : %-10d] [version : %d] [survival_time : %d]\n",
+           meta_iter->key().ToString().c_str(),
+           parsed_bitmaps_meta_value.count(),
+           static_cast<unsigned long>(parsed_bitmaps_meta_value.cardinality()),
+           parsed_bitmaps_meta_value.timestamp(),
+           parsed_bitmaps_meta_value.version(),
+           survival_time);
+  }
+  delete meta_iter;
+
+  printf("\n***************Bitmaps Container Data***************\n");
+  BitmapContainer container;
+  auto container_iter = db_->NewIterator(iterator_options, handles_[1]);
+  for (container_iter->SeekToFirst();
+       container_iter->Valid();
+       container_iter->Next()) {
+    ParsedBitmapsDataKey parsed_bitmaps_data_key(container_iter->key());
+    container.Decode(container_iter->value());
+    printf("[key : %-30s] [chunk : %-5d] [type : %d] [cardinality : %-5u] [size : %-5lu] [version : %d]\n",
+           parsed_bitmaps_data_key.key().ToString().c_str(),
+           parsed_bitmaps_data_key.chunk(),
+           container_iter->value().size() ? container_iter->value()[0] : 0,
+           container.cardinality(),
+           static_cast<unsigned long>(container_iter->value().size()),
+           parsed_bitmaps_data_key.version());
+  }
+  delete container_iter;
+}
+
+}  //  namespace blackwidow
@@ -0,0 +1,63 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_REDIS_BITMAPS_H_
+#define SRC_REDIS_BITMAPS_H_
+
+#include <string>
+#include <vector>
+
+#include "src/redis.h"
+#include "blackwidow/blackwidow.h"
+
+namespace blackwidow {
+
+// Compressed bitmaps over offsets in [0, 2^32), see bitmaps_container.h
+class RedisBitmaps : public Redis {
+  public:
+    RedisBitmaps() = default;
+    ~RedisBitmaps();
+
+    // Common Commands
+    virtual Status Open(const rocksdb::Options& options,
+                        const std::string& db_path) override;
+    virtual Status CompactRange(const rocksdb::Slice* begin,
+                                const rocksdb::Slice* end) override;
+    virtual Status CompactKey(const Slice& key) override;
+    virtual Status GetStaleEntries(uint64_t* stale,
+                                   uint64_t* total) override;
+    virtual Status GetProperty(const std::string& property, std::string* out) override;
+    virtual Status ScanKeyNum(uint64_t* num) override;
+    virtual Status ScanKeys(const std::string& pattern,
+                            std::vector<std::string>* keys) override;
+
+    // Bitmaps Commands
+    Status BmSetBit(const Slice& key, int64_t offset, int32_t value,
+                    int32_t* ret);
+    Status BmGetBit(const Slice& key, int64_t offset, int32_t* ret);
+    Status BmBitCount(const Slice& key, int64_t start_offset,
+                      int64_t end_offset, int64_t* ret, bool have_range);
+    Status BmBitOp(BitOpType op, const std::string& dest_key,
+                   const std::vector<std::string>& src_keys, int64_t* ret);
+
+    // Keys Commands
+    virtual Status Expire(const Slice& key, int32_t ttl) override;
+    virtual Status Del(const Slice& key) override;
+    virtual bool Scan(const std::string& start_key, const std::string& pattern,
+                      std::vector<std::string>* keys,
+                      int64_t* count, std::string* next_key) override;
+    virtual Status Expireat(const Slice& key, int32_t timestamp) override;
+    virtual Status Persist(const Slice& key) override;
+    virtual Status TTL(const Slice& key, int64_t* timestamp) override;
+
+    // Iterate all data
+    void ScanDatabase();
+
+  private:
+    std::vector<rocksdb::ColumnFamilyHandle*> handles_;
+};
+
+}  //  namespace blackwidow
+#endif  //  SRC_REDIS_BITMAPS_H_
@@ -0,0 +1,1187 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/redis_filters.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <set>
+
+#include "blackwidow/util.h"
+#include "src/base_filter.h"
+#include "src/blackwidow_murmur3.h"
+#include "src/filters_meta_value_format.h"
+#include "src/scope_record_lock.h"
+#include "src/scope_snapshot.h"
+#include "src/stale_entries_collector.h"
+
+namespace blackwidow {
+
+static const uint64_t kMaxCapacity = 1ULL << 40;
+static const double kDefaultErrorRate = 0.01;
+static const uint64_t kDefaultBloomCapacity = 100;
+static const int32_t kDefaultExpansion = 2;
+static const uint64_t kDefaultCuckooCapacity = 1024;
+// Every bloom filter layer halves the error rate of the previous one, so
+// the error rate of the whole filter stays below twice the first one
+static const double kTighteningRatio = 0.5;
+// Large sub filters are split in segments of this size, an item only
+// touches one segment of every sub filter
+static const uint64_t kSegmentBytes = 4096;
+// 8 bits fingerprints in buckets of 4 slots, two buckets are checked
+static const uint32_t kBucketSlots = 4;
+static const double kCuckooErrorRate = 2.0 * kBucketSlots / 256;
+static const int kMaxKicks = 500;
+static const uint32_t kFilterHashSeed = 0x5bd1e995;
+static const uint32_t kFilterHashSeedHigh = 0x9747b28c;
+
+// The sub filter and segment indexes of a segment
+typedef std::pair<uint32_t, uint32_t> SegmentID;
+
+// The segments of a filter read by a command, the ones changed are written
+// back by Flush(). The sub filters from stored_sub_filters on were added
+// by the command, their segments are not read.
+class FilterSegments {
+ public:
+  FilterSegments(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* cf,
+                 const rocksdb::ReadOptions& read_options, const Slice& key,
+                 int32_t version, uint32_t stored_sub_filters)
+    : db_(db),
+      cf_(cf),
+      read_options_(read_options),
+      key_(key),
+      version_(version),
+      stored_sub_filters_(stored_sub_filters) {
+  }
+
+  // Queues a segment for the next Load()
+  void Want(const SegmentID& id, size_t size) {
+    if (id.first < stored_sub_filters_
+      && segments_.find(id) == segments_.end()) {
+      wanted_[id] = size;
+    }
+  }
+
+  // Reads all the segments wanted with a single MultiGet
+  Status Load() {
+    if (wanted_.empty()) {
+      return Status::OK();
+    }
+    std::vector<std::string> keys;
+    for (const auto& wanted : wanted_) {
+      FiltersDataKey filters_data_key(key_, version_, wanted.first.first,
+                                      wanted.first.second);
+      keys.push_back(filters_data_key.Encode().ToString());
+    }
+    std::vector<Slice> key_slices(keys.begin(), keys.end());
+    std::vector<rocksdb::ColumnFamilyHandle*> cfs(keys.size(), cf_);
+    std::vector<std::string> values;
+    std::vector<Status> statuses = db_->MultiGet(read_options_, cfs,
+                                                 key_slices, &values);
+    size_t idx = 0;
+    for (const auto& wanted : wanted_) {
+      Status s = Install(wanted.first, wanted.second, statuses[idx],
+                         &values[idx]);
+      if (!s.ok()) {
+        return s;
+      }
+      idx++;
+    }
+    wanted_.clear();
+    return Status::OK();
+  }
+
+  // The segment id, read now if it was not loaded yet
+  Status Get(const SegmentID& id, size_t size, std::string** segment) {
+    auto iter = segments_.find(id);
+    if (iter == segments_.end()) {
+      std::string value;
+      Status s = Status::NotFound();
+      if (id.first < stored_sub_filters_) {
+        FiltersDataKey filters_data_key(key_, version_, id.first, id.second);
+        s = db_->Get(read_options_, cf_, filters_data_key.Encode(), &value);
+      }
+      s = Install(id, size, s, &value);
+      if (!s.ok()) {
+        return s;
+      }
+      iter = segments_.find(id);
+    }
+    *segment = &iter->second;
+    return Status::OK();
+  }
+
+  void SetDirty(const SegmentID& id) {
+    dirty_.insert(id);
+  }
+
+  void Flush(rocksdb::WriteBatch* batch) {
+    for (const auto& id : dirty_) {
+      FiltersDataKey filters_data_key(key_, version_, id.first, id.second);
+      batch->Put(cf_, filters_data_key.Encode(), segments_[id]);
+    }
+  }
+
+ private:
+  // A segment never written reads as zeros
+  Status Install(const SegmentID& id, size_t size, const Status& s,
+                 std::string* value) {
+    if (s.IsNotFound()) {
+      value->assign(size, '\0');
+    } else if (!s.ok()) {
+      return s;
+    } else if (value->size() != size) {
+      return Status::Corruption("Invalid filter segment");
+    }
+    segments_[id].swap(*value);
+    return Status::OK();
+  }
+
+  rocksdb::DB* db_;
+  rocksdb::ColumnFamilyHandle* cf_;
+  const rocksdb::ReadOptions& read_options_;
+  Slice key_;
+  int32_t version_;
+  uint32_t stored_sub_filters_;
+  std::map<SegmentID, size_t> wanted_;
+  std::map<SegmentID, std::string> segments_;
+  std::set<SegmentID> dirty_;
+};
+
+// The two 32 bits murmur3 hashes of an item
+static uint64_t HashItem(const std::string& item) {
+  uint32_t low, high;
+  MurmurHash3_x86_32(item.data(), static_cast<int>(item.size()),
+                     kFilterHashSeed, &low);
+  MurmurHash3_x86_32(item.data(), static_cast<int>(item.size()),
+                     kFilterHashSeedHigh, &high);
+  return static_cast<uint64_t>(high) << 32 | low;
+}
+
+// A layer of a scalable bloom filter. Every segment is a bloom filter of
+// its own, an item sets all its bits in a single segment picked by its
+// hash, so that a check reads one segment per layer
+struct BloomLayer {
+  uint64_t capacity;
+  uint32_t hashes;
+  uint32_t segments;
+  uint64_t segment_bits;
+};
+
+static BloomLayer BloomLayerOf(ParsedFiltersMetaValue* meta, int32_t index) {
+  BloomLayer layer;
+  double capacity = meta->capacity() * pow(meta->expansion(), index);
+  layer.capacity = capacity < kMaxCapacity
+    ? static_cast<uint64_t>(capacity) : kMaxCapacity;
+  double error_rate = meta->error_rate() * pow(kTighteningRatio, index);
+  // 9.6 bits per item and 7 hashes at 1%
+  double bits_per_item = -log(error_rate) / (M_LN2 * M_LN2);
+  layer.hashes = static_cast<uint32_t>(ceil(M_LN2 * bits_per_item));
+  uint64_t bits = static_cast<uint64_t>(ceil(layer.capacity * bits_per_item));
+  uint64_t bytes = (bits + 63) / 64 * 8;
+  if (bytes <= kSegmentBytes) {
+    layer.segments = 1;
+    layer.segment_bits = bytes * 8;
+  } else {
+    layer.segments = static_cast<uint32_t>(std::min<uint64_t>(
+          (bytes + kSegmentBytes - 1) / kSegmentBytes, UINT32_MAX));
+    layer.segment_bits = kSegmentBytes * 8;
+  }
+  return layer;
+}
+
+static SegmentID BloomSegmentOf(uint64_t hash, uint32_t index,
+                                const BloomLayer& layer) {
+  // Mixed apart from the bit positions, which use the halves of the hash
+  uint64_t mixed = (hash * 0x9E3779B97F4A7C15ULL) >> 32;
+  return SegmentID(index, static_cast<uint32_t>(mixed % layer.segments));
+}
+
+static bool BloomCheck(uint64_t hash, const BloomLayer& layer,
+                       const std::string& segment) {
+  uint64_t a = hash & 0xffffffff;
+  uint64_t b = (hash >> 32) | 1;
+  for (uint32_t i = 0; i < layer.hashes; i++) {
+    uint64_t bit = (a + i * b) % layer.segment_bits;
+    if (!(segment[bit >> 3] & (1 << (bit & 7)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void BloomSet(uint64_t hash, const BloomLayer& layer,
+                     std::string* segment) {
+  uint64_t a = hash & 0xffffffff;
+  uint64_t b = (hash >> 32) | 1;
+  for (uint32_t i = 0; i < layer.hashes; i++) {
+    uint64_t bit = (a + i * b) % layer.segment_bits;
+    (*segment)[bit >> 3] |= static_cast<char>(1 << (bit & 7));
+  }
+}
+
+// The buckets of a cuckoo filter, a power of 2 of them so that the other
+// bucket of a fingerprint is found from the fingerprint and either bucket
+struct CuckooTable {
+  uint64_t buckets;
+  uint64_t buckets_per_segment;
+};
+
+static CuckooTable CuckooTableOf(uint64_t capacity) {
+  CuckooTable table;
+  table.buckets = 1;
+  while (table.buckets * kBucketSlots < capacity) {
+    table.buckets <<= 1;
+  }
+  table.buckets_per_segment = std::min(table.buckets,
+                                       kSegmentBytes / kBucketSlots);
+  return table;
+}
+
+static char Fingerprint(uint64_t hash) {
+  // 0 stands for an empty slot
+  uint8_t fingerprint = static_cast<uint8_t>(hash >> 56);
+  return static_cast<char>(fingerprint == 0 ? 1 : fingerprint);
+}
+
+static uint64_t AltBucket(uint64_t bucket, char fingerprint,
+                          const CuckooTable& table) {
+  return (bucket ^ fmix32(static_cast<uint8_t>(fingerprint)))
+    & (table.buckets - 1);
+}
+
+static SegmentID CuckooSegmentOf(uint64_t bucket, const CuckooTable& table) {
+  return SegmentID(0, static_cast<uint32_t>(bucket / table.buckets_per_segment));
+}
+
+static Status CuckooBucket(FilterSegments* segments, const CuckooTable& table,
+                           uint64_t bucket, char** slots) {
+  std::string* segment;
+  Status s = segments->Get(CuckooSegmentOf(bucket, table),
+                           table.buckets_per_segment * kBucketSlots, &segment);
+  if (!s.ok()) {
+    return s;
+  }
+  *slots = &(*segment)[(bucket % table.buckets_per_segment) * kBucketSlots];
+  return Status::OK();
+}
+
+// Looks for fingerprint in both its buckets, slot points to it when found
+// and is nullptr otherwise
+static Status CuckooFind(FilterSegments* segments, const CuckooTable& table,
+                         uint64_t bucket1, uint64_t bucket2, char fingerprint,
+                         char** slot, uint64_t* bucket) {
+  *slot = nullptr;
+  for (uint64_t candidate : {bucket1, bucket2}) {
+    char* slots;
+    Status s = CuckooBucket(segments, table, candidate, &slots);
+    if (!s.ok()) {
+      return s;
+    }
+    for (uint32_t i = 0; i < kBucketSlots; i++) {
+      if (slots[i] == fingerprint) {
+        *slot = &slots[i];
+        *bucket = candidate;
+        return Status::OK();
+      }
+    }
+  }
+  return Status::OK();
+}
+
+// Puts fingerprint in a free slot of its buckets, moving the fingerprints
+// in the way to their other bucket up to kMaxKicks times. The moves are
+// undone and Status::Incomplete() is returned when no room is found
+static Status CuckooInsert(FilterSegments* segments, const CuckooTable& table,
+                           uint64_t bucket1, uint64_t bucket2,
+                           char fingerprint, uint64_t hash) {
+  char* slots;
+  Status s;
+  for (uint64_t candidate : {bucket1, bucket2}) {
+    s = CuckooBucket(segments, table, candidate, &slots);
+    if (!s.ok()) {
+      return s;
+    }
+    for (uint32_t i = 0; i < kBucketSlots; i++) {
+      if (slots[i] == 0) {
+        slots[i] = fingerprint;
+        segments->SetDirty(CuckooSegmentOf(candidate, table));
+        return Status::OK();
+      }
+    }
+  }
+
+  std::vector<std::pair<uint64_t, uint32_t>> kicks;
+  uint32_t random = static_cast<uint32_t>(hash) | 1;
+  uint64_t bucket = random & 2 ? bucket2 : bucket1;
+  char victim = fingerprint;
+  for (int kick = 0; kick < kMaxKicks; kick++) {
+    s = CuckooBucket(segments, table, bucket, &slots);
+    if (!s.ok()) {
+      return s;
+    }
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    uint32_t slot = random % kBucketSlots;
+    std::swap(victim, slots[slot]);
+    segments->SetDirty(CuckooSegmentOf(bucket, table));
+    kicks.push_back(std::make_pair(bucket, slot));
+
+    bucket = AltBucket(bucket, victim, table);
+    s = CuckooBucket(segments, table, bucket, &slots);
+    if (!s.ok()) {
+      return s;
+    }
+    for (uint32_t i = 0; i < kBucketSlots; i++) {
+      if (slots[i] == 0) {
+        slots[i] = victim;
+        segments->SetDirty(CuckooSegmentOf(bucket, table));
+        return Status::OK();
+      }
+    }
+  }
+
+  for (auto iter = kicks.rbegin(); iter != kicks.rend(); ++iter) {
+    s = CuckooBucket(segments, table, iter->first, &slots);
+    if (!s.ok()) {
+      return s;
+    }
+    std::swap(victim, slots[iter->second]);
+  }
+  return Status::Incomplete("Filter is full");
+}
+
+static Status WrongKind() {
+  return Status::InvalidArgument("The key holds another kind of filter");
+}
+
+// Whether meta_value, read with status s, is a filter which is neither
+// stale nor deleted
+static bool IsLiveFilter(const Status& s, std::string* meta_value) {
+  if (!s.ok()) {
+    return false;
+  }
+  ParsedFiltersMetaValue parsed_filters_meta_value(meta_value);
+  return !parsed_filters_meta_value.IsStale()
+    && parsed_filters_meta_value.count() != 0;
+}
+
+// Replaces meta_value, read with status s, by the one of an empty filter.
+// A stale or deleted filter gets a new version, its segments are dropped
+static void NewFilterMetaValue(const Status& s, char kind, uint64_t capacity,
+                               double error_rate, int32_t expansion,
+                               std::string* meta_value) {
+  FiltersMetaValue filters_meta_value(static_cast<FilterKind>(kind),
+                                      capacity, error_rate, expansion);
+  if (s.ok()) {
+    ParsedFiltersMetaValue parsed_filters_meta_value(meta_value);
+    filters_meta_value.set_version(
+        parsed_filters_meta_value.InitialMetaValue());
+  } else {
+    filters_meta_value.UpdateVersion();
+  }
+  *meta_value = filters_meta_value.Encode().ToString();
+}
+
+RedisFilters::~RedisFilters() {
+  std::vector<rocksdb::ColumnFamilyHandle*> tmp_handles = handles_;
+  handles_.clear();
+  for (auto handle : tmp_handles) {
+    delete handle;
+  }
+}
+
+Status RedisFilters::Open(const rocksdb::Options& options,
+                          const std::string& db_path) {
+  rocksdb::Options ops(options);
+  Status s = rocksdb::DB::Open(ops, db_path, &db_);
+  if (s.ok()) {
+    // create column families
+    rocksdb::ColumnFamilyHandle *dcf = nullptr;
+    s = db_->CreateColumnFamily(rocksdb::ColumnFamilyOptions(),
+        "data_cf", &dcf);
+    if (!s.ok()) {
+      return s;
+    }
+    // close DB
+    delete dcf;
+    delete db_;
+  }
+
+  // Open
+  rocksdb::DBOptions db_ops(options);
+  rocksdb::ColumnFamilyOptions meta_cf_ops(options);
+  rocksdb::ColumnFamilyOptions data_cf_ops(options);
+  meta_cf_ops.compaction_filter_factory =
+    std::make_shared<FiltersMetaFilterFactory>();
+  data_cf_ops.compaction_filter_factory =
+    std::make_shared<FiltersDataFilterFactory>(&db_, &handles_);
+
+  meta_cf_ops.table_properties_collector_factories.push_back(
+    std::make_shared<StaleEntriesCollectorFactory>(kBaseMetaFormat));
+  data_cf_ops.table_properties_collector_factories.push_back(
+    std::make_shared<StaleEntriesCollectorFactory>(kVersionedKeyFormat));
+
+  //use the bloom filter policy to reduce disk reads
+  rocksdb::BlockBasedTableOptions table_options;
+  table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, true));
+  meta_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_options));
+  data_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_options));
+
+  std::vector<rocksdb::ColumnFamilyDescriptor> column_families;
+  // Meta CF
+  column_families.push_back(rocksdb::ColumnFamilyDescriptor(
+      rocksdb::kDefaultColumnFamilyName, meta_cf_ops));
+  // Segment CF
+  column_families.push_back(rocksdb::ColumnFamilyDescriptor(
+      "data_cf", data_cf_ops));
+  return rocksdb::DB::Open(db_ops, db_path, column_families, &handles_, &db_);
+}
+
+Status RedisFilters::CompactRange(const rocksdb::Slice* begin,
+                                  const rocksdb::Slice* end) {
+  for (auto handle : handles_) {
+    Status s = db_->CompactRange(default_compact_range_options_,
+        handle, begin, end);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
+Status RedisFilters::CompactKey(const Slice& key) {
+  return CompactKeyData(key, handles_[1]);
+}
+
+Status RedisFilters::GetStaleEntries(uint64_t* stale, uint64_t* total) {
+  return SumStaleEntries(db_, handles_, stale, total);
+}
+
+Status RedisFilters::GetProperty(const std::string& property, std::string* out) {
+  db_->GetProperty(property, out);
+  return Status::OK();
+}
+
+Status RedisFilters::ScanKeyNum(uint64_t* num) {
+
+  uint64_t count = 0;
+  rocksdb::ReadOptions iterator_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  iterator_options.snapshot = snapshot;
+  iterator_options.fill_cache = false;
+
+  rocksdb::Iterator* iter = db_->NewIterator(iterator_options, handles_[0]);
+  for (iter->SeekToFirst();
+       iter->Valid();
+       iter->Next()) {
+    ThrottleScan(iter->key().size() + iter->value().size());
+    ParsedFiltersMetaValue parsed_filters_meta_value(iter->value());
+    if (!parsed_filters_meta_value.IsStale()
+      && parsed_filters_meta_value.count() != 0) {
+      count++;
+    }
+  }
+  *num = count;
+  delete iter;
+  return Status::OK();
+}
+
+Status RedisFilters::ScanKeys(const std::string& pattern,
+                              std::vector<std::string>* keys) {
+
+  std::string key;
+  rocksdb::ReadOptions iterator_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  iterator_options.snapshot = snapshot;
+  iterator_options.fill_cache = false;
+
+  rocksdb::Iterator* iter = db_->NewIterator(iterator_options, handles_[0]);
+  for (iter->SeekToFirst();
+       iter->Valid();
+       iter->Next()) {
+    ThrottleScan(iter->key().size() + iter->value().size());
+    ParsedFiltersMetaValue parsed_filters_meta_value(iter->value());
+    if (!parsed_filters_meta_value.IsStale()
+      && parsed_filters_meta_value.count() != 0) {
+      key = iter->key().ToString();
+      if (StringMatch(pattern.data(), pattern.size(), key.data(), key.size(), 0)) {
+        keys->push_back(key);
+      }
+    }
+  }
+  delete iter;
+  return Status::OK();
+}
+
+Status RedisFilters::BFReserve(const Slice& key, double error_rate,
+                               uint64_t capacity, int32_t expansion) {
+  if (!(error_rate > 0 && error_rate < 1)) {
+    return Status::InvalidArgument("error rate must be in the range (0, 1)");
+  } else if (capacity == 0 || capacity > kMaxCapacity) {
+    return Status::InvalidArgument("capacity is out of range");
+  } else if (expansion < 1) {
+    return Status::InvalidArgument("expansion must be positive");
+  }
+  return Reserve(key, kBloomFilter, capacity, error_rate, expansion);
+}
+
+// The segments touched by the items in all the layers are read with one
+// MultiGet, then the items missing from every layer are added to the last
+// one. A full last layer is followed by a larger one.
+Status RedisFilters::BFAdd(const Slice& key,
+                           const std::vector<std::string>& items,
+                           std::vector<bool>* added) {
+  if (items.empty()) {
+    return Status::InvalidArgument("wrong number of arguments");
+  }
+  added->assign(items.size(), false);
+
+  rocksdb::WriteBatch batch;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+
+  std::string meta_value;
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (!s.ok() && !s.IsNotFound()) {
+    return s;
+  }
+  bool created = !IsLiveFilter(s, &meta_value);
+  if (created) {
+    NewFilterMetaValue(s, kBloomFilter, kDefaultBloomCapacity,
+                       kDefaultErrorRate, kDefaultExpansion, &meta_value);
+  }
+  ParsedFiltersMetaValue parsed_filters_meta_value(&meta_value);
+  if (parsed_filters_meta_value.kind() != kBloomFilter) {
+    return WrongKind();
+  }
+
+  std::vector<BloomLayer> layers;
+  uint64_t last_layer_items = parsed_filters_meta_value.items();
+  for (int32_t idx = 0; idx < parsed_filters_meta_value.count(); idx++) {
+    layers.push_back(BloomLayerOf(&parsed_filters_meta_value, idx));
+    // Only the last layer is not full
+    if (idx + 1 < parsed_filters_meta_value.count()) {
+      last_layer_items -= layers.back().capacity;
+    }
+  }
+
+  FilterSegments segments(db_, handles_[1], default_read_options_, key,
+                          parsed_filters_meta_value.version(),
+                          created ? 0 : layers.size());
+  std::vector<uint64_t> hashes;
+  for (const auto& item : items) {
+    uint64_t hash = HashItem(item);
+    hashes.push_back(hash);
+    for (uint32_t idx = 0; idx < layers.size(); idx++) {
+      segments.Want(BloomSegmentOf(hash, idx, layers[idx]),
+                    layers[idx].segment_bits / 8);
+    }
+  }
+  s = segments.Load();
+  if (!s.ok()) {
+    return s;
+  }
+
+  uint64_t count = 0;
+  std::string* segment;
+  for (size_t item_idx = 0; item_idx < items.size(); item_idx++) {
+    uint64_t hash = hashes[item_idx];
+    bool found = false;
+    for (uint32_t idx = 0; idx < layers.size() && !found; idx++) {
+      s = segments.Get(BloomSegmentOf(hash, idx, layers[idx]),
+                       layers[idx].segment_bits / 8, &segment);
+      if (!s.ok()) {
+        return s;
+      }
+      found = BloomCheck(hash, layers[idx], *segment);
+    }
+    if (found) {
+      continue;
+    }
+    if (last_layer_items >= layers.back().capacity) {
+      layers.push_back(BloomLayerOf(&parsed_filters_meta_value, layers.size()));
+      last_layer_items = 0;
+    }
+    uint32_t last = layers.size() - 1;
+    SegmentID id = BloomSegmentOf(hash, last, layers[last]);
+    s = segments.Get(id, layers[last].segment_bits / 8, &segment);
+    if (!s.ok()) {
+      return s;
+    }
+    BloomSet(hash, layers[last], segment);
+    segments.SetDirty(id);
+    last_layer_items++;
+    (*added)[item_idx] = true;
+    count++;
+  }
+  if (count == 0) {
+    return Status::OK();
+  }
+
+  parsed_filters_meta_value.set_count(layers.size());
+  parsed_filters_meta_value.ModifyItems(count);
+  batch.Put(handles_[0], key, meta_value);
+  segments.Flush(&batch);
+  return db_->Write(default_write_options_, &batch);
+}
+
+Status RedisFilters::BFExists(const Slice& key,
+                              const std::vector<std::string>& items,
+                              std::vector<bool>* exists) {
+  exists->assign(items.size(), false);
+  rocksdb::ReadOptions read_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  read_options.snapshot = snapshot;
+
+  std::string meta_value;
+  Status s = db_->Get(read_options, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedFiltersMetaValue parsed_filters_meta_value(&meta_value);
+    if (parsed_filters_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_filters_meta_value.count() == 0) {
+      return Status::NotFound();
+    } else if (parsed_filters_meta_value.kind() != kBloomFilter) {
+      return WrongKind();
+    }
+
+    std::vector<BloomLayer> layers;
+    for (int32_t idx = 0; idx < parsed_filters_meta_value.count(); idx++) {
+      layers.push_back(BloomLayerOf(&parsed_filters_meta_value, idx));
+    }
+    FilterSegments segments(db_, handles_[1], read_options, key,
+                            parsed_filters_meta_value.version(),
+                            layers.size());
+    std::vector<uint64_t> hashes;
+    for (const auto& item : items) {
+      uint64_t hash = HashItem(item);
+      hashes.push_back(hash);
+      for (uint32_t idx = 0; idx < layers.size(); idx++) {
+        segments.Want(BloomSegmentOf(hash, idx, layers[idx]),
+                      layers[idx].segment_bits / 8);
+      }
+    }
+    s = segments.Load();
+    if (!s.ok()) {
+      return s;
+    }
+
+    std::string* segment;
+    for (size_t item_idx = 0; item_idx < items.size(); item_idx++) {
+      for (uint32_t idx = 0; idx < layers.size(); idx++) {
+        s = segments.Get(BloomSegmentOf(hashes[item_idx], idx, layers[idx]),
+                         layers[idx].segment_bits / 8, &segment);
+        if (!s.ok()) {
+          return s;
+        }
+        if (BloomCheck(hashes[item_idx], layers[idx], *segment)) {
+          (*exists)[item_idx] = true;
+          break;
+        }
+      }
+    }
+  }
+  return s;
+}
+
+Status RedisFilters::BFInfo(const Slice& key, FilterInfo* info) {
+  return GetInfo(key, kBloomFilter, info);
+}
+
+Status RedisFilters::CFReserve(const Slice& key, uint64_t capacity) {
+  if (capacity == 0 || capacity > kMaxCapacity) {
+    return Status::InvalidArgument("capacity is out of range");
+  }
+  return Reserve(key, kCuckooFilter, capacity, kCuckooErrorRate, 0);
+}
+
+Status RedisFilters::CFAdd(const Slice& key,
+                           const std::vector<std::string>& items,
+                           std::vector<bool>* added) {
+  if (items.empty()) {
+    return Status::InvalidArgument("wrong number of arguments");
+  }
+  added->assign(items.size(), false);
+
+  rocksdb::WriteBatch batch;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+
+  std::string meta_value;
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (!s.ok() && !s.IsNotFound()) {
+    return s;
+  }
+  bool created = !IsLiveFilter(s, &meta_value);
+  if (created) {
+    NewFilterMetaValue(s, kCuckooFilter, kDefaultCuckooCapacity,
+                       kCuckooErrorRate, 0, &meta_value);
+  }
+  ParsedFiltersMetaValue parsed_filters_meta_value(&meta_value);
+  if (parsed_filters_meta_value.kind() != kCuckooFilter) {
+    return WrongKind();
+  }
+
+  CuckooTable table = CuckooTableOf(parsed_filters_meta_value.capacity());
+  FilterSegments segments(db_, handles_[1], default_read_options_, key,
+                          parsed_filters_meta_value.version(), created ? 0 : 1);
+  std::vector<uint64_t> hashes;
+  for (const auto& item : items) {
+    uint64_t hash = HashItem(item);
+    uint64_t bucket = hash & (table.buckets - 1);
+    hashes.push_back(hash);
+    segments.Want(CuckooSegmentOf(bucket, table),
+                  table.buckets_per_segment * kBucketSlots);
+    segments.Want(CuckooSegmentOf(AltBucket(bucket, Fingerprint(hash), table),
+                                  table),
+                  table.buckets_per_segment * kBucketSlots);
+  }
+  s = segments.Load();
+  if (!s.ok()) {
+    return s;
+  }
+
+  uint64_t count = 0;
+  bool full = false;
+  for (size_t idx = 0; idx < items.size(); idx++) {
+    uint64_t hash = hashes[idx];
+    char fingerprint = Fingerprint(hash);
+    uint64_t bucket1 = hash & (table.buckets - 1);
+    uint64_t bucket2 = AltBucket(bucket1, fingerprint, table);
+    char* slot;
+    uint64_t bucket;
+    s = CuckooFind(&segments, table, bucket1, bucket2, fingerprint,
+                   &slot, &bucket);
+    if (!s.ok()) {
+      return s;
+    } else if (slot != nullptr) {
+      continue;
+    }
+    s = CuckooInsert(&segments, table, bucket1, bucket2, fingerprint, hash);
+    if (s.IsIncomplete()) {
+      full = true;
+      continue;
+    } else if (!s.ok()) {
+      return s;
+    }
+    (*added)[idx] = true;
+    count++;
+  }
+
+  if (count != 0) {
+    parsed_filters_meta_value.ModifyItems(count);
+    batch.Put(handles_[0], key, meta_value);
+    segments.Flush(&batch);
+    s = db_->Write(default_write_options_, &batch);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return full ? Status::Incomplete("Filter is full") : Status::OK();
+}
+
+Status RedisFilters::CFExists(const Slice& key,
+                              const std::vector<std::string>& items,
+                              std::vector<bool>* exists) {
+  exists->assign(items.size(), false);
+  rocksdb::ReadOptions read_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  read_options.snapshot = snapshot;
+
+  std::string meta_value;
+  Status s = db_->Get(read_options, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedFiltersMetaValue parsed_filters_meta_value(&meta_value);
+    if (parsed_filters_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_filters_meta_value.count() == 0) {
+      return Status::NotFound();
+    } else if (parsed_filters_meta_value.kind() != kCuckooFilter) {
+      return WrongKind();
+    }
+
+    CuckooTable table = CuckooTableOf(parsed_filters_meta_value.capacity());
+    FilterSegments segments(db_, handles_[1], read_options, key,
+                            parsed_filters_meta_value.version(), 1);
+    std::vector<uint64_t> hashes;
+    for (const auto& item : items) {
+      uint64_t hash = HashItem(item);
+      uint64_t bucket = hash & (table.buckets - 1);
+      hashes.push_back(hash);
+      segments.Want(CuckooSegmentOf(bucket, table),
+                    table.buckets_per_segment * kBucketSlots);
+      segments.Want(CuckooSegmentOf(AltBucket(bucket, Fingerprint(hash),
+                                              table), table),
+                    table.buckets_per_segment * kBucketSlots);
+    }
+    s = segments.Load();
+    if (!s.ok()) {
+      return s;
+    }
+
+    for (size_t idx = 0; idx < items.size(); idx++) {
+      uint64_t hash = hashes[idx];
+      char fingerprint = Fingerprint(hash);
+      uint64_t bucket1 = hash & (table.buckets - 1);
+      char* slot;
+      uint64_t bucket;
+      s = CuckooFind(&segments, table, bucket1,
+                     AltBucket(bucket1, fingerprint, table), fingerprint,
+                     &slot, &bucket);
+      if (!s.ok()) {
+        return s;
+      }
+      (*exists)[idx] = slot != nullptr;
+    }
+  }
+  return s;
+}
+
+// Only items known to be added may be removed, a false positive removes
+// the fingerprint of another item
+Status RedisFilters::CFDel(const Slice& key,
+                           const std::vector<std::string>& items,
+                           int32_t* ret) {
+  *ret = 0;
+  rocksdb::WriteBatch batch;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+
+  std::string meta_value;
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedFiltersMetaValue parsed_filters_meta_value(&meta_value);
+    if (parsed_filters_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_filters_meta_value.count() == 0) {
+      return Status::NotFound();
+    } else if (parsed_filters_meta_value.kind() != kCuckooFilter) {
+      return WrongKind();
+    }
+
+    CuckooTable table = CuckooTableOf(parsed_filters_meta_value.capacity());
+    FilterSegments segments(db_, handles_[1], default_read_options_, key,
+                            parsed_filters_meta_value.version(), 1);
+    std::vector<uint64_t> hashes;
+    for (const auto& item : items) {
+      uint64_t hash = HashItem(item);
+      uint64_t bucket = hash & (table.buckets - 1);
+      hashes.push_back(hash);
+      segments.Want(CuckooSegmentOf(bucket, table),
+                    table.buckets_per_segment * kBucketSlots);
+      segments.Want(CuckooSegmentOf(AltBucket(bucket, Fingerprint(hash),
+                                              table), table),
+                    table.buckets_per_segment * kBucketSlots);
+    }
+    s = segments.Load();
+    if (!s.ok()) {
+      return s;
+    }
+
+    for (uint64_t hash : hashes) {
+      char fingerprint = Fingerprint(hash);
+      uint64_t bucket1 = hash & (table.buckets - 1);
+      char* slot;
+      uint64_t bucket;
+      s = CuckooFind(&segments, table, bucket1,
+                     AltBucket(bucket1, fingerprint, table), fingerprint,
+                     &slot, &bucket);
+      if (!s.ok()) {
+        return s;
+      } else if (slot != nullptr) {
+        *slot = 0;
+        segments.SetDirty(CuckooSegmentOf(bucket, table));
+        (*ret)++;
+      }
+    }
+
+    if (*ret != 0) {
+      uint64_t filter_items = parsed_filters_meta_value.items();
+      parsed_filters_meta_value.set_items(
+          filter_items > static_cast<uint64_t>(*ret) ? filter_items - *ret : 0);
+      batch.Put(handles_[0], key, meta_value);
+      segments.Flush(&batch);
+      s = db_->Write(default_write_options_, &batch);
+    }
+  }
+  return s;
+}
+
+Status RedisFilters::CFInfo(const Slice& key, FilterInfo* info) {
+  return GetInfo(key, kCuckooFilter, info);
+}
+
+Status RedisFilters::Card(const Slice& key, uint64_t* items) {
+  *items = 0;
+  FilterInfo info;
+  Status s = GetInfo(key, 0, &info);
+  if (s.ok()) {
+    *items = info.items;
+  }
+  return s;
+}
+
+Status RedisFilters::Reserve(const Slice& key, char kind, uint64_t capacity,
+                             double error_rate, int32_t expansion) {
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+  std::string meta_value;
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (!s.ok() && !s.IsNotFound()) {
+    return s;
+  } else if (IsLiveFilter(s, &meta_value)) {
+    return Status::InvalidArgument("item exists");
+  }
+  NewFilterMetaValue(s, kind, capacity, error_rate, expansion, &meta_value);
+  return db_->Put(default_write_options_, handles_[0], key, meta_value);
+}
+
+// A kind of 0 matches both kinds of filters
+Status RedisFilters::GetInfo(const Slice& key, char kind, FilterInfo* info) {
+  std::string meta_value;
+  Status s = GetCachedValue(key, &meta_value);
+  if (s.ok()) {
+    ParsedFiltersMetaValue parsed_filters_meta_value(&meta_value);
+    if (parsed_filters_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_filters_meta_value.count() == 0) {
+      return Status::NotFound();
+    } else if (kind != 0 && parsed_filters_meta_value.kind() != kind) {
+      return WrongKind();
+    }
+    info->items = parsed_filters_meta_value.items();
+    info->filters = parsed_filters_meta_value.count();
+    info->error_rate = parsed_filters_meta_value.error_rate();
+    info->expansion = parsed_filters_meta_value.expansion();
+    info->capacity = 0;
+    info->bytes = 0;
+    if (parsed_filters_meta_value.kind() == kBloomFilter) {
+      for (int32_t idx = 0; idx < info->filters; idx++) {
+        BloomLayer layer = BloomLayerOf(&parsed_filters_meta_value, idx);
+        info->capacity += layer.capacity;
+        info->bytes += layer.segments * layer.segment_bits / 8;
+      }
+    } else {
+      CuckooTable table = CuckooTableOf(parsed_filters_meta_value.capacity());
+      info->capacity = table.buckets * kBucketSlots;
+      info->bytes = table.buckets * kBucketSlots;
+    }
+  }
+  return s;
+}
+
+Status RedisFilters::Expire(const Slice& key, int32_t ttl) {
+  std::string meta_value;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedFiltersMetaValue parsed_filters_meta_value(&meta_value);
+    if (parsed_filters_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_filters_meta_value.count() == 0) {
+      return Status::NotFound();
+    }
+    if (ttl > 0) {
+      parsed_filters_meta_value.SetRelativeTimestamp(ttl);
+    } else {
+      parsed_filters_meta_value.InitialMetaValue();
+    }
+    s = db_->Put(default_write_options_, handles_[0], key, meta_value);
+  }
+  return s;
+}
+
+Status RedisFilters::Del(const Slice& key) {
+  std::string meta_value;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedFiltersMetaValue parsed_filters_meta_value(&meta_value);
+    if (parsed_filters_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_filters_meta_value.count() == 0) {
+      return Status::NotFound();
+    } else {
+      parsed_filters_meta_value.InitialMetaValue();
+      s = db_->Put(default_write_options_, handles_[0], key, meta_value);
+    }
+  }
+  return s;
+}
+
+bool RedisFilters::Scan(const std::string& start_key,
+                        const std::string& pattern,
+                        std::vector<std::string>* keys,
+                        int64_t* count,
+                        std::string* next_key) {
+  std::string meta_key;
+  bool is_finish = true;
+  rocksdb::ReadOptions iterator_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  iterator_options.snapshot = snapshot;
+  iterator_options.fill_cache = false;
+
+  rocksdb::Iterator* it = db_->NewIterator(iterator_options, handles_[0]);
+
+  it->Seek(start_key);
+  while (it->Valid() && (*count) > 0) {
+    ParsedFiltersMetaValue parsed_meta_value(it->value());
+    if (parsed_meta_value.IsStale()
+      || parsed_meta_value.count() == 0) {
+      it->Next();
+      continue;
+    } else {
+      meta_key = it->key().ToString();
+      if (StringMatch(pattern.data(), pattern.size(),
+                         meta_key.data(), meta_key.size(), 0)) {
+        keys->push_back(meta_key);
+      }
+      (*count)--;
+      it->Next();
+    }
+  }
+
+  if (it->Valid()) {
+    *next_key = it->key().ToString();
+    is_finish = false;
+  } else {
+    *next_key = "";
+  }
+  delete it;
+  return is_finish;
+}
+
+Status RedisFilters::Expireat(const Slice& key, int32_t timestamp) {
+  std::string meta_value;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedFiltersMetaValue parsed_filters_meta_value(&meta_value);
+    if (parsed_filters_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_filters_meta_value.count() == 0) {
+      return Status::NotFound();
+    } else {
+      parsed_filters_meta_value.set_timestamp(timestamp);
+      s = db_->Put(default_write_options_, handles_[0], key, meta_value);
+    }
+  }
+  return s;
+}
+
+Status RedisFilters::Persist(const Slice& key) {
+  std::string meta_value;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedFiltersMetaValue parsed_filters_meta_value(&meta_value);
+    if (parsed_filters_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_filters_meta_value.count() == 0) {
+      return Status::NotFound();
+    } else {
+      int32_t timestamp = parsed_filters_meta_value.timestamp();
+      if (timestamp == 0) {
+        return Status::NotFound("Not have an associated timeout");
+      }  else {
+        parsed_filters_meta_value.set_timestamp(0);
+        s = db_->Put(default_write_options_, handles_[0], key, meta_value);
+      }
+    }
+  }
+  return s;
+}
+
+Status RedisFilters::TTL(const Slice& key, int64_t* timestamp) {
+  std::string meta_value;
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedFiltersMetaValue parsed_filters_meta_value(&meta_value);
+    if (parsed_filters_meta_value.IsStale()) {
+      *timestamp = -2;
+      return Status::NotFound("Stale");
+    } else if (parsed_filters_meta_value.count() == 0) {
+      *timestamp = -2;
+      return Status::NotFound();
+    } else {
+      *timestamp = parsed_filters_meta_value.timestamp();
+      if (*timestamp == 0) {
+        *timestamp = -1;
+      } else {
+        int64_t curtime;
+        rocksdb::Env::Default()->GetCurrentTime(&curtime);
+        *timestamp = *timestamp - curtime > 0 ? *timestamp - curtime : -1;
+      }
+    }
+  } else if (s.IsNotFound()) {
+    *timestamp = -2;
+  }
+  return s;
+}
+
+void RedisFilters::ScanDatabase() {
+
+  rocksdb::ReadOptions iterator_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  iterator_options.snapshot = snapshot;
+  iterator_options.fill_cache = false;
+  int32_t current_time = time(NULL);
+
+  printf("\n***************Filters Meta Data***************\n");
+  auto meta_iter = db_->NewIterator(iterator_options, handles_[0]);
+  for (meta_iter->SeekToFirst();
+       meta_iter->Valid();
+       meta_iter->Next()) {
+    ParsedFiltersMetaValue parsed_filters_meta_value(meta_iter->value());
+    int32_t survival_time = 0;
+    if (parsed_filters_meta_value.timestamp() != 0) {
+      survival_time = parsed_filters_meta_value.timestamp() - current_time > 0 ?
+        parsed_filters_meta_value.timestamp() - current_time : -1;
+    }
+
+    printf("[key : %-30s] [kind : %c] [sub filters : %-3d] [items : %-10llu] [capacity : %-10llu] [timestamp : %-10d] [version : %d] [survival_time : %d]\n",
+           meta_iter->key().ToString().c_str(),
+           parsed_filters_meta_value.kind(),
+           parsed_filters_meta_value.count(),
+           static_cast<unsigned long long>(parsed_filters_meta_value.items()),
+           static_cast<unsigned long long>(parsed_filters_meta_value.capacity()),
+           parsed_filters_meta_value.timestamp(),
+           parsed_filters_meta_value.version(),
+           survival_time);
+  }
+  delete meta_iter;
+
+  printf("\n***************Filters Segment Data***************\n");
+  auto segment_iter = db_->NewIterator(iterator_options, handles_[1]);
+  for (segment_iter->SeekToFirst();
+       segment_iter->Valid();
+       segment_iter->Next()) {
+    ParsedFiltersDataKey parsed_filters_data_key(segment_iter->key());
+    printf("[key : %-30s] [sub filter : %-3u] [segment : %-8u] [size : %-5lu] [version : %d]\n",
+           parsed_filters_data_key.key().ToString().c_str(),
+           parsed_filters_data_key.sub_filter(),
+           parsed_filters_data_key.segment(),
+           static_cast<unsigned long>(segment_iter->value().size()),
+           parsed_filters_data_key.version());
+  }
+  delete segment_iter;
+}
+
+}  //  namespace blackwidow
@@ -0,0 +1,78 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_REDIS_FILTERS_H_
+#define SRC_REDIS_FILTERS_H_
+
+#include <string>
+#include <vector>
+
+#include "src/redis.h"
+#include "blackwidow/blackwidow.h"
+
+namespace blackwidow {
+
+// Scalable bloom filters and cuckoo filters split in segments, see
+// filters_meta_value_format.h
+class RedisFilters : public Redis {
+  public:
+    RedisFilters() = default;
+    ~RedisFilters();
+
+    // Common Commands
+    virtual Status Open(const rocksdb::Options& options,
+                        const std::string& db_path) override;
+    virtual Status CompactRange(const rocksdb::Slice* begin,
+                                const rocksdb::Slice* end) override;
+    virtual Status CompactKey(const Slice& key) override;
+    virtual Status GetStaleEntries(uint64_t* stale,
+                                   uint64_t* total) override;
+    virtual Status GetProperty(const std::string& property, std::string* out) override;
+    virtual Status ScanKeyNum(uint64_t* num) override;
+    virtual Status ScanKeys(const std::string& pattern,
+                            std::vector<std::string>* keys) override;
+
+    // Filters Commands
+    Status BFReserve(const Slice& key, double error_rate, uint64_t capacity,
+                     int32_t expansion);
+    Status BFAdd(const Slice& key, const std::vector<std::string>& items,
+                 std::vector<bool>* added);
+    Status BFExists(const Slice& key, const std::vector<std::string>& items,
+                    std::vector<bool>* exists);
+    Status BFInfo(const Slice& key, FilterInfo* info);
+    Status CFReserve(const Slice& key, uint64_t capacity);
+    Status CFAdd(const Slice& key, const std::vector<std::string>& items,
+                 std::vector<bool>* added);
+    Status CFExists(const Slice& key, const std::vector<std::string>& items,
+                    std::vector<bool>* exists);
+    Status CFDel(const Slice& key, const std::vector<std::string>& items,
+                 int32_t* ret);
+    Status CFInfo(const Slice& key, FilterInfo* info);
+    // The number of items added to the filter of any kind stored at key
+    Status Card(const Slice& key, uint64_t* items);
+
+    // Keys Commands
+    virtual Status Expire(const Slice& key, int32_t ttl) override;
+    virtual Status Del(const Slice& key) override;
+    virtual bool Scan(const std::string& start_key, const std::string& pattern,
+                      std::vector<std::string>* keys,
+                      int64_t* count, std::string* next_key) override;
+    virtual Status Expireat(const Slice& key, int32_t timestamp) override;
+    virtual Status Persist(const Slice& key) override;
+    virtual Status TTL(const Slice& key, int64_t* timestamp) override;
+
+    // Iterate all data
+    void ScanDatabase();
+
+  private:
+    std::vector<rocksdb::ColumnFamilyHandle*> handles_;
+
+    Status Reserve(const Slice& key, char kind, uint64_t capacity,
+                   double error_rate, int32_t expansion);
+    Status GetInfo(const Slice& key, char kind, FilterInfo* info);
+};
+
+}  //  namespace blackwidow
+#endif  //  SRC_REDIS_FILTERS_H_
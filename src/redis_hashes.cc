@@ -10,7 +10,9 @@
 #include "blackwidow/util.h"
 #include "src/base_filter.h"
 #include "src/scope_record_lock.h"
+#include "src/scope_iterators.h"
 #include "src/scope_snapshot.h"
+#include "src/stale_entries_collector.h"
 
 namespace blackwidow {
 
@@ -19,6 +21,7 @@ RedisHashes::RedisHashes() {
 }
 
 RedisHashes::~RedisHashes() {
+  iter_pool_.Clear();
   std::vector<rocksdb::ColumnFamilyHandle*> tmp_handles = handles_;
   handles_.clear();
   for (auto handle : tmp_handles) {
@@ -45,6 +48,8 @@ Status RedisHashes::Open(const rocksdb::Options& options,
 
   // Open
   rocksdb::DBOptions db_ops(options);
+  db_ops.listeners.push_back(
+    std::make_shared<IteratorPoolListener>(&iter_pool_));
   rocksdb::ColumnFamilyOptions meta_cf_ops(options);
   rocksdb::ColumnFamilyOptions data_cf_ops(options);
   meta_cf_ops.compaction_filter_factory =
@@ -52,6 +57,11 @@ Status RedisHashes::Open(const rocksdb::Options& options,
   data_cf_ops.compaction_filter_factory =
     std::make_shared<HashesDataFilterFactory>(&db_, &handles_);
 
+  meta_cf_ops.table_properties_collector_factories.push_back(
+    std::make_shared<StaleEntriesCollectorFactory>(kBaseMetaFormat));
+  data_cf_ops.table_properties_collector_factories.push_back(
+    std::make_shared<StaleEntriesCollectorFactory>(kVersionedKeyFormat));
+
   //use the bloom filter policy to reduce disk reads
   rocksdb::BlockBasedTableOptions table_options;
   table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, true));
@@ -79,6 +89,14 @@ Status RedisHashes::CompactRange(const rocksdb::Slice* begin,
       handles_[1], begin, end);
 }
 
+Status RedisHashes::CompactKey(const Slice& key) {
+  return CompactKeyData(key, handles_[1]);
+}
+
+Status RedisHashes::GetStaleEntries(uint64_t* stale, uint64_t* total) {
+  return SumStaleEntries(db_, handles_, stale, total);
+}
+
 Status RedisHashes::GetProperty(const std::string& property, std::string* out) {
   db_->GetProperty(property, out);
   return Status::OK();
@@ -97,6 +115,7 @@ Status RedisHashes::ScanKeyNum(uint64_t* num) {
   for (iter->SeekToFirst();
        iter->Valid();
        iter->Next()) {
+    ThrottleScan(iter->key().size() + iter->value().size());
     ParsedHashesMetaValue parsed_hashes_meta_value(iter->value());
     if (!parsed_hashes_meta_value.IsStale()
       && parsed_hashes_meta_value.count() != 0) {
@@ -122,6 +141,7 @@ Status RedisHashes::ScanKeys(const std::string& pattern,
   for (iter->SeekToFirst();
        iter->Valid();
        iter->Next()) {
+    ThrottleScan(iter->key().size() + iter->value().size());
     ParsedHashesMetaValue parsed_hashes_meta_value(iter->value());
     if (!parsed_hashes_meta_value.IsStale()
       && parsed_hashes_meta_value.count() != 0) {
@@ -149,16 +169,13 @@ Status RedisHashes::HDel(const Slice& key,
   }
 
   rocksdb::WriteBatch batch;
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot;
 
   std::string meta_value;
   int32_t del_cnt = 0;
   int32_t version = 0;
   ScopeRecordLock l(lock_mgr_, key);
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-  Status s = db_->Get(read_options, handles_[0], key, &meta_value);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
     ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
     if (parsed_hashes_meta_value.IsStale()) {
@@ -170,7 +187,7 @@ Status RedisHashes::HDel(const Slice& key,
       int32_t hlen = parsed_hashes_meta_value.count();
       for (const auto& field : filtered_fields) {
         HashesDataKey hashes_data_key(key, version, field);
-        s = db_->Get(read_options, handles_[1],
+        s = db_->Get(default_read_options_, handles_[1],
                 hashes_data_key.Encode(), &data_value);
         if (s.ok()) {
           del_cnt++;
@@ -204,11 +221,9 @@ Status RedisHashes::HGet(const Slice& key, const Slice& field,
                          std::string* value) {
   std::string meta_value;
   int32_t version = 0;
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-  Status s = db_->Get(read_options, handles_[0], key, &meta_value);
+  // The field is looked up under the version of the meta value, so there
+  // is no need to read both of them at the same snapshot
+  Status s = GetCachedValue(key, &meta_value);
   if (s.ok()) {
     ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
     if (parsed_hashes_meta_value.IsStale()) {
@@ -216,7 +231,28 @@ Status RedisHashes::HGet(const Slice& key, const Slice& field,
     } else {
       version = parsed_hashes_meta_value.version();
       HashesDataKey data_key(key, version, field);
-      s = db_->Get(read_options, handles_[1], data_key.Encode(), value);
+      s = db_->Get(default_read_options_, handles_[1], data_key.Encode(), value);
+    }
+  }
+  return s;
+}
+
+Status RedisHashes::HGet(const Slice& key, const Slice& field,
+                         PinnableValue* value) {
+  std::string meta_value;
+  value->Reset();
+  Status s = GetCachedValue(key, &meta_value);
+  if (s.ok()) {
+    ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
+    if (parsed_hashes_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else {
+      HashesDataKey data_key(key, parsed_hashes_meta_value.version(), field);
+      s = db_->Get(default_read_options_, handles_[1],
+                   data_key.Encode(), &value->pinnable_);
+      if (s.ok()) {
+        value->value_ = value->pinnable_;
+      }
     }
   }
   return s;
@@ -224,14 +260,10 @@ Status RedisHashes::HGet(const Slice& key, const Slice& field,
 
 Status RedisHashes::HGetall(const Slice& key,
                             std::vector<FieldValue>* fvs) {
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot;
-
   std::string meta_value;
   int32_t version = 0;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-  Status s = db_->Get(read_options, handles_[0], key, &meta_value);
+  ScopePooledIterators iters(&iter_pool_, db_, handles_[0], handles_[1]);
+  Status s = iters.Get(0, key, &meta_value);
   if (s.ok()) {
     ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
     if (parsed_hashes_meta_value.IsStale()) {
@@ -240,7 +272,7 @@ Status RedisHashes::HGetall(const Slice& key,
       version = parsed_hashes_meta_value.version();
       HashesDataKey hashes_data_key(key, version, "");
       Slice prefix = hashes_data_key.Encode();
-      auto iter = db_->NewIterator(read_options, handles_[1]);
+      rocksdb::Iterator* iter = iters[1];
       for (iter->Seek(prefix);
            iter->Valid() && iter->key().starts_with(prefix);
            iter->Next()) {
@@ -248,7 +280,6 @@ Status RedisHashes::HGetall(const Slice& key,
         fvs->push_back({parsed_hashes_data_key.field().ToString(),
                 iter->value().ToString()});
       }
-      delete iter;
     }
   }
   return s;
@@ -259,6 +290,7 @@ Status RedisHashes::HIncrby(const Slice& key, const Slice& field, int64_t value,
   *ret = 0;
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
 
   int32_t version = 0;
   std::string old_value;
@@ -329,6 +361,7 @@ Status RedisHashes::HIncrbyfloat(const Slice& key, const Slice& field,
   new_value->clear();
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
 
   int32_t version = 0;
   std::string meta_value;
@@ -396,14 +429,10 @@ Status RedisHashes::HIncrbyfloat(const Slice& key, const Slice& field,
 
 Status RedisHashes::HKeys(const Slice& key,
                           std::vector<std::string>* fields) {
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot;
-
   std::string meta_value;
   int32_t version = 0;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-  Status s = db_->Get(read_options, handles_[0], key, &meta_value);
+  ScopePooledIterators iters(&iter_pool_, db_, handles_[0], handles_[1]);
+  Status s = iters.Get(0, key, &meta_value);
   if (s.ok()) {
     ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
     if (parsed_hashes_meta_value.IsStale()) {
@@ -412,14 +441,13 @@ Status RedisHashes::HKeys(const Slice& key,
       version = parsed_hashes_meta_value.version();
       HashesDataKey hashes_data_key(key, version, "");
       Slice prefix = hashes_data_key.Encode();
-      auto iter = db_->NewIterator(read_options, handles_[1]);
+      rocksdb::Iterator* iter = iters[1];
       for (iter->Seek(prefix);
            iter->Valid() && iter->key().starts_with(prefix);
            iter->Next()) {
         ParsedHashesDataKey parsed_hashes_data_key(iter->key());
         fields->push_back(parsed_hashes_data_key.field().ToString());
       }
-      delete iter;
     }
   }
   return s;
@@ -428,7 +456,7 @@ Status RedisHashes::HKeys(const Slice& key,
 Status RedisHashes::HLen(const Slice& key, int32_t* ret) {
   *ret = 0;
   std::string meta_value;
-  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  Status s = GetCachedValue(key, &meta_value);
   if (s.ok()) {
     ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
     if (parsed_hashes_meta_value.IsStale()) {
@@ -451,11 +479,8 @@ Status RedisHashes::HMGet(const Slice& key,
   int32_t version = 0;
   std::string value;
   std::string meta_value;
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-  Status s = db_->Get(read_options, handles_[0], key, &meta_value);
+  ScopeIterators iters(db_, {handles_[0], handles_[1]});
+  Status s = iters.Get(0, key, &meta_value);
   if (s.ok()) {
     ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
     if (parsed_hashes_meta_value.IsStale()) {
@@ -464,8 +489,7 @@ Status RedisHashes::HMGet(const Slice& key,
       version = parsed_hashes_meta_value.version();
       for (const auto& field : fields) {
         HashesDataKey hashes_data_key(key, version, field);
-        s = db_->Get(read_options, handles_[1],
-                hashes_data_key.Encode(), &value);
+        s = iters.Get(1, hashes_data_key.Encode(), &value);
         if (s.ok()) {
           values->push_back(value);
         } else if (s.IsNotFound()) {
@@ -498,6 +522,7 @@ Status RedisHashes::HMSet(const Slice& key,
 
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
 
   int32_t version = 0;
   std::string meta_value;
@@ -551,6 +576,7 @@ Status RedisHashes::HSet(const Slice& key, const Slice& field,
                          const Slice& value, int32_t* res) {
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
 
   int32_t version = 0;
   std::string meta_value;
@@ -605,6 +631,7 @@ Status RedisHashes::HSetnx(const Slice& key, const Slice& field,
                            const Slice& value, int32_t* ret) {
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
 
   int32_t version = 0;
   std::string meta_value;
@@ -653,14 +680,10 @@ Status RedisHashes::HSetnx(const Slice& key, const Slice& field,
 
 Status RedisHashes::HVals(const Slice& key,
                           std::vector<std::string>* values) {
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot;
-
   std::string meta_value;
   int32_t version = 0;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-  Status s = db_->Get(read_options, handles_[0], key, &meta_value);
+  ScopePooledIterators iters(&iter_pool_, db_, handles_[0], handles_[1]);
+  Status s = iters.Get(0, key, &meta_value);
   if (s.ok()) {
     ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
     if (parsed_hashes_meta_value.IsStale()) {
@@ -669,13 +692,12 @@ Status RedisHashes::HVals(const Slice& key,
       version = parsed_hashes_meta_value.version();
       HashesDataKey hashes_data_key(key, version, "");
       Slice prefix = hashes_data_key.Encode();
-      auto iter = db_->NewIterator(read_options, handles_[1]);
+      rocksdb::Iterator* iter = iters[1];
       for (iter->Seek(prefix);
            iter->Valid() && iter->key().starts_with(prefix);
            iter->Next()) {
         values->push_back(iter->value().ToString());
       }
-      delete iter;
     }
   }
   return s;
@@ -704,13 +726,10 @@ Status RedisHashes::HScan(const Slice& key, int64_t cursor, const std::string& p
 
   int64_t rest = count;
   int64_t step_length = count;
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot;
 
   std::string meta_value;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-  Status s = db_->Get(read_options, handles_[0], key, &meta_value);
+  ScopeIterators iters(db_, {handles_[0], handles_[1]});
+  Status s = iters.Get(0, key, &meta_value);
   if (s.ok()) {
     ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
     if (parsed_hashes_meta_value.IsStale()
@@ -727,7 +746,7 @@ Status RedisHashes::HScan(const Slice& key, int64_t cursor, const std::string& p
       HashesDataKey hashes_data_prefix(key, version, Slice());
       HashesDataKey hashes_start_data_key(key, version, start_field);
       std::string prefix = hashes_data_prefix.Encode().ToString();
-      rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[1]);
+      rocksdb::Iterator* iter = iters[1];
       for (iter->Seek(hashes_start_data_key.Encode());
            iter->Valid() && rest > 0 && iter->key().starts_with(prefix);
            iter->Next()) {
@@ -747,7 +766,6 @@ Status RedisHashes::HScan(const Slice& key, int64_t cursor, const std::string& p
       } else {
         *next_cursor = 0;
       }
-      delete iter;
     }
   } else {
     *next_cursor = 0;
@@ -785,6 +803,7 @@ Status RedisHashes::StoreHScanNextField(const Slice& key, const Slice& pattern,
 Status RedisHashes::Expire(const Slice& key, int32_t ttl) {
   std::string meta_value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
     ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
@@ -807,6 +826,7 @@ Status RedisHashes::Expire(const Slice& key, int32_t ttl) {
 Status RedisHashes::Del(const Slice& key) {
   std::string meta_value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
     ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
@@ -868,6 +888,7 @@ bool RedisHashes::Scan(const std::string& start_key,
 Status RedisHashes::Expireat(const Slice& key, int32_t timestamp) {
   std::string meta_value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
     ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
@@ -884,6 +905,7 @@ Status RedisHashes::Expireat(const Slice& key, int32_t timestamp) {
 Status RedisHashes::Persist(const Slice& key) {
   std::string meta_value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
     ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
@@ -25,6 +25,9 @@ class RedisHashes : public Redis {
                         const std::string& db_path) override;
     virtual Status CompactRange(const rocksdb::Slice* begin,
                                 const rocksdb::Slice* end) override;
+    virtual Status CompactKey(const Slice& key) override;
+    virtual Status GetStaleEntries(uint64_t* stale,
+                                   uint64_t* total) override;
     virtual Status GetProperty(const std::string& property, std::string* out) override;
     virtual Status ScanKeyNum(uint64_t* num) override;
     virtual Status ScanKeys(const std::string& pattern,
@@ -35,6 +38,7 @@ class RedisHashes : public Redis {
                 int32_t* ret);
     Status HExists(const Slice& key, const Slice& field);
     Status HGet(const Slice& key, const Slice& field, std::string* value);
+    Status HGet(const Slice& key, const Slice& field, PinnableValue* value);
     Status HGetall(const Slice& key,
                    std::vector<FieldValue>* fvs);
     Status HIncrby(const Slice& key, const Slice& field, int64_t value,
@@ -5,113 +5,643 @@
 
 #include <cmath>
 #include <string>
+#include <string.h>
 #include <algorithm>
+#ifdef __SSE4_2__
+#include <immintrin.h>
+#endif
 #include "src/redis_hyperloglog.h"
+#include "src/coding.h"
 #include "src/blackwidow_murmur3.h"
 
 namespace blackwidow {
 
 const int32_t HLL_HASH_SEED = 313;
+const int32_t HLL_HASH_SEED_HIGH = 0x5bd1e995;
+static const char kHllMagic[] = "HYLL";
 
-HyperLogLog::HyperLogLog(uint8_t precision, std::string origin_register) {
-  b_ = precision;
-  m_ = 1 << precision;
-  alpha_ = Alpha();
-  register_ = new char[m_];
-  for (uint32_t i = 0; i < m_; ++i) {
-    register_[i] = 0;
+static size_t DenseSize(uint32_t m) {
+  // One more byte so that a register never straddles the end
+  return (m * 6 + 7) / 8 + 1;
+}
+
+static uint8_t DenseGet(const uint8_t* p, uint32_t index) {
+  uint32_t byte = index * 6 / 8;
+  uint32_t fb = index * 6 & 7;
+  return ((p[byte] >> fb) | (p[byte + 1] << (8 - fb))) & 63;
+}
+
+static void DenseSet(uint8_t* p, uint32_t index, uint8_t val) {
+  uint32_t byte = index * 6 / 8;
+  uint32_t fb = index * 6 & 7;
+  p[byte] &= ~(63 << fb);
+  p[byte] |= val << fb;
+  p[byte + 1] &= ~(63 >> (8 - fb));
+  p[byte + 1] |= val >> (8 - fb);
+}
+
+// Unpack the 6 bits registers, 4 registers out of every 3 bytes
+static void DenseUnpack(const uint8_t* p, uint32_t m, uint8_t* raw) {
+  for (uint32_t idx = 0; idx < m; idx += 4, p += 3) {
+    raw[idx] = p[0] & 63;
+    raw[idx + 1] = ((p[0] >> 6) | (p[1] << 2)) & 63;
+    raw[idx + 2] = ((p[1] >> 4) | (p[2] << 4)) & 63;
+    raw[idx + 3] = p[2] >> 2;
   }
-  if (origin_register != "") {
-    for (uint32_t i = 0; i < m_; ++i) {
-      register_[i] = origin_register[i];
+}
+
+static void DensePack(const uint8_t* raw, uint32_t m, uint8_t* p) {
+  for (uint32_t idx = 0; idx < m; idx += 4, p += 3) {
+    p[0] = raw[idx] | raw[idx + 1] << 6;
+    p[1] = raw[idx + 1] >> 2 | raw[idx + 2] << 4;
+    p[2] = raw[idx + 2] >> 4 | raw[idx + 3] << 2;
+  }
+}
+
+// A value may have as few as 1 << kMinPrecision registers, so the vector
+// kernels finish whatever is left below their width one register at a time
+void MergeMaxScalar(uint8_t* dst, const uint8_t* src, uint32_t m) {
+  for (uint32_t idx = 0; idx < m; ++idx) {
+    if (dst[idx] < src[idx]) {
+      dst[idx] = src[idx];
     }
   }
 }
 
+#ifdef __SSE4_2__
+void MergeMaxSSE(uint8_t* dst, const uint8_t* src, uint32_t m) {
+  uint32_t idx = 0;
+  for (; idx + 16 <= m; idx += 16) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + idx));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + idx));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + idx),
+                     _mm_max_epu8(a, b));
+  }
+  MergeMaxScalar(dst + idx, src + idx, m - idx);
+}
+
+void MergeMaxAVX2(uint8_t* dst, const uint8_t* src, uint32_t m) {
+  uint32_t idx = MergeMaxAVX2Vectors(dst, src, m);
+  MergeMaxScalar(dst + idx, src + idx, m - idx);
+}
+#endif
+
+typedef void (*MergeMaxFunc)(uint8_t* dst, const uint8_t* src, uint32_t m);
+
+static MergeMaxFunc SelectMergeMax() {
+#ifdef __SSE4_2__
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return MergeMaxAVX2;
+  }
+  return MergeMaxSSE;
+#else
+  return MergeMaxScalar;
+#endif
+}
+
+void MergeMax(uint8_t* dst, const uint8_t* src, uint32_t m) {
+  static const MergeMaxFunc func = SelectMergeMax();
+  func(dst, src, m);
+}
+
+// Count the registers per value, spread over 4 tables so that runs of
+// equal registers do not serialize on the same counter
+static void RawHistogram(const uint8_t* raw, uint32_t m,
+                         uint32_t* hist, uint32_t size) {
+  std::vector<uint32_t> tables(4 * 256, 0);
+  uint32_t* t0 = &tables[0];
+  uint32_t* t1 = t0 + 256;
+  uint32_t* t2 = t1 + 256;
+  uint32_t* t3 = t2 + 256;
+  for (uint32_t idx = 0; idx < m; idx += 4) {
+    t0[raw[idx]]++;
+    t1[raw[idx + 1]]++;
+    t2[raw[idx + 2]]++;
+    t3[raw[idx + 3]]++;
+  }
+  for (uint32_t val = 0; val < 256; ++val) {
+    hist[std::min(val, size - 1)] += t0[val] + t1[val] + t2[val] + t3[val];
+  }
+}
+
+// Map a register of a sketch with 2^from registers to the register it
+// would have been in a sketch with 2^to registers, the index bits above
+// `to` are the lowest bits the rank is counted from in the smaller sketch
+static void FoldRegister(uint32_t from, uint32_t to,
+                         uint32_t* index, uint8_t* rank) {
+  if (from == to) {
+    return;
+  }
+  uint32_t high = *index >> to;
+  *index &= (1 << to) - 1;
+  if (high != 0) {
+    *rank = ::__builtin_ctz(high) + 1;
+  } else {
+    *rank += from - to;
+  }
+}
+
+HyperLogLog::HyperLogLog(uint8_t precision,
+                         const std::string& origin_register)
+    : card_(-1) {
+  valid_ = Decode(precision, origin_register);
+  if (!valid_) {
+    encoding_ = kSparse;
+    card_ = -1;
+    b_ = precision;
+    registers_.clear();
+    entries_.clear();
+  }
+  m_ = 1 << b_;
+}
+
 HyperLogLog::~HyperLogLog() {
-  delete [] register_;
 }
 
-std::string HyperLogLog::Add(const char* value, uint32_t len) {
+bool HyperLogLog::Decode(uint8_t precision,
+                         const std::string& origin_register) {
+  if (origin_register.empty()) {
+    encoding_ = kSparse;
+    b_ = precision;
+    m_ = 1 << b_;
+    return b_ >= kMinPrecision && b_ <= kMaxPrecision;
+  }
+
+  if (origin_register.size() >= kHeaderSize
+    && !memcmp(origin_register.data(), kHllMagic, 4)) {
+    uint8_t encoding = static_cast<uint8_t>(origin_register[4]);
+    b_ = static_cast<uint8_t>(origin_register[5]);
+    if (b_ < kMinPrecision || b_ > kMaxPrecision) {
+      return false;
+    }
+    m_ = 1 << b_;
+    if (origin_register[6] & kCardValid) {
+      card_ = DecodeFixed64(origin_register.data() + 8);
+    }
+    if (encoding == kDense) {
+      if (origin_register.size() != kHeaderSize + DenseSize(m_)) {
+        return false;
+      }
+      encoding_ = kDense;
+      registers_.assign(origin_register, kHeaderSize, std::string::npos);
+      return true;
+    } else if (encoding == kSparse) {
+      encoding_ = kSparse;
+      return DecodeSparse(origin_register.data() + kHeaderSize,
+                          origin_register.size() - kHeaderSize);
+    }
+    return false;
+  }
+
+  // Registers are never larger than the magic bytes, so a value of
+  // exactly this size without the magic was written by an older version
+  if (origin_register.size() == (1 << kLegacyPrecision)) {
+    encoding_ = kLegacy;
+    b_ = kLegacyPrecision;
+    m_ = 1 << b_;
+    registers_ = origin_register;
+    return true;
+  }
+  return false;
+}
+
+// Call visit(index, rank, run) for every VAL opcode of a sparse payload
+template <typename Visitor>
+static bool WalkSparse(const char* data, size_t size, uint32_t m,
+                       Visitor visit) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+  const uint8_t* end = p + size;
+  uint32_t index = 0;
+  while (p < end) {
+    uint8_t op = *p;
+    if ((op & 0xc0) == 0) {
+      // ZERO: 00xxxxxx
+      index += (op & 0x3f) + 1;
+      p++;
+    } else if ((op & 0xc0) == 0x40) {
+      // XZERO: 01xxxxxx yyyyyyyy
+      if (p + 1 >= end) {
+        return false;
+      }
+      index += (((op & 0x3f) << 8) | p[1]) + 1;
+      p += 2;
+    } else {
+      // VAL: 1vvvvvxx
+      uint8_t rank = ((op >> 2) & 0x1f) + 1;
+      uint32_t run = (op & 0x3) + 1;
+      if (index + run > m) {
+        return false;
+      }
+      visit(index, rank, run);
+      index += run;
+      p++;
+    }
+    if (index > m) {
+      return false;
+    }
+  }
+  return index == m;
+}
+
+bool HyperLogLog::DecodeSparse(const char* data, size_t size) {
+  return WalkSparse(data, size, m_,
+      [this](uint32_t index, uint8_t rank, uint32_t run) {
+        for (uint32_t idx = 0; idx < run; ++idx) {
+          entries_.push_back((index + idx) << 8 | rank);
+        }
+      });
+}
+
+static void AppendSparseZeros(uint32_t len, std::string* payload) {
+  while (len > 0) {
+    uint32_t run = std::min(len, static_cast<uint32_t>(16384));
+    if (run > 64) {
+      payload->push_back(static_cast<char>(0x40 | ((run - 1) >> 8)));
+      payload->push_back(static_cast<char>((run - 1) & 0xff));
+    } else {
+      payload->push_back(static_cast<char>(run - 1));
+    }
+    len -= run;
+  }
+}
+
+void HyperLogLog::EncodeSparse(std::string* payload) const {
+  uint32_t index = 0;
+  size_t pos = 0;
+  while (pos < entries_.size()) {
+    uint32_t next = entries_[pos] >> 8;
+    uint8_t rank = entries_[pos] & 0xff;
+    AppendSparseZeros(next - index, payload);
+    uint32_t run = 1;
+    while (run < kSparseValRunMax
+      && pos + run < entries_.size()
+      && entries_[pos + run] == ((next + run) << 8 | rank)) {
+      run++;
+    }
+    payload->push_back(static_cast<char>(0x80 | (rank - 1) << 2 | (run - 1)));
+    index = next + run;
+    pos += run;
+  }
+  AppendSparseZeros(m_ - index, payload);
+}
+
+std::string HyperLogLog::Encode() const {
+  if (encoding_ == kLegacy) {
+    return registers_;
+  }
+
+  std::string value(kHeaderSize, 0);
+  memcpy(&value[0], kHllMagic, 4);
+  value[5] = static_cast<char>(b_);
+  if (card_ >= 0) {
+    value[6] = kCardValid;
+    EncodeFixed64(&value[8], card_);
+  }
+  if (encoding_ == kSparse) {
+    std::string payload;
+    EncodeSparse(&payload);
+    if (payload.size() <= kSparseMaxBytes) {
+      value[4] = kSparse;
+      value.append(payload);
+      return value;
+    }
+    // Too many distinct registers to stay sparse
+    std::string dense(DenseSize(m_), 0);
+    uint8_t* p = reinterpret_cast<uint8_t*>(&dense[0]);
+    for (const auto& entry : entries_) {
+      DenseSet(p, entry >> 8, entry & 0xff);
+    }
+    value[4] = kDense;
+    value.append(dense);
+    return value;
+  }
+  value[4] = kDense;
+  if (encoding_ == kRaw) {
+    std::string dense(DenseSize(m_), 0);
+    DensePack(reinterpret_cast<const uint8_t*>(registers_.data()), m_,
+              reinterpret_cast<uint8_t*>(&dense[0]));
+    value.append(dense);
+  } else {
+    value.append(registers_);
+  }
+  return value;
+}
+
+uint8_t HyperLogLog::GetRegister(uint32_t index) const {
+  if (encoding_ == kLegacy || encoding_ == kRaw) {
+    return static_cast<uint8_t>(registers_[index]);
+  } else if (encoding_ == kDense) {
+    return DenseGet(reinterpret_cast<const uint8_t*>(registers_.data()),
+                    index);
+  }
+  auto iter = std::lower_bound(entries_.begin(), entries_.end(), index << 8);
+  if (iter != entries_.end() && (*iter >> 8) == index) {
+    return *iter & 0xff;
+  }
+  return 0;
+}
+
+bool HyperLogLog::SetRegisterMax(uint32_t index, uint8_t rank) {
+  if (encoding_ == kLegacy || encoding_ == kRaw) {
+    if (rank > static_cast<uint8_t>(registers_[index])) {
+      registers_[index] = static_cast<char>(rank);
+      return true;
+    }
+    return false;
+  } else if (encoding_ == kDense) {
+    uint8_t* p = reinterpret_cast<uint8_t*>(&registers_[0]);
+    if (rank > DenseGet(p, index)) {
+      DenseSet(p, index, rank);
+      return true;
+    }
+    return false;
+  }
+
+  if (rank > kSparseValMax) {
+    ToDense();
+    return SetRegisterMax(index, rank);
+  }
+  auto iter = std::lower_bound(entries_.begin(), entries_.end(), index << 8);
+  if (iter != entries_.end() && (*iter >> 8) == index) {
+    if (rank > (*iter & 0xff)) {
+      *iter = index << 8 | rank;
+      return true;
+    }
+    return false;
+  }
+  if (entries_.size() >= kSparseMaxEntries) {
+    ToDense();
+    return SetRegisterMax(index, rank);
+  }
+  entries_.insert(iter, index << 8 | rank);
+  return true;
+}
+
+void HyperLogLog::ToDense() {
+  if (encoding_ != kSparse) {
+    return;
+  }
+  registers_.assign(DenseSize(m_), 0);
+  uint8_t* p = reinterpret_cast<uint8_t*>(&registers_[0]);
+  for (const auto& entry : entries_) {
+    DenseSet(p, entry >> 8, entry & 0xff);
+  }
+  std::vector<uint32_t>().swap(entries_);
+  encoding_ = kDense;
+}
+
+void HyperLogLog::ToRaw() {
+  if (encoding_ == kLegacy || encoding_ == kRaw) {
+    return;
+  }
+  std::string raw(m_, 0);
+  uint8_t* p = reinterpret_cast<uint8_t*>(&raw[0]);
+  if (encoding_ == kDense) {
+    DenseUnpack(reinterpret_cast<const uint8_t*>(registers_.data()), m_, p);
+  } else {
+    for (const auto& entry : entries_) {
+      p[entry >> 8] = entry & 0xff;
+    }
+    std::vector<uint32_t>().swap(entries_);
+  }
+  registers_.swap(raw);
+  encoding_ = kRaw;
+}
+
+void HyperLogLog::NonZeroRegisters(std::vector<uint32_t>* entries) const {
+  if (encoding_ == kSparse) {
+    *entries = entries_;
+    return;
+  }
+  entries->clear();
+  for (uint32_t idx = 0; idx < m_; ++idx) {
+    uint8_t rank = GetRegister(idx);
+    if (rank != 0) {
+      entries->push_back(idx << 8 | rank);
+    }
+  }
+}
+
+// Shrink the sketch to 2^precision registers, a legacy sketch is switched
+// to the current hash layout on the way
+void HyperLogLog::Fold(uint8_t precision) {
+  card_ = -1;
+  std::vector<uint32_t> entries;
+  NonZeroRegisters(&entries);
+  uint32_t from = b_;
+  b_ = precision;
+  m_ = 1 << b_;
+  encoding_ = kSparse;
+  registers_.clear();
+  entries_.clear();
+  for (const auto& entry : entries) {
+    uint32_t index = entry >> 8;
+    uint8_t rank = entry & 0xff;
+    FoldRegister(from, b_, &index, &rank);
+    SetRegisterMax(index, rank);
+  }
+}
+
+bool HyperLogLog::Add(const char* value, uint32_t len) {
   uint32_t hash_value;
   MurmurHash3_x86_32(value, len, HLL_HASH_SEED,
                      static_cast<void *>(&hash_value));
-  int32_t index = hash_value & ((1 << b_) - 1);
-  uint8_t rank = Nclz((hash_value << b_), 32 - b_);
-  if (rank > register_[index])
-    register_[index] = rank;
-  std::string result(m_, 0);
-  for (uint32_t i = 0; i < m_; ++i) {
-    result[i] = register_[i];
+  uint32_t index = hash_value & (m_ - 1);
+  uint8_t rank;
+  if (encoding_ == kLegacy) {
+    rank = Nclz((hash_value << b_), 32 - b_);
+  } else {
+    // The rank is counted from the hash bits above the index, take them
+    // from a second hash so that there are enough of them
+    uint32_t high_value;
+    MurmurHash3_x86_32(value, len, HLL_HASH_SEED_HIGH,
+                       static_cast<void *>(&high_value));
+    uint64_t hash = static_cast<uint64_t>(high_value) << 32 | hash_value;
+    hash >>= b_;
+    hash |= 1ULL << (64 - b_);
+    rank = ::__builtin_ctzll(hash) + 1;
   }
-  return result;
+  if (!SetRegisterMax(index, rank)) {
+    return false;
+  }
+  card_ = -1;
+  return true;
 }
 
-double HyperLogLog::Estimate() const {
-  double estimate = FirstEstimate();
-  if (estimate <= 2.5 * m_) {
-    uint32_t zeros = CountZero();
-    if (zeros != 0) {
-      estimate = m_ * log(static_cast<double>(m_) / zeros);
+void HyperLogLog::Histogram(std::vector<uint32_t>* hist) const {
+  hist->assign(kRegisterMax + 1, 0);
+  if (encoding_ == kSparse) {
+    (*hist)[0] = m_ - entries_.size();
+    for (const auto& entry : entries_) {
+      (*hist)[entry & 0xff]++;
     }
-  } else if (estimate > pow(2, 32) / 30.0) {
-    estimate = log1p(estimate * -1 / pow(2, 32)) * pow(2, 32) * -1;
+  } else if (encoding_ == kDense) {
+    std::string raw(m_, 0);
+    DenseUnpack(reinterpret_cast<const uint8_t*>(registers_.data()), m_,
+                reinterpret_cast<uint8_t*>(&raw[0]));
+    RawHistogram(reinterpret_cast<const uint8_t*>(raw.data()), m_,
+                 &(*hist)[0], hist->size());
+  } else {
+    RawHistogram(reinterpret_cast<const uint8_t*>(registers_.data()), m_,
+                 &(*hist)[0], hist->size());
   }
-  return estimate;
 }
 
-double HyperLogLog::FirstEstimate() const {
-  double estimate, sum = 0.0;
-  for (uint32_t i = 0; i < m_; i++) {
-    sum += 1.0 / (1 << register_[i]);
+static double Sigma(double x) {
+  if (x == 1.0) {
+    return INFINITY;
   }
+  double z_prime;
+  double y = 1;
+  double z = x;
+  do {
+    x *= x;
+    z_prime = z;
+    z += x * y;
+    y += y;
+  } while (z_prime != z);
+  return z;
+}
 
-  estimate = alpha_ * m_ * m_ / sum;
-  return estimate;
+static double Tau(double x) {
+  if (x == 0.0 || x == 1.0) {
+    return 0.0;
+  }
+  double z_prime;
+  double y = 1.0;
+  double z = 1 - x;
+  do {
+    x = sqrt(x);
+    z_prime = z;
+    y *= 0.5;
+    z -= pow(1 - x, 2) * y;
+  } while (z_prime != z);
+  return z / 3;
 }
 
-double HyperLogLog::Alpha() const {
-  switch (m_) {
-    case 16:
-      return 0.673;
-    case 32:
-      return 0.697;
-    case 64:
-      return 0.709;
-    default:
-      return 0.7213 / (1 + 1.079 / m_);
-    }
+// The improved estimator of Otmar Ertl, "New cardinality estimation
+// algorithms for HyperLogLog sketches", it only needs the histogram of the
+// registers and needs neither the linear counting nor the bias correction
+double HyperLogLog::Estimate() const {
+  std::vector<uint32_t> hist;
+  Histogram(&hist);
+  // Ranks go from 1 to q + 1, q being the hash bits above the index
+  uint32_t q = (encoding_ == kLegacy ? 32 : 64) - b_;
+  double m = m_;
+  double z = m * Tau((m - hist[q + 1]) / m);
+  for (uint32_t rank = q; rank >= 1; --rank) {
+    z += hist[rank];
+    z *= 0.5;
+  }
+  z += m * Sigma(hist[0] / m);
+  return 0.5 / log(2) * m * m / z;
 }
 
-uint32_t HyperLogLog::CountZero() const {
-  uint32_t count = 0;
-  for (uint32_t i = 0; i < m_; i++) {
-    if (register_[i] == 0) {
-      count++;
-    }
+int64_t HyperLogLog::Count() {
+  if (card_ < 0) {
+    card_ = static_cast<int64_t>(Estimate());
+  }
+  return card_;
+}
+
+bool HyperLogLog::CachedCount(const std::string& value, int64_t* card) {
+  if (value.size() < kHeaderSize
+    || memcmp(value.data(), kHllMagic, 4)
+    || !(value[6] & kCardValid)) {
+    return false;
   }
-  return count;
+  *card = DecodeFixed64(value.data() + 8);
+  return true;
 }
 
-std::string HyperLogLog::Merge(const HyperLogLog & hll) {
-  if (m_ != hll.m_) {
-    // TODO(shq) the number of registers doesn't match
+void HyperLogLog::Merge(const HyperLogLog& hll) {
+  if (!hll.valid_) {
+    return;
+  }
+  card_ = -1;
+  if (encoding_ == kSparse && entries_.empty()
+    && hll.encoding_ == kLegacy) {
+    // Keep merging legacy values exactly
+    encoding_ = kLegacy;
+    b_ = hll.b_;
+    m_ = hll.m_;
+    registers_ = hll.registers_;
+    return;
+  }
+  // Registers of the two hash layouts can only be combined approximately,
+  // the result always uses the current layout
+  bool mixed = (encoding_ == kLegacy) != (hll.encoding_ == kLegacy);
+  uint8_t precision = std::min(b_, hll.b_);
+  if (precision < b_ || (mixed && encoding_ == kLegacy)) {
+    Fold(precision);
   }
-  for (uint32_t r = 0; r < m_; r++) {
-    if (register_[r] < hll.register_[r]) {
-      register_[r] |= hll.register_[r];
+  if (hll.encoding_ != kSparse) {
+    ToRaw();
+    if (hll.b_ == b_ && !mixed) {
+      uint8_t* dst = reinterpret_cast<uint8_t*>(&registers_[0]);
+      const uint8_t* src = reinterpret_cast<const uint8_t*>(
+          hll.registers_.data());
+      if (hll.encoding_ == kDense) {
+        std::string raw(m_, 0);
+        DenseUnpack(src, m_, reinterpret_cast<uint8_t*>(&raw[0]));
+        MergeMax(dst, reinterpret_cast<const uint8_t*>(raw.data()), m_);
+      } else {
+        MergeMax(dst, src, m_);
+      }
+      return;
     }
   }
 
-  std::string result(m_, 0);
-  for (uint32_t i = 0; i < m_; ++i) {
-    result[i] = register_[i];
+  std::vector<uint32_t> entries;
+  hll.NonZeroRegisters(&entries);
+  for (const auto& entry : entries) {
+    uint32_t index = entry >> 8;
+    uint8_t rank = entry & 0xff;
+    FoldRegister(hll.b_, b_, &index, &rank);
+    SetRegisterMax(index, rank);
   }
-  return result;
+}
+
+bool HyperLogLog::Merge(const char* value, size_t size) {
+  if (encoding_ != kLegacy
+    && size >= kHeaderSize
+    && !memcmp(value, kHllMagic, 4)
+    && static_cast<uint8_t>(value[5]) == b_) {
+    uint8_t encoding = static_cast<uint8_t>(value[4]);
+    if (encoding == kDense && size == kHeaderSize + DenseSize(m_)) {
+      card_ = -1;
+      ToRaw();
+      scratch_.resize(m_);
+      uint8_t* raw = reinterpret_cast<uint8_t*>(&scratch_[0]);
+      DenseUnpack(reinterpret_cast<const uint8_t*>(value + kHeaderSize),
+                  m_, raw);
+      MergeMax(reinterpret_cast<uint8_t*>(&registers_[0]), raw, m_);
+      return true;
+    } else if (encoding == kSparse) {
+      card_ = -1;
+      return WalkSparse(value + kHeaderSize, size - kHeaderSize, m_,
+          [this](uint32_t index, uint8_t rank, uint32_t run) {
+            for (uint32_t idx = 0; idx < run; ++idx) {
+              SetRegisterMax(index + idx, rank);
+            }
+          });
+    }
+  }
+
+  HyperLogLog hll(b_, std::string(value, size));
+  if (!hll.Valid()) {
+    return false;
+  }
+  Merge(hll);
+  return true;
 }
 
 // ::__builtin_clz(x): 返回左起第一个‘1’之前0的个数
 uint8_t HyperLogLog::Nclz(uint32_t x, int b) {
+  if (x == 0) {
+    return static_cast<uint8_t>(b) + 1;
+  }
   return (uint8_t)std::min(b, ::__builtin_clz(x)) + 1;
 }
 
@@ -6,33 +6,114 @@
 #ifndef SRC_REDIS_HYPERLOGLOG_H_
 #define SRC_REDIS_HYPERLOGLOG_H_
 
-#include <iostream>
+#include <stdint.h>
+
 #include <string>
+#include <vector>
 
 namespace blackwidow {
 
+// Register max-merge kernels, dst[i] = max(dst[i], src[i]) over m registers
+// of one byte. MergeMax runs the fastest one the cpu supports.
+void MergeMax(uint8_t* dst, const uint8_t* src, uint32_t m);
+void MergeMaxScalar(uint8_t* dst, const uint8_t* src, uint32_t m);
+#ifdef __SSE4_2__
+void MergeMaxSSE(uint8_t* dst, const uint8_t* src, uint32_t m);
+// Only once __builtin_cpu_supports("avx2") said so
+void MergeMaxAVX2(uint8_t* dst, const uint8_t* src, uint32_t m);
+// Built with -mavx2 in redis_hyperloglog_avx2.cc, merges the registers of
+// the whole vectors and returns how many
+uint32_t MergeMaxAVX2Vectors(uint8_t* dst, const uint8_t* src, uint32_t m);
+#endif
+
+// HyperLogLog value layout, mostly borrowed from redis:
+//
+// | magic "HYLL" | encoding | precision | flags | unused | card | registers |
+//       4 Bytes     1 Byte     1 Byte    1 Byte  1 Byte  8 Bytes
+//
+// card caches the last estimated cardinality, it is only valid while the
+// kCardValid flag is set and any change of the registers drops it.
+//
+// The dense encoding packs every register in 6 bits, the sparse encoding
+// run-length encodes the registers with the ZERO / XZERO / VAL opcodes of
+// redis, new values start sparse and are promoted to dense once they grow.
+//
+// Values written by older versions are the 1 << 17 registers stored one
+// per byte with a different hash layout, they are still read, updated and
+// written back in that legacy encoding.
 class HyperLogLog {
  public:
-  HyperLogLog(uint8_t precision, std::string origin_resiter);
+  HyperLogLog(uint8_t precision, const std::string& origin_register);
   ~HyperLogLog();
 
+  bool Valid() const { return valid_; }
+  bool IsSparse() const { return encoding_ == kSparse; }
+  uint8_t Precision() const { return b_; }
+
   double Estimate() const;
-  double FirstEstimate() const;
-  uint32_t CountZero() const;
-  double Alpha() const;
+  // The cached cardinality, estimated and cached if there is none
+  int64_t Count();
+  // Read the cached cardinality of a stored value without decoding it
+  static bool CachedCount(const std::string& value, int64_t* card);
   uint8_t Nclz(uint32_t x, int b);
 
-  std::string Add(const char* str, uint32_t len);
-  std::string Merge(const HyperLogLog& hll);
+  // Return true if one of the registers changed
+  bool Add(const char* str, uint32_t len);
+  void Merge(const HyperLogLog& hll);
+  // Merge a stored value straight from its encoding, return false if it is
+  // not a valid value
+  bool Merge(const char* value, size_t size);
+  std::string Encode() const;
 
  protected:
-  uint32_t m_;  // register bit width
-  uint32_t b_;  // regieter size
-  double alpha_;
-  char* register_;  // register;
+  enum Encoding {
+    kDense = 0,
+    kSparse = 1,
+    kLegacy = 2,
+    // One byte per register, only used in memory for merging
+    kRaw = 3
+  };
+
+  enum {
+    kHeaderSize = 16,
+    kCardValid = 1,
+    kLegacyPrecision = 17,
+    kMinPrecision = 4,
+    kMaxPrecision = 18,
+    kRegisterBits = 6,
+    kRegisterMax = (1 << kRegisterBits) - 1,
+    kSparseValMax = 32,
+    kSparseValRunMax = 4,
+    kSparseZeroRunMax = 64,
+    kSparseXZeroRunMax = 16384,
+    kSparseMaxEntries = 1024,
+    kSparseMaxBytes = 3000
+  };
+
+  bool Decode(uint8_t precision, const std::string& origin_register);
+  bool DecodeSparse(const char* data, size_t size);
+
+  uint8_t GetRegister(uint32_t index) const;
+  bool SetRegisterMax(uint32_t index, uint8_t rank);
+  void ToDense();
+  void ToRaw();
+  void Fold(uint8_t precision);
+  void NonZeroRegisters(std::vector<uint32_t>* entries) const;
+  void Histogram(std::vector<uint32_t>* hist) const;
+  void EncodeSparse(std::string* payload) const;
+
+  bool valid_;
+  Encoding encoding_;
+  int64_t card_;  // -1 if unknown
+  uint32_t m_;  // register count
+  uint32_t b_;  // register bit width
+  std::string registers_;  // dense, legacy or raw registers
+  // sparse registers, (index << 8 | rank) sorted by index
+  std::vector<uint32_t> entries_;
+  // Unpacked registers of the value being merged
+  std::string scratch_;
 };
 
 }  // namespace blackwidow
 
 #endif  // SRC_REDIS_HYPERLOGLOG_H_
-
@@ -0,0 +1,34 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+// Built with -mavx2, keep it to the vector loops so that nothing compiled
+// here is shared with the code which runs on any cpu
+
+#include "src/redis_hyperloglog.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace blackwidow {
+
+#ifdef __SSE4_2__
+uint32_t MergeMaxAVX2Vectors(uint8_t* dst, const uint8_t* src, uint32_t m) {
+  uint32_t idx = 0;
+#ifdef __AVX2__
+  for (; idx + 32 <= m; idx += 32) {
+    __m256i a = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(dst + idx));
+    __m256i b = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(src + idx));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + idx),
+                        _mm256_max_epu8(a, b));
+  }
+#endif
+  return idx;
+}
+#endif
+
+}  //  namespace blackwidow
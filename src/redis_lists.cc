@@ -4,13 +4,16 @@
 //  of patent rights can be found in the PATENTS file in the same directory.
 
 
+#include <limits>
 #include <memory>
 
 #include "blackwidow/util.h"
 #include "src/redis_lists.h"
 #include "src/lists_filter.h"
 #include "src/scope_record_lock.h"
+#include "src/scope_iterators.h"
 #include "src/scope_snapshot.h"
+#include "src/stale_entries_collector.h"
 
 namespace blackwidow {
 
@@ -55,6 +58,11 @@ Status RedisLists::Open(const rocksdb::Options& options,
     std::make_shared<ListsDataFilterFactory>(&db_, &handles_);
   data_cf_ops.comparator = ListsDataKeyComparator();
 
+  meta_cf_ops.table_properties_collector_factories.push_back(
+    std::make_shared<StaleEntriesCollectorFactory>(kListsMetaFormat));
+  data_cf_ops.table_properties_collector_factories.push_back(
+    std::make_shared<StaleEntriesCollectorFactory>(kVersionedKeyFormat));
+
   //use the bloom filter policy to reduce disk reads
   rocksdb::BlockBasedTableOptions table_options;
   table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, true));
@@ -82,6 +90,27 @@ Status RedisLists::CompactRange(const rocksdb::Slice* begin,
       handles_[1], begin, end);
 }
 
+Status RedisLists::CompactKey(const Slice& key) {
+  Status s = db_->CompactRange(default_compact_range_options_,
+      handles_[0], &key, &key);
+  if (!s.ok()) {
+    return s;
+  }
+  // The data keys are ordered by version and index, every version of key
+  // lies between these two
+  ListsDataKey start_key(key, std::numeric_limits<int32_t>::min(), 0);
+  ListsDataKey end_key(key, std::numeric_limits<int32_t>::max(),
+                       std::numeric_limits<uint64_t>::max());
+  Slice begin = start_key.Encode();
+  Slice end = end_key.Encode();
+  return db_->CompactRange(default_compact_range_options_,
+      handles_[1], &begin, &end);
+}
+
+Status RedisLists::GetStaleEntries(uint64_t* stale, uint64_t* total) {
+  return SumStaleEntries(db_, handles_, stale, total);
+}
+
 Status RedisLists::GetProperty(const std::string& property, std::string* out) {
   db_->GetProperty(property, out);
   return Status::OK();
@@ -100,6 +129,7 @@ Status RedisLists::ScanKeyNum(uint64_t* num) {
   for (iter->SeekToFirst();
        iter->Valid();
        iter->Next()) {
+    ThrottleScan(iter->key().size() + iter->value().size());
     ParsedListsMetaValue parsed_lists_meta_value(iter->value());
     if (!parsed_lists_meta_value.IsStale()
       && parsed_lists_meta_value.count() != 0) {
@@ -124,6 +154,7 @@ Status RedisLists::ScanKeys(const std::string& pattern,
   for (iter->SeekToFirst();
        iter->Valid();
        iter->Next()) {
+    ThrottleScan(iter->key().size() + iter->value().size());
     ParsedListsMetaValue parsed_lists_meta_value(iter->value());
     if (!parsed_lists_meta_value.IsStale()
       && parsed_lists_meta_value.count() != 0) {
@@ -138,40 +169,73 @@ Status RedisLists::ScanKeys(const std::string& pattern,
 }
 
 Status RedisLists::LIndex(const Slice& key, int64_t index, std::string* element) {
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot;
+  PinnableValue pinnable_element;
+  Status s = LIndex(key, index, &pinnable_element);
+  if (s.ok()) {
+    element->assign(pinnable_element.data(), pinnable_element.size());
+  }
+  return s;
+}
 
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
+Status RedisLists::LIndex(const Slice& key, int64_t index,
+                          PinnableValue* element) {
   std::string meta_value;
-  Status s = db_->Get(read_options, handles_[0], key, &meta_value);
+  element->Reset();
+  Status s = GetCachedValue(key, &meta_value);
   if (s.ok()) {
-    ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
-    int32_t version = parsed_lists_meta_value.version();
-    if (parsed_lists_meta_value.IsStale()) {
-      return Status::NotFound("Stale");
-    } else if (parsed_lists_meta_value.count() == 0) {
-      return Status::NotFound();
-    } else {
-      std::string tmp_element;
-      uint64_t target_index = index >= 0 ?
-            parsed_lists_meta_value.left_index() + index + 1 :
-            parsed_lists_meta_value.right_index() + index;
-      if (parsed_lists_meta_value.left_index() < target_index
-        && target_index < parsed_lists_meta_value.right_index()) {
-        ListsDataKey lists_data_key(key, version, target_index);
-        s = db_->Get(read_options, handles_[1], lists_data_key.Encode(), &tmp_element);
-        if (s.ok()) {
-          *element = tmp_element;
-        }
-      } else {
-        return Status::NotFound();
+    s = GetElement(default_read_options_, key, index, &meta_value,
+                   &element->pinnable_);
+    if (s.IsIncomplete()) {
+      // The element was popped after the meta value had been read, read
+      // both of them again at the same snapshot
+      rocksdb::ReadOptions read_options;
+      const rocksdb::Snapshot* snapshot;
+      ScopeSnapshot ss(db_, &snapshot);
+      read_options.snapshot = snapshot;
+      s = db_->Get(read_options, handles_[0], key, &meta_value);
+      if (s.ok()) {
+        s = GetElement(read_options, key, index, &meta_value,
+                       &element->pinnable_);
       }
     }
   }
+  if (s.ok()) {
+    element->value_ = element->pinnable_;
+  }
   return s;
 }
 
+// Returns Status::Incomplete() if the index is within the bounds of the
+// meta value but the element is missing
+Status RedisLists::GetElement(const rocksdb::ReadOptions& read_options,
+                              const Slice& key, int64_t index,
+                              std::string* meta_value,
+                              rocksdb::PinnableSlice* element) {
+  ParsedListsMetaValue parsed_lists_meta_value(meta_value);
+  int32_t version = parsed_lists_meta_value.version();
+  if (parsed_lists_meta_value.IsStale()) {
+    return Status::NotFound("Stale");
+  } else if (parsed_lists_meta_value.count() == 0) {
+    return Status::NotFound();
+  } else {
+    uint64_t target_index = index >= 0 ?
+          parsed_lists_meta_value.left_index() + index + 1 :
+          parsed_lists_meta_value.right_index() + index;
+    if (parsed_lists_meta_value.left_index() < target_index
+      && target_index < parsed_lists_meta_value.right_index()) {
+      ListsDataKey lists_data_key(key, version, target_index);
+      element->Reset();
+      Status s = db_->Get(read_options, handles_[1], lists_data_key.Encode(), element);
+      if (s.IsNotFound()) {
+        return Status::Incomplete("Element missing");
+      }
+      return s;
+    } else {
+      return Status::NotFound();
+    }
+  }
+}
+
 Status RedisLists::LInsert(const Slice& key,
                            const BeforeOrAfter& before_or_after,
                            const std::string& pivot,
@@ -180,6 +244,7 @@ Status RedisLists::LInsert(const Slice& key,
   *ret = 0;
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   std::string meta_value;
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
@@ -279,7 +344,7 @@ Status RedisLists::LInsert(const Slice& key,
 Status RedisLists::LLen(const Slice& key, uint64_t* len) {
   *len = 0;
   std::string meta_value;
-  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  Status s = GetCachedValue(key, &meta_value);
   if (s.ok()) {
     ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
     if (parsed_lists_meta_value.IsStale()) {
@@ -299,6 +364,7 @@ Status RedisLists::LLen(const Slice& key, uint64_t* len) {
 Status RedisLists::LPop(const Slice& key, std::string* element) {
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   std::string meta_value;
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
@@ -332,6 +398,7 @@ Status RedisLists::LPush(const Slice& key,
   *ret = 0;
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
 
   uint64_t index = 0;
   int32_t version = 0;
@@ -376,6 +443,7 @@ Status RedisLists::LPushx(const Slice& key, const Slice& value, uint64_t* len) {
   *len = 0;
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
 
   std::string meta_value;
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
@@ -402,14 +470,9 @@ Status RedisLists::LPushx(const Slice& key, const Slice& value, uint64_t* len) {
 
 Status RedisLists::LRange(const Slice& key, int64_t start, int64_t stop,
                           std::vector<std::string>* ret) {
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot;
-
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-
   std::string meta_value;
-  Status s = db_->Get(read_options, handles_[0], key, &meta_value);
+  ScopeIterators iters(db_, {handles_[0], handles_[1]});
+  Status s = iters.Get(0, key, &meta_value);
   if (s.ok()) {
     ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
     if (parsed_lists_meta_value.IsStale()) {
@@ -438,8 +501,7 @@ Status RedisLists::LRange(const Slice& key, int64_t start, int64_t stop,
         if (sublist_right_index > origin_right_index) {
           sublist_right_index = origin_right_index;
         }
-        rocksdb::Iterator* iter = db_->NewIterator(read_options,
-                handles_[1]);
+        rocksdb::Iterator* iter = iters[1];
         uint64_t current_index = sublist_left_index;
         ListsDataKey start_data_key(key, version, current_index);
         for (iter->Seek(start_data_key.Encode());
@@ -447,7 +509,6 @@ Status RedisLists::LRange(const Slice& key, int64_t start, int64_t stop,
              iter->Next(), current_index++) {
           ret->push_back(iter->value().ToString());
         }
-        delete iter;
         return Status::OK();
       }
     }
@@ -461,6 +522,7 @@ Status RedisLists::LRem(const Slice& key, int64_t count,
   *ret = 0;
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   std::string meta_value;
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
@@ -580,6 +642,7 @@ Status RedisLists::LRem(const Slice& key, int64_t count,
 
 Status RedisLists::LSet(const Slice& key, int64_t index, const Slice& value) {
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   std::string meta_value;
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
@@ -605,10 +668,12 @@ Status RedisLists::LSet(const Slice& key, int64_t index, const Slice& value) {
   return s;
 }
 
-Status RedisLists::LTrim(const Slice& key, int64_t start, int64_t stop) {
-
+Status RedisLists::LTrim(const Slice& key, int64_t start, int64_t stop,
+                         uint64_t* trimmed) {
+  *trimmed = 0;
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
 
   std::string meta_value;
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
@@ -636,6 +701,7 @@ Status RedisLists::LTrim(const Slice& key, int64_t start, int64_t stop) {
           ListsDataKey lists_data_key(key, version, idx);
           batch.Delete(handles_[1], lists_data_key.Encode());
         }
+        *trimmed = parsed_lists_meta_value.count();
         parsed_lists_meta_value.InitialMetaValue();
         batch.Put(handles_[0], key, meta_value);
       } else {
@@ -653,6 +719,7 @@ Status RedisLists::LTrim(const Slice& key, int64_t start, int64_t stop) {
         parsed_lists_meta_value.ModifyRightIndex(-(origin_right_index - sublist_right_index));
         parsed_lists_meta_value.ModifyCount(-delete_node_num);
         batch.Put(handles_[0], key, meta_value);
+        *trimmed = delete_node_num;
         for (uint64_t idx = origin_left_index; idx < sublist_left_index; ++idx) {
           ListsDataKey lists_data_key(key, version, idx);
           batch.Delete(handles_[1], lists_data_key.Encode());
@@ -672,6 +739,7 @@ Status RedisLists::LTrim(const Slice& key, int64_t start, int64_t stop) {
 Status RedisLists::RPop(const Slice& key, std::string* element) {
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
 
   std::string meta_value;
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
@@ -707,6 +775,8 @@ Status RedisLists::RPoplpush(const Slice& source,
   Status s;
   rocksdb::WriteBatch batch;
   MultiScopeRecordLock l(lock_mgr_, {source.ToString(), destination.ToString()});
+  ScopeRowCacheInvalidate ri(row_cache_,
+      std::vector<std::string>{source.ToString(), destination.ToString()});
   if (!source.compare(destination)) {
     std::string meta_value;
     s = db_->Get(default_read_options_, handles_[0], source, &meta_value);
@@ -814,6 +884,8 @@ Status RedisLists::RPush(const Slice& key,
                          uint64_t* ret) {
   *ret = 0;
   rocksdb::WriteBatch batch;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
 
   uint64_t index = 0;
   int32_t version = 0;
@@ -859,6 +931,7 @@ Status RedisLists::RPushx(const Slice& key, const Slice& value, uint64_t* len) {
   rocksdb::WriteBatch batch;
 
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   std::string meta_value;
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
@@ -885,6 +958,7 @@ Status RedisLists::RPushx(const Slice& key, const Slice& value, uint64_t* len) {
 Status RedisLists::Expire(const Slice& key, int32_t ttl) {
   std::string meta_value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
     ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
@@ -905,6 +979,7 @@ Status RedisLists::Expire(const Slice& key, int32_t ttl) {
 Status RedisLists::Del(const Slice& key) {
   std::string meta_value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
     ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
@@ -965,6 +1040,7 @@ bool RedisLists::Scan(const std::string& start_key,
 Status RedisLists::Expireat(const Slice& key, int32_t timestamp) {
   std::string meta_value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
     ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
@@ -981,6 +1057,7 @@ Status RedisLists::Expireat(const Slice& key, int32_t timestamp) {
 Status RedisLists::Persist(const Slice& key) {
   std::string meta_value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
     ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
@@ -26,6 +26,9 @@ class RedisLists : public Redis {
                         const std::string& db_path) override;
     virtual Status CompactRange(const rocksdb::Slice* begin,
                                 const rocksdb::Slice* end) override;
+    virtual Status CompactKey(const Slice& key) override;
+    virtual Status GetStaleEntries(uint64_t* stale,
+                                   uint64_t* total) override;
     virtual Status GetProperty(const std::string& property, std::string* out) override;
     virtual Status ScanKeyNum(uint64_t* num) override;
     virtual Status ScanKeys(const std::string& pattern,
@@ -34,6 +37,7 @@ class RedisLists : public Redis {
 
     // Lists commands;
     Status LIndex(const Slice& key, int64_t index, std::string* element);
+    Status LIndex(const Slice& key, int64_t index, PinnableValue* element);
     Status LInsert(const Slice& key, const BeforeOrAfter& before_or_after,
                    const std::string& pivot, const std::string& value, int64_t* ret);
     Status LLen(const Slice& key, uint64_t* len);
@@ -45,7 +49,8 @@ class RedisLists : public Redis {
                   std::vector<std::string>* ret);
     Status LRem(const Slice& key, int64_t count, const Slice& value, uint64_t* ret);
     Status LSet(const Slice& key, int64_t index, const Slice& value);
-    Status LTrim(const Slice& key, int64_t start, int64_t stop);
+    Status LTrim(const Slice& key, int64_t start, int64_t stop,
+                 uint64_t* trimmed);
     Status RPop(const Slice& key, std::string* element);
     Status RPoplpush(const Slice& source, const Slice& destination, std::string* element);
     Status RPush(const Slice& key, const std::vector<std::string>& values,
@@ -67,6 +72,11 @@ class RedisLists : public Redis {
 
   private:
     std::vector<rocksdb::ColumnFamilyHandle*> handles_;
+
+    Status GetElement(const rocksdb::ReadOptions& read_options,
+                      const Slice& key, int64_t index,
+                      std::string* meta_value,
+                      rocksdb::PinnableSlice* element);
 };
 
 }  //  namespace blackwidow
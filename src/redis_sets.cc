@@ -6,6 +6,8 @@
 #include "src/redis_sets.h"
 
 #include <map>
+#include <array>
+#include <bitset>
 #include <memory>
 #include <random>
 #include <algorithm>
@@ -13,7 +15,9 @@
 #include "blackwidow/util.h"
 #include "src/base_filter.h"
 #include "src/scope_record_lock.h"
+#include "src/scope_iterators.h"
 #include "src/scope_snapshot.h"
+#include "src/stale_entries_collector.h"
 
 namespace blackwidow {
 
@@ -23,6 +27,7 @@ RedisSets::RedisSets() {
 }
 
 RedisSets::~RedisSets() {
+  iter_pool_.Clear();
   std::vector<rocksdb::ColumnFamilyHandle*> tmp_handles = handles_;
   handles_.clear();
   for (auto handle : tmp_handles) {
@@ -49,6 +54,8 @@ Status RedisSets::Open(const rocksdb::Options& options,
 
   // Open
   rocksdb::DBOptions db_ops(options);
+  db_ops.listeners.push_back(
+    std::make_shared<IteratorPoolListener>(&iter_pool_));
   rocksdb::ColumnFamilyOptions meta_cf_ops(options);
   rocksdb::ColumnFamilyOptions member_cf_ops(options);
   meta_cf_ops.compaction_filter_factory =
@@ -56,6 +63,11 @@ Status RedisSets::Open(const rocksdb::Options& options,
   member_cf_ops.compaction_filter_factory =
       std::make_shared<SetsMemberFilterFactory>(&db_, &handles_);
 
+  meta_cf_ops.table_properties_collector_factories.push_back(
+    std::make_shared<StaleEntriesCollectorFactory>(kBaseMetaFormat));
+  member_cf_ops.table_properties_collector_factories.push_back(
+    std::make_shared<StaleEntriesCollectorFactory>(kVersionedKeyFormat));
+
   //use the bloom filter policy to reduce disk reads
   rocksdb::BlockBasedTableOptions table_options;
   table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, true));
@@ -83,6 +95,14 @@ Status RedisSets::CompactRange(const rocksdb::Slice* begin,
       handles_[1], begin, end);
 }
 
+Status RedisSets::CompactKey(const Slice& key) {
+  return CompactKeyData(key, handles_[1]);
+}
+
+Status RedisSets::GetStaleEntries(uint64_t* stale, uint64_t* total) {
+  return SumStaleEntries(db_, handles_, stale, total);
+}
+
 Status RedisSets::GetProperty(const std::string& property, std::string* out) {
   db_->GetProperty(property, out);
   return Status::OK();
@@ -101,6 +121,7 @@ Status RedisSets::ScanKeyNum(uint64_t* num) {
   for (iter->SeekToFirst();
        iter->Valid();
        iter->Next()) {
+    ThrottleScan(iter->key().size() + iter->value().size());
     ParsedSetsMetaValue parsed_sets_meta_value(iter->value());
     if (!parsed_sets_meta_value.IsStale()
       && parsed_sets_meta_value.count() != 0) {
@@ -126,6 +147,7 @@ Status RedisSets::ScanKeys(const std::string& pattern,
   for (iter->SeekToFirst();
        iter->Valid();
        iter->Next()) {
+    ThrottleScan(iter->key().size() + iter->value().size());
     ParsedSetsMetaValue parsed_sets_meta_value(iter->value());
     if (!parsed_sets_meta_value.IsStale()
       && parsed_sets_meta_value.count() != 0) {
@@ -152,6 +174,7 @@ Status RedisSets::SAdd(const Slice& key,
 
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   int32_t version = 0;
   std::string meta_value;
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
@@ -210,7 +233,7 @@ Status RedisSets::SAdd(const Slice& key,
 Status RedisSets::SCard(const Slice& key, int32_t* ret) {
   *ret = 0;
   std::string meta_value;
-  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  Status s = GetCachedValue(key, &meta_value);
   if (s.ok()) {
     ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
     if (parsed_sets_meta_value.IsStale()) {
@@ -310,6 +333,7 @@ Status RedisSets::SDiffstore(const Slice& destination,
   std::string meta_value;
   int32_t version = 0;
   ScopeRecordLock l(lock_mgr_, destination);
+  ScopeRowCacheInvalidate ri(row_cache_, destination);
   ScopeSnapshot ss(db_, &snapshot);
   read_options.snapshot = snapshot;
   std::vector<KeyVersion> vaild_sets;
@@ -488,6 +512,7 @@ Status RedisSets::SInterstore(const Slice& destination,
   int32_t version = 0;
   bool have_invalid_sets = false;
   ScopeRecordLock l(lock_mgr_, destination);
+  ScopeRowCacheInvalidate ri(row_cache_, destination);
   ScopeSnapshot ss(db_, &snapshot);
   read_options.snapshot = snapshot;
   std::vector<KeyVersion> vaild_sets;
@@ -586,14 +611,11 @@ Status RedisSets::SInterstore(const Slice& destination,
 
 Status RedisSets::SIsmember(const Slice& key, const Slice& member,
                             int32_t* ret) {
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot;
-
   std::string meta_value;
   int32_t version = 0;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-  Status s = db_->Get(read_options, handles_[0], key, &meta_value);
+  // The member is looked up under the version of the meta value, so there
+  // is no need to read both of them at the same snapshot
+  Status s = GetCachedValue(key, &meta_value);
   if (s.ok()) {
     ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
     if (parsed_sets_meta_value.IsStale()) {
@@ -603,7 +625,7 @@ Status RedisSets::SIsmember(const Slice& key, const Slice& member,
       std::string member_value;
       version = parsed_sets_meta_value.version();
       SetsMemberKey sets_member_key(key, version, member);
-      s = db_->Get(read_options, handles_[1],
+      s = db_->Get(default_read_options_, handles_[1],
               sets_member_key.Encode(), &member_value);
       *ret = s.ok() ? 1 : 0;
     }
@@ -615,14 +637,10 @@ Status RedisSets::SIsmember(const Slice& key, const Slice& member,
 
 Status RedisSets::SMembers(const Slice& key,
                            std::vector<std::string>* members) {
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot;
-
   std::string meta_value;
   int32_t version = 0;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-  Status s = db_->Get(read_options, handles_[0], key, &meta_value);
+  ScopePooledIterators iters(&iter_pool_, db_, handles_[0], handles_[1]);
+  Status s = iters.Get(0, key, &meta_value);
   if (s.ok()) {
     ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
     if (parsed_sets_meta_value.IsStale()) {
@@ -631,14 +649,13 @@ Status RedisSets::SMembers(const Slice& key,
       version = parsed_sets_meta_value.version();
       SetsMemberKey sets_member_key(key, version, Slice());
       Slice prefix = sets_member_key.Encode();
-      auto iter = db_->NewIterator(read_options, handles_[1]);
+      rocksdb::Iterator* iter = iters[1];
       for (iter->Seek(prefix);
            iter->Valid() && iter->key().starts_with(prefix);
            iter->Next()) {
         ParsedSetsMemberKey parsed_sets_member_key(iter->key());
         members->push_back(parsed_sets_member_key.member().ToString());
       }
-      delete iter;
     }
   }
   return s;
@@ -654,6 +671,7 @@ Status RedisSets::SMove(const Slice& source, const Slice& destination,
   std::string meta_value;
   std::vector<std::string> keys {source.ToString(), destination.ToString()};
   MultiScopeRecordLock ml(lock_mgr_, keys);
+  ScopeRowCacheInvalidate ri(row_cache_, keys);
 
   if (source == destination) {
     *ret = 1;
@@ -728,13 +746,18 @@ Status RedisSets::SMove(const Slice& source, const Slice& destination,
   return db_->Write(default_write_options_, &batch);
 }
 
-Status RedisSets::SPop(const Slice& key, std::string* member, bool* need_compact) {
-
-  std::default_random_engine engine;
-
+Status RedisSets::SPop(const Slice& key, int32_t count,
+                       std::vector<std::string>* members,
+                       bool* need_compact) {
+  members->clear();
+  if (count <= 0) {
+    return count == 0 ? Status::OK() :
+      Status::InvalidArgument("count must be positive");
+  }
   std::string meta_value;
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
 
   uint64_t start_us = slash::NowMicros();
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
@@ -745,39 +768,26 @@ Status RedisSets::SPop(const Slice& key, std::string* member, bool* need_compact
     } else if (parsed_sets_meta_value.count() == 0) {
       return Status::NotFound();
     } else {
-      engine.seed(time(NULL));
-      int32_t cur_index = 0;
-      int32_t size = parsed_sets_meta_value.count();
-      int32_t target_index = engine() % (size < 50 ? size : 50);
       int32_t version = parsed_sets_meta_value.version();
-
-      SetsMemberKey sets_member_key(key, version, Slice());
-      auto iter = db_->NewIterator(default_read_options_, handles_[1]);
-      for (iter->Seek(sets_member_key.Encode());
-           iter->Valid() && cur_index < size;
-           iter->Next(), cur_index++) {
-
-        if (cur_index == target_index) {
-          batch.Delete(handles_[1], iter->key());
-          ParsedSetsMemberKey parsed_sets_member_key(iter->key());
-          *member = parsed_sets_member_key.member().ToString();
-
-          parsed_sets_meta_value.ModifyCount(-1);
-          batch.Put(handles_[0], key, meta_value);
-          break;
-        }
+      SampleMembers(key, version, parsed_sets_meta_value.count(),
+                    count, true, members);
+      for (const auto& member : *members) {
+        SetsMemberKey sets_member_key(key, version, member);
+        batch.Delete(handles_[1], sets_member_key.Encode());
       }
-      delete iter;
+      parsed_sets_meta_value.ModifyCount(
+          -static_cast<int32_t>(members->size()));
+      batch.Put(handles_[0], key, meta_value);
     }
   } else {
     return s;
   }
 
-  uint64_t count = 0;
+  uint64_t spop_count = 0;
   uint64_t duration = slash::NowMicros() - start_us;
-  AddAndGetSpopCount(key.ToString(), &count);
+  AddAndGetSpopCount(key.ToString(), members->size(), &spop_count);
   if (duration >= SPOP_COMPACT_THRESHOLD_DURATION
-    || count >= SPOP_COMPACT_THRESHOLD_COUNT) {
+    || spop_count >= SPOP_COMPACT_THRESHOLD_COUNT) {
     *need_compact = true;
     ResetSpopCount(key.ToString());
   }
@@ -794,13 +804,14 @@ Status RedisSets::ResetSpopCount(const std::string& key) {
   return Status::OK();
 }
 
-Status RedisSets::AddAndGetSpopCount(const std::string& key, uint64_t* count) {
+Status RedisSets::AddAndGetSpopCount(const std::string& key, uint64_t popped,
+                                     uint64_t* count) {
   slash::MutexLock l(&spop_counts_mutex_);
   if (spop_counts_store_.map_.find(key) == spop_counts_store_.map_.end()) {
-    *count = ++spop_counts_store_.map_[key];
+    *count = spop_counts_store_.map_[key] += popped;
     spop_counts_store_.list_.push_front(key);
   } else {
-    *count = ++spop_counts_store_.map_[key];
+    *count = spop_counts_store_.map_[key] += popped;
     spop_counts_store_.list_.remove(key);
     spop_counts_store_.list_.push_front(key);
   }
@@ -820,15 +831,7 @@ Status RedisSets::SRandmember(const Slice& key, int32_t count,
   }
 
   members->clear();
-  int32_t last_seed = time(NULL);
-  std::default_random_engine engine;
-
   std::string meta_value;
-  rocksdb::WriteBatch batch;
-  ScopeRecordLock l(lock_mgr_, key);
-  std::vector<int32_t> targets;
-  std::unordered_set<int32_t> unique;
-
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
     ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
@@ -837,50 +840,463 @@ Status RedisSets::SRandmember(const Slice& key, int32_t count,
     } else if (parsed_sets_meta_value.count() == 0) {
       return Status::NotFound();
     } else {
-      int32_t size = parsed_sets_meta_value.count();
-      int32_t version = parsed_sets_meta_value.version();
-      if (count > 0) {
-        count = count <= size ? count : size;
-        while (targets.size() < static_cast<size_t>(count)) {
-          engine.seed(last_seed);
-          last_seed = engine();
-          uint32_t pos = last_seed % size;
-          if (unique.find(pos) == unique.end()) {
-            unique.insert(pos);
-            targets.push_back(pos);
-          }
-        }
-      } else {
-        count = -count;
-        while (targets.size() < static_cast<size_t>(count)) {
-          engine.seed(last_seed);
-          last_seed = engine();
-          targets.push_back(last_seed % size);
+      SampleMembers(key, parsed_sets_meta_value.version(),
+                    parsed_sets_meta_value.count(),
+                    count > 0 ? count : -count, count > 0, members);
+    }
+  }
+  return s;
+}
+
+static std::mt19937_64& RandomEngine() {
+  static thread_local std::mt19937_64 engine(std::random_device{}());
+  return engine;
+}
+
+// The members of a set as integers in their order, for the seeks of
+// SampleMembers. After the common prefix of the first and the last member
+// every byte is a digit, whose values are the bytes the members learned had
+// at that place above a zero for the end of the member, so digits, hex,
+// names or any other bytes of any width make dense integers. A byte not
+// learned yet counts as the one below it and maxes the digits after it,
+// which keeps the order, and seeking Decode(code) lands on the first member
+// whose code is at least code.
+class MemberCoder {
+ public:
+  static const size_t kMaxPlaces = 64;
+
+  explicit MemberCoder(const std::string& common) : common_(common) {}
+
+  // Whether member had a byte not met yet
+  bool Learn(const Slice& member) {
+    if (!member.starts_with(common_)) {
+      return false;
+    }
+    bool learned = false;
+    for (size_t i = common_.size();
+         i < member.size() && i - common_.size() < kMaxPlaces; i++) {
+      size_t place = i - common_.size();
+      if (place == seen_.size()) {
+        seen_.emplace_back();
+      }
+      uint8_t byte = static_cast<uint8_t>(member[i]);
+      if (!seen_[place][byte]) {
+        seen_[place].set(byte);
+        learned = true;
+      }
+    }
+    return learned;
+  }
+
+  // Keeps the places which fit in 62 bits, false when none does
+  bool Build() {
+    radixes_.clear();
+    bytes_.clear();
+    digits_.clear();
+    uint64_t range = 1;
+    for (const auto& seen : seen_) {
+      uint64_t radix = seen.count() + 1;
+      if (range > (static_cast<uint64_t>(1) << 62) / radix) {
+        break;
+      }
+      range *= radix;
+      radixes_.push_back(radix);
+      bytes_.emplace_back();
+      digits_.emplace_back();
+      uint16_t digit = 0;
+      for (int32_t byte = 0; byte < 256; byte++) {
+        if (seen[byte]) {
+          bytes_.back().push_back(static_cast<char>(byte));
+          digit++;
         }
+        digits_.back()[byte] = digit;
       }
-      std::sort(targets.begin(), targets.end());
+    }
+    weights_.assign(radixes_.size(), 1);
+    for (size_t place = radixes_.size(); place > 1; place--) {
+      weights_[place - 2] = weights_[place - 1] * radixes_[place - 1];
+    }
+    range_ = range;
+    return range > 1;
+  }
 
-      int32_t cur_index = 0, idx = 0;
-      SetsMemberKey sets_member_key(key, version, Slice());
-      auto iter = db_->NewIterator(default_read_options_, handles_[1]);
-      for (iter->Seek(sets_member_key.Encode());
-           iter->Valid() && cur_index < size;
-           iter->Next(), cur_index++) {
-        if (static_cast<size_t>(idx) >= targets.size()) {
+  uint64_t Encode(const Slice& member) const {
+    if (!member.starts_with(common_)) {
+      return member.compare(common_) < 0 ? 0 : range_ - 1;
+    }
+    uint64_t code = 0;
+    bool missed = false;
+    for (size_t place = 0; place < radixes_.size(); place++) {
+      size_t i = common_.size() + place;
+      uint64_t digit = radixes_[place] - 1;
+      if (!missed) {
+        if (i >= member.size()) {
           break;
         }
-        ParsedSetsMemberKey parsed_sets_member_key(iter->key());
-        while (static_cast<size_t>(idx) < targets.size()
-          && cur_index == targets[idx]) {
-          idx++;
-          members->push_back(parsed_sets_member_key.member().ToString());
+        uint8_t byte = static_cast<uint8_t>(member[i]);
+        digit = digits_[place][byte];
+        missed = digit == 0 || bytes_[place][digit - 1] != member[i];
+      }
+      code += digit * weights_[place];
+    }
+    return code;
+  }
+
+  std::string Decode(uint64_t code) const {
+    std::string member = common_;
+    for (size_t place = 0; place < radixes_.size(); place++) {
+      uint64_t digit = code / weights_[place] % radixes_[place];
+      if (digit == 0) {
+        // Past the members which end here, before the ones going on
+        if (code % weights_[place] != 0) {
+          member.push_back('\0');
         }
+        break;
       }
-      random_shuffle(members->begin(), members->end());
-      delete iter;
+      member.push_back(bytes_[place][digit - 1]);
     }
+    return member;
   }
-  return s;
+
+ private:
+  const std::string common_;
+  std::vector<std::bitset<256>> seen_;
+  std::vector<std::string> bytes_;
+  std::vector<std::array<uint16_t, 256>> digits_;
+  std::vector<uint64_t> radixes_;
+  std::vector<uint64_t> weights_;
+  uint64_t range_ = 1;
+};
+
+static bool OnMember(rocksdb::Iterator* iter, const std::string& prefix) {
+  return iter->Valid() && iter->key().starts_with(prefix);
+}
+
+static std::string MemberAt(rocksdb::Iterator* iter) {
+  return ParsedSetsMemberKey(iter->key()).member().ToString();
+}
+
+// A seek key with a byte drawn between the ones of the first and the last
+// member after their common prefix
+static std::string RandomSeekKey(const std::string& prefix,
+                                 const std::string& first,
+                                 const std::string& last, size_t common) {
+  int32_t low = common < first.size()
+    ? static_cast<uint8_t>(first[common]) : 0;
+  int32_t high = static_cast<uint8_t>(last[common]);
+  int32_t byte =
+    std::uniform_int_distribution<int32_t>(low, high)(RandomEngine());
+  return prefix + last.substr(0, common) + static_cast<char>(byte);
+}
+
+// Learns the bytes the members starting with parent have after it, a seek
+// for each, and returns the ones more than one member goes on with
+static std::string LearnPlace(rocksdb::Iterator* iter,
+                              const std::string& prefix,
+                              const std::string& parent, MemberCoder* coder,
+                              int32_t* seeks) {
+  std::string branches;
+  iter->Seek(prefix + parent);
+  while (OnMember(iter, prefix)) {
+    Slice member = ParsedSetsMemberKey(iter->key()).member();
+    if (!member.starts_with(parent)) {
+      break;
+    }
+    coder->Learn(member);
+    if (member.size() == parent.size()) {
+      iter->Next();
+      continue;
+    }
+    std::string branch = parent + member[parent.size()];
+    iter->Next();
+    if (OnMember(iter, prefix)) {
+      Slice next = ParsedSetsMemberKey(iter->key()).member();
+      coder->Learn(next);
+      if (next.starts_with(branch)) {
+        branches.push_back(branch.back());
+      }
+    }
+    if (static_cast<uint8_t>(branch.back()) == 0xff || (*seeks)-- <= 0) {
+      break;
+    }
+    branch.back()++;
+    iter->Seek(prefix + branch);
+  }
+  return branches;
+}
+
+// Reads up to n members from where iter is on, forward or backward, into a
+// run of members in order and learns their bytes
+static void ReadRun(rocksdb::Iterator* iter, const std::string& prefix,
+                    int32_t n, bool forward, MemberCoder* coder,
+                    std::vector<std::vector<std::string>>* runs) {
+  runs->emplace_back();
+  std::vector<std::string>* run = &runs->back();
+  for (int32_t i = 0; i < n && OnMember(iter, prefix); i++) {
+    run->push_back(MemberAt(iter));
+    coder->Learn(run->back());
+    if (forward) {
+      iter->Next();
+    } else {
+      iter->Prev();
+    }
+  }
+  if (!forward) {
+    std::reverse(run->begin(), run->end());
+  }
+}
+
+// Picks count members by seeks, false when the set is too uneven for the
+// codes of its members or the draws ran out
+static bool SeekMembers(rocksdb::Iterator* iter, const std::string& prefix,
+                        const std::string& first, const std::string& last,
+                        size_t common, int32_t size, int32_t count,
+                        bool distinct, std::vector<std::string>* members) {
+  std::mt19937_64& engine = RandomEngine();
+  // The pilot, runs of members at the head and the tail of the set and at
+  // the end of random paths down from the common prefix, teaches the coder
+  // the bytes and how dense the set gets
+  MemberCoder coder(last.substr(0, common));
+  std::vector<std::vector<std::string>> runs;
+  iter->Seek(prefix);
+  ReadRun(iter, prefix, SETS_SAMPLE_PILOT_SIZE, true, &coder, &runs);
+  iter->SeekToLast();
+  ReadRun(iter, prefix, SETS_SAMPLE_PILOT_SIZE, false, &coder, &runs);
+  int32_t seeks = SETS_SAMPLE_PILOT_SEEKS;
+  while (seeks > 0) {
+    std::string parent = last.substr(0, common);
+    while (seeks > 0 && parent.size() < common + MemberCoder::kMaxPlaces) {
+      std::string branches = LearnPlace(iter, prefix, parent, &coder, &seeks);
+      if (branches.empty()) {
+        break;
+      }
+      parent.push_back(branches[std::uniform_int_distribution<size_t>(
+          0, branches.size() - 1)(engine)]);
+    }
+    if (parent.size() == common) {
+      break;
+    }
+    iter->Seek(prefix + parent);
+    ReadRun(iter, prefix, SETS_SAMPLE_WINDOW + 1, true, &coder, &runs);
+  }
+
+  uint64_t low = 0;
+  uint64_t head = 0;
+  uint64_t total = 0;
+  double density = 0;
+  bool learned = true;
+  std::uniform_int_distribution<int32_t> step(0, SETS_SAMPLE_WINDOW - 1);
+  std::uniform_real_distribution<double> keep(0, 1);
+  std::unordered_set<std::string> unique;
+  int64_t attempts =
+    static_cast<int64_t>(count) * SETS_SAMPLE_MAX_DENSITY * 4 + 64;
+  while (members->size() < static_cast<size_t>(count) && attempts-- > 0) {
+    // Every draw is uniform whatever the coder, so the bytes met on the
+    // way are learned and the coder rebuilt between the draws
+    if (learned) {
+      if (!coder.Build()) {
+        return false;
+      }
+      low = coder.Encode(first);
+      uint64_t high = coder.Encode(last);
+      if (high <= low) {
+        return false;
+      }
+      // Positions from 1 to total, the first member owns the head, as wide
+      // as an average window so that the windows cut by the head of the set
+      // are not too dense, and every other one the codes after the member
+      // before it
+      head = std::max<uint64_t>((high - low) / size, 1) * SETS_SAMPLE_WINDOW;
+      total = high - low + head;
+      density = SETS_SAMPLE_MAX_DENSITY;
+      for (const auto& run : runs) {
+        for (size_t i = SETS_SAMPLE_WINDOW; i < run.size(); i++) {
+          uint64_t positions = coder.Encode(run[i])
+            - coder.Encode(run[i - SETS_SAMPLE_WINDOW]);
+          density = std::max(density, static_cast<double>(total) / size
+            * SETS_SAMPLE_WINDOW / std::max<uint64_t>(positions, 1));
+        }
+      }
+      learned = false;
+    }
+    // The positions owned by a window of members are kept whole down to
+    // least, past SETS_SAMPLE_MAX_DENSITY times the average the draws are
+    // mostly thrown away, and a window denser than least met on the way
+    // lowers it and restarts the picks
+    if (density > SETS_SAMPLE_MAX_DENSITY * 4) {
+      return false;
+    }
+    double least =
+      static_cast<double>(total) / size * SETS_SAMPLE_WINDOW / density;
+    uint64_t position =
+      std::uniform_int_distribution<uint64_t>(1, total)(engine);
+    if (position <= head) {
+      iter->Seek(prefix);
+    } else {
+      iter->Seek(prefix + coder.Decode(low + position - head));
+    }
+    for (int32_t i = step(engine); i > 0 && OnMember(iter, prefix); i--) {
+      iter->Next();
+    }
+    if (!OnMember(iter, prefix)) {
+      continue;
+    }
+    std::string member = MemberAt(iter);
+    uint64_t positions = coder.Encode(member) - low + head;
+    int32_t back = 0;
+    while (back < SETS_SAMPLE_WINDOW) {
+      iter->Prev();
+      if (!OnMember(iter, prefix)) {
+        break;
+      }
+      learned |= coder.Learn(ParsedSetsMemberKey(iter->key()).member());
+      back++;
+    }
+    if (back == SETS_SAMPLE_WINDOW) {
+      positions -= coder.Encode(ParsedSetsMemberKey(iter->key()).member())
+        - low + head;
+    }
+    learned |= coder.Learn(member);
+    if (positions < least) {
+      density = static_cast<double>(total) / size * SETS_SAMPLE_WINDOW
+        / std::max<uint64_t>(positions, 1);
+      members->clear();
+      unique.clear();
+    } else if (keep(engine) * positions >= least) {
+      continue;
+    }
+    if (!distinct || unique.insert(member).second) {
+      members->push_back(std::move(member));
+    }
+  }
+  return members->size() == static_cast<size_t>(count);
+}
+
+// Picks count members among the n from start on, going on at the head of
+// the set past its end
+static void ScanMembers(rocksdb::Iterator* iter, const std::string& prefix,
+                        const std::string& start, int32_t n, int32_t count,
+                        bool distinct, std::vector<std::string>* members) {
+  std::mt19937_64& engine = RandomEngine();
+  std::vector<int32_t> targets;
+  if (distinct) {
+    // Floyd's algorithm, count distinct indexes in [0, n)
+    std::unordered_set<int32_t> unique;
+    for (int32_t i = n - count; i < n; i++) {
+      int32_t index =
+        std::uniform_int_distribution<int32_t>(0, i)(engine);
+      if (!unique.insert(index).second) {
+        index = i;
+        unique.insert(index);
+      }
+      targets.push_back(index);
+    }
+  } else {
+    std::uniform_int_distribution<int32_t> distribution(0, n - 1);
+    for (int32_t i = 0; i < count; i++) {
+      targets.push_back(distribution(engine));
+    }
+  }
+  std::sort(targets.begin(), targets.end());
+
+  int32_t cur_index = 0;
+  size_t idx = 0;
+  bool wrapped = start == prefix;
+  iter->Seek(start);
+  while (idx < targets.size()) {
+    if (!OnMember(iter, prefix)) {
+      if (wrapped) {
+        break;
+      }
+      wrapped = true;
+      iter->Seek(prefix);
+      continue;
+    }
+    if (wrapped && start != prefix && iter->key().compare(start) >= 0) {
+      break;
+    }
+    ParsedSetsMemberKey parsed_sets_member_key(iter->key());
+    while (idx < targets.size() && cur_index == targets[idx]) {
+      idx++;
+      members->push_back(parsed_sets_member_key.member().ToString());
+    }
+    iter->Next();
+    cur_index++;
+  }
+  std::shuffle(members->begin(), members->end(), engine);
+}
+
+// Up to SETS_SAMPLE_SCAN_SIZE members, or when a scan of the set costs less
+// than the seeks for count members, the members are numbered by a scan and
+// picked by a uniform index.
+//
+// Otherwise the members are coded as integers in their order, see
+// MemberCoder, and a uniform position between the first and the last code
+// is sought, landing on a member with a probability proportional to the
+// positions it owns, the ones after the member before it. A member a few
+// steps after the landing one is taken, so a window of SETS_SAMPLE_WINDOW
+// members owns its positions, and kept with a probability inverse to them,
+// which makes the members equally likely whatever their bytes, width or
+// gaps. The pilot and the draws bound the inverse by the densest window they
+// meet, and the sets whose densest windows are more than four times
+// SETS_SAMPLE_MAX_DENSITY the average, the ones mixing members of different
+// shapes, go back to the scan, as do the draws which run out. On sets larger
+// than SETS_SAMPLE_MAX_SCAN_SIZE members, or twice count, that scan is
+// capped to as many members from a random seek.
+void RedisSets::SampleMembers(const Slice& key, int32_t version, int32_t size,
+                              int32_t count, bool distinct,
+                              std::vector<std::string>* members) {
+  SetsMemberKey sets_member_key(key, version, Slice());
+  std::string prefix = sets_member_key.Encode().ToString();
+  std::string upper_bound = prefix;
+  while (!upper_bound.empty()
+    && static_cast<uint8_t>(upper_bound.back()) == 0xff) {
+    upper_bound.pop_back();
+  }
+  if (!upper_bound.empty()) {
+    upper_bound.back()++;
+  }
+  Slice upper_bound_slice(upper_bound);
+  rocksdb::ReadOptions read_options;
+  if (!upper_bound.empty()) {
+    read_options.iterate_upper_bound = &upper_bound_slice;
+  }
+  std::unique_ptr<rocksdb::Iterator> iter(
+      db_->NewIterator(read_options, handles_[1]));
+
+  if (distinct && count > size) {
+    count = size;
+  }
+  if (size > SETS_SAMPLE_SCAN_SIZE
+    && static_cast<int64_t>(count) * SETS_SAMPLE_SEEK_COST < size) {
+    iter->SeekToLast();
+    if (!OnMember(iter.get(), prefix)) {
+      return;
+    }
+    std::string last = MemberAt(iter.get());
+    iter->Seek(prefix);
+    std::string first = MemberAt(iter.get());
+    size_t common = 0;
+    while (common < first.size() && common < last.size()
+      && first[common] == last[common]) {
+      common++;
+    }
+    if (common < last.size()) {
+      if (SeekMembers(iter.get(), prefix, first, last, common, size, count,
+                      distinct, members)) {
+        return;
+      }
+      members->clear();
+      int32_t window = std::max(SETS_SAMPLE_MAX_SCAN_SIZE, count * 2);
+      if (size > window) {
+        ScanMembers(iter.get(), prefix,
+                    RandomSeekKey(prefix, first, last, common), window,
+                    count, distinct, members);
+        return;
+      }
+    }
+  }
+  ScanMembers(iter.get(), prefix, prefix, size, count, distinct, members);
 }
 
 Status RedisSets::SRem(const Slice& key,
@@ -888,6 +1304,7 @@ Status RedisSets::SRem(const Slice& key,
                        int32_t* ret) {
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
 
   int32_t version = 0;
   std::string meta_value;
@@ -989,6 +1406,7 @@ Status RedisSets::SUnionstore(const Slice& destination,
   std::string meta_value;
   int32_t version = 0;
   ScopeRecordLock l(lock_mgr_, destination);
+  ScopeRowCacheInvalidate ri(row_cache_, destination);
   ScopeSnapshot ss(db_, &snapshot);
   read_options.snapshot = snapshot;
   std::vector<KeyVersion> vaild_sets;
@@ -1061,13 +1479,10 @@ Status RedisSets::SScan(const Slice& key, int64_t cursor, const std::string& pat
 
   int64_t rest = count;
   int64_t step_length = count;
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot;
 
   std::string meta_value;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-  Status s = db_->Get(read_options, handles_[0], key, &meta_value);
+  ScopeIterators iters(db_, {handles_[0], handles_[1]});
+  Status s = iters.Get(0, key, &meta_value);
   if (s.ok()) {
     ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
     if (parsed_sets_meta_value.IsStale()
@@ -1085,7 +1500,7 @@ Status RedisSets::SScan(const Slice& key, int64_t cursor, const std::string& pat
       SetsMemberKey sets_member_prefix(key, version, Slice());
       SetsMemberKey sets_member_key(key, version, start_member);
       std::string prefix = sets_member_prefix.Encode().ToString();
-      rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[1]);
+      rocksdb::Iterator* iter = iters[1];
       for (iter->Seek(sets_member_key.Encode());
            iter->Valid() && rest > 0 && iter->key().starts_with(prefix);
            iter->Next()) {
@@ -1105,7 +1520,6 @@ Status RedisSets::SScan(const Slice& key, int64_t cursor, const std::string& pat
       } else {
         *next_cursor = 0;
       }
-      delete iter;
     }
   } else {
     *next_cursor = 0;
@@ -1143,6 +1557,7 @@ Status RedisSets::StoreSScanNextMember(const Slice& key, const Slice& pattern, i
 Status RedisSets::Expire(const Slice& key, int32_t ttl) {
   std::string meta_value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
     ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
@@ -1165,6 +1580,7 @@ Status RedisSets::Expire(const Slice& key, int32_t ttl) {
 Status RedisSets::Del(const Slice& key) {
   std::string meta_value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
     ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
@@ -1226,6 +1642,7 @@ bool RedisSets::Scan(const std::string& start_key,
 Status RedisSets::Expireat(const Slice& key, int32_t timestamp) {
   std::string meta_value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
     ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
@@ -1242,6 +1659,7 @@ Status RedisSets::Expireat(const Slice& key, int32_t timestamp) {
 Status RedisSets::Persist(const Slice& key) {
   std::string meta_value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
     ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
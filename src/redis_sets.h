@@ -18,6 +18,13 @@
 
 #define SPOP_COMPACT_THRESHOLD_COUNT     500
 #define SPOP_COMPACT_THRESHOLD_DURATION  1000         // 1000us
+#define SETS_SAMPLE_SCAN_SIZE            256
+#define SETS_SAMPLE_SEEK_COST            128          // reads per seek pick
+#define SETS_SAMPLE_MAX_SCAN_SIZE        10000
+#define SETS_SAMPLE_PILOT_SIZE           16
+#define SETS_SAMPLE_PILOT_SEEKS          64
+#define SETS_SAMPLE_WINDOW               8
+#define SETS_SAMPLE_MAX_DENSITY          4
 
 namespace blackwidow {
 
@@ -31,6 +38,9 @@ class RedisSets : public Redis {
                         const std::string& db_path) override;
     virtual Status CompactRange(const rocksdb::Slice* begin,
                                 const rocksdb::Slice* end) override;
+    virtual Status CompactKey(const Slice& key) override;
+    virtual Status GetStaleEntries(uint64_t* stale,
+                                   uint64_t* total) override;
     virtual Status GetProperty(const std::string& property, std::string* out) override;
     virtual Status ScanKeyNum(uint64_t* num) override;
     virtual Status ScanKeys(const std::string& pattern,
@@ -56,7 +66,8 @@ class RedisSets : public Redis {
                     std::vector<std::string>* members);
     Status SMove(const Slice& source, const Slice& destination,
                  const Slice& member, int32_t* ret);
-    Status SPop(const Slice& key, std::string* member, bool* need_compact);
+    Status SPop(const Slice& key, int32_t count,
+                std::vector<std::string>* members, bool* need_compact);
     Status SRandmember(const Slice& key, int32_t count,
                        std::vector<std::string>* members);
     Status SRem(const Slice& key, const std::vector<std::string>& members,
@@ -89,7 +100,13 @@ class RedisSets : public Redis {
     slash::Mutex spop_counts_mutex_;
     BlackWidow::LRU<std::string, uint64_t> spop_counts_store_;
     Status ResetSpopCount(const std::string& key);
-    Status AddAndGetSpopCount(const std::string& key, uint64_t* count);
+    Status AddAndGetSpopCount(const std::string& key, uint64_t popped,
+                              uint64_t* count);
+
+    // Picks count random members of the set at key, distinct or not
+    void SampleMembers(const Slice& key, int32_t version, int32_t size,
+                       int32_t count, bool distinct,
+                       std::vector<std::string>* members);
 
     // For SScan
     slash::Mutex sscan_cursors_mutex_;
@@ -0,0 +1,947 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/redis_streams.h"
+
+#include <limits>
+#include <memory>
+#include <set>
+
+#include "blackwidow/util.h"
+#include "slash/include/env.h"
+#include "src/base_filter.h"
+#include "src/streams_meta_value_format.h"
+#include "src/scope_record_lock.h"
+#include "src/scope_iterators.h"
+#include "src/scope_snapshot.h"
+#include "src/stale_entries_collector.h"
+
+namespace blackwidow {
+
+// The id given to an entry added with 0-0
+static Status NextStreamID(const StreamID& last_id, StreamID* id) {
+  const uint64_t kMax = std::numeric_limits<uint64_t>::max();
+  uint64_t now_ms = slash::NowMicros() / 1000;
+  if (now_ms > last_id.ms) {
+    *id = StreamID(now_ms, 0);
+  } else if (last_id.seq < kMax) {
+    *id = StreamID(last_id.ms, last_id.seq + 1);
+  } else if (last_id.ms < kMax) {
+    *id = StreamID(last_id.ms + 1, 0);
+  } else {
+    return Status::InvalidArgument("The stream has exhausted the last possible ID");
+  }
+  return Status::OK();
+}
+
+static std::string EncodeGroupValue(const StreamID& last_delivered_id) {
+  std::string value(kStreamIDLength, '\0');
+  EncodeStreamID(&value[0], last_delivered_id);
+  return value;
+}
+
+static std::string EncodePendingValue(uint64_t delivery_time_ms,
+                                      uint64_t delivery_count,
+                                      const Slice& consumer) {
+  std::string value(2 * sizeof(uint64_t), '\0');
+  EncodeFixed64(&value[0], delivery_time_ms);
+  EncodeFixed64(&value[sizeof(uint64_t)], delivery_count);
+  value.append(consumer.data(), consumer.size());
+  return value;
+}
+
+static bool DecodePendingValue(const Slice& value,
+                               StreamPendingEntry* pending_entry) {
+  if (value.size() < 2 * sizeof(uint64_t)) {
+    return false;
+  }
+  pending_entry->delivery_time_ms = DecodeFixed64(value.data());
+  pending_entry->delivery_count =
+    DecodeFixed64(value.data() + sizeof(uint64_t));
+  pending_entry->consumer.assign(value.data() + 2 * sizeof(uint64_t),
+                                 value.size() - 2 * sizeof(uint64_t));
+  return true;
+}
+
+static Status ParseEntry(rocksdb::Iterator* iter, StreamEntry* entry) {
+  ParsedStreamsDataKey parsed_streams_data_key(iter->key());
+  entry->id = parsed_streams_data_key.id();
+  if (!DecodeStreamEntry(iter->value(), &entry->field_values)) {
+    return Status::Corruption("Invalid stream entry");
+  }
+  return Status::OK();
+}
+
+RedisStreams::~RedisStreams() {
+  std::vector<rocksdb::ColumnFamilyHandle*> tmp_handles = handles_;
+  handles_.clear();
+  for (auto handle : tmp_handles) {
+    delete handle;
+  }
+}
+
+Status RedisStreams::Open(const rocksdb::Options& options,
+                          const std::string& db_path) {
+  rocksdb::Options ops(options);
+  Status s = rocksdb::DB::Open(ops, db_path, &db_);
+  if (s.ok()) {
+    // create column families
+    rocksdb::ColumnFamilyHandle *dcf = nullptr, *gcf = nullptr;
+    s = db_->CreateColumnFamily(rocksdb::ColumnFamilyOptions(),
+        "data_cf", &dcf);
+    if (!s.ok()) {
+      return s;
+    }
+    s = db_->CreateColumnFamily(rocksdb::ColumnFamilyOptions(),
+        "group_cf", &gcf);
+    if (!s.ok()) {
+      return s;
+    }
+    // close DB
+    delete dcf;
+    delete gcf;
+    delete db_;
+  }
+
+  // Open
+  rocksdb::DBOptions db_ops(options);
+  rocksdb::ColumnFamilyOptions meta_cf_ops(options);
+  rocksdb::ColumnFamilyOptions data_cf_ops(options);
+  rocksdb::ColumnFamilyOptions group_cf_ops(options);
+  meta_cf_ops.compaction_filter_factory =
+    std::make_shared<StreamsMetaFilterFactory>();
+  data_cf_ops.compaction_filter_factory =
+    std::make_shared<StreamsDataFilterFactory>(&db_, &handles_);
+  group_cf_ops.compaction_filter_factory =
+    std::make_shared<StreamsDataFilterFactory>(&db_, &handles_);
+
+  meta_cf_ops.table_properties_collector_factories.push_back(
+    std::make_shared<StaleEntriesCollectorFactory>(kBaseMetaFormat));
+  data_cf_ops.table_properties_collector_factories.push_back(
+    std::make_shared<StaleEntriesCollectorFactory>(kVersionedKeyFormat));
+  group_cf_ops.table_properties_collector_factories.push_back(
+    std::make_shared<StaleEntriesCollectorFactory>(kVersionedKeyFormat));
+
+  //use the bloom filter policy to reduce disk reads
+  rocksdb::BlockBasedTableOptions table_options;
+  table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, true));
+  meta_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_options));
+  data_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_options));
+  group_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_options));
+
+  std::vector<rocksdb::ColumnFamilyDescriptor> column_families;
+  // Meta CF
+  column_families.push_back(rocksdb::ColumnFamilyDescriptor(
+      rocksdb::kDefaultColumnFamilyName, meta_cf_ops));
+  // Entry CF
+  column_families.push_back(rocksdb::ColumnFamilyDescriptor(
+      "data_cf", data_cf_ops));
+  // Consumer group CF
+  column_families.push_back(rocksdb::ColumnFamilyDescriptor(
+      "group_cf", group_cf_ops));
+  return rocksdb::DB::Open(db_ops, db_path, column_families, &handles_, &db_);
+}
+
+Status RedisStreams::CompactRange(const rocksdb::Slice* begin,
+                                  const rocksdb::Slice* end) {
+  for (auto handle : handles_) {
+    Status s = db_->CompactRange(default_compact_range_options_,
+        handle, begin, end);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
+Status RedisStreams::CompactKey(const Slice& key) {
+  Status s = CompactKeyData(key, handles_[1]);
+  if (!s.ok()) {
+    return s;
+  }
+  std::string start_key, end_key;
+  CalculateStartAndEndKey(key.ToString(), &start_key, &end_key);
+  Slice begin(start_key), end(end_key);
+  return db_->CompactRange(default_compact_range_options_,
+      handles_[2], &begin, &end);
+}
+
+Status RedisStreams::GetStaleEntries(uint64_t* stale, uint64_t* total) {
+  return SumStaleEntries(db_, handles_, stale, total);
+}
+
+Status RedisStreams::GetProperty(const std::string& property, std::string* out) {
+  db_->GetProperty(property, out);
+  return Status::OK();
+}
+
+Status RedisStreams::ScanKeyNum(uint64_t* num) {
+
+  uint64_t count = 0;
+  rocksdb::ReadOptions iterator_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  iterator_options.snapshot = snapshot;
+  iterator_options.fill_cache = false;
+
+  rocksdb::Iterator* iter = db_->NewIterator(iterator_options, handles_[0]);
+  for (iter->SeekToFirst();
+       iter->Valid();
+       iter->Next()) {
+    ThrottleScan(iter->key().size() + iter->value().size());
+    ParsedStreamsMetaValue parsed_streams_meta_value(iter->value());
+    if (!parsed_streams_meta_value.IsStale()
+      && parsed_streams_meta_value.count() != 0) {
+      count++;
+    }
+  }
+  *num = count;
+  delete iter;
+  return Status::OK();
+}
+
+Status RedisStreams::ScanKeys(const std::string& pattern,
+                              std::vector<std::string>* keys) {
+
+  std::string key;
+  rocksdb::ReadOptions iterator_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  iterator_options.snapshot = snapshot;
+  iterator_options.fill_cache = false;
+
+  rocksdb::Iterator* iter = db_->NewIterator(iterator_options, handles_[0]);
+  for (iter->SeekToFirst();
+       iter->Valid();
+       iter->Next()) {
+    ThrottleScan(iter->key().size() + iter->value().size());
+    ParsedStreamsMetaValue parsed_streams_meta_value(iter->value());
+    if (!parsed_streams_meta_value.IsStale()
+      && parsed_streams_meta_value.count() != 0) {
+      key = iter->key().ToString();
+      if (StringMatch(pattern.data(), pattern.size(), key.data(), key.size(), 0)) {
+        keys->push_back(key);
+      }
+    }
+  }
+  delete iter;
+  return Status::OK();
+}
+
+// The meta value and the entry are written in one batch, without reading
+// any entry
+Status RedisStreams::XAdd(const Slice& key,
+                          const std::vector<FieldValue>& field_values,
+                          StreamID* id) {
+  if (field_values.empty()) {
+    return Status::InvalidArgument("wrong number of arguments");
+  }
+
+  rocksdb::WriteBatch batch;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+
+  int32_t version = 0;
+  std::string meta_value;
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    // An emptied stream keeps its version and its last id, so the ids
+    // given to new entries keep growing
+    ParsedStreamsMetaValue parsed_streams_meta_value(&meta_value);
+    if (parsed_streams_meta_value.IsStale()) {
+      version = parsed_streams_meta_value.InitialMetaValue();
+    } else {
+      version = parsed_streams_meta_value.version();
+    }
+    const StreamID& last_id = parsed_streams_meta_value.last_id();
+    if (*id == StreamID()) {
+      s = NextStreamID(last_id, id);
+      if (!s.ok()) {
+        return s;
+      }
+    } else if (!(last_id < *id)) {
+      return Status::InvalidArgument("The ID specified in XADD is equal or "
+                                     "smaller than the target stream top item");
+    }
+    parsed_streams_meta_value.ModifyCount(1);
+    parsed_streams_meta_value.set_last_id(*id);
+    batch.Put(handles_[0], key, meta_value);
+  } else if (s.IsNotFound()) {
+    if (*id == StreamID()) {
+      s = NextStreamID(StreamID(), id);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    StreamsMetaValue streams_meta_value(1, *id);
+    version = streams_meta_value.UpdateVersion();
+    batch.Put(handles_[0], key, streams_meta_value.Encode());
+  } else {
+    return s;
+  }
+
+  std::string entry_value;
+  EncodeStreamEntry(field_values, &entry_value);
+  StreamsDataKey streams_data_key(key, version, *id);
+  batch.Put(handles_[1], streams_data_key.Encode(), entry_value);
+  return db_->Write(default_write_options_, &batch);
+}
+
+Status RedisStreams::XLen(const Slice& key, int32_t* len) {
+  *len = 0;
+  std::string meta_value;
+  Status s = GetCachedValue(key, &meta_value);
+  if (s.ok()) {
+    ParsedStreamsMetaValue parsed_streams_meta_value(&meta_value);
+    if (parsed_streams_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_streams_meta_value.count() == 0) {
+      return Status::NotFound();
+    } else {
+      *len = parsed_streams_meta_value.count();
+    }
+  }
+  return s;
+}
+
+Status RedisStreams::XRange(const Slice& key, const StreamID& start,
+                            const StreamID& end, int32_t count,
+                            std::vector<StreamEntry>* entries) {
+  entries->clear();
+  std::string meta_value;
+  ScopeIterators iters(db_, {handles_[0], handles_[1]});
+  Status s = iters.Get(0, key, &meta_value);
+  if (s.ok()) {
+    ParsedStreamsMetaValue parsed_streams_meta_value(&meta_value);
+    if (parsed_streams_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_streams_meta_value.count() == 0) {
+      return Status::NotFound();
+    } else if (end < start) {
+      return s;
+    }
+    int32_t version = parsed_streams_meta_value.version();
+    BaseDataKey prefix_key(key, version, Slice());
+    Slice prefix = prefix_key.Encode();
+    StreamsDataKey streams_data_key(key, version, start);
+    StreamEntry entry;
+    rocksdb::Iterator* iter = iters[1];
+    for (iter->Seek(streams_data_key.Encode());
+         iter->Valid() && iter->key().starts_with(prefix)
+           && (count < 0 || static_cast<int32_t>(entries->size()) < count);
+         iter->Next()) {
+      s = ParseEntry(iter, &entry);
+      if (!s.ok()) {
+        return s;
+      }
+      if (end < entry.id) {
+        break;
+      }
+      entries->push_back(entry);
+    }
+  }
+  return s;
+}
+
+Status RedisStreams::XRevRange(const Slice& key, const StreamID& end,
+                               const StreamID& start, int32_t count,
+                               std::vector<StreamEntry>* entries) {
+  entries->clear();
+  std::string meta_value;
+  ScopeIterators iters(db_, {handles_[0], handles_[1]});
+  Status s = iters.Get(0, key, &meta_value);
+  if (s.ok()) {
+    ParsedStreamsMetaValue parsed_streams_meta_value(&meta_value);
+    if (parsed_streams_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_streams_meta_value.count() == 0) {
+      return Status::NotFound();
+    } else if (end < start) {
+      return s;
+    }
+    int32_t version = parsed_streams_meta_value.version();
+    BaseDataKey prefix_key(key, version, Slice());
+    Slice prefix = prefix_key.Encode();
+    StreamsDataKey streams_data_key(key, version, end);
+    StreamEntry entry;
+    rocksdb::Iterator* iter = iters[1];
+    for (iter->SeekForPrev(streams_data_key.Encode());
+         iter->Valid() && iter->key().starts_with(prefix)
+           && (count < 0 || static_cast<int32_t>(entries->size()) < count);
+         iter->Prev()) {
+      s = ParseEntry(iter, &entry);
+      if (!s.ok()) {
+        return s;
+      }
+      if (entry.id < start) {
+        break;
+      }
+      entries->push_back(entry);
+    }
+  }
+  return s;
+}
+
+Status RedisStreams::XDel(const Slice& key, const std::vector<StreamID>& ids,
+                          int32_t* ret) {
+  *ret = 0;
+  rocksdb::WriteBatch batch;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+  std::string meta_value, entry_value;
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedStreamsMetaValue parsed_streams_meta_value(&meta_value);
+    if (parsed_streams_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_streams_meta_value.count() == 0) {
+      return Status::NotFound();
+    }
+    int32_t del_cnt = 0;
+    int32_t version = parsed_streams_meta_value.version();
+    std::set<std::pair<uint64_t, uint64_t>> unique;
+    for (const auto& id : ids) {
+      if (!unique.insert(std::make_pair(id.ms, id.seq)).second) {
+        continue;
+      }
+      StreamsDataKey streams_data_key(key, version, id);
+      s = db_->Get(default_read_options_, handles_[1],
+                   streams_data_key.Encode(), &entry_value);
+      if (s.ok()) {
+        del_cnt++;
+        batch.Delete(handles_[1], streams_data_key.Encode());
+      } else if (!s.IsNotFound()) {
+        return s;
+      }
+    }
+    *ret = del_cnt;
+    if (del_cnt == 0) {
+      return Status::OK();
+    }
+    parsed_streams_meta_value.ModifyCount(-del_cnt);
+    batch.Put(handles_[0], key, meta_value);
+  } else {
+    return s;
+  }
+  return db_->Write(default_write_options_, &batch);
+}
+
+Status RedisStreams::XTrim(const Slice& key, int32_t maxlen, int32_t* ret) {
+  if (maxlen < 0) {
+    *ret = 0;
+    return Status::InvalidArgument("maxlen is negative");
+  }
+  return Trim(key, maxlen, nullptr, ret);
+}
+
+Status RedisStreams::XTrimMinID(const Slice& key, const StreamID& min_id,
+                                int32_t* ret) {
+  return Trim(key, 0, &min_id, ret);
+}
+
+// Trims the oldest entries down to maxlen, or those older than min_id if
+// it is given. The entries are still walked to be counted, but they are
+// removed by a single range tombstone instead of one tombstone each.
+Status RedisStreams::Trim(const Slice& key, int32_t maxlen,
+                          const StreamID* min_id, int32_t* ret) {
+  *ret = 0;
+  rocksdb::WriteBatch batch;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+  std::string meta_value;
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedStreamsMetaValue parsed_streams_meta_value(&meta_value);
+    if (parsed_streams_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_streams_meta_value.count() == 0) {
+      return Status::NotFound();
+    }
+    int32_t to_delete = parsed_streams_meta_value.count() - maxlen;
+    if (min_id == nullptr && to_delete <= 0) {
+      return Status::OK();
+    }
+
+    int32_t del_cnt = 0;
+    int32_t version = parsed_streams_meta_value.version();
+    BaseDataKey prefix_key(key, version, Slice());
+    Slice prefix = prefix_key.Encode();
+    std::string last_key;
+    rocksdb::Iterator* iter = db_->NewIterator(default_read_options_, handles_[1]);
+    for (iter->Seek(prefix);
+         iter->Valid() && iter->key().starts_with(prefix);
+         iter->Next()) {
+      if (min_id == nullptr ? del_cnt >= to_delete
+          : !(ParsedStreamsDataKey(iter->key()).id() < *min_id)) {
+        break;
+      }
+      last_key.assign(iter->key().data(), iter->key().size());
+      del_cnt++;
+    }
+    s = iter->status();
+    delete iter;
+    if (!s.ok()) {
+      return s;
+    }
+    if (del_cnt == 0) {
+      return Status::OK();
+    }
+
+    // The smallest key after the last entry removed closes the range
+    last_key.push_back('\0');
+    batch.DeleteRange(handles_[1], prefix, last_key);
+    *ret = del_cnt;
+    parsed_streams_meta_value.ModifyCount(-del_cnt);
+    batch.Put(handles_[0], key, meta_value);
+  } else {
+    return s;
+  }
+  return db_->Write(default_write_options_, &batch);
+}
+
+Status RedisStreams::XGroupCreate(const Slice& key, const Slice& group,
+                                  const StreamID& id) {
+  ScopeRecordLock l(lock_mgr_, key);
+  std::string meta_value, group_value;
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedStreamsMetaValue parsed_streams_meta_value(&meta_value);
+    if (parsed_streams_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_streams_meta_value.count() == 0) {
+      return Status::NotFound();
+    }
+    StreamsGroupKey streams_group_key(key,
+        parsed_streams_meta_value.version(), group);
+    s = db_->Get(default_read_options_, handles_[2],
+                 streams_group_key.Encode(), &group_value);
+    if (s.ok()) {
+      return Status::InvalidArgument("Consumer group name already exists");
+    } else if (!s.IsNotFound()) {
+      return s;
+    }
+    s = db_->Put(default_write_options_, handles_[2],
+                 streams_group_key.Encode(), EncodeGroupValue(id));
+  }
+  return s;
+}
+
+Status RedisStreams::XGroupDestroy(const Slice& key, const Slice& group) {
+  rocksdb::WriteBatch batch;
+  ScopeRecordLock l(lock_mgr_, key);
+  std::string meta_value;
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedStreamsMetaValue parsed_streams_meta_value(&meta_value);
+    if (parsed_streams_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_streams_meta_value.count() == 0) {
+      return Status::NotFound();
+    }
+    StreamsGroupKey streams_group_key(key,
+        parsed_streams_meta_value.version(), group);
+    Slice group_key = streams_group_key.Encode();
+    // The group comes first, then its pending entries
+    rocksdb::Iterator* iter = db_->NewIterator(default_read_options_, handles_[2]);
+    iter->Seek(group_key);
+    if (!iter->Valid() || iter->key() != group_key) {
+      s = iter->status().ok() ? Status::NotFound("No such consumer group")
+                              : iter->status();
+      delete iter;
+      return s;
+    }
+    for (; iter->Valid() && iter->key().starts_with(group_key); iter->Next()) {
+      batch.Delete(handles_[2], iter->key());
+    }
+    s = iter->status();
+    delete iter;
+    if (!s.ok()) {
+      return s;
+    }
+  } else {
+    return s;
+  }
+  return db_->Write(default_write_options_, &batch);
+}
+
+Status RedisStreams::XReadGroup(const Slice& key, const Slice& group,
+                                const Slice& consumer, int32_t count,
+                                std::vector<StreamEntry>* entries) {
+  entries->clear();
+  rocksdb::WriteBatch batch;
+  ScopeRecordLock l(lock_mgr_, key);
+  std::string meta_value, group_value;
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedStreamsMetaValue parsed_streams_meta_value(&meta_value);
+    if (parsed_streams_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_streams_meta_value.count() == 0) {
+      return Status::NotFound();
+    }
+    int32_t version = parsed_streams_meta_value.version();
+    StreamsGroupKey streams_group_key(key, version, group);
+    s = db_->Get(default_read_options_, handles_[2],
+                 streams_group_key.Encode(), &group_value);
+    if (s.IsNotFound()) {
+      return Status::NotFound("No such consumer group");
+    } else if (!s.ok()) {
+      return s;
+    } else if (group_value.size() < kStreamIDLength) {
+      return Status::Corruption("Invalid consumer group");
+    }
+    StreamID last_delivered_id = DecodeStreamID(group_value.data());
+
+    BaseDataKey prefix_key(key, version, Slice());
+    Slice prefix = prefix_key.Encode();
+    StreamsDataKey streams_data_key(key, version, last_delivered_id);
+    StreamEntry entry;
+    rocksdb::Iterator* iter = db_->NewIterator(default_read_options_, handles_[1]);
+    for (iter->Seek(streams_data_key.Encode());
+         iter->Valid() && iter->key().starts_with(prefix)
+           && (count < 0 || static_cast<int32_t>(entries->size()) < count);
+         iter->Next()) {
+      s = ParseEntry(iter, &entry);
+      if (!s.ok()) {
+        break;
+      }
+      if (entry.id == last_delivered_id) {
+        continue;
+      }
+      entries->push_back(entry);
+    }
+    if (s.ok()) {
+      s = iter->status();
+    }
+    delete iter;
+    if (!s.ok()) {
+      entries->clear();
+      return s;
+    } else if (entries->empty()) {
+      return Status::OK();
+    }
+
+    uint64_t now_ms = slash::NowMicros() / 1000;
+    std::string pending_value = EncodePendingValue(now_ms, 1, consumer);
+    for (const auto& delivered : *entries) {
+      StreamsGroupKey streams_pending_key(key, version, group, delivered.id);
+      batch.Put(handles_[2], streams_pending_key.Encode(), pending_value);
+    }
+    batch.Put(handles_[2], streams_group_key.Encode(),
+              EncodeGroupValue(entries->back().id));
+  } else {
+    return s;
+  }
+  return db_->Write(default_write_options_, &batch);
+}
+
+Status RedisStreams::XAck(const Slice& key, const Slice& group,
+                          const std::vector<StreamID>& ids, int32_t* ret) {
+  *ret = 0;
+  rocksdb::WriteBatch batch;
+  ScopeRecordLock l(lock_mgr_, key);
+  std::string meta_value, pending_value;
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedStreamsMetaValue parsed_streams_meta_value(&meta_value);
+    if (parsed_streams_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_streams_meta_value.count() == 0) {
+      return Status::NotFound();
+    }
+    int32_t ack_cnt = 0;
+    int32_t version = parsed_streams_meta_value.version();
+    std::set<std::pair<uint64_t, uint64_t>> unique;
+    for (const auto& id : ids) {
+      if (!unique.insert(std::make_pair(id.ms, id.seq)).second) {
+        continue;
+      }
+      StreamsGroupKey streams_pending_key(key, version, group, id);
+      s = db_->Get(default_read_options_, handles_[2],
+                   streams_pending_key.Encode(), &pending_value);
+      if (s.ok()) {
+        ack_cnt++;
+        batch.Delete(handles_[2], streams_pending_key.Encode());
+      } else if (!s.IsNotFound()) {
+        return s;
+      }
+    }
+    *ret = ack_cnt;
+    if (ack_cnt == 0) {
+      return Status::OK();
+    }
+  } else {
+    return s;
+  }
+  return db_->Write(default_write_options_, &batch);
+}
+
+Status RedisStreams::XPending(const Slice& key, const Slice& group,
+                              int32_t count,
+                              std::vector<StreamPendingEntry>* entries) {
+  entries->clear();
+  std::string meta_value;
+  ScopeIterators iters(db_, {handles_[0], handles_[2]});
+  Status s = iters.Get(0, key, &meta_value);
+  if (s.ok()) {
+    ParsedStreamsMetaValue parsed_streams_meta_value(&meta_value);
+    if (parsed_streams_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_streams_meta_value.count() == 0) {
+      return Status::NotFound();
+    }
+    StreamsGroupKey streams_group_key(key,
+        parsed_streams_meta_value.version(), group);
+    Slice group_key = streams_group_key.Encode();
+    rocksdb::Iterator* iter = iters[1];
+    iter->Seek(group_key);
+    if (!iter->Valid() || iter->key() != group_key) {
+      return iter->status().ok() ? Status::NotFound("No such consumer group")
+                                 : iter->status();
+    }
+    StreamPendingEntry pending_entry;
+    for (iter->Next();
+         iter->Valid() && iter->key().starts_with(group_key)
+           && (count < 0 || static_cast<int32_t>(entries->size()) < count);
+         iter->Next()) {
+      ParsedStreamsGroupKey parsed_streams_group_key(iter->key());
+      pending_entry.id = parsed_streams_group_key.id();
+      if (!DecodePendingValue(iter->value(), &pending_entry)) {
+        return Status::Corruption("Invalid pending entry");
+      }
+      entries->push_back(pending_entry);
+    }
+    s = iter->status();
+  }
+  return s;
+}
+
+Status RedisStreams::Expire(const Slice& key, int32_t ttl) {
+  std::string meta_value;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedStreamsMetaValue parsed_streams_meta_value(&meta_value);
+    if (parsed_streams_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_streams_meta_value.count() == 0) {
+      return Status::NotFound();
+    }
+    if (ttl > 0) {
+      parsed_streams_meta_value.SetRelativeTimestamp(ttl);
+    } else {
+      parsed_streams_meta_value.InitialMetaValue();
+    }
+    s = db_->Put(default_write_options_, handles_[0], key, meta_value);
+  }
+  return s;
+}
+
+Status RedisStreams::Del(const Slice& key) {
+  std::string meta_value;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedStreamsMetaValue parsed_streams_meta_value(&meta_value);
+    if (parsed_streams_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_streams_meta_value.count() == 0) {
+      return Status::NotFound();
+    } else {
+      parsed_streams_meta_value.InitialMetaValue();
+      s = db_->Put(default_write_options_, handles_[0], key, meta_value);
+    }
+  }
+  return s;
+}
+
+bool RedisStreams::Scan(const std::string& start_key,
+                        const std::string& pattern,
+                        std::vector<std::string>* keys,
+                        int64_t* count,
+                        std::string* next_key) {
+  std::string meta_key;
+  bool is_finish = true;
+  rocksdb::ReadOptions iterator_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  iterator_options.snapshot = snapshot;
+  iterator_options.fill_cache = false;
+
+  rocksdb::Iterator* it = db_->NewIterator(iterator_options, handles_[0]);
+
+  it->Seek(start_key);
+  while (it->Valid() && (*count) > 0) {
+    ParsedStreamsMetaValue parsed_meta_value(it->value());
+    if (parsed_meta_value.IsStale()
+      || parsed_meta_value.count() == 0) {
+      it->Next();
+      continue;
+    } else {
+      meta_key = it->key().ToString();
+      if (StringMatch(pattern.data(), pattern.size(),
+                         meta_key.data(), meta_key.size(), 0)) {
+        keys->push_back(meta_key);
+      }
+      (*count)--;
+      it->Next();
+    }
+  }
+
+  if (it->Valid()) {
+    *next_key = it->key().ToString();
+    is_finish = false;
+  } else {
+    *next_key = "";
+  }
+  delete it;
+  return is_finish;
+}
+
+Status RedisStreams::Expireat(const Slice& key, int32_t timestamp) {
+  std::string meta_value;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedStreamsMetaValue parsed_streams_meta_value(&meta_value);
+    if (parsed_streams_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_streams_meta_value.count() == 0) {
+      return Status::NotFound();
+    } else {
+      parsed_streams_meta_value.set_timestamp(timestamp);
+      s = db_->Put(default_write_options_, handles_[0], key, meta_value);
+    }
+  }
+  return s;
+}
+
+Status RedisStreams::Persist(const Slice& key) {
+  std::string meta_value;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedStreamsMetaValue parsed_streams_meta_value(&meta_value);
+    if (parsed_streams_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_streams_meta_value.count() == 0) {
+      return Status::NotFound();
+    } else {
+      int32_t timestamp = parsed_streams_meta_value.timestamp();
+      if (timestamp == 0) {
+        return Status::NotFound("Not have an associated timeout");
+      }  else {
+        parsed_streams_meta_value.set_timestamp(0);
+        s = db_->Put(default_write_options_, handles_[0], key, meta_value);
+      }
+    }
+  }
+  return s;
+}
+
+Status RedisStreams::TTL(const Slice& key, int64_t* timestamp) {
+  std::string meta_value;
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedStreamsMetaValue parsed_streams_meta_value(&meta_value);
+    if (parsed_streams_meta_value.IsStale()) {
+      *timestamp = -2;
+      return Status::NotFound("Stale");
+    } else if (parsed_streams_meta_value.count() == 0) {
+      *timestamp = -2;
+      return Status::NotFound();
+    } else {
+      *timestamp = parsed_streams_meta_value.timestamp();
+      if (*timestamp == 0) {
+        *timestamp = -1;
+      } else {
+        int64_t curtime;
+        rocksdb::Env::Default()->GetCurrentTime(&curtime);
+        *timestamp = *timestamp - curtime > 0 ? *timestamp - curtime : -1;
+      }
+    }
+  } else if (s.IsNotFound()) {
+    *timestamp = -2;
+  }
+  return s;
+}
+
+void RedisStreams::ScanDatabase() {
+
+  rocksdb::ReadOptions iterator_options;
+  const rocksdb::Snapshot* snapshot;
+  ScopeSnapshot ss(db_, &snapshot);
+  iterator_options.snapshot = snapshot;
+  iterator_options.fill_cache = false;
+  int32_t current_time = time(NULL);
+
+  printf("\n***************Streams Meta Data***************\n");
+  auto meta_iter = db_->NewIterator(iterator_options, handles_[0]);
+  for (meta_iter->SeekToFirst();
+       meta_iter->Valid();
+       meta_iter->Next()) {
+    ParsedStreamsMetaValue parsed_streams_meta_value(meta_iter->value());
+    int32_t survival_time = 0;
+    if (parsed_streams_meta_value.timestamp() != 0) {
+      survival_time = parsed_streams_meta_value.timestamp() - current_time > 0 ?
+        parsed_streams_meta_value.timestamp() - current_time : -1;
+    }
+
+    printf("[key : %-30s] [count : %-10d] [last_id : %llu-%llu] [timestamp : %-10d] [version : %d] [survival_time : %d]\n",
+           meta_iter->key().ToString().c_str(),
+           parsed_streams_meta_value.count(),
+           static_cast<unsigned long long>(parsed_streams_meta_value.last_id().ms),
+           static_cast<unsigned long long>(parsed_streams_meta_value.last_id().seq),
+           parsed_streams_meta_value.timestamp(),
+           parsed_streams_meta_value.version(),
+           survival_time);
+  }
+  delete meta_iter;
+
+  printf("\n***************Streams Entry Data***************\n");
+  auto entry_iter = db_->NewIterator(iterator_options, handles_[1]);
+  for (entry_iter->SeekToFirst();
+       entry_iter->Valid();
+       entry_iter->Next()) {
+    ParsedStreamsDataKey parsed_streams_data_key(entry_iter->key());
+    StreamID id = parsed_streams_data_key.id();
+    printf("[key : %-30s] [id : %llu-%llu] [size : %-5lu] [version : %d]\n",
+           parsed_streams_data_key.key().ToString().c_str(),
+           static_cast<unsigned long long>(id.ms),
+           static_cast<unsigned long long>(id.seq),
+           static_cast<unsigned long>(entry_iter->value().size()),
+           parsed_streams_data_key.version());
+  }
+  delete entry_iter;
+
+  printf("\n***************Streams Group Data***************\n");
+  auto group_iter = db_->NewIterator(iterator_options, handles_[2]);
+  for (group_iter->SeekToFirst();
+       group_iter->Valid();
+       group_iter->Next()) {
+    ParsedStreamsGroupKey parsed_streams_group_key(group_iter->key());
+    if (parsed_streams_group_key.is_pending()) {
+      StreamID id = parsed_streams_group_key.id();
+      printf("[key : %-30s] [group : %-20s] [pending : %llu-%llu] [version : %d]\n",
+             parsed_streams_group_key.key().ToString().c_str(),
+             parsed_streams_group_key.group().ToString().c_str(),
+             static_cast<unsigned long long>(id.ms),
+             static_cast<unsigned long long>(id.seq),
+             parsed_streams_group_key.version());
+    } else {
+      printf("[key : %-30s] [group : %-20s] [version : %d]\n",
+             parsed_streams_group_key.key().ToString().c_str(),
+             parsed_streams_group_key.group().ToString().c_str(),
+             parsed_streams_group_key.version());
+    }
+  }
+  delete group_iter;
+}
+
+}  //  namespace blackwidow
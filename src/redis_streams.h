@@ -0,0 +1,82 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_REDIS_STREAMS_H_
+#define SRC_REDIS_STREAMS_H_
+
+#include <string>
+#include <vector>
+
+#include "src/redis.h"
+#include "blackwidow/blackwidow.h"
+
+namespace blackwidow {
+
+// Streams of entries sorted by id, see streams_meta_value_format.h
+class RedisStreams : public Redis {
+  public:
+    RedisStreams() = default;
+    ~RedisStreams();
+
+    // Common Commands
+    virtual Status Open(const rocksdb::Options& options,
+                        const std::string& db_path) override;
+    virtual Status CompactRange(const rocksdb::Slice* begin,
+                                const rocksdb::Slice* end) override;
+    virtual Status CompactKey(const Slice& key) override;
+    virtual Status GetStaleEntries(uint64_t* stale,
+                                   uint64_t* total) override;
+    virtual Status GetProperty(const std::string& property, std::string* out) override;
+    virtual Status ScanKeyNum(uint64_t* num) override;
+    virtual Status ScanKeys(const std::string& pattern,
+                            std::vector<std::string>* keys) override;
+
+    // Streams Commands
+    Status XAdd(const Slice& key, const std::vector<FieldValue>& field_values,
+                StreamID* id);
+    Status XLen(const Slice& key, int32_t* len);
+    Status XRange(const Slice& key, const StreamID& start,
+                  const StreamID& end, int32_t count,
+                  std::vector<StreamEntry>* entries);
+    Status XRevRange(const Slice& key, const StreamID& end,
+                     const StreamID& start, int32_t count,
+                     std::vector<StreamEntry>* entries);
+    Status XDel(const Slice& key, const std::vector<StreamID>& ids,
+                int32_t* ret);
+    Status XTrim(const Slice& key, int32_t maxlen, int32_t* ret);
+    Status XTrimMinID(const Slice& key, const StreamID& min_id, int32_t* ret);
+    Status XGroupCreate(const Slice& key, const Slice& group,
+                        const StreamID& id);
+    Status XGroupDestroy(const Slice& key, const Slice& group);
+    Status XReadGroup(const Slice& key, const Slice& group,
+                      const Slice& consumer, int32_t count,
+                      std::vector<StreamEntry>* entries);
+    Status XAck(const Slice& key, const Slice& group,
+                const std::vector<StreamID>& ids, int32_t* ret);
+    Status XPending(const Slice& key, const Slice& group, int32_t count,
+                    std::vector<StreamPendingEntry>* entries);
+
+    // Keys Commands
+    virtual Status Expire(const Slice& key, int32_t ttl) override;
+    virtual Status Del(const Slice& key) override;
+    virtual bool Scan(const std::string& start_key, const std::string& pattern,
+                      std::vector<std::string>* keys,
+                      int64_t* count, std::string* next_key) override;
+    virtual Status Expireat(const Slice& key, int32_t timestamp) override;
+    virtual Status Persist(const Slice& key) override;
+    virtual Status TTL(const Slice& key, int64_t* timestamp) override;
+
+    // Iterate all data
+    void ScanDatabase();
+
+  private:
+    std::vector<rocksdb::ColumnFamilyHandle*> handles_;
+
+    Status Trim(const Slice& key, int32_t maxlen, const StreamID* min_id,
+                int32_t* ret);
+};
+
+}  //  namespace blackwidow
+#endif  //  SRC_REDIS_STREAMS_H_
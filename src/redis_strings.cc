@@ -11,28 +11,90 @@
 #include <limits>
 
 #include "blackwidow/util.h"
+#include "src/strings_bitops.h"
 #include "src/strings_filter.h"
 #include "src/scope_record_lock.h"
 #include "src/scope_snapshot.h"
+#include "src/stale_entries_collector.h"
 
 namespace blackwidow {
 
+RedisStrings::~RedisStrings() {
+  std::vector<rocksdb::ColumnFamilyHandle*> tmp_handles = handles_;
+  handles_.clear();
+  for (auto handle : tmp_handles) {
+    delete handle;
+  }
+}
+
 Status RedisStrings::Open(const rocksdb::Options& options,
     const std::string& db_path) {
   rocksdb::Options ops(options);
-  ops.compaction_filter_factory = std::make_shared<StringsFilterFactory>();
+  Status s = rocksdb::DB::Open(ops, db_path, &db_);
+  if (s.ok()) {
+    // create column family
+    rocksdb::ColumnFamilyHandle* cf;
+    s = db_->CreateColumnFamily(rocksdb::ColumnFamilyOptions(),
+        "data_cf", &cf);
+    if (!s.ok()) {
+      return s;
+    }
+    // close DB
+    delete cf;
+    delete db_;
+  }
+
+  // Open
+  rocksdb::DBOptions db_ops(options);
+  rocksdb::ColumnFamilyOptions strings_cf_ops(options);
+  rocksdb::ColumnFamilyOptions segments_cf_ops(options);
+  strings_cf_ops.compaction_filter_factory =
+    std::make_shared<StringsFilterFactory>();
+  segments_cf_ops.compaction_filter_factory =
+    std::make_shared<StringsSegmentFilterFactory>(&db_, &handles_);
+
+  strings_cf_ops.table_properties_collector_factories.push_back(
+    std::make_shared<StaleEntriesCollectorFactory>(kStringsValueFormat));
+  segments_cf_ops.table_properties_collector_factories.push_back(
+    std::make_shared<StaleEntriesCollectorFactory>(kSegmentKeyFormat));
 
   //use the bloom filter policy to reduce disk reads
   rocksdb::BlockBasedTableOptions table_options;
   table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, true));
-  ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_options));
+  strings_cf_ops.table_factory.reset(
+      rocksdb::NewBlockBasedTableFactory(table_options));
+  segments_cf_ops.table_factory.reset(
+      rocksdb::NewBlockBasedTableFactory(table_options));
 
-  return rocksdb::DB::Open(ops, db_path, &db_);
+  std::vector<rocksdb::ColumnFamilyDescriptor> column_families;
+  // Strings values and segments metas
+  column_families.push_back(rocksdb::ColumnFamilyDescriptor(
+      rocksdb::kDefaultColumnFamilyName, strings_cf_ops));
+  // Segments of the large values
+  column_families.push_back(rocksdb::ColumnFamilyDescriptor(
+      "data_cf", segments_cf_ops));
+  return rocksdb::DB::Open(db_ops, db_path, column_families, &handles_, &db_);
 }
 
 Status RedisStrings::CompactRange(const rocksdb::Slice* begin,
     const rocksdb::Slice* end) {
-  return db_->CompactRange(default_compact_range_options_, begin, end);
+  Status s = db_->CompactRange(default_compact_range_options_,
+      handles_[0], begin, end);
+  if (!s.ok()) {
+    return s;
+  }
+  // The segment keys are prefixed with the key size, the range of user
+  // keys does not map to a range of segment keys
+  return db_->CompactRange(default_compact_range_options_,
+      handles_[1], nullptr, nullptr);
+}
+
+Status RedisStrings::CompactKey(const Slice& key) {
+  return CompactKeyData(key, handles_[1]);
+}
+
+Status RedisStrings::GetStaleEntries(uint64_t* stale, uint64_t* total) {
+  return SumStaleEntries(db_, handles_, stale, total);
 }
 
 Status RedisStrings::GetProperty(const std::string& property, std::string* out) {
@@ -55,6 +117,7 @@ Status RedisStrings::ScanKeyNum(uint64_t* num) {
   for (iter->SeekToFirst();
        iter->Valid();
        iter->Next()) {
+    ThrottleScan(iter->key().size() + iter->value().size());
     ParsedStringsValue parsed_strings_value(iter->value());
     if (!parsed_strings_value.IsStale()) {
       count++;
@@ -80,6 +143,7 @@ Status RedisStrings::ScanKeys(const std::string& pattern,
   for (iter->SeekToFirst();
        iter->Valid();
        iter->Next()) {
+    ThrottleScan(iter->key().size() + iter->value().size());
     ParsedStringsValue parsed_strings_value(iter->value());
     if (!parsed_strings_value.IsStale()) {
       key = iter->key().ToString();
@@ -97,53 +161,37 @@ Status RedisStrings::Append(const Slice& key, const Slice& value,
   std::string old_value;
   *ret = 0;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, key, &old_value);
   if (s.ok()) {
     ParsedStringsValue parsed_strings_value(&old_value);
     if (parsed_strings_value.IsStale()) {
       *ret = value.size();
       StringsValue strings_value(value);
-      return db_->Put(default_write_options_, key, strings_value.Encode());
+      return PutValue(key, &strings_value);
     } else {
+      int32_t timestamp = parsed_strings_value.timestamp();
       parsed_strings_value.StripSuffix();
+      if (StringsSegmentsMeta::IsSegmentsMeta(old_value)) {
+        // Only the tail segments are rewritten
+        StringsSegmentsMeta meta(old_value);
+        return SegmentsSetrange(key, meta, timestamp, meta.length(),
+                                value, ret);
+      }
       *ret = old_value.size() + value.size();
-      old_value += value.data();
+      old_value.append(value.data(), value.size());
       StringsValue strings_value(old_value);
-      return db_->Put(default_write_options_, key, strings_value.Encode());
+      strings_value.set_timestamp(timestamp);
+      return PutValue(key, &strings_value);
     }
   } else if (s.IsNotFound()) {
     *ret = value.size();
     StringsValue strings_value(value);
-    return db_->Put(default_write_options_, key, strings_value.Encode());
+    return PutValue(key, &strings_value);
   }
   return s;
 }
 
-int GetBitCount(const unsigned char* value, int64_t bytes) {
-  int bit_num = 0;
-  static const unsigned char bitsinbyte[256] =
-    {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
-     1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-     1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-     2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-     1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-     2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-     2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-     3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-     1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-     2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-     2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-     3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-     2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-     3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-     3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-     4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8};
-  for (int i = 0; i < bytes; i++) {
-    bit_num += bitsinbyte[static_cast<unsigned int>(value[i])];
-  }
-  return bit_num;
-}
-
 Status RedisStrings::BitCount(const Slice& key,
                               int64_t start_offset, int64_t end_offset,
                               int32_t* ret, bool have_range) {
@@ -158,7 +206,9 @@ Status RedisStrings::BitCount(const Slice& key,
       parsed_strings_value.StripSuffix();
       const unsigned char* bit_value =
         reinterpret_cast<const unsigned char*>(value.data());
-      int64_t value_length = value.length();
+      bool segmented = StringsSegmentsMeta::IsSegmentsMeta(value);
+      int64_t value_length = segmented ?
+        StringsSegmentsMeta(value).length() : value.length();
       if (have_range) {
         if (start_offset < 0) {
           start_offset = start_offset + value_length;
@@ -183,6 +233,10 @@ Status RedisStrings::BitCount(const Slice& key,
         start_offset = 0;
         end_offset = std::max(value_length - 1, static_cast<int64_t>(0));
       }
+      if (segmented) {
+        return SegmentsBitCount(key, StringsSegmentsMeta(value),
+                                start_offset, end_offset, ret);
+      }
       *ret = GetBitCount(bit_value + start_offset,
                          end_offset - start_offset + 1);
     }
@@ -195,45 +249,19 @@ Status RedisStrings::BitCount(const Slice& key,
 std::string BitOpOperate(BitOpType op,
                          const std::vector<std::string> &src_values,
                          int64_t max_len) {
-  char* dest_value = new char[max_len];
-
-  char byte, output;
-  for (int64_t j = 0; j < max_len; j++) {
-    if (j < static_cast<int64_t>(src_values[0].size())) {
-      output = src_values[0][j];
-    } else {
-      output = 0;
-    }
-    if (op == kBitOpNot) {
-      output = ~(output);
-    }
-    for (size_t i = 1; i < src_values.size(); i++) {
-      if (static_cast<int64_t>(src_values[i].size()) - 1 >= j) {
-        byte = src_values[i][j];
-      } else {
-        byte = 0;
-      }
-      switch (op) {
-        case kBitOpNot:
-          break;
-        case kBitOpAnd:
-          output &= byte;
-          break;
-        case kBitOpOr:
-          output |= byte;
-          break;
-        case kBitOpXor:
-          output ^= byte;
-          break;
-        case kBitOpDefault:
-          break;
-      }
-    }
-    dest_value[j] = output;
+  std::string dest_value(src_values[0], 0,
+      std::min(static_cast<int64_t>(src_values[0].size()), max_len));
+  dest_value.resize(max_len, '\0');
+  unsigned char* dest = reinterpret_cast<unsigned char*>(&dest_value[0]);
+  if (op == kBitOpNot) {
+    BitOpApply(op, dest, nullptr, 0, max_len);
+  }
+  for (size_t i = 1; i < src_values.size(); i++) {
+    BitOpApply(op, dest,
+               reinterpret_cast<const unsigned char*>(src_values[i].data()),
+               src_values[i].size(), max_len);
   }
-  std::string dest_str(dest_value, max_len);
-  delete[] dest_value;
-  return dest_str;
+  return dest_value;
 }
 
 Status RedisStrings::BitOp(BitOpType op,
@@ -259,8 +287,20 @@ Status RedisStrings::BitOp(BitOpType op,
         value_len = 0;
       } else {
         parsed_strings_value.StripSuffix();
+        if (StringsSegmentsMeta::IsSegmentsMeta(value)) {
+          StringsSegmentsMeta meta(value);
+          value_len = meta.length();
+          if (value_len <= static_cast<int64_t>(kSegmentsThreshold)
+            || meta.segment_size() != kSegmentSize) {
+            s = LoadSegments(default_read_options_, src_keys[i], &value);
+            if (!s.ok()) {
+              return s;
+            }
+          }
+        } else {
+          value_len = value.size();
+        }
         src_values.push_back(value);
-        value_len = value.size();
       }
     } else if (s.IsNotFound()) {
       src_values.push_back(std::string(""));
@@ -271,19 +311,26 @@ Status RedisStrings::BitOp(BitOpType op,
     max_len = std::max(max_len, value_len);
   }
 
+  if (max_len > static_cast<int64_t>(kSegmentsThreshold)) {
+    *ret = max_len;
+    return SegmentsBitOp(op, dest_key, src_keys, src_values, max_len);
+  }
+
   std::string dest_value = BitOpOperate(op, src_values, max_len);
   *ret = dest_value.size();
 
   StringsValue strings_value(Slice(dest_value.c_str(),
                                    static_cast<size_t>(max_len)));
   ScopeRecordLock l(lock_mgr_, dest_key);
-  return db_->Put(default_write_options_, dest_key, strings_value.Encode());
+  ScopeRowCacheInvalidate ri(row_cache_, dest_key);
+  return PutValue(dest_key, &strings_value);
 }
 
 Status RedisStrings::Decrby(const Slice& key, int64_t value, int64_t* ret) {
   std::string old_value;
   std::string new_value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, key, &old_value);
   if (s.ok()) {
     ParsedStringsValue parsed_strings_value(&old_value);
@@ -291,7 +338,7 @@ Status RedisStrings::Decrby(const Slice& key, int64_t value, int64_t* ret) {
       *ret = -value;
       new_value = std::to_string(*ret);
       StringsValue strings_value(new_value);
-      return db_->Put(default_write_options_, key, strings_value.Encode());
+      return PutValue(key, &strings_value);
     } else {
       parsed_strings_value.StripSuffix();
       char* end = nullptr;
@@ -306,20 +353,20 @@ Status RedisStrings::Decrby(const Slice& key, int64_t value, int64_t* ret) {
       *ret = ival - value;
       new_value = std::to_string(*ret);
       StringsValue strings_value(new_value);
-      return db_->Put(default_write_options_, key, strings_value.Encode());
+      return PutValue(key, &strings_value);
     }
   } else if (s.IsNotFound()) {
     *ret = -value;
     new_value = std::to_string(*ret);
     StringsValue strings_value(new_value);
-    return db_->Put(default_write_options_, key, strings_value.Encode());
+    return PutValue(key, &strings_value);
   } else {
     return s;
   }
 }
 
 Status RedisStrings::Get(const Slice& key, std::string* value) {
-  Status s = db_->Get(default_read_options_, key, value);
+  Status s = GetCachedValue(key, value);
   if (s.ok()) {
     ParsedStringsValue parsed_strings_value(value);
     if (parsed_strings_value.IsStale()) {
@@ -327,6 +374,35 @@ Status RedisStrings::Get(const Slice& key, std::string* value) {
       return Status::NotFound("Stale");
     } else {
       parsed_strings_value.StripSuffix();
+      s = LoadSegments(default_read_options_, key, value);
+    }
+  }
+  return s;
+}
+
+Status RedisStrings::Get(const Slice& key, PinnableValue* value) {
+  value->value_.clear();
+  Status s = GetCachedValue(key, &value->pinnable_);
+  if (s.ok()) {
+    // The suffix is sliced off, the pinned value is left untouched
+    ParsedStringsValue parsed_strings_value(
+        static_cast<const Slice&>(value->pinnable_));
+    if (parsed_strings_value.IsStale()) {
+      value->Reset();
+      return Status::NotFound("Stale");
+    }
+    value->value_ = parsed_strings_value.value();
+    if (StringsSegmentsMeta::IsSegmentsMeta(value->value_)) {
+      std::string user_value = value->value_.ToString();
+      s = LoadSegments(default_read_options_, key, &user_value);
+      value->pinnable_.Reset();
+      if (!s.ok()) {
+        value->value_.clear();
+        return s;
+      }
+      value->pinnable_.GetSelf()->swap(user_value);
+      value->pinnable_.PinSelf();
+      value->value_ = value->pinnable_;
     }
   }
   return s;
@@ -346,6 +422,21 @@ Status RedisStrings::GetBit(const Slice& key, int64_t offset, int32_t* ret) {
         data_value = parsed_strings_value.value().ToString();
       }
     }
+    if (StringsSegmentsMeta::IsSegmentsMeta(data_value)) {
+      // Only read the segment holding the bit
+      StringsSegmentsMeta meta(data_value);
+      uint64_t byte = offset >> 3;
+      if (offset < 0 || byte >= meta.length()) {
+        *ret = 0;
+        return Status::OK();
+      }
+      s = GetSegment(default_read_options_, key, meta,
+                     byte / meta.segment_size(), &data_value);
+      if (!s.ok()) {
+        return s;
+      }
+      offset -= (byte - byte % meta.segment_size()) << 3;
+    }
     size_t byte = offset >> 3;
     size_t bit = 7 - (offset & 0x7);
     if (byte + 1 > data_value.length()) {
@@ -371,7 +462,9 @@ Status RedisStrings::Getrange(const Slice& key,
       return Status::NotFound("Stale");
     } else {
       parsed_strings_value.StripSuffix();
-      int64_t size = value.size();
+      bool segmented = StringsSegmentsMeta::IsSegmentsMeta(value);
+      int64_t size = segmented ?
+        StringsSegmentsMeta(value).length() : value.size();
       int64_t start_t = start_offset >= 0 ? start_offset : size + start_offset;
       int64_t end_t = end_offset >= 0 ? end_offset : size + end_offset;
       if (start_t > size - 1 ||
@@ -389,6 +482,11 @@ Status RedisStrings::Getrange(const Slice& key,
       if (start_t == 0 && end_t < 0) {
         end_t = 0;
       }
+      if (segmented) {
+        // Only read the segments holding the range
+        return SegmentsGetrange(key, StringsSegmentsMeta(value),
+                                start_t, end_t, ret);
+      }
       *ret = value.substr(start_t, end_t-start_t+1);
       return Status::OK();
     }
@@ -400,6 +498,7 @@ Status RedisStrings::Getrange(const Slice& key,
 Status RedisStrings::GetSet(const Slice& key, const Slice& value,
                             std::string* old_value) {
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, key, old_value);
   if (s.ok()) {
     ParsedStringsValue parsed_strings_value(old_value);
@@ -407,18 +506,23 @@ Status RedisStrings::GetSet(const Slice& key, const Slice& value,
       *old_value = "";
     } else {
       parsed_strings_value.StripSuffix();
+      s = LoadSegments(default_read_options_, key, old_value);
+      if (!s.ok()) {
+        return s;
+      }
     }
   } else if (!s.IsNotFound()) {
     return s;
   }
   StringsValue strings_value(value);
-  return db_->Put(default_write_options_, key, strings_value.Encode());
+  return PutValue(key, &strings_value);
 }
 
 Status RedisStrings::Incrby(const Slice& key, int64_t value, int64_t* ret) {
   std::string old_value;
   std::string new_value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, key, &old_value);
   if (s.ok()) {
     ParsedStringsValue parsed_strings_value(&old_value);
@@ -427,7 +531,7 @@ Status RedisStrings::Incrby(const Slice& key, int64_t value, int64_t* ret) {
       char buf[32];
       Int64ToStr(buf, 32, value);
       StringsValue strings_value(buf);
-      return db_->Put(default_write_options_, key, strings_value.Encode());
+      return PutValue(key, &strings_value);
     } else {
       parsed_strings_value.StripSuffix();
       char* end = nullptr;
@@ -443,14 +547,14 @@ Status RedisStrings::Incrby(const Slice& key, int64_t value, int64_t* ret) {
       char buf[32];
       Int64ToStr(buf, 32, *ret);
       StringsValue strings_value(buf);
-      return db_->Put(default_write_options_, key, strings_value.Encode());
+      return PutValue(key, &strings_value);
     }
   } else if (s.IsNotFound()) {
     *ret = value;
     char buf[32];
     Int64ToStr(buf, 32, value);
     StringsValue strings_value(buf);
-    return db_->Put(default_write_options_, key, strings_value.Encode());
+    return PutValue(key, &strings_value);
   } else {
     return s;
   }
@@ -464,6 +568,7 @@ Status RedisStrings::Incrbyfloat(const Slice& key, const Slice& value,
     return Status::Corruption("Value is not a vaild float");
   }
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, key, &old_value);
   if (s.ok()) {
     ParsedStringsValue parsed_strings_value(&old_value);
@@ -471,7 +576,7 @@ Status RedisStrings::Incrbyfloat(const Slice& key, const Slice& value,
       LongDoubleToStr(long_double_by, &new_value);
       *ret = new_value;
       StringsValue strings_value(new_value);
-      return db_->Put(default_write_options_, key, strings_value.Encode());
+      return PutValue(key, &strings_value);
     } else {
       parsed_strings_value.StripSuffix();
       long double total, old_number;
@@ -485,13 +590,13 @@ Status RedisStrings::Incrbyfloat(const Slice& key, const Slice& value,
       }
       *ret = new_value;
       StringsValue strings_value(new_value);
-      return db_->Put(default_write_options_, key, strings_value.Encode());
+      return PutValue(key, &strings_value);
     }
   } else if (s.IsNotFound()) {
     LongDoubleToStr(long_double_by, &new_value);
     *ret = new_value;
     StringsValue strings_value(new_value);
-    return db_->Put(default_write_options_, key, strings_value.Encode());
+    return PutValue(key, &strings_value);
   } else {
     return s;
   }
@@ -499,25 +604,31 @@ Status RedisStrings::Incrbyfloat(const Slice& key, const Slice& value,
 
 Status RedisStrings::MGet(const std::vector<std::string>& keys,
                           std::vector<std::string>* values) {
-  Status s;
-  std::string value;
   rocksdb::ReadOptions read_options;
   const rocksdb::Snapshot* snapshot;
   ScopeSnapshot ss(db_, &snapshot);
   read_options.snapshot = snapshot;
-  for (const auto& key : keys) {
-    s = db_->Get(read_options, key, &value);
-    if (s.ok()) {
+  std::vector<Slice> key_slices(keys.begin(), keys.end());
+  std::vector<std::string> raw_values;
+  std::vector<Status> statuses = db_->MultiGet(read_options,
+                                               key_slices, &raw_values);
+  for (size_t idx = 0; idx < keys.size(); ++idx) {
+    std::string& value = raw_values[idx];
+    if (statuses[idx].ok()) {
       ParsedStringsValue parsed_strings_value(&value);
       if (parsed_strings_value.IsStale()) {
         value.clear();
       } else {
         parsed_strings_value.StripSuffix();
+        Status s = LoadSegments(read_options, keys[idx], &value);
+        if (!s.ok()) {
+          return s;
+        }
       }
     } else {
       value.clear();
     }
-    values->push_back(value);
+    values->push_back(std::move(value));
   }
   return Status::OK();
 }
@@ -529,10 +640,11 @@ Status RedisStrings::MSet(const std::vector<KeyValue>& kvs) {
   }
 
   MultiScopeRecordLock ml(lock_mgr_, keys);
+  ScopeRowCacheInvalidate ri(row_cache_, keys);
   rocksdb::WriteBatch batch;
   for (const auto& kv : kvs) {
     StringsValue strings_value(kv.value);
-    batch.Put(kv.key, strings_value.Encode());
+    WriteValue(&batch, kv.key, &strings_value);
   }
   return db_->Write(default_write_options_, &batch);
 }
@@ -565,10 +677,11 @@ Status RedisStrings::MSetnx(const std::vector<KeyValue>& kvs,
 Status RedisStrings::Set(const Slice& key, const Slice& value, const int32_t ttl) {
   StringsValue strings_value(value);
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   if (ttl > 0) {
     strings_value.SetRelativeTimestamp(ttl);
   }
-  return db_->Put(default_write_options_, key, strings_value.Encode());
+  return PutValue(key, &strings_value);
 }
 
 Status RedisStrings::Setxx(const Slice& key, const Slice& value, int32_t* ret, const int32_t ttl) {
@@ -576,6 +689,7 @@ Status RedisStrings::Setxx(const Slice& key, const Slice& value, int32_t* ret, c
   std::string old_value;
   StringsValue strings_value(value);
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, key, &old_value);
   if (s.ok()) {
     ParsedStringsValue parsed_strings_value(old_value);
@@ -594,8 +708,38 @@ Status RedisStrings::Setxx(const Slice& key, const Slice& value, int32_t* ret, c
     if (ttl > 0) {
       strings_value.SetRelativeTimestamp(ttl);
     }
-    return db_->Put(default_write_options_, key, strings_value.Encode());
+    return PutValue(key, &strings_value);
+  }
+}
+
+Status RedisStrings::Setvx(const Slice& key, const Slice& value,
+                           const Slice& new_value, int32_t* ret) {
+  *ret = 0;
+  std::string old_value;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+  Status s = db_->Get(default_read_options_, key, &old_value);
+  if (s.ok()) {
+    ParsedStringsValue parsed_strings_value(&old_value);
+    if (parsed_strings_value.IsStale()) {
+      return Status::OK();
+    }
+    int32_t timestamp = parsed_strings_value.timestamp();
+    parsed_strings_value.StripSuffix();
+    s = LoadSegments(default_read_options_, key, &old_value);
+    if (!s.ok()) {
+      return s;
+    } else if (value.compare(old_value) != 0) {
+      return Status::OK();
+    }
+    StringsValue strings_value(new_value);
+    strings_value.set_timestamp(timestamp);
+    *ret = 1;
+    return PutValue(key, &strings_value);
+  } else if (s.IsNotFound()) {
+    return Status::OK();
   }
+  return s;
 }
 
 Status RedisStrings::SetBit(const Slice& key, int64_t offset,
@@ -606,17 +750,46 @@ Status RedisStrings::SetBit(const Slice& key, int64_t offset,
   }
 
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, key, &meta_value);
   if (s.ok() || s.IsNotFound()) {
     std::string data_value;
+    int32_t timestamp = 0;
     if (s.ok()) {
       ParsedStringsValue parsed_strings_value(&meta_value);
       if (!parsed_strings_value.IsStale()) {
         data_value = parsed_strings_value.value().ToString();
+        timestamp = parsed_strings_value.timestamp();
       }
     }
+    if (StringsSegmentsMeta::IsSegmentsMeta(data_value)) {
+      return SegmentsSetBit(key, StringsSegmentsMeta(data_value), timestamp,
+                            offset, on, ret);
+    }
     size_t byte = offset >> 3;
     size_t bit = 7 - (offset & 0x7);
+    if (byte >= kSegmentsThreshold && byte >= data_value.size()) {
+      // The value grows into segments, only the old bytes and the segment
+      // holding the bit are written, the zeros between them are not stored
+      *ret = 0;
+      if (!on) {
+        return Status::OK();
+      }
+      rocksdb::WriteBatch batch;
+      StringsSegmentsMeta meta(byte + 1,
+          db_->GetLatestSequenceNumber() + 1, kSegmentSize);
+      PutSegments(&batch, key, meta, data_value);
+      std::string segment(byte % kSegmentSize + 1, '\0');
+      segment.back() = static_cast<char>(1 << bit);
+      StringsSegmentKey segment_key(key, meta.version(),
+                                    byte / kSegmentSize);
+      batch.Put(handles_[1], segment_key.Encode(), segment);
+      std::string new_meta = meta.Encode();
+      StringsValue strings_value(new_meta);
+      strings_value.set_timestamp(timestamp);
+      batch.Put(key, strings_value.Encode());
+      return db_->Write(default_write_options_, &batch);
+    }
     char byte_val;
     size_t value_lenth = data_value.length();
     if (byte + 1 > value_lenth) {
@@ -638,7 +811,8 @@ Status RedisStrings::SetBit(const Slice& key, int64_t offset,
       data_value.append(1, byte_val);
     }
     StringsValue strings_value(data_value);
-    return  db_->Put(rocksdb::WriteOptions(), key, strings_value.Encode());
+    strings_value.set_timestamp(timestamp);
+    return PutValue(key, &strings_value);
   } else {
     return s;
   }
@@ -651,13 +825,15 @@ Status RedisStrings::Setex(const Slice& key, const Slice& value, int32_t ttl) {
   StringsValue strings_value(value);
   strings_value.SetRelativeTimestamp(ttl);
   ScopeRecordLock l(lock_mgr_, key);
-  return db_->Put(default_write_options_, key, strings_value.Encode());
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+  return PutValue(key, &strings_value);
 }
 
 Status RedisStrings::Setnx(const Slice& key, const Slice& value, int32_t* ret, const int32_t ttl) {
   *ret = 0;
   std::string old_value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, key, &old_value);
   if (s.ok()) {
     ParsedStringsValue parsed_strings_value(&old_value);
@@ -666,7 +842,7 @@ Status RedisStrings::Setnx(const Slice& key, const Slice& value, int32_t* ret, c
       if (ttl > 0) {
         strings_value.SetRelativeTimestamp(ttl);
       }
-      s = db_->Put(default_write_options_, key, strings_value.Encode());
+      s = PutValue(key, &strings_value);
       if (s.ok()) {
         *ret = 1;
       }
@@ -676,7 +852,7 @@ Status RedisStrings::Setnx(const Slice& key, const Slice& value, int32_t* ret, c
     if (ttl > 0) {
       strings_value.SetRelativeTimestamp(ttl);
     }
-    s = db_->Put(default_write_options_, key, strings_value.Encode());
+    s = PutValue(key, &strings_value);
     if (s.ok()) {
       *ret = 1;
     }
@@ -693,15 +869,23 @@ Status RedisStrings::Setrange(const Slice& key, int64_t start_offset,
   }
 
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, key, &old_value);
   if (s.ok()) {
     ParsedStringsValue parsed_strings_value(&old_value);
+    int32_t timestamp = 0;
     parsed_strings_value.StripSuffix();
     if (parsed_strings_value.IsStale()) {
       std::string tmp(start_offset, '\0');
       new_value = tmp.append(value.data());
       *ret = new_value.length();
     } else {
+      timestamp = parsed_strings_value.timestamp();
+      if (StringsSegmentsMeta::IsSegmentsMeta(old_value)) {
+        // Only the segments covered by the range are rewritten
+        return SegmentsSetrange(key, StringsSegmentsMeta(old_value),
+                                timestamp, start_offset, value, ret);
+      }
       if (static_cast<size_t>(start_offset) > old_value.length()) {
         old_value.resize(start_offset);
         new_value = old_value.append(value.data());
@@ -716,72 +900,33 @@ Status RedisStrings::Setrange(const Slice& key, int64_t start_offset,
     }
     *ret = new_value.length();
     StringsValue strings_value(new_value);
-    return db_->Put(default_write_options_, key, strings_value.Encode());
+    strings_value.set_timestamp(timestamp);
+    return PutValue(key, &strings_value);
   } else if (s.IsNotFound()) {
     std::string tmp(start_offset, '\0');
     new_value = tmp.append(value.data());
     *ret = new_value.length();
     StringsValue strings_value(new_value);
-    return db_->Put(default_write_options_, key, strings_value.Encode());
+    return PutValue(key, &strings_value);
   }
   return s;
 }
 
 Status RedisStrings::Strlen(const Slice& key, int32_t *len) {
+  *len = 0;
   std::string value;
-  Status s = Get(key, &value);
+  Status s = GetCachedValue(key, &value);
   if (s.ok()) {
-    *len = value.size();
-  } else {
-    *len = 0;
-  }
-  return s;
-}
-
-int32_t GetBitPos(const unsigned char* s, unsigned int bytes, int bit) {
-  uint64_t word = 0;
-  uint64_t skip_val = 0;
-  unsigned char* value = const_cast<unsigned char *>(s);
-  uint64_t* l = reinterpret_cast<uint64_t *>(value);
-  int pos = 0;
-  if (bit == 0) {
-    skip_val = std::numeric_limits<uint64_t>::max();
-  } else {
-    skip_val = 0;
-  }
-  // skip 8 bytes at one time, find the first int64 that should not be skipped
-  while (bytes >= sizeof(*l)) {
-    if (*l != skip_val) {
-      break;
-    }
-    l++;
-    bytes = bytes - sizeof(*l);
-    pos = pos + 8 * sizeof(*l);
-  }
-  unsigned char * c = reinterpret_cast<unsigned char *>(l);
-  for (size_t j = 0; j < sizeof(*l); j++) {
-    word = word << 8;
-    if (bytes) {
-      word = word | *c;
-      c++;
-      bytes--;
-    }
-  }
-  if (bit == 1 && word == 0) {
-    return -1;
-  }
-  // set each bit of mask to 0 except msb
-  uint64_t mask = std::numeric_limits<uint64_t>::max();
-  mask = mask >> 1;
-  mask = ~(mask);
-  while (mask) {
-    if (((word & mask) != 0) == bit) {
-      return pos;
+    ParsedStringsValue parsed_strings_value(&value);
+    if (parsed_strings_value.IsStale()) {
+      return Status::NotFound("Stale");
     }
-    pos++;
-    mask = mask >> 1;
+    parsed_strings_value.StripSuffix();
+    // The length of a segmented value is kept in its meta
+    *len = StringsSegmentsMeta::IsSegmentsMeta(value) ?
+      StringsSegmentsMeta(value).length() : value.size();
   }
-  return pos;
+  return s;
 }
 
 Status RedisStrings::BitPos(const Slice& key, int32_t bit,
@@ -802,14 +947,17 @@ Status RedisStrings::BitPos(const Slice& key, int32_t bit,
       parsed_strings_value.StripSuffix();
       const unsigned char* bit_value =
         reinterpret_cast<const unsigned char* >(value.data());
-      int64_t value_length = value.length();
+      bool segmented = StringsSegmentsMeta::IsSegmentsMeta(value);
+      int64_t value_length = segmented ?
+        StringsSegmentsMeta(value).length() : value.length();
       int64_t start_offset = 0;
       int64_t end_offset = std::max(value_length - 1, static_cast<int64_t>(0));
+      if (segmented) {
+        return SegmentsBitPos(key, StringsSegmentsMeta(value), bit,
+                              start_offset, end_offset, ret);
+      }
       int64_t bytes = end_offset - start_offset + 1;
       int64_t pos = GetBitPos(bit_value + start_offset, bytes, bit);
-      if (pos == (8 * bytes) && bit == 0) {
-        pos = -1;
-      }
       if (pos != -1) {
         pos = pos + 8 * start_offset;
       }
@@ -839,7 +987,9 @@ Status RedisStrings::BitPos(const Slice& key, int32_t bit,
       parsed_strings_value.StripSuffix();
       const unsigned char* bit_value =
         reinterpret_cast<const unsigned char* >(value.data());
-      int64_t value_length = value.length();
+      bool segmented = StringsSegmentsMeta::IsSegmentsMeta(value);
+      int64_t value_length = segmented ?
+        StringsSegmentsMeta(value).length() : value.length();
       int64_t end_offset = std::max(value_length - 1, static_cast<int64_t>(0));
       if (start_offset < 0) {
         start_offset = start_offset + value_length;
@@ -855,11 +1005,12 @@ Status RedisStrings::BitPos(const Slice& key, int32_t bit,
         *ret = -1;
         return Status::OK();
       }
+      if (segmented) {
+        return SegmentsBitPos(key, StringsSegmentsMeta(value), bit,
+                              start_offset, end_offset, ret);
+      }
       int64_t bytes = end_offset - start_offset + 1;
       int64_t pos = GetBitPos(bit_value + start_offset, bytes, bit);
-      if (pos == (8 * bytes) && bit == 0) {
-        pos = -1;
-      }
       if (pos != -1) {
         pos = pos + 8 * start_offset;
       }
@@ -890,7 +1041,9 @@ Status RedisStrings::BitPos(const Slice& key, int32_t bit,
       parsed_strings_value.StripSuffix();
       const unsigned char* bit_value =
         reinterpret_cast<const unsigned char* >(value.data());
-      int64_t value_length = value.length();
+      bool segmented = StringsSegmentsMeta::IsSegmentsMeta(value);
+      int64_t value_length = segmented ?
+        StringsSegmentsMeta(value).length() : value.length();
       if (start_offset < 0) {
         start_offset = start_offset + value_length;
       }
@@ -901,7 +1054,7 @@ Status RedisStrings::BitPos(const Slice& key, int32_t bit,
         end_offset = end_offset + value_length;
       }
       // converting to int64_t just avoid warning
-      if (end_offset > static_cast<int64_t>(value.length()) - 1) {
+      if (end_offset > value_length - 1) {
         end_offset = value_length - 1;
       }
       if (end_offset < 0) {
@@ -915,11 +1068,12 @@ Status RedisStrings::BitPos(const Slice& key, int32_t bit,
         *ret = -1;
         return Status::OK();
       }
+      if (segmented) {
+        return SegmentsBitPos(key, StringsSegmentsMeta(value), bit,
+                              start_offset, end_offset, ret);
+      }
       int64_t bytes = end_offset - start_offset + 1;
       int64_t pos = GetBitPos(bit_value + start_offset, bytes, bit);
-      if (pos == (8 * bytes) && bit == 0) {
-        pos = -1;
-      }
       if (pos != -1) {
         pos = pos + 8 * start_offset;
       }
@@ -934,6 +1088,7 @@ Status RedisStrings::BitPos(const Slice& key, int32_t bit,
 Status RedisStrings::Expire(const Slice& key, int32_t ttl) {
   std::string value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, key, &value);
   if (s.ok()) {
     ParsedStringsValue parsed_strings_value(&value);
@@ -953,6 +1108,7 @@ Status RedisStrings::Expire(const Slice& key, int32_t ttl) {
 Status RedisStrings::Del(const Slice& key) {
   std::string value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, key, &value);
   if (s.ok()) {
     ParsedStringsValue parsed_strings_value(&value);
@@ -1012,6 +1168,7 @@ bool RedisStrings::Scan(const std::string& start_key,
 Status RedisStrings::Expireat(const Slice& key, int32_t timestamp) {
   std::string value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, key, &value);
   if (s.ok()) {
     ParsedStringsValue parsed_strings_value(&value);
@@ -1028,6 +1185,7 @@ Status RedisStrings::Expireat(const Slice& key, int32_t timestamp) {
 Status RedisStrings::Persist(const Slice& key) {
   std::string value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, key, &value);
   if (s.ok()) {
     ParsedStringsValue parsed_strings_value(&value);
@@ -1102,4 +1260,404 @@ void RedisStrings::ScanDatabase() {
   delete iter;
 }
 
+static bool IsZeroBytes(const char* data, size_t size) {
+  for (size_t idx = 0; idx < size; ++idx) {
+    if (data[idx] != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool NeedsSegments(const Slice& user_value) {
+  return user_value.size() > kSegmentsThreshold
+    || StringsSegmentsMeta::IsSegmentsMeta(user_value);
+}
+
+Status RedisStrings::PutValue(const Slice& key, StringsValue* strings_value) {
+  if (!NeedsSegments(strings_value->user_value())) {
+    return db_->Put(default_write_options_, key, strings_value->Encode());
+  }
+  rocksdb::WriteBatch batch;
+  WriteValue(&batch, key, strings_value);
+  return db_->Write(default_write_options_, &batch);
+}
+
+void RedisStrings::WriteValue(rocksdb::WriteBatch* batch, const Slice& key,
+                              StringsValue* strings_value) {
+  if (NeedsSegments(strings_value->user_value())) {
+    WriteSegments(batch, key, strings_value->user_value(),
+                  strings_value->timestamp());
+  } else {
+    batch->Put(key, strings_value->Encode());
+  }
+}
+
+void RedisStrings::WriteSegments(rocksdb::WriteBatch* batch,
+                                 const Slice& key, const Slice& user_value,
+                                 int32_t timestamp) {
+  // The caller holds the record lock and every earlier value of the key has
+  // been written with a smaller sequence number, so the version is new
+  StringsSegmentsMeta meta(user_value.size(),
+      db_->GetLatestSequenceNumber() + 1, kSegmentSize);
+  PutSegments(batch, key, meta, user_value);
+  std::string meta_value = meta.Encode();
+  StringsValue strings_value(meta_value);
+  strings_value.set_timestamp(timestamp);
+  batch->Put(key, strings_value.Encode());
+}
+
+void RedisStrings::PutSegments(rocksdb::WriteBatch* batch, const Slice& key,
+                               const StringsSegmentsMeta& meta,
+                               const Slice& data) {
+  uint64_t segment_size = meta.segment_size();
+  for (uint64_t offset = 0; offset < data.size(); offset += segment_size) {
+    size_t size = std::min<uint64_t>(segment_size, data.size() - offset);
+    if (!IsZeroBytes(data.data() + offset, size)) {
+      StringsSegmentKey segment_key(key, meta.version(),
+                                    offset / segment_size);
+      batch->Put(handles_[1], segment_key.Encode(),
+                 Slice(data.data() + offset, size));
+    }
+  }
+}
+
+Status RedisStrings::LoadSegments(const rocksdb::ReadOptions& read_options,
+                                  const Slice& key, std::string* user_value) {
+  if (!StringsSegmentsMeta::IsSegmentsMeta(*user_value)) {
+    return Status::OK();
+  }
+  StringsSegmentsMeta meta(*user_value);
+  std::string value(meta.length(), '\0');
+  std::string prefix =
+    StringsSegmentKey(key, meta.version(), 0).EncodePrefix();
+  rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[1]);
+  for (iter->Seek(prefix);
+       iter->Valid() && iter->key().starts_with(prefix);
+       iter->Next()) {
+    ParsedStringsSegmentKey parsed_segment_key(iter->key());
+    uint64_t offset = static_cast<uint64_t>(parsed_segment_key.index())
+      * meta.segment_size();
+    if (offset < meta.length()) {
+      size_t size = std::min<uint64_t>(iter->value().size(),
+                                       meta.length() - offset);
+      memcpy(&value[offset], iter->value().data(), size);
+    }
+  }
+  Status s = iter->status();
+  delete iter;
+  if (s.ok()) {
+    user_value->swap(value);
+  }
+  return s;
+}
+
+Status RedisStrings::GetSegment(const rocksdb::ReadOptions& read_options,
+                                const Slice& key,
+                                const StringsSegmentsMeta& meta,
+                                uint32_t index, std::string* segment) {
+  StringsSegmentKey segment_key(key, meta.version(), index);
+  Status s = db_->Get(read_options, handles_[1],
+                      segment_key.Encode(), segment);
+  if (s.IsNotFound()) {
+    segment->clear();
+    return Status::OK();
+  }
+  return s;
+}
+
+Status RedisStrings::SegmentsGetrange(const Slice& key,
+                                      const StringsSegmentsMeta& meta,
+                                      int64_t start_offset,
+                                      int64_t end_offset, std::string* ret) {
+  ret->assign(end_offset - start_offset + 1, '\0');
+  int64_t segment_size = meta.segment_size();
+  StringsSegmentKey start_key(key, meta.version(),
+                              start_offset / segment_size);
+  std::string prefix = start_key.EncodePrefix();
+  rocksdb::Iterator* iter = db_->NewIterator(default_read_options_,
+                                             handles_[1]);
+  for (iter->Seek(start_key.Encode());
+       iter->Valid() && iter->key().starts_with(prefix);
+       iter->Next()) {
+    ParsedStringsSegmentKey parsed_segment_key(iter->key());
+    int64_t segment_start =
+      static_cast<int64_t>(parsed_segment_key.index()) * segment_size;
+    if (segment_start > end_offset) {
+      break;
+    }
+    int64_t begin = std::max(start_offset, segment_start);
+    int64_t end = std::min(end_offset, static_cast<int64_t>(
+          segment_start + iter->value().size() - 1));
+    if (begin <= end) {
+      memcpy(&(*ret)[begin - start_offset],
+             iter->value().data() + begin - segment_start, end - begin + 1);
+    }
+  }
+  Status s = iter->status();
+  delete iter;
+  if (!s.ok()) {
+    ret->clear();
+  }
+  return s;
+}
+
+Status RedisStrings::SegmentsSetrange(const Slice& key,
+                                      StringsSegmentsMeta meta,
+                                      int32_t timestamp, int64_t start_offset,
+                                      const Slice& value, int32_t* ret) {
+  uint64_t end_offset = start_offset + value.size();
+  if (value.empty()) {
+    *ret = meta.length();
+    return Status::OK();
+  }
+
+  rocksdb::WriteBatch batch;
+  uint64_t segment_size = meta.segment_size();
+  uint32_t first = start_offset / segment_size;
+  uint32_t last = (end_offset - 1) / segment_size;
+  for (uint32_t index = first; index <= last; ++index) {
+    uint64_t segment_start = static_cast<uint64_t>(index) * segment_size;
+    uint64_t begin = std::max<uint64_t>(start_offset, segment_start);
+    uint64_t end = std::min(end_offset, segment_start + segment_size);
+    std::string segment;
+    // A segment covered by the whole range does not need to be read
+    if (begin != segment_start || end != segment_start + segment_size) {
+      Status s = GetSegment(default_read_options_, key, meta,
+                            index, &segment);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    if (segment.size() < end - segment_start) {
+      segment.resize(end - segment_start, '\0');
+    }
+    memcpy(&segment[begin - segment_start],
+           value.data() + begin - start_offset, end - begin);
+
+    StringsSegmentKey segment_key(key, meta.version(), index);
+    if (IsZeroBytes(segment.data(), segment.size())) {
+      batch.Delete(handles_[1], segment_key.Encode());
+    } else {
+      batch.Put(handles_[1], segment_key.Encode(), segment);
+    }
+  }
+  if (end_offset > meta.length()) {
+    meta.set_length(end_offset);
+    std::string meta_value = meta.Encode();
+    StringsValue strings_value(meta_value);
+    strings_value.set_timestamp(timestamp);
+    batch.Put(key, strings_value.Encode());
+  }
+  *ret = meta.length();
+  return db_->Write(default_write_options_, &batch);
+}
+
+Status RedisStrings::SegmentsSetBit(const Slice& key, StringsSegmentsMeta meta,
+                                    int32_t timestamp, int64_t offset,
+                                    int32_t on, int32_t* ret) {
+  uint64_t byte = offset >> 3;
+  uint32_t bit = 7 - (offset & 0x7);
+  uint32_t index = byte / meta.segment_size();
+  size_t pos = byte % meta.segment_size();
+  std::string segment;
+  Status s = GetSegment(default_read_options_, key, meta, index, &segment);
+  if (!s.ok()) {
+    return s;
+  }
+  *ret = pos < segment.size() ? (segment[pos] >> bit) & 0x1 : 0;
+  if (*ret == on) {
+    return Status::OK();
+  }
+  if (pos >= segment.size()) {
+    segment.resize(pos + 1, '\0');
+  }
+  if (on) {
+    segment[pos] |= static_cast<char>(1 << bit);
+  } else {
+    segment[pos] &= static_cast<char>(~(1 << bit));
+  }
+
+  rocksdb::WriteBatch batch;
+  StringsSegmentKey segment_key(key, meta.version(), index);
+  if (IsZeroBytes(segment.data(), segment.size())) {
+    batch.Delete(handles_[1], segment_key.Encode());
+  } else {
+    batch.Put(handles_[1], segment_key.Encode(), segment);
+  }
+  if (byte >= meta.length()) {
+    meta.set_length(byte + 1);
+    std::string meta_value = meta.Encode();
+    StringsValue strings_value(meta_value);
+    strings_value.set_timestamp(timestamp);
+    batch.Put(key, strings_value.Encode());
+  }
+  return db_->Write(default_write_options_, &batch);
+}
+
+Status RedisStrings::SegmentsBitCount(const Slice& key,
+                                      const StringsSegmentsMeta& meta,
+                                      int64_t start_offset,
+                                      int64_t end_offset, int32_t* ret) {
+  *ret = 0;
+  int64_t segment_size = meta.segment_size();
+  StringsSegmentKey start_key(key, meta.version(),
+                              start_offset / segment_size);
+  std::string prefix = start_key.EncodePrefix();
+  rocksdb::Iterator* iter = db_->NewIterator(default_read_options_,
+                                             handles_[1]);
+  for (iter->Seek(start_key.Encode());
+       iter->Valid() && iter->key().starts_with(prefix);
+       iter->Next()) {
+    ParsedStringsSegmentKey parsed_segment_key(iter->key());
+    int64_t segment_start =
+      static_cast<int64_t>(parsed_segment_key.index()) * segment_size;
+    if (segment_start > end_offset) {
+      break;
+    }
+    int64_t begin = std::max(start_offset, segment_start);
+    int64_t end = std::min(end_offset, static_cast<int64_t>(
+          segment_start + iter->value().size() - 1));
+    if (begin <= end) {
+      *ret += GetBitCount(reinterpret_cast<const unsigned char*>(
+            iter->value().data()) + begin - segment_start, end - begin + 1);
+    }
+  }
+  Status s = iter->status();
+  delete iter;
+  return s;
+}
+
+Status RedisStrings::SegmentsBitPos(const Slice& key,
+                                    const StringsSegmentsMeta& meta,
+                                    int32_t bit, int64_t start_offset,
+                                    int64_t end_offset, int64_t* ret) {
+  *ret = -1;
+  int64_t segment_size = meta.segment_size();
+  // The first byte of the range which has not been looked at yet
+  int64_t next = start_offset;
+  StringsSegmentKey start_key(key, meta.version(),
+                              start_offset / segment_size);
+  std::string prefix = start_key.EncodePrefix();
+  rocksdb::Iterator* iter = db_->NewIterator(default_read_options_,
+                                             handles_[1]);
+  for (iter->Seek(start_key.Encode());
+       iter->Valid() && iter->key().starts_with(prefix);
+       iter->Next()) {
+    ParsedStringsSegmentKey parsed_segment_key(iter->key());
+    int64_t segment_start =
+      static_cast<int64_t>(parsed_segment_key.index()) * segment_size;
+    if (segment_start > end_offset) {
+      break;
+    }
+    // The missing segments in between are zeros
+    if (bit == 0 && segment_start > next) {
+      *ret = next * 8;
+      break;
+    }
+    int64_t begin = std::max(start_offset, segment_start);
+    int64_t stored_end = std::min(end_offset, static_cast<int64_t>(
+          segment_start + iter->value().size() - 1));
+    if (begin <= stored_end) {
+      int64_t bytes = stored_end - begin + 1;
+      int64_t pos = GetBitPos(reinterpret_cast<const unsigned char*>(
+            iter->value().data()) + begin - segment_start, bytes, bit);
+      if (pos != -1) {
+        *ret = pos + 8 * begin;
+        break;
+      }
+    }
+    next = std::min(end_offset, segment_start + segment_size - 1) + 1;
+    // So is the part of the segment which is not stored
+    int64_t zeros = std::max(begin, stored_end + 1);
+    if (bit == 0 && zeros < next) {
+      *ret = zeros * 8;
+      break;
+    }
+  }
+  if (*ret == -1 && bit == 0 && next <= end_offset) {
+    *ret = next * 8;
+  }
+  Status s = iter->status();
+  delete iter;
+  return s;
+}
+
+Status RedisStrings::SegmentsBitOp(BitOpType op, const std::string& dest_key,
+                                   const std::vector<std::string>& src_keys,
+                                   const std::vector<std::string>& src_values,
+                                   int64_t max_len) {
+  // Walk the segments of the segmented sources side by side, the other
+  // sources are sliced in segments on the fly
+  std::vector<rocksdb::Iterator*> iters(src_values.size(), nullptr);
+  std::vector<std::string> prefixes(src_values.size());
+  for (size_t i = 0; i < src_values.size(); i++) {
+    if (StringsSegmentsMeta::IsSegmentsMeta(src_values[i])) {
+      StringsSegmentsMeta meta(src_values[i]);
+      prefixes[i] =
+        StringsSegmentKey(src_keys[i], meta.version(), 0).EncodePrefix();
+      iters[i] = db_->NewIterator(default_read_options_, handles_[1]);
+      iters[i]->Seek(prefixes[i]);
+    }
+  }
+
+  ScopeRecordLock l(lock_mgr_, dest_key);
+  ScopeRowCacheInvalidate ri(row_cache_, dest_key);
+  StringsSegmentsMeta meta(max_len, db_->GetLatestSequenceNumber() + 1,
+                           kSegmentSize);
+  // Segments and meta go in a single batch, otherwise the compaction filter
+  // could drop segments written before their meta
+  rocksdb::WriteBatch batch;
+  std::vector<std::string> segments(src_values.size());
+  for (uint64_t index = 0; index < meta.segment_num(); ++index) {
+    int64_t offset = index * kSegmentSize;
+    int64_t size = std::min<int64_t>(kSegmentSize, max_len - offset);
+    bool all_empty = true, any_empty = false;
+    for (size_t i = 0; i < src_values.size(); i++) {
+      segments[i].clear();
+      rocksdb::Iterator* iter = iters[i];
+      if (iter != nullptr) {
+        if (iter->Valid() && iter->key().starts_with(prefixes[i])
+          && ParsedStringsSegmentKey(iter->key()).index() == index) {
+          segments[i].assign(iter->value().data(), iter->value().size());
+          iter->Next();
+        }
+      } else if (offset < static_cast<int64_t>(src_values[i].size())) {
+        segments[i] = src_values[i].substr(offset, size);
+      }
+      if (segments[i].empty()) {
+        any_empty = true;
+      } else {
+        all_empty = false;
+      }
+    }
+    // Skip the segments which are zeros whatever the missing ones hold
+    if (op != kBitOpNot && (all_empty || (op == kBitOpAnd && any_empty))) {
+      continue;
+    }
+    std::string segment = BitOpOperate(op, segments, size);
+    if (!IsZeroBytes(segment.data(), segment.size())) {
+      StringsSegmentKey segment_key(dest_key, meta.version(), index);
+      batch.Put(handles_[1], segment_key.Encode(), segment);
+    }
+  }
+
+  Status s;
+  for (auto iter : iters) {
+    if (iter != nullptr) {
+      if (s.ok()) {
+        s = iter->status();
+      }
+      delete iter;
+    }
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  std::string meta_value = meta.Encode();
+  StringsValue strings_value(meta_value);
+  batch.Put(dest_key, strings_value.Encode());
+  return db_->Write(default_write_options_, &batch);
+}
+
 }  //  namespace blackwidow
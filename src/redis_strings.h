@@ -11,6 +11,8 @@
 #include <algorithm>
 
 #include "src/redis.h"
+#include "src/strings_value_format.h"
+#include "src/strings_segment_format.h"
 #include "blackwidow/blackwidow.h"
 
 namespace blackwidow {
@@ -18,13 +20,16 @@ namespace blackwidow {
 class RedisStrings : public Redis {
   public:
     RedisStrings() = default;
-    ~RedisStrings() = default;
+    ~RedisStrings();
 
     // Common Commands
     virtual Status Open(const rocksdb::Options& options,
                         const std::string& db_path) override;
     virtual Status CompactRange(const rocksdb::Slice* begin,
                                 const rocksdb::Slice* end) override;
+    virtual Status CompactKey(const Slice& key) override;
+    virtual Status GetStaleEntries(uint64_t* stale,
+                                   uint64_t* total) override;
     virtual Status GetProperty(const std::string& property, std::string* out) override;
     virtual Status ScanKeyNum(uint64_t* num) override;
     virtual Status ScanKeys(const std::string& pattern,
@@ -38,6 +43,7 @@ class RedisStrings : public Redis {
                  const std::vector<std::string>& src_keys, int64_t* ret);
     Status Decrby(const Slice& key, int64_t value, int64_t* ret);
     Status Get(const Slice& key, std::string* value);
+    Status Get(const Slice& key, PinnableValue* value);
     Status GetBit(const Slice& key, int64_t offset, int32_t* ret);
     Status Getrange(const Slice& key, int64_t start_offset, int64_t end_offset,
                     std::string* ret);
@@ -50,6 +56,9 @@ class RedisStrings : public Redis {
     Status MSetnx(const std::vector<KeyValue>& kvs, int32_t* ret);
     Status Set(const Slice& key, const Slice& value, const int32_t ttl = 0);
     Status Setxx(const Slice& key, const Slice& value, int32_t* ret, const int32_t ttl = 0);
+    // Set key to new_value only if it still holds value, the ttl is kept
+    Status Setvx(const Slice& key, const Slice& value,
+                 const Slice& new_value, int32_t* ret);
     Status SetBit(const Slice& key, int64_t offset, int32_t value, int32_t* ret);
     Status Setex(const Slice& key, const Slice& value, int32_t ttl);
     Status Setnx(const Slice& key, const Slice& value, int32_t* ret, const int32_t ttl = 0);
@@ -76,6 +85,47 @@ class RedisStrings : public Redis {
 
     // Iterate all data
     void ScanDatabase();
+
+  private:
+    std::vector<rocksdb::ColumnFamilyHandle*> handles_;
+
+    // Write a strings value, values larger than kSegmentsThreshold and user
+    // values which would be mistaken for a segments meta go in segments
+    Status PutValue(const Slice& key, StringsValue* strings_value);
+    void WriteValue(rocksdb::WriteBatch* batch, const Slice& key,
+                    StringsValue* strings_value);
+    void WriteSegments(rocksdb::WriteBatch* batch, const Slice& key,
+                       const Slice& user_value, int32_t timestamp);
+    // Write the non zero segments of data, the head of the value of meta
+    void PutSegments(rocksdb::WriteBatch* batch, const Slice& key,
+                     const StringsSegmentsMeta& meta, const Slice& data);
+    // Replace a segments meta by the value it refers to
+    Status LoadSegments(const rocksdb::ReadOptions& read_options,
+                        const Slice& key, std::string* user_value);
+    Status GetSegment(const rocksdb::ReadOptions& read_options,
+                      const Slice& key, const StringsSegmentsMeta& meta,
+                      uint32_t index, std::string* segment);
+    Status SegmentsGetrange(const Slice& key, const StringsSegmentsMeta& meta,
+                            int64_t start_offset, int64_t end_offset,
+                            std::string* ret);
+    // Overwrite the bytes of the segmented value from start_offset on,
+    // growing it if needed, Append writes at the end of the value
+    Status SegmentsSetrange(const Slice& key, StringsSegmentsMeta meta,
+                            int32_t timestamp, int64_t start_offset,
+                            const Slice& value, int32_t* ret);
+    Status SegmentsSetBit(const Slice& key, StringsSegmentsMeta meta,
+                          int32_t timestamp, int64_t offset, int32_t on,
+                          int32_t* ret);
+    Status SegmentsBitCount(const Slice& key, const StringsSegmentsMeta& meta,
+                            int64_t start_offset, int64_t end_offset,
+                            int32_t* ret);
+    Status SegmentsBitPos(const Slice& key, const StringsSegmentsMeta& meta,
+                          int32_t bit, int64_t start_offset,
+                          int64_t end_offset, int64_t* ret);
+    Status SegmentsBitOp(BitOpType op, const std::string& dest_key,
+                         const std::vector<std::string>& src_keys,
+                         const std::vector<std::string>& src_values,
+                         int64_t max_len);
 };
 
 }  //  namespace blackwidow
@@ -11,7 +11,9 @@
 #include "blackwidow/util.h"
 #include "src/zsets_filter.h"
 #include "src/scope_record_lock.h"
+#include "src/scope_iterators.h"
 #include "src/scope_snapshot.h"
+#include "src/stale_entries_collector.h"
 
 namespace blackwidow {
 
@@ -21,6 +23,7 @@ rocksdb::Comparator* ZSetsScoreKeyComparator() {
 }
 
 RedisZSets::~RedisZSets() {
+  iter_pool_.Clear();
   std::vector<rocksdb::ColumnFamilyHandle*> tmp_handles = handles_;
   handles_.clear();
   for (auto handle : tmp_handles) {
@@ -50,6 +53,8 @@ Status RedisZSets::Open(const rocksdb::Options& options,
   }
 
   rocksdb::DBOptions db_ops(options);
+  db_ops.listeners.push_back(
+    std::make_shared<IteratorPoolListener>(&iter_pool_));
   rocksdb::ColumnFamilyOptions meta_cf_ops(options);
   rocksdb::ColumnFamilyOptions data_cf_ops(options);
   rocksdb::ColumnFamilyOptions score_cf_ops(options);
@@ -61,6 +66,13 @@ Status RedisZSets::Open(const rocksdb::Options& options,
     std::make_shared<ZSetsScoreFilterFactory>(&db_, &handles_);
   score_cf_ops.comparator = ZSetsScoreKeyComparator();
 
+  meta_cf_ops.table_properties_collector_factories.push_back(
+    std::make_shared<StaleEntriesCollectorFactory>(kBaseMetaFormat));
+  data_cf_ops.table_properties_collector_factories.push_back(
+    std::make_shared<StaleEntriesCollectorFactory>(kVersionedKeyFormat));
+  score_cf_ops.table_properties_collector_factories.push_back(
+    std::make_shared<StaleEntriesCollectorFactory>(kVersionedKeyFormat));
+
   //use the bloom filter policy to reduce disk reads
   rocksdb::BlockBasedTableOptions table_options;
   table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, true));
@@ -94,6 +106,28 @@ Status RedisZSets::CompactRange(const rocksdb::Slice* begin,
           handles_[2], begin, end);
 }
 
+Status RedisZSets::CompactKey(const Slice& key) {
+  Status s = CompactKeyData(key, handles_[1]);
+  if (!s.ok()) {
+    return s;
+  }
+  // The score keys compare their key and version bytewise, then the score,
+  // versions 0 and -1 have the lowest and the highest bytes
+  ZSetsScoreKey start_key(key, 0,
+                          -std::numeric_limits<double>::infinity(), Slice());
+  ZSetsScoreKey end_key(key, -1,
+                        std::numeric_limits<double>::infinity(), Slice());
+  Slice begin = start_key.Encode();
+  Slice end = end_key.Encode();
+  s = db_->CompactRange(default_compact_range_options_,
+      handles_[2], &begin, &end);
+  return s;
+}
+
+Status RedisZSets::GetStaleEntries(uint64_t* stale, uint64_t* total) {
+  return SumStaleEntries(db_, handles_, stale, total);
+}
+
 Status RedisZSets::GetProperty(const std::string& property, std::string* out) {
   db_->GetProperty(property, out);
   return Status::OK();
@@ -112,6 +146,7 @@ Status RedisZSets::ScanKeyNum(uint64_t* num) {
   for (iter->SeekToFirst();
        iter->Valid();
        iter->Next()) {
+    ThrottleScan(iter->key().size() + iter->value().size());
     ParsedZSetsMetaValue parsed_zsets_meta_value(iter->value());
     if (!parsed_zsets_meta_value.IsStale()
       && parsed_zsets_meta_value.count() != 0) {
@@ -137,6 +172,7 @@ Status RedisZSets::ScanKeys(const std::string& pattern,
   for (iter->SeekToFirst();
        iter->Valid();
        iter->Next()) {
+    ThrottleScan(iter->key().size() + iter->value().size());
     ParsedZSetsMetaValue parsed_zsets_meta_value(iter->value());
     if (!parsed_zsets_meta_value.IsStale()
       && parsed_zsets_meta_value.count() != 0) {
@@ -168,6 +204,7 @@ Status RedisZSets::ZAdd(const Slice& key,
   std::string meta_value;
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
     bool is_stale = false;
@@ -243,7 +280,7 @@ Status RedisZSets::ZCard(const Slice& key, int32_t* card) {
   *card = 0;
   std::string meta_value;
 
-  Status s = db_->Get(default_read_options_, key, &meta_value);
+  Status s = GetCachedValue(key, &meta_value);
   if (s.ok()) {
     ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
     if (parsed_zsets_meta_value.IsStale()) {
@@ -266,14 +303,11 @@ Status RedisZSets::ZCount(const Slice& key,
                           bool right_close,
                           int32_t* ret) {
   *ret = 0;
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot = nullptr;
 
   std::string meta_value;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
 
-  Status s = db_->Get(read_options, key, &meta_value);
+  ScopeIterators iters(db_, {handles_[0], handles_[2]});
+  Status s = iters.Get(0, key, &meta_value);
   if (s.ok()) {
     ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
     if (parsed_zsets_meta_value.IsStale()) {
@@ -286,10 +320,13 @@ Status RedisZSets::ZCount(const Slice& key,
       int32_t cur_index = 0;
       int32_t stop_index = parsed_zsets_meta_value.count() - 1;
       ScoreMember score_member;
-      ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::lowest(), Slice());
-      rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[2]);
+      ZSetsMemberKey zsets_prefix_key(key, version, Slice());
+      Slice prefix = zsets_prefix_key.Encode();
+      ZSetsScoreKey zsets_score_key(key, version, min, Slice());
+      rocksdb::Iterator* iter = iters[1];
       for (iter->Seek(zsets_score_key.Encode());
-           iter->Valid() && cur_index <= stop_index;
+           iter->Valid() && iter->key().starts_with(prefix)
+             && cur_index <= stop_index;
            iter->Next(), ++cur_index) {
           bool left_pass = false;
           bool right_pass = false;
@@ -308,7 +345,6 @@ Status RedisZSets::ZCount(const Slice& key,
             break;
           }
       }
-      delete iter;
       *ret = cnt;
     }
   }
@@ -326,6 +362,7 @@ Status RedisZSets::ZIncrby(const Slice& key,
   std::string meta_value;
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
     ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
@@ -377,14 +414,9 @@ Status RedisZSets::ZRange(const Slice& key,
                           int32_t stop,
                           std::vector<ScoreMember>* score_members) {
   score_members->clear();
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot = nullptr;
-
   std::string meta_value;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-
-  Status s = db_->Get(read_options, key, &meta_value);
+  ScopePooledIterators iters(&iter_pool_, db_, handles_[0], handles_[2]);
+  Status s = iters.Get(0, key, &meta_value);
   if (s.ok()) {
     ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
     if (parsed_zsets_meta_value.IsStale()) {
@@ -406,9 +438,12 @@ Status RedisZSets::ZRange(const Slice& key,
       int32_t cur_index = 0;
       ScoreMember score_member;
       ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::lowest(), Slice());
-      rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[2]);
+      ZSetsMemberKey zsets_prefix_key(key, version, Slice());
+      Slice prefix = zsets_prefix_key.Encode();
+      rocksdb::Iterator* iter = iters[1];
       for (iter->Seek(zsets_score_key.Encode());
-           iter->Valid() && cur_index <= stop_index;
+           iter->Valid() && iter->key().starts_with(prefix)
+             && cur_index <= stop_index;
            iter->Next(), ++cur_index) {
         if (cur_index >= start_index) {
           ParsedZSetsScoreKey parsed_zsets_score_key(iter->key());
@@ -417,7 +452,6 @@ Status RedisZSets::ZRange(const Slice& key,
           score_members->push_back(score_member);
         }
       }
-      delete iter;
     }
   }
   return s;
@@ -430,13 +464,10 @@ Status RedisZSets::ZRangebyscore(const Slice& key,
                                  bool right_close,
                                  std::vector<ScoreMember>* score_members) {
   score_members->clear();
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot = nullptr;
 
   std::string meta_value;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-  Status s = db_->Get(read_options, handles_[0], key, &meta_value);
+  ScopeIterators iters(db_, {handles_[0], handles_[2]});
+  Status s = iters.Get(0, key, &meta_value);
   if (s.ok()) {
     ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
     if (parsed_zsets_meta_value.IsStale()) {
@@ -448,10 +479,14 @@ Status RedisZSets::ZRangebyscore(const Slice& key,
       int32_t index = 0;
       int32_t stop_index = parsed_zsets_meta_value.count() - 1;
       ScoreMember score_member;
-      ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::lowest(), Slice());
-      rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[2]);
+      // The scan starts at min rather than at the lowest score
+      ZSetsMemberKey zsets_prefix_key(key, version, Slice());
+      Slice prefix = zsets_prefix_key.Encode();
+      ZSetsScoreKey zsets_score_key(key, version, min, Slice());
+      rocksdb::Iterator* iter = iters[1];
       for (iter->Seek(zsets_score_key.Encode());
-           iter->Valid() && index <= stop_index;
+           iter->Valid() && iter->key().starts_with(prefix)
+             && index <= stop_index;
            iter->Next(), ++index) {
         bool left_pass = false;
         bool right_pass = false;
@@ -473,7 +508,42 @@ Status RedisZSets::ZRangebyscore(const Slice& key,
           break;
         }
       }
-      delete iter;
+    }
+  }
+  return s;
+}
+
+Status RedisZSets::ZScanScoreRanges(const Slice& key,
+    const std::vector<std::pair<double, double>>& ranges,
+    const ScoreVisitor& visitor) {
+  std::string meta_value;
+  ScopeIterators iters(db_, {handles_[0], handles_[2]});
+  Status s = iters.Get(0, key, &meta_value);
+  if (s.ok()) {
+    ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
+    if (parsed_zsets_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_zsets_meta_value.count() == 0) {
+      return Status::NotFound();
+    } else {
+      int32_t version = parsed_zsets_meta_value.version();
+      ZSetsMemberKey zsets_prefix_key(key, version, Slice());
+      Slice prefix = zsets_prefix_key.Encode();
+      rocksdb::Iterator* iter = iters[1];
+      for (const auto& range : ranges) {
+        ZSetsScoreKey zsets_score_key(key, version, range.first, Slice());
+        for (iter->Seek(zsets_score_key.Encode());
+             iter->Valid() && iter->key().starts_with(prefix);
+             iter->Next()) {
+          ParsedZSetsScoreKey parsed_zsets_score_key(iter->key());
+          if (parsed_zsets_score_key.score() >= range.second) {
+            break;
+          }
+          visitor(parsed_zsets_score_key.score(),
+                  parsed_zsets_score_key.member());
+        }
+      }
+      s = iter->status();
     }
   }
   return s;
@@ -483,13 +553,10 @@ Status RedisZSets::ZRank(const Slice& key,
                          const Slice& member,
                          int32_t* rank) {
   *rank = -1;
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot = nullptr;
 
   std::string meta_value;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-  Status s = db_->Get(read_options, handles_[0], key, &meta_value);
+  ScopeIterators iters(db_, {handles_[0], handles_[2]});
+  Status s = iters.Get(0, key, &meta_value);
   if (s.ok()) {
     ParsedZSetsMetaValue  parsed_zsets_meta_value(&meta_value);
     if (parsed_zsets_meta_value.IsStale()) {
@@ -503,7 +570,7 @@ Status RedisZSets::ZRank(const Slice& key,
       int32_t stop_index = parsed_zsets_meta_value.count() - 1;
       ScoreMember score_member;
       ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::lowest(), Slice());
-      rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[2]);
+      rocksdb::Iterator* iter = iters[1];
       for (iter->Seek(zsets_score_key.Encode());
            iter->Valid() && index <= stop_index;
            iter->Next(), ++index) {
@@ -513,7 +580,6 @@ Status RedisZSets::ZRank(const Slice& key,
             break;
           }
       }
-      delete iter;
       if (found) {
         *rank = index;
         return Status::OK();
@@ -541,6 +607,7 @@ Status RedisZSets::ZRem(const Slice& key,
   std::string meta_value;
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
     ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
@@ -578,6 +645,93 @@ Status RedisZSets::ZRem(const Slice& key,
   return db_->Write(default_write_options_, &batch);
 }
 
+Status RedisZSets::ZPopMin(const Slice& key,
+                           int32_t count,
+                           std::vector<ScoreMember>* score_members) {
+  return ZPop(key, count, false, score_members);
+}
+
+Status RedisZSets::ZPopMax(const Slice& key,
+                           int32_t count,
+                           std::vector<ScoreMember>* score_members) {
+  return ZPop(key, count, true, score_members);
+}
+
+// Takes the members from the head or the tail of the score cf, so a pop
+// reads no more than it removes
+Status RedisZSets::ZPop(const Slice& key, int32_t count, bool max,
+                        std::vector<ScoreMember>* score_members) {
+  score_members->clear();
+  if (count <= 0) {
+    return count == 0 ? Status::OK() :
+      Status::InvalidArgument("count must be positive");
+  }
+  std::string meta_value;
+  rocksdb::WriteBatch batch;
+  ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
+  if (s.ok()) {
+    ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
+    if (parsed_zsets_meta_value.IsStale()) {
+      return Status::NotFound("Stale");
+    } else if (parsed_zsets_meta_value.count() == 0) {
+      return Status::NotFound();
+    } else {
+      int32_t version = parsed_zsets_meta_value.version();
+      ZSetsMemberKey zsets_prefix_key(key, version, Slice());
+      Slice prefix = zsets_prefix_key.Encode();
+      rocksdb::Iterator* iter = db_->NewIterator(default_read_options_, handles_[2]);
+      if (max) {
+        // The members scored +inf sort after the seek key, the tail is the
+        // last of them if there are any
+        ZSetsScoreKey zsets_score_key(key, version,
+            std::numeric_limits<double>::infinity(), Slice());
+        std::string last_key;
+        for (iter->Seek(zsets_score_key.Encode());
+             iter->Valid() && iter->key().starts_with(prefix);
+             iter->Next()) {
+          last_key = iter->key().ToString();
+        }
+        iter->SeekForPrev(last_key.empty() ? zsets_score_key.Encode()
+                                           : Slice(last_key));
+      } else {
+        ZSetsScoreKey zsets_score_key(key, version,
+            -std::numeric_limits<double>::infinity(), Slice());
+        iter->Seek(zsets_score_key.Encode());
+      }
+      ScoreMember score_member;
+      while (iter->Valid() && iter->key().starts_with(prefix)
+        && static_cast<int32_t>(score_members->size()) < count) {
+        ParsedZSetsScoreKey parsed_zsets_score_key(iter->key());
+        score_member.score = parsed_zsets_score_key.score();
+        score_member.member = parsed_zsets_score_key.member().ToString();
+        score_members->push_back(score_member);
+        ZSetsMemberKey zsets_member_key(key, version, score_member.member);
+        batch.Delete(handles_[1], zsets_member_key.Encode());
+        batch.Delete(handles_[2], iter->key());
+        if (max) {
+          iter->Prev();
+        } else {
+          iter->Next();
+        }
+      }
+      s = iter->status();
+      delete iter;
+      if (!s.ok()) {
+        score_members->clear();
+        return s;
+      }
+      parsed_zsets_meta_value.ModifyCount(
+          -static_cast<int32_t>(score_members->size()));
+      batch.Put(handles_[0], key, meta_value);
+    }
+  } else {
+    return s;
+  }
+  return db_->Write(default_write_options_, &batch);
+}
+
 Status RedisZSets::ZRemrangebyrank(const Slice& key,
                                    int32_t start,
                                    int32_t stop,
@@ -586,6 +740,7 @@ Status RedisZSets::ZRemrangebyrank(const Slice& key,
   std::string meta_value;
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
     ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
@@ -637,6 +792,7 @@ Status RedisZSets::ZRemrangebyscore(const Slice& key,
   std::string meta_value;
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
     ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
@@ -692,14 +848,9 @@ Status RedisZSets::ZRevrange(const Slice& key,
                              int32_t stop,
                              std::vector<ScoreMember>* score_members) {
   score_members->clear();
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot = nullptr;
-
   std::string meta_value;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-
-  Status s = db_->Get(read_options, key, &meta_value);
+  ScopePooledIterators iters(&iter_pool_, db_, handles_[0], handles_[2]);
+  Status s = iters.Get(0, key, &meta_value);
   if (s.ok()) {
     ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
     if (parsed_zsets_meta_value.IsStale()) {
@@ -722,9 +873,12 @@ Status RedisZSets::ZRevrange(const Slice& key,
       std::vector<ScoreMember> tmp_sms;
       ScoreMember score_member;
       ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::lowest(), Slice());
-      rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[2]);
+      ZSetsMemberKey zsets_prefix_key(key, version, Slice());
+      Slice prefix = zsets_prefix_key.Encode();
+      rocksdb::Iterator* iter = iters[1];
       for (iter->Seek(zsets_score_key.Encode());
-           iter->Valid() && cur_index <= stop_index;
+           iter->Valid() && iter->key().starts_with(prefix)
+             && cur_index <= stop_index;
            iter->Next(), ++cur_index) {
         if (cur_index >= start_index) {
           ParsedZSetsScoreKey parsed_zsets_score_key(iter->key());
@@ -733,7 +887,6 @@ Status RedisZSets::ZRevrange(const Slice& key,
           tmp_sms.push_back(score_member);
         }
       }
-      delete iter;
       score_members->assign(tmp_sms.rbegin(), tmp_sms.rend());
     }
   }
@@ -747,13 +900,10 @@ Status RedisZSets::ZRevrangebyscore(const Slice& key,
                                     bool right_close,
                                     std::vector<ScoreMember>* score_members) {
   score_members->clear();
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot = nullptr;
 
   std::string meta_value;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-  Status s = db_->Get(read_options, handles_[0], key, &meta_value);
+  ScopeIterators iters(db_, {handles_[0], handles_[2]});
+  Status s = iters.Get(0, key, &meta_value);
   if (s.ok()) {
     ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
     if (parsed_zsets_meta_value.IsStale()) {
@@ -765,7 +915,7 @@ Status RedisZSets::ZRevrangebyscore(const Slice& key,
       int32_t left = parsed_zsets_meta_value.count();
       ScoreMember score_member;
       ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::max(), Slice());
-      rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[2]);
+      rocksdb::Iterator* iter = iters[1];
       for (iter->SeekForPrev(zsets_score_key.Encode());
            iter->Valid() && left > 0;
            iter->Prev(), --left) {
@@ -789,7 +939,6 @@ Status RedisZSets::ZRevrangebyscore(const Slice& key,
           break;
         }
       }
-      delete iter;
     }
   }
   return s;
@@ -799,14 +948,11 @@ Status RedisZSets::ZRevrank(const Slice& key,
                             const Slice& member,
                             int32_t* rank) {
   *rank = -1;
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot = nullptr;
 
   std::string meta_value;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
 
-  Status s = db_->Get(read_options, key, &meta_value);
+  ScopeIterators iters(db_, {handles_[0], handles_[2]});
+  Status s = iters.Get(0, key, &meta_value);
   if (s.ok()) {
     ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
     if (parsed_zsets_meta_value.IsStale()) {
@@ -819,7 +965,7 @@ Status RedisZSets::ZRevrank(const Slice& key,
       int32_t left = parsed_zsets_meta_value.count();
       int32_t version = parsed_zsets_meta_value.version();
       ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::max(), Slice());
-      rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[2]);
+      rocksdb::Iterator* iter = iters[1];
       for (iter->SeekForPrev(zsets_score_key.Encode());
            iter->Valid() && left >= 0;
            iter->Prev(), --left, ++rev_index) {
@@ -829,7 +975,6 @@ Status RedisZSets::ZRevrank(const Slice& key,
           break;
         }
       }
-      delete iter;
       if (found) {
         *rank = rev_index;
       } else {
@@ -843,14 +988,10 @@ Status RedisZSets::ZRevrank(const Slice& key,
 Status RedisZSets::ZScore(const Slice& key, const Slice& member, double* score) {
 
   *score = 0;
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot = nullptr;
-
   std::string meta_value;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-
-  Status s = db_->Get(read_options, key, &meta_value);
+  // The member is looked up under the version of the meta value, so there
+  // is no need to read both of them at the same snapshot
+  Status s = GetCachedValue(key, &meta_value);
   if (s.ok()) {
     ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
     int32_t version = parsed_zsets_meta_value.version();
@@ -861,7 +1002,7 @@ Status RedisZSets::ZScore(const Slice& key, const Slice& member, double* score)
     } else {
       std::string data_value;
       ZSetsMemberKey zsets_member_key(key, version, member);
-      s = db_->Get(read_options, handles_[1], zsets_member_key.Encode(), &data_value);
+      s = db_->Get(default_read_options_, handles_[1], zsets_member_key.Encode(), &data_value);
       if (s.ok()) {
         uint64_t tmp = DecodeFixed64(data_value.data());
         const void* ptr_tmp = reinterpret_cast<const void*>(&tmp);
@@ -892,6 +1033,7 @@ Status RedisZSets::ZUnionstore(const Slice& destination,
   ScopeSnapshot ss(db_, &snapshot);
   read_options.snapshot = snapshot;
   ScopeRecordLock l(lock_mgr_, destination);
+  ScopeRowCacheInvalidate ri(row_cache_, destination);
   std::map<std::string, double> member_score_map;
 
   Status s;
@@ -979,6 +1121,7 @@ Status RedisZSets::ZInterstore(const Slice& destination,
   ScopeSnapshot ss(db_, &snapshot);
   read_options.snapshot = snapshot;
   ScopeRecordLock l(lock_mgr_, destination);
+  ScopeRowCacheInvalidate ri(row_cache_, destination);
 
   std::string meta_value;
   int32_t version = 0;
@@ -1090,19 +1233,15 @@ Status RedisZSets::ZRangebylex(const Slice& key,
                                bool left_close,
                                bool right_close,
                                std::vector<std::string>* members) {
-
   members->clear();
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot = nullptr;
 
   std::string meta_value;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
 
   bool left_no_limit = !min.compare("-");
   bool right_not_limit = !max.compare("+");
   
-  Status s = db_->Get(read_options, handles_[0], key, &meta_value);
+  ScopeIterators iters(db_, {handles_[0], handles_[1]});
+  Status s = iters.Get(0, key, &meta_value);
   if (s.ok()) { 
     ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
     if (parsed_zsets_meta_value.IsStale()
@@ -1113,7 +1252,7 @@ Status RedisZSets::ZRangebylex(const Slice& key,
       int32_t cur_index = 0;
       int32_t stop_index = parsed_zsets_meta_value.count() - 1;
       ZSetsMemberKey zsets_member_key(key, version, Slice());
-      rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[1]);
+      rocksdb::Iterator* iter = iters[1];
       for (iter->Seek(zsets_member_key.Encode());
            iter->Valid() && cur_index <= stop_index;
            iter->Next(), ++cur_index) {
@@ -1138,7 +1277,6 @@ Status RedisZSets::ZRangebylex(const Slice& key,
           break;
         }
       }
-      delete iter;
     }
   } 
   return s;
@@ -1164,19 +1302,15 @@ Status RedisZSets::ZRemrangebylex(const Slice& key,
                                   int32_t* ret) {
   *ret = 0;
   rocksdb::WriteBatch batch;
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot = nullptr;
-
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
 
   bool left_no_limit = !min.compare("-");
   bool right_not_limit = !max.compare("+");
   
   int32_t del_cnt = 0;
   std::string meta_value;
-  Status s = db_->Get(read_options, handles_[0], key, &meta_value);
+  Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) { 
     ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
     if (parsed_zsets_meta_value.IsStale()
@@ -1187,7 +1321,8 @@ Status RedisZSets::ZRemrangebylex(const Slice& key,
       int32_t cur_index = 0;
       int32_t stop_index = parsed_zsets_meta_value.count() - 1;
       ZSetsMemberKey zsets_member_key(key, version, Slice());
-      rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[1]);
+      rocksdb::Iterator* iter = db_->NewIterator(default_read_options_,
+                                                 handles_[1]);
       for (iter->Seek(zsets_member_key.Encode());
            iter->Valid() && cur_index <= stop_index;
            iter->Next(), ++cur_index) {
@@ -1235,6 +1370,7 @@ Status RedisZSets::ZRemrangebylex(const Slice& key,
 Status RedisZSets::Expire(const Slice& key, int32_t ttl) {
   std::string meta_value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, key, &meta_value);
   if (s.ok()) {
     ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
@@ -1254,6 +1390,7 @@ Status RedisZSets::Expire(const Slice& key, int32_t ttl) {
 Status RedisZSets::Del(const Slice& key) {
   std::string meta_value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, key, &meta_value);
   if (s.ok()) {
     ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
@@ -1315,6 +1452,7 @@ bool RedisZSets::Scan(const std::string& start_key,
 Status RedisZSets::Expireat(const Slice& key, int32_t timestamp) {
   std::string meta_value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
     ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
@@ -1339,13 +1477,10 @@ Status RedisZSets::ZScan(const Slice& key, int64_t cursor, const std::string& pa
 
   int64_t rest = count;
   int64_t step_length = count;
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot;
 
   std::string meta_value;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-  Status s = db_->Get(read_options, handles_[0], key, &meta_value);
+  ScopeIterators iters(db_, {handles_[0], handles_[1]});
+  Status s = iters.Get(0, key, &meta_value);
   if (s.ok()) {
     ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
     if (parsed_zsets_meta_value.IsStale()
@@ -1363,7 +1498,7 @@ Status RedisZSets::ZScan(const Slice& key, int64_t cursor, const std::string& pa
       ZSetsMemberKey zsets_member_prefix(key, version, Slice());
       ZSetsMemberKey zsets_member_key(key, version, start_member);
       std::string prefix = zsets_member_prefix.Encode().ToString();
-      rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[1]);
+      rocksdb::Iterator* iter = iters[1];
       for (iter->Seek(zsets_member_key.Encode());
            iter->Valid() && rest > 0 && iter->key().starts_with(prefix);
            iter->Next()) {
@@ -1386,7 +1521,6 @@ Status RedisZSets::ZScan(const Slice& key, int64_t cursor, const std::string& pa
       } else {
         *next_cursor = 0;
       }
-      delete iter;
     }
   } else {
     *next_cursor = 0;
@@ -1424,6 +1558,7 @@ Status RedisZSets::StoreZScanNextMember(const Slice& key, const Slice& pattern,
 Status RedisZSets::Persist(const Slice& key) {
   std::string meta_value;
   ScopeRecordLock l(lock_mgr_, key);
+  ScopeRowCacheInvalidate ri(row_cache_, key);
   Status s = db_->Get(default_read_options_, handles_[0], key, &meta_value);
   if (s.ok()) {
     ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
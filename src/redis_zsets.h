@@ -6,7 +6,9 @@
 #ifndef SRC_REDIS_ZSETS_h
 #define SRC_REDIS_ZSETS_h
 
+#include <functional>
 #include <unordered_set>
+#include <utility>
 
 #include "src/redis.h"
 #include "src/custom_comparator.h"
@@ -24,6 +26,9 @@ class RedisZSets : public Redis {
                         const std::string& db_path) override;
     virtual Status CompactRange(const rocksdb::Slice* begin,
                                 const rocksdb::Slice* end) override;
+    virtual Status CompactKey(const Slice& key) override;
+    virtual Status GetStaleEntries(uint64_t* stale,
+                                   uint64_t* total) override;
     virtual Status GetProperty(const std::string& property, std::string* out) override;
     virtual Status ScanKeyNum(uint64_t* num) override;
     virtual Status ScanKeys(const std::string& pattern,
@@ -54,12 +59,25 @@ class RedisZSets : public Redis {
                          bool left_close,
                          bool right_close,
                          std::vector<ScoreMember>* score_members);
+    // Calls visitor on the members with a score within one of the [min, max)
+    // ranges, with one seek per range. Overlapping ranges visit their common
+    // members more than once.
+    typedef std::function<void(double score, const Slice& member)> ScoreVisitor;
+    Status ZScanScoreRanges(const Slice& key,
+                            const std::vector<std::pair<double, double>>& ranges,
+                            const ScoreVisitor& visitor);
     Status ZRank(const Slice& key,
                  const Slice& member,
                  int32_t* rank);
     Status ZRem(const Slice& key,
                 std::vector<std::string> members,
                 int32_t* ret);
+    Status ZPopMin(const Slice& key,
+                   int32_t count,
+                   std::vector<ScoreMember>* score_members);
+    Status ZPopMax(const Slice& key,
+                   int32_t count,
+                   std::vector<ScoreMember>* score_members);
     Status ZRemrangebyrank(const Slice& key,
                            int32_t start,
                            int32_t stop,
@@ -137,6 +155,9 @@ class RedisZSets : public Redis {
 
     Status GetZScanStartMember(const Slice& key, const Slice& pattern, int64_t cursor, std::string* start_member);
     Status StoreZScanNextMember(const Slice& key, const Slice& pattern, int64_t cursor, const std::string& next_member);
+
+    Status ZPop(const Slice& key, int32_t count, bool max,
+                std::vector<ScoreMember>* score_members);
 };
 
 } // namespace blackwidow
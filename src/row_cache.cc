@@ -0,0 +1,167 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/row_cache.h"
+
+#include <string.h>
+
+#include "src/murmurhash.h"
+
+namespace blackwidow {
+
+RowCache::FrequencySketch::FrequencySketch() {
+  Reset();
+}
+
+void RowCache::FrequencySketch::Reset() {
+  memset(table_, 0, sizeof(table_));
+  samples_ = 0;
+}
+
+void RowCache::FrequencySketch::Increment(uint64_t hash) {
+  uint32_t h1 = static_cast<uint32_t>(hash);
+  uint32_t h2 = static_cast<uint32_t>(hash >> 32) | 1;
+  for (uint32_t row = 0; row < kSketchDepth; ++row) {
+    uint8_t* counter = &table_[row][(h1 + row * h2) & (kSketchWidth - 1)];
+    if (*counter < 15) {
+      (*counter)++;
+    }
+  }
+
+  if (++samples_ >= kSketchWidth * 8) {
+    for (uint32_t row = 0; row < kSketchDepth; ++row) {
+      for (uint32_t idx = 0; idx < kSketchWidth; ++idx) {
+        table_[row][idx] >>= 1;
+      }
+    }
+    samples_ /= 2;
+  }
+}
+
+uint32_t RowCache::FrequencySketch::Estimate(uint64_t hash) const {
+  uint32_t h1 = static_cast<uint32_t>(hash);
+  uint32_t h2 = static_cast<uint32_t>(hash >> 32) | 1;
+  uint32_t min = 15;
+  for (uint32_t row = 0; row < kSketchDepth; ++row) {
+    uint8_t counter = table_[row][(h1 + row * h2) & (kSketchWidth - 1)];
+    if (counter < min) {
+      min = counter;
+    }
+  }
+  return min;
+}
+
+RowCache::RowCache(size_t capacity)
+    : shard_capacity_(capacity / kNumShards),
+      hits_(0),
+      misses_(0),
+      rejects_(0) {
+  shards_ = new Shard[kNumShards];
+}
+
+RowCache::~RowCache() {
+  delete[] shards_;
+}
+
+uint64_t RowCache::Hash(const Slice& key) {
+  // Spread the murmur hash over all the 64 bits, the shard is picked
+  // from the high bits and the sketch counters from the low ones
+  uint64_t hash = MurmurHash(key.data(), static_cast<int>(key.size()), 0);
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+bool RowCache::Lookup(const Slice& key, std::string* value, uint64_t* token) {
+  uint64_t hash = Hash(key);
+  Shard* shard = GetShard(hash);
+  slash::MutexLock l(&shard->mutex);
+  shard->sketch.Increment(hash);
+  auto iter = shard->index.find(key.ToString());
+  if (iter == shard->index.end()) {
+    *token = shard->epochs[hash % kEpochSlots];
+    misses_++;
+    return false;
+  }
+  shard->lru.splice(shard->lru.begin(), shard->lru, iter->second);
+  value->assign(iter->second->value);
+  hits_++;
+  return true;
+}
+
+void RowCache::Insert(const Slice& key, const Slice& value, uint64_t token) {
+  uint64_t hash = Hash(key);
+  Shard* shard = GetShard(hash);
+  slash::MutexLock l(&shard->mutex);
+  if (shard->epochs[hash % kEpochSlots] != token) {
+    // The key may have been written after it was read
+    return;
+  }
+
+  std::string key_str = key.ToString();
+  auto iter = shard->index.find(key_str);
+  if (iter != shard->index.end()) {
+    shard->usage -= Charge(*iter->second);
+    shard->lru.erase(iter->second);
+    shard->index.erase(iter);
+  }
+
+  Entry entry;
+  entry.key = key_str;
+  entry.value = value.ToString();
+  entry.hash = hash;
+  size_t charge = Charge(entry);
+  if (charge > shard_capacity_) {
+    rejects_++;
+    return;
+  }
+
+  if (shard->usage + charge > shard_capacity_) {
+    // TinyLFU admission, only displace the LRU victim with an entry which
+    // is more popular than the victim
+    const Entry& victim = shard->lru.back();
+    if (shard->sketch.Estimate(hash) <= shard->sketch.Estimate(victim.hash)) {
+      rejects_++;
+      return;
+    }
+    while (!shard->lru.empty()
+      && shard->usage + charge > shard_capacity_) {
+      shard->usage -= Charge(shard->lru.back());
+      shard->index.erase(shard->lru.back().key);
+      shard->lru.pop_back();
+    }
+  }
+
+  shard->lru.push_front(entry);
+  shard->index[key_str] = shard->lru.begin();
+  shard->usage += charge;
+}
+
+void RowCache::Erase(const Slice& key) {
+  uint64_t hash = Hash(key);
+  Shard* shard = GetShard(hash);
+  slash::MutexLock l(&shard->mutex);
+  shard->epochs[hash % kEpochSlots]++;
+  auto iter = shard->index.find(key.ToString());
+  if (iter != shard->index.end()) {
+    shard->usage -= Charge(*iter->second);
+    shard->lru.erase(iter->second);
+    shard->index.erase(iter);
+  }
+}
+
+size_t RowCache::GetUsage() {
+  size_t usage = 0;
+  for (uint32_t idx = 0; idx < kNumShards; ++idx) {
+    slash::MutexLock l(&shards_[idx].mutex);
+    usage += shards_[idx].usage;
+  }
+  return usage;
+}
+
+}  //  namespace blackwidow
@@ -0,0 +1,146 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_ROW_CACHE_H_
+#define SRC_ROW_CACHE_H_
+
+#include <list>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "rocksdb/slice.h"
+#include "slash/include/slash_mutex.h"
+
+namespace blackwidow {
+
+using Slice = rocksdb::Slice;
+
+// RowCache keeps the encoded values of the hottest keys of one Redis
+// instance: the strings values of RedisStrings and the meta values of the
+// other data types, so a read of a hot key does not need to go through
+// the memtables and the block cache.
+//
+// The values are cached in their stored format, timestamps included, so a
+// cached value expires exactly like the stored one and the compaction
+// filters never need to touch the cache. Every write must Erase() the key
+// once it is done.
+//
+// A value read from the db may only be inserted with the token which
+// Lookup() returned before the db was read, the insert is dropped if the
+// key may have been written in between.
+//
+// The cache is sharded by key and each shard is an LRU list guarded by a
+// TinyLFU admission policy: a new entry may only evict the LRU victim if it
+// has been looked up more often recently, so a scan over cold keys can not
+// flush out the hot ones.
+class RowCache {
+ public:
+  explicit RowCache(size_t capacity);
+  ~RowCache();
+
+  bool Lookup(const Slice& key, std::string* value, uint64_t* token);
+  void Insert(const Slice& key, const Slice& value, uint64_t token);
+  void Erase(const Slice& key);
+
+  uint64_t hits() const { return hits_; }
+  uint64_t misses() const { return misses_; }
+  uint64_t rejects() const { return rejects_; }
+  size_t GetUsage();
+
+ private:
+  enum {
+    kNumShardBits = 6,
+    kNumShards = 1 << kNumShardBits,
+    kEpochSlots = 64,
+    kSketchDepth = 4,
+    kSketchWidth = 4096,
+    kEntryOverhead = 64
+  };
+
+  // Count-min sketch of the recent lookups, the counters are halved every
+  // kSketchWidth * 8 samples so that the frequencies reflect recent history
+  class FrequencySketch {
+   public:
+    FrequencySketch();
+    void Increment(uint64_t hash);
+    uint32_t Estimate(uint64_t hash) const;
+   private:
+    void Reset();
+    uint8_t table_[kSketchDepth][kSketchWidth];
+    uint32_t samples_;
+  };
+
+  struct Entry {
+    std::string key;
+    std::string value;
+    uint64_t hash;
+  };
+
+  struct Shard {
+    Shard() : usage(0), epochs(kEpochSlots, 0) {}
+    slash::Mutex mutex;
+    std::list<Entry> lru;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t usage;
+    std::vector<uint64_t> epochs;
+    FrequencySketch sketch;
+  };
+
+  static uint64_t Hash(const Slice& key);
+  Shard* GetShard(uint64_t hash) {
+    return &shards_[hash >> (64 - kNumShardBits)];
+  }
+  static size_t Charge(const Entry& entry) {
+    return entry.key.size() + entry.value.size() + kEntryOverhead;
+  }
+
+  size_t shard_capacity_;
+  Shard* shards_;
+
+  std::atomic<uint64_t> hits_;
+  std::atomic<uint64_t> misses_;
+  std::atomic<uint64_t> rejects_;
+
+  // No copying allowed
+  RowCache(const RowCache&);
+  void operator=(const RowCache&);
+};
+
+// Erase the written keys from the row cache once the write is done, it has
+// to be declared after the record lock so it runs before the lock is
+// released.
+class ScopeRowCacheInvalidate {
+ public:
+  ScopeRowCacheInvalidate(RowCache* row_cache, const Slice& key) :
+    row_cache_(row_cache) {
+    if (row_cache_ != nullptr) {
+      keys_.push_back(key.ToString());
+    }
+  }
+  ScopeRowCacheInvalidate(RowCache* row_cache,
+                          const std::vector<std::string>& keys) :
+    row_cache_(row_cache) {
+    if (row_cache_ != nullptr) {
+      keys_ = keys;
+    }
+  }
+  ~ScopeRowCacheInvalidate() {
+    if (row_cache_ != nullptr) {
+      for (const auto& key : keys_) {
+        row_cache_->Erase(key);
+      }
+    }
+  }
+ private:
+  RowCache* const row_cache_;
+  std::vector<std::string> keys_;
+  ScopeRowCacheInvalidate(const ScopeRowCacheInvalidate&);
+  void operator=(const ScopeRowCacheInvalidate&);
+};
+
+}  //  namespace blackwidow
+#endif  //  SRC_ROW_CACHE_H_
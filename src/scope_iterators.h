@@ -0,0 +1,60 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_SCOPE_ITERATORS_H_
+#define SRC_SCOPE_ITERATORS_H_
+
+#include <string>
+#include <vector>
+
+#include "rocksdb/db.h"
+
+namespace blackwidow {
+
+// Iterators over several column families at a snapshot of their own, for
+// the reads of a single key which need its meta value and its data to
+// agree. The point lookups are made with Get at the same snapshot, so they
+// still use the bloom filters.
+class ScopeIterators {
+ public:
+  ScopeIterators(rocksdb::DB* db,
+                 const std::vector<rocksdb::ColumnFamilyHandle*>& cfs)
+    : db_(db), cfs_(cfs) {
+    read_options_.snapshot = db_->GetSnapshot();
+    status_ = db_->NewIterators(read_options_, cfs_, &iters_);
+  }
+  ~ScopeIterators() {
+    for (auto iter : iters_) {
+      delete iter;
+    }
+    db_->ReleaseSnapshot(read_options_.snapshot);
+  }
+
+  rocksdb::Iterator* operator[](size_t index) const {
+    return iters_[index];
+  }
+
+  // Point lookup of key in the column family at index
+  rocksdb::Status Get(size_t index, const rocksdb::Slice& key,
+                      std::string* value) const {
+    if (!status_.ok()) {
+      return status_;
+    }
+    return db_->Get(read_options_, cfs_[index], key, value);
+  }
+
+ private:
+  rocksdb::DB* const db_;
+  const std::vector<rocksdb::ColumnFamilyHandle*> cfs_;
+  rocksdb::ReadOptions read_options_;
+  rocksdb::Status status_;
+  std::vector<rocksdb::Iterator*> iters_;
+
+  ScopeIterators(const ScopeIterators&);
+  void operator=(const ScopeIterators&);
+};
+
+}  // namespace blackwidow
+#endif  // SRC_SCOPE_ITERATORS_H_
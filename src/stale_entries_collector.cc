@@ -0,0 +1,168 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/stale_entries_collector.h"
+
+#include <cstdlib>
+
+#include "src/coding.h"
+#include "src/base_meta_value_format.h"
+#include "src/lists_meta_value_format.h"
+#include "src/strings_value_format.h"
+
+namespace blackwidow {
+
+const char kStaleEntriesProperty[] = "blackwidow.stale-entries";
+const char kTotalEntriesProperty[] = "blackwidow.total-entries";
+
+const uint64_t StaleEntriesCollector::kMinEntries;
+const double StaleEntriesCollector::kCompactRatio = 0.5;
+
+StaleEntriesCollector::StaleEntriesCollector(StaleEntriesFormat format)
+  : format_(format),
+    stale_(0),
+    total_(0),
+    need_compact_(false),
+    cur_deletions_(0) {
+  int64_t unix_time;
+  rocksdb::Env::Default()->GetCurrentTime(&unix_time);
+  now_ = static_cast<int32_t>(unix_time);
+}
+
+bool StaleEntriesCollector::IsStaleValue(const Slice& value) const {
+  switch (format_) {
+    case kStringsValueFormat: {
+      ParsedStringsValue parsed_strings_value(value);
+      return parsed_strings_value.timestamp() != 0
+        && parsed_strings_value.timestamp() < now_;
+    }
+    case kBaseMetaFormat: {
+      if (value.size() < sizeof(int32_t) * 3) {
+        return false;
+      }
+      ParsedBaseMetaValue parsed_meta_value(value);
+      return parsed_meta_value.count() == 0
+        || (parsed_meta_value.timestamp() != 0
+          && parsed_meta_value.timestamp() < now_);
+    }
+    case kListsMetaFormat: {
+      if (value.size() < sizeof(uint64_t)
+          + ParsedListsMetaValue::kListsMetaValueSuffixLength) {
+        return false;
+      }
+      ParsedListsMetaValue parsed_meta_value(value);
+      return parsed_meta_value.count() == 0
+        || (parsed_meta_value.timestamp() != 0
+          && parsed_meta_value.timestamp() < now_);
+    }
+    default:
+      return false;
+  }
+}
+
+// The keys of the versioned formats are ordered by key first under every
+// comparator, so all the versions of a key come one after the other
+void StaleEntriesCollector::AddVersion(const Slice& key,
+                                       rocksdb::EntryType type) {
+  size_t version_size = format_ == kSegmentKeyFormat ?
+    sizeof(uint64_t) : sizeof(int32_t);
+  if (key.size() < sizeof(int32_t)) {
+    return;
+  }
+  uint32_t key_size = DecodeFixed32(key.data());
+  if (key.size() < sizeof(int32_t) + key_size + version_size) {
+    return;
+  }
+  Slice user_key(key.data() + sizeof(int32_t), key_size);
+  if (user_key != Slice(cur_key_)) {
+    FinishKey();
+    cur_key_.assign(user_key.data(), user_key.size());
+  }
+  if (type == rocksdb::kEntryDelete || type == rocksdb::kEntrySingleDelete) {
+    cur_deletions_++;
+    return;
+  }
+  const char* ptr = user_key.data() + key_size;
+  uint64_t version = format_ == kSegmentKeyFormat ?
+    DecodeFixed64(ptr) : static_cast<uint64_t>(DecodeFixed32(ptr));
+  cur_versions_[version]++;
+}
+
+// Everything but the newest version of the key is stale
+void StaleEntriesCollector::FinishKey() {
+  stale_ += cur_deletions_;
+  if (!cur_versions_.empty()) {
+    auto newest = cur_versions_.rbegin();
+    for (const auto& version : cur_versions_) {
+      if (version.first != newest->first) {
+        stale_ += version.second;
+      }
+    }
+  }
+  cur_versions_.clear();
+  cur_deletions_ = 0;
+}
+
+Status StaleEntriesCollector::AddUserKey(const Slice& key, const Slice& value,
+                                         rocksdb::EntryType type,
+                                         rocksdb::SequenceNumber seq,
+                                         uint64_t file_size) {
+  total_++;
+  if (format_ == kVersionedKeyFormat || format_ == kSegmentKeyFormat) {
+    AddVersion(key, type);
+    return Status::OK();
+  }
+  if (type == rocksdb::kEntryDelete || type == rocksdb::kEntrySingleDelete) {
+    stale_++;
+  } else if (type == rocksdb::kEntryPut && IsStaleValue(value)) {
+    // The timestamp of a value in a blob file is out of reach here
+    stale_++;
+  }
+  return Status::OK();
+}
+
+Status StaleEntriesCollector::Finish(
+    rocksdb::UserCollectedProperties* properties) {
+  FinishKey();
+  need_compact_ = total_ >= kMinEntries
+    && stale_ >= total_ * kCompactRatio;
+  *properties = GetReadableProperties();
+  return Status::OK();
+}
+
+rocksdb::UserCollectedProperties
+StaleEntriesCollector::GetReadableProperties() const {
+  return rocksdb::UserCollectedProperties{
+    {kStaleEntriesProperty, std::to_string(stale_)},
+    {kTotalEntriesProperty, std::to_string(total_)}};
+}
+
+static uint64_t ParseProperty(const rocksdb::UserCollectedProperties& props,
+                              const char* name) {
+  auto iter = props.find(name);
+  return iter == props.end() ? 0 : std::strtoull(iter->second.c_str(),
+                                                 nullptr, 10);
+}
+
+Status SumStaleEntries(rocksdb::DB* db,
+                       const std::vector<rocksdb::ColumnFamilyHandle*>& cfs,
+                       uint64_t* stale, uint64_t* total) {
+  for (auto cf : cfs) {
+    rocksdb::TablePropertiesCollection props;
+    Status s = db->GetPropertiesOfAllTables(cf, &props);
+    if (!s.ok()) {
+      return s;
+    }
+    for (const auto& table : props) {
+      const rocksdb::UserCollectedProperties& user_props =
+        table.second->user_collected_properties;
+      *stale += ParseProperty(user_props, kStaleEntriesProperty);
+      *total += ParseProperty(user_props, kTotalEntriesProperty);
+    }
+  }
+  return Status::OK();
+}
+
+}  //  namespace blackwidow
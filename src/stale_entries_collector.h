@@ -0,0 +1,108 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_STALE_ENTRIES_COLLECTOR_H_
+#define SRC_STALE_ENTRIES_COLLECTOR_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "rocksdb/db.h"
+#include "rocksdb/table_properties.h"
+
+namespace blackwidow {
+
+using Status = rocksdb::Status;
+using Slice = rocksdb::Slice;
+
+// Names of the user collected properties of every SST
+extern const char kStaleEntriesProperty[];
+extern const char kTotalEntriesProperty[];
+
+// How the entries of a column family are laid out
+enum StaleEntriesFormat {
+  // Strings values, stale once expired
+  kStringsValueFormat,
+  // Meta values of hashes, sets, zsets and bitmaps, stale once expired or
+  // emptied
+  kBaseMetaFormat,
+  kListsMetaFormat,
+  // Keys made of | key size | key | int32 version | ..., older versions
+  // of a key are stale
+  kVersionedKeyFormat,
+  // Same with the uint64 version of the strings segments
+  kSegmentKeyFormat
+};
+
+// Counts the entries of an SST which the next compaction would drop, the
+// deletions, the expired or emptied meta values and the data of a key
+// under any version but the newest one found in the SST. The data whose
+// meta is gone is only found by the compaction filters, it would take a
+// lookup per key.
+//
+// Like CompactOnDeletionCollector, the SSTs which are at least
+// kCompactRatio stale get marked for compaction, so the compactions pick
+// the densest garbage first.
+class StaleEntriesCollector : public rocksdb::TablePropertiesCollector {
+ public:
+  static const uint64_t kMinEntries = 1000;
+  static const double kCompactRatio;
+
+  explicit StaleEntriesCollector(StaleEntriesFormat format);
+
+  virtual Status AddUserKey(const Slice& key, const Slice& value,
+                            rocksdb::EntryType type,
+                            rocksdb::SequenceNumber seq,
+                            uint64_t file_size) override;
+  virtual Status Finish(rocksdb::UserCollectedProperties* properties) override;
+  virtual rocksdb::UserCollectedProperties
+    GetReadableProperties() const override;
+  virtual const char* Name() const override {
+    return "StaleEntriesCollector";
+  }
+  virtual bool NeedCompact() const override { return need_compact_; }
+
+ private:
+  bool IsStaleValue(const Slice& value) const;
+  void AddVersion(const Slice& key, rocksdb::EntryType type);
+  void FinishKey();
+
+  const StaleEntriesFormat format_;
+  int32_t now_;
+  uint64_t stale_;
+  uint64_t total_;
+  bool need_compact_;
+
+  // Entries per version of the current key, only for the versioned keys
+  std::string cur_key_;
+  std::map<uint64_t, uint64_t> cur_versions_;
+  uint64_t cur_deletions_;
+};
+
+class StaleEntriesCollectorFactory
+  : public rocksdb::TablePropertiesCollectorFactory {
+ public:
+  explicit StaleEntriesCollectorFactory(StaleEntriesFormat format)
+    : format_(format) {}
+  virtual rocksdb::TablePropertiesCollector* CreateTablePropertiesCollector(
+      rocksdb::TablePropertiesCollectorFactory::Context context) override {
+    return new StaleEntriesCollector(format_);
+  }
+  virtual const char* Name() const override {
+    return "StaleEntriesCollectorFactory";
+  }
+
+ private:
+  const StaleEntriesFormat format_;
+};
+
+// Adds the stale and total entries recorded in the SSTs of cfs
+Status SumStaleEntries(rocksdb::DB* db,
+                       const std::vector<rocksdb::ColumnFamilyHandle*>& cfs,
+                       uint64_t* stale, uint64_t* total);
+
+}  //  namespace blackwidow
+#endif  //  SRC_STALE_ENTRIES_COLLECTOR_H_
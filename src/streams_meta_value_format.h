@@ -0,0 +1,239 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_STREAMS_META_VALUE_FORMAT_H_
+#define SRC_STREAMS_META_VALUE_FORMAT_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base_meta_value_format.h"
+#include "src/base_data_key_format.h"
+#include "blackwidow/blackwidow.h"
+
+namespace blackwidow {
+
+// The meta value of a stream:
+//
+// | entry count | last id ms | last id seq | version | timestamp |
+//     4 Bytes      8 Bytes       8 Bytes     4 Bytes   4 Bytes
+//
+// The entries are stored in the data column family under the BaseDataKey of
+// the stream with the big endian id as data, so they are sorted by id. The
+// consumer groups and their pending entries live in the group column family,
+// see StreamsGroupKey.
+class StreamsMetaValue : public BaseMetaValue {
+ public:
+  static const size_t kUserValueLength = sizeof(int32_t) + 2 * sizeof(uint64_t);
+
+  StreamsMetaValue(int32_t count, const StreamID& last_id) :
+    BaseMetaValue(Slice(buf_, kUserValueLength)) {
+    EncodeFixed32(buf_, count);
+    EncodeFixed64(buf_ + sizeof(int32_t), last_id.ms);
+    EncodeFixed64(buf_ + sizeof(int32_t) + sizeof(uint64_t), last_id.seq);
+  }
+
+ private:
+  char buf_[kUserValueLength];
+};
+
+class ParsedStreamsMetaValue : public ParsedBaseMetaValue {
+ public:
+  // Use this constructor after rocksdb::DB::Get();
+  explicit ParsedStreamsMetaValue(std::string* internal_value_str) :
+    ParsedBaseMetaValue(internal_value_str) {
+    DecodeLastID();
+  }
+
+  // Use this constructor in rocksdb::CompactionFilter::Filter();
+  explicit ParsedStreamsMetaValue(const Slice& internal_value_slice) :
+    ParsedBaseMetaValue(internal_value_slice) {
+    DecodeLastID();
+  }
+
+  int32_t InitialMetaValue() {
+    set_last_id(StreamID());
+    return ParsedBaseMetaValue::InitialMetaValue();
+  }
+
+  const StreamID& last_id() {
+    return last_id_;
+  }
+
+  void set_last_id(const StreamID& last_id) {
+    last_id_ = last_id;
+    if (value_ != nullptr
+      && user_value_.size() >= StreamsMetaValue::kUserValueLength) {
+      char* dst = const_cast<char*>(value_->data()) + sizeof(int32_t);
+      EncodeFixed64(dst, last_id_.ms);
+      EncodeFixed64(dst + sizeof(uint64_t), last_id_.seq);
+    }
+  }
+
+ private:
+  void DecodeLastID() {
+    if (user_value_.size() >= StreamsMetaValue::kUserValueLength) {
+      const char* ptr = user_value_.data() + sizeof(int32_t);
+      last_id_.ms = DecodeFixed64(ptr);
+      last_id_.seq = DecodeFixed64(ptr + sizeof(uint64_t));
+    }
+  }
+
+  StreamID last_id_;
+};
+
+// Stream ids in big endian, so that the bytewise order is the id order
+static const size_t kStreamIDLength = 2 * sizeof(uint64_t);
+
+inline void EncodeStreamID(char* buf, const StreamID& id) {
+  for (size_t i = 0; i < sizeof(uint64_t); i++) {
+    buf[i] = static_cast<char>(id.ms >> (56 - 8 * i));
+    buf[sizeof(uint64_t) + i] = static_cast<char>(id.seq >> (56 - 8 * i));
+  }
+}
+
+inline StreamID DecodeStreamID(const char* ptr) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(ptr);
+  StreamID id;
+  for (size_t i = 0; i < sizeof(uint64_t); i++) {
+    id.ms = (id.ms << 8) | p[i];
+    id.seq = (id.seq << 8) | p[sizeof(uint64_t) + i];
+  }
+  return id;
+}
+
+class StreamsDataKey : public BaseDataKey {
+ public:
+  StreamsDataKey(const Slice& key, int32_t version, const StreamID& id) :
+    BaseDataKey(key, version, Slice(buf_, kStreamIDLength)) {
+    EncodeStreamID(buf_, id);
+  }
+
+ private:
+  char buf_[kStreamIDLength];
+};
+
+class ParsedStreamsDataKey : public ParsedBaseDataKey {
+ public:
+  explicit ParsedStreamsDataKey(const std::string* key)
+            : ParsedBaseDataKey(key) {}
+  explicit ParsedStreamsDataKey(const Slice& key)
+            : ParsedBaseDataKey(key) {}
+  StreamID id() {
+    return DecodeStreamID(data_.data());
+  }
+};
+
+// The keys of the group column family, the group itself:
+//
+// | group size | group |  ->  | last delivered id |
+//     4 Bytes                      16 Bytes
+//
+// and every entry delivered to the group and not acknowledged yet, right
+// after the group:
+//
+// | group size | group | id |  ->  | delivery time | delivery count | consumer |
+//                        16 Bytes      8 Bytes          8 Bytes
+//
+// as data of the BaseDataKey of the stream.
+class StreamsGroupKey {
+ public:
+  StreamsGroupKey(const Slice& key, int32_t version, const Slice& group) :
+    data_(EncodeData(group, nullptr)), data_key_(key, version, data_) {
+  }
+  StreamsGroupKey(const Slice& key, int32_t version, const Slice& group,
+                  const StreamID& id) :
+    data_(EncodeData(group, &id)), data_key_(key, version, data_) {
+  }
+
+  const Slice Encode() {
+    return data_key_.Encode();
+  }
+
+ private:
+  static std::string EncodeData(const Slice& group, const StreamID* id) {
+    std::string data(sizeof(int32_t) + group.size()
+                     + (id != nullptr ? kStreamIDLength : 0), '\0');
+    char* dst = &data[0];
+    EncodeFixed32(dst, group.size());
+    memcpy(dst + sizeof(int32_t), group.data(), group.size());
+    if (id != nullptr) {
+      EncodeStreamID(dst + sizeof(int32_t) + group.size(), *id);
+    }
+    return data;
+  }
+
+  std::string data_;
+  BaseDataKey data_key_;
+};
+
+class ParsedStreamsGroupKey : public ParsedBaseDataKey {
+ public:
+  explicit ParsedStreamsGroupKey(const Slice& key)
+            : ParsedBaseDataKey(key) {}
+  Slice group() {
+    return Slice(data_.data() + sizeof(int32_t),
+                 DecodeFixed32(data_.data()));
+  }
+  // Whether the key is a pending entry of the group rather than the group
+  bool is_pending() {
+    return data_.size() > sizeof(int32_t) + DecodeFixed32(data_.data());
+  }
+  StreamID id() {
+    return DecodeStreamID(data_.data() + data_.size() - kStreamIDLength);
+  }
+};
+
+// | field count | field size | field | value size | value | ...
+//     4 Bytes      4 Bytes              4 Bytes
+inline void EncodeStreamEntry(const std::vector<FieldValue>& field_values,
+                              std::string* dst) {
+  char buf[sizeof(int32_t)];
+  dst->clear();
+  EncodeFixed32(buf, field_values.size());
+  dst->append(buf, sizeof(int32_t));
+  for (const auto& fv : field_values) {
+    EncodeFixed32(buf, fv.field.size());
+    dst->append(buf, sizeof(int32_t));
+    dst->append(fv.field);
+    EncodeFixed32(buf, fv.value.size());
+    dst->append(buf, sizeof(int32_t));
+    dst->append(fv.value);
+  }
+}
+
+inline bool DecodeStreamEntry(const Slice& value,
+                              std::vector<FieldValue>* field_values) {
+  field_values->clear();
+  const char* ptr = value.data();
+  const char* limit = value.data() + value.size();
+  if (limit - ptr < static_cast<ptrdiff_t>(sizeof(int32_t))) {
+    return false;
+  }
+  uint32_t count = DecodeFixed32(ptr);
+  ptr += sizeof(int32_t);
+  std::string* strs[2];
+  for (uint32_t i = 0; i < count; i++) {
+    field_values->push_back(FieldValue());
+    strs[0] = &field_values->back().field;
+    strs[1] = &field_values->back().value;
+    for (auto str : strs) {
+      if (limit - ptr < static_cast<ptrdiff_t>(sizeof(int32_t))) {
+        return false;
+      }
+      uint32_t size = DecodeFixed32(ptr);
+      ptr += sizeof(int32_t);
+      if (static_cast<size_t>(limit - ptr) < size) {
+        return false;
+      }
+      str->assign(ptr, size);
+      ptr += size;
+    }
+  }
+  return true;
+}
+
+}  //  namespace blackwidow
+#endif  //  SRC_STREAMS_META_VALUE_FORMAT_H_
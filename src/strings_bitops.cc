@@ -0,0 +1,233 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/strings_bitops.h"
+
+#include <string.h>
+#include <algorithm>
+#ifdef __SSE4_2__
+#include <immintrin.h>
+#endif
+
+namespace blackwidow {
+
+static inline uint64_t LoadWord(const unsigned char* p) {
+  uint64_t word;
+  memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+static inline void StoreWord(unsigned char* p, uint64_t word) {
+  memcpy(p, &word, sizeof(word));
+}
+
+// Word at a time versions, they also handle the tails of the vector ones
+
+static int64_t BitCountWords(const unsigned char* p, int64_t bytes) {
+  int64_t count = 0;
+  int64_t idx = 0;
+  for (; idx + 32 <= bytes; idx += 32) {
+    count += __builtin_popcountll(LoadWord(p + idx))
+      + __builtin_popcountll(LoadWord(p + idx + 8))
+      + __builtin_popcountll(LoadWord(p + idx + 16))
+      + __builtin_popcountll(LoadWord(p + idx + 24));
+  }
+  for (; idx + 8 <= bytes; idx += 8) {
+    count += __builtin_popcountll(LoadWord(p + idx));
+  }
+  for (; idx < bytes; ++idx) {
+    count += __builtin_popcount(p[idx]);
+  }
+  return count;
+}
+
+static int64_t BitPosWords(const unsigned char* p, int64_t bytes,
+                           int32_t bit) {
+  const uint64_t skip = bit ? 0 : ~static_cast<uint64_t>(0);
+  int64_t idx = 0;
+  while (idx + 8 <= bytes && LoadWord(p + idx) == skip) {
+    idx += 8;
+  }
+  for (; idx < bytes; ++idx) {
+    unsigned int byte = bit ? p[idx] : static_cast<unsigned char>(~p[idx]);
+    if (byte != 0) {
+      return idx * 8 + __builtin_clz(byte) - 24;
+    }
+  }
+  return -1;
+}
+
+struct AndOp {
+  static const BitOpType kType = kBitOpAnd;
+  static uint64_t Apply(uint64_t a, uint64_t b) { return a & b; }
+#ifdef __SSE4_2__
+  static __m128i Apply(__m128i a, __m128i b) { return _mm_and_si128(a, b); }
+#endif
+};
+
+struct OrOp {
+  static const BitOpType kType = kBitOpOr;
+  static uint64_t Apply(uint64_t a, uint64_t b) { return a | b; }
+#ifdef __SSE4_2__
+  static __m128i Apply(__m128i a, __m128i b) { return _mm_or_si128(a, b); }
+#endif
+};
+
+struct XorOp {
+  static const BitOpType kType = kBitOpXor;
+  static uint64_t Apply(uint64_t a, uint64_t b) { return a ^ b; }
+#ifdef __SSE4_2__
+  static __m128i Apply(__m128i a, __m128i b) { return _mm_xor_si128(a, b); }
+#endif
+};
+
+// Unary, the second operand is ignored
+struct NotOp {
+  static const BitOpType kType = kBitOpNot;
+  static uint64_t Apply(uint64_t a, uint64_t) { return ~a; }
+#ifdef __SSE4_2__
+  static __m128i Apply(__m128i a, __m128i) {
+    return _mm_xor_si128(a, _mm_set1_epi8(-1));
+  }
+#endif
+};
+
+template <typename Op>
+static void ApplyWords(unsigned char* dst, const unsigned char* src,
+                       int64_t n) {
+  int64_t idx = 0;
+  for (; idx + 8 <= n; idx += 8) {
+    StoreWord(dst + idx, Op::Apply(LoadWord(dst + idx), LoadWord(src + idx)));
+  }
+  for (; idx < n; ++idx) {
+    dst[idx] = static_cast<unsigned char>(Op::Apply(dst[idx], src[idx]));
+  }
+}
+
+#ifdef __SSE4_2__
+static int64_t BitCountSSE(const unsigned char* p, int64_t bytes) {
+  // POPCNT comes with SSE4.2, the plain word loop is the fastest use of it
+  return BitCountWords(p, bytes);
+}
+
+static int64_t BitPosSSE(const unsigned char* p, int64_t bytes,
+                         int32_t bit) {
+  const __m128i skip = bit ? _mm_setzero_si128() : _mm_set1_epi8(-1);
+  int64_t idx = 0;
+  for (; idx + 16 <= bytes; idx += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + idx));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, skip)) != 0xffff) {
+      break;
+    }
+  }
+  int64_t pos = BitPosWords(p + idx, bytes - idx, bit);
+  return pos == -1 ? -1 : pos + idx * 8;
+}
+
+template <typename Op>
+static void ApplySSE(unsigned char* dst, const unsigned char* src,
+                     int64_t n) {
+  int64_t idx = 0;
+  for (; idx + 16 <= n; idx += 16) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + idx));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + idx));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + idx), Op::Apply(a, b));
+  }
+  ApplyWords<Op>(dst + idx, src + idx, n - idx);
+}
+
+static int64_t BitCountAVX2(const unsigned char* p, int64_t bytes) {
+  int64_t count;
+  int64_t done = BitCountAVX2Blocks(p, bytes, &count);
+  return count + BitCountWords(p + done, bytes - done);
+}
+
+static int64_t BitPosAVX2(const unsigned char* p, int64_t bytes,
+                          int32_t bit) {
+  int64_t idx = BitPosAVX2Skip(p, bytes, bit);
+  int64_t pos = BitPosWords(p + idx, bytes - idx, bit);
+  return pos == -1 ? -1 : pos + idx * 8;
+}
+
+template <typename Op>
+static void ApplyAVX2(unsigned char* dst, const unsigned char* src,
+                      int64_t n) {
+  int64_t idx = BitOpAVX2Vectors(Op::kType, dst, src, n);
+  ApplyWords<Op>(dst + idx, src + idx, n - idx);
+}
+#endif
+
+const BitKernels& WordBitKernels() {
+  static const BitKernels kernels{BitCountWords, BitPosWords,
+    ApplyWords<AndOp>, ApplyWords<OrOp>, ApplyWords<XorOp>,
+    ApplyWords<NotOp>};
+  return kernels;
+}
+
+#ifdef __SSE4_2__
+const BitKernels& SSEBitKernels() {
+  static const BitKernels kernels{BitCountSSE, BitPosSSE, ApplySSE<AndOp>,
+    ApplySSE<OrOp>, ApplySSE<XorOp>, ApplySSE<NotOp>};
+  return kernels;
+}
+
+const BitKernels& AVX2BitKernels() {
+  static const BitKernels kernels{BitCountAVX2, BitPosAVX2,
+    ApplyAVX2<AndOp>, ApplyAVX2<OrOp>, ApplyAVX2<XorOp>, ApplyAVX2<NotOp>};
+  return kernels;
+}
+#endif
+
+static const BitKernels& SelectBitKernels() {
+#ifdef __SSE4_2__
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return AVX2BitKernels();
+  }
+  return SSEBitKernels();
+#else
+  return WordBitKernels();
+#endif
+}
+
+static const BitKernels& Kernels() {
+  static const BitKernels& kernels = SelectBitKernels();
+  return kernels;
+}
+
+int64_t GetBitCount(const unsigned char* value, int64_t bytes) {
+  return Kernels().bit_count(value, bytes);
+}
+
+int64_t GetBitPos(const unsigned char* value, int64_t bytes, int32_t bit) {
+  return Kernels().bit_pos(value, bytes, bit);
+}
+
+void BitOpApply(BitOpType op, unsigned char* dest,
+                const unsigned char* src, int64_t src_len, int64_t len) {
+  const BitKernels& kernels = Kernels();
+  int64_t common = std::min(src_len, len);
+  switch (op) {
+    case kBitOpAnd:
+      kernels.and_func(dest, src, common);
+      if (len > common) {
+        memset(dest + common, 0, len - common);
+      }
+      break;
+    case kBitOpOr:
+      kernels.or_func(dest, src, common);
+      break;
+    case kBitOpXor:
+      kernels.xor_func(dest, src, common);
+      break;
+    case kBitOpNot:
+      kernels.not_func(dest, dest, len);
+      break;
+    case kBitOpDefault:
+      break;
+  }
+}
+
+}  //  namespace blackwidow
@@ -0,0 +1,70 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_STRINGS_BITOPS_H_
+#define SRC_STRINGS_BITOPS_H_
+
+#include <stdint.h>
+
+#include "blackwidow/blackwidow.h"
+
+namespace blackwidow {
+
+// Bit kernels of the strings commands. The AVX2 or SSE4.2 version is
+// selected at runtime when the cpu supports it, else they work a 64 bits
+// word at a time.
+
+// Count the bits set in value[0, bytes)
+int64_t GetBitCount(const unsigned char* value, int64_t bytes);
+
+// Return the position of the first bit set to bit in value[0, bytes), the
+// bits of a byte are numbered from the most significant one, -1 if there
+// is none
+int64_t GetBitPos(const unsigned char* value, int64_t bytes, int32_t bit);
+
+// dest[0, len) = dest op src, src is padded with zero bytes up to len, the
+// src of kBitOpNot is ignored
+void BitOpApply(BitOpType op, unsigned char* dest,
+                const unsigned char* src, int64_t src_len, int64_t len);
+
+typedef int64_t (*BitCountFunc)(const unsigned char* p, int64_t bytes);
+typedef int64_t (*BitPosFunc)(const unsigned char* p, int64_t bytes,
+                              int32_t bit);
+// dst[0, n) = dst op src[0, n), dst and src may be the same
+typedef void (*ApplyFunc)(unsigned char* dst, const unsigned char* src,
+                          int64_t n);
+
+struct BitKernels {
+  BitCountFunc bit_count;
+  BitPosFunc bit_pos;
+  ApplyFunc and_func;
+  ApplyFunc or_func;
+  ApplyFunc xor_func;
+  ApplyFunc not_func;
+};
+
+// The kernels of each instruction set, the word at a time ones run on any
+// cpu
+const BitKernels& WordBitKernels();
+#ifdef __SSE4_2__
+const BitKernels& SSEBitKernels();
+// Only once __builtin_cpu_supports("avx2") said so
+const BitKernels& AVX2BitKernels();
+
+// Built with -mavx2 in strings_bitops_avx2.cc, each returns how many bytes
+// it went through, the caller finishes the rest
+
+// Counts the bits of the whole 512 bytes blocks
+int64_t BitCountAVX2Blocks(const unsigned char* p, int64_t bytes,
+                           int64_t* count);
+// Skips the 64 bytes chunks with no bit set to bit
+int64_t BitPosAVX2Skip(const unsigned char* p, int64_t bytes, int32_t bit);
+// Applies op to the whole 32 bytes vectors
+int64_t BitOpAVX2Vectors(BitOpType op, unsigned char* dst,
+                         const unsigned char* src, int64_t n);
+#endif
+
+}  //  namespace blackwidow
+#endif  //  SRC_STRINGS_BITOPS_H_
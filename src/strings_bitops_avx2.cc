@@ -0,0 +1,183 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+// Built with -mavx2, keep it to the vector loops so that nothing compiled
+// here is shared with the code which runs on any cpu
+
+#include "src/strings_bitops.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace blackwidow {
+
+#ifdef __SSE4_2__
+#ifdef __AVX2__
+namespace {
+
+// Count the bits of each byte with a nibble lookup table, then sum the
+// bytes of every 64 bits lane
+inline __m256i Popcount(__m256i v) {
+  const __m256i lookup = _mm256_setr_epi8(
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+  __m256i lo = _mm256_and_si256(v, low_mask);
+  __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+  __m256i count = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                  _mm256_shuffle_epi8(lookup, hi));
+  return _mm256_sad_epu8(count, _mm256_setzero_si256());
+}
+
+// Carry save adder, h:l = a + b + c bitwise
+inline void CSA(__m256i* h, __m256i* l, __m256i a, __m256i b, __m256i c) {
+  __m256i u = _mm256_xor_si256(a, b);
+  *h = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(u, c));
+  *l = _mm256_xor_si256(u, c);
+}
+
+struct AndVectors {
+  static __m256i Apply(__m256i a, __m256i b) {
+    return _mm256_and_si256(a, b);
+  }
+};
+
+struct OrVectors {
+  static __m256i Apply(__m256i a, __m256i b) {
+    return _mm256_or_si256(a, b);
+  }
+};
+
+struct XorVectors {
+  static __m256i Apply(__m256i a, __m256i b) {
+    return _mm256_xor_si256(a, b);
+  }
+};
+
+struct NotVectors {
+  static __m256i Apply(__m256i a, __m256i) {
+    return _mm256_xor_si256(a, _mm256_set1_epi8(-1));
+  }
+};
+
+template <typename Op>
+int64_t ApplyVectors(unsigned char* dst, const unsigned char* src,
+                     int64_t n) {
+  int64_t idx = 0;
+  for (; idx + 32 <= n; idx += 32) {
+    __m256i a = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(dst + idx));
+    __m256i b = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(src + idx));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + idx),
+                        Op::Apply(a, b));
+  }
+  return idx;
+}
+
+}  // namespace
+#endif
+
+// Harley-Seal: sum 16 vectors with a tree of carry save adders and only
+// count the bits of the sixteens, that is one popcount per 512 bytes
+int64_t BitCountAVX2Blocks(const unsigned char* p, int64_t bytes,
+                           int64_t* count) {
+  *count = 0;
+#ifdef __AVX2__
+  const __m256i* data = reinterpret_cast<const __m256i*>(p);
+  const int64_t blocks = bytes / 512;
+  __m256i total = _mm256_setzero_si256();
+  __m256i ones = _mm256_setzero_si256();
+  __m256i twos = _mm256_setzero_si256();
+  __m256i fours = _mm256_setzero_si256();
+  __m256i eights = _mm256_setzero_si256();
+  __m256i sixteens, twos_a, twos_b, fours_a, fours_b, eights_a, eights_b;
+#define BW_LOAD(i) _mm256_loadu_si256(data + (i))
+  for (int64_t block = 0; block < blocks; ++block, data += 16) {
+    CSA(&twos_a, &ones, ones, BW_LOAD(0), BW_LOAD(1));
+    CSA(&twos_b, &ones, ones, BW_LOAD(2), BW_LOAD(3));
+    CSA(&fours_a, &twos, twos, twos_a, twos_b);
+    CSA(&twos_a, &ones, ones, BW_LOAD(4), BW_LOAD(5));
+    CSA(&twos_b, &ones, ones, BW_LOAD(6), BW_LOAD(7));
+    CSA(&fours_b, &twos, twos, twos_a, twos_b);
+    CSA(&eights_a, &fours, fours, fours_a, fours_b);
+    CSA(&twos_a, &ones, ones, BW_LOAD(8), BW_LOAD(9));
+    CSA(&twos_b, &ones, ones, BW_LOAD(10), BW_LOAD(11));
+    CSA(&fours_a, &twos, twos, twos_a, twos_b);
+    CSA(&twos_a, &ones, ones, BW_LOAD(12), BW_LOAD(13));
+    CSA(&twos_b, &ones, ones, BW_LOAD(14), BW_LOAD(15));
+    CSA(&fours_b, &twos, twos, twos_a, twos_b);
+    CSA(&eights_b, &fours, fours, fours_a, fours_b);
+    CSA(&sixteens, &eights, eights, eights_a, eights_b);
+    total = _mm256_add_epi64(total, Popcount(sixteens));
+  }
+#undef BW_LOAD
+  total = _mm256_slli_epi64(total, 4);
+  total = _mm256_add_epi64(total, _mm256_slli_epi64(Popcount(eights), 3));
+  total = _mm256_add_epi64(total, _mm256_slli_epi64(Popcount(fours), 2));
+  total = _mm256_add_epi64(total, _mm256_slli_epi64(Popcount(twos), 1));
+  total = _mm256_add_epi64(total, Popcount(ones));
+
+  int64_t lanes[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), total);
+  *count = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  return blocks * 512;
+#else
+  return 0;
+#endif
+}
+
+int64_t BitPosAVX2Skip(const unsigned char* p, int64_t bytes, int32_t bit) {
+  int64_t idx = 0;
+#ifdef __AVX2__
+  if (bit) {
+    for (; idx + 64 <= bytes; idx += 64) {
+      __m256i a = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(p + idx));
+      __m256i b = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(p + idx + 32));
+      __m256i v = _mm256_or_si256(a, b);
+      if (!_mm256_testz_si256(v, v)) {
+        break;
+      }
+    }
+  } else {
+    const __m256i all_ones = _mm256_set1_epi8(-1);
+    for (; idx + 64 <= bytes; idx += 64) {
+      __m256i a = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(p + idx));
+      __m256i b = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(p + idx + 32));
+      if (!_mm256_testc_si256(_mm256_and_si256(a, b), all_ones)) {
+        break;
+      }
+    }
+  }
+#endif
+  return idx;
+}
+
+int64_t BitOpAVX2Vectors(BitOpType op, unsigned char* dst,
+                         const unsigned char* src, int64_t n) {
+#ifdef __AVX2__
+  switch (op) {
+    case kBitOpAnd:
+      return ApplyVectors<AndVectors>(dst, src, n);
+    case kBitOpOr:
+      return ApplyVectors<OrVectors>(dst, src, n);
+    case kBitOpXor:
+      return ApplyVectors<XorVectors>(dst, src, n);
+    case kBitOpNot:
+      return ApplyVectors<NotVectors>(dst, src, n);
+    default:
+      break;
+  }
+#endif
+  return 0;
+}
+#endif
+
+}  //  namespace blackwidow
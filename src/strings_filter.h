@@ -8,8 +8,11 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 
 #include "src/strings_value_format.h"
+#include "src/strings_segment_format.h"
+#include "rocksdb/db.h"
 #include "rocksdb/compaction_filter.h"
 #include "src/debug.h"
 
@@ -42,6 +45,8 @@ class StringsFilter : public rocksdb::CompactionFilter {
       }
     }
 
+    // The ttl is stored in the value, so a strings value in a blob file is
+    // read back and goes through Filter()
     virtual const char* Name() const override { return "StringsFilter"; }
 };
 
@@ -58,5 +63,119 @@ class StringsFilterFactory : public rocksdb::CompactionFilterFactory {
     }
 };
 
+// Drop the segments of the values which were deleted, expired or
+// overwritten, the meta is looked up once per key like BaseDataFilter
+class StringsSegmentFilter : public rocksdb::CompactionFilter {
+  public:
+    StringsSegmentFilter(rocksdb::DB* db,
+                         std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr) :
+      db_(db),
+      cf_handles_ptr_(cf_handles_ptr),
+      cur_key_(""),
+      meta_not_found_(false),
+      cur_meta_version_(0),
+      cur_meta_timestamp_(0) {}
+
+    virtual bool Filter(int level, const Slice& key,
+                        const rocksdb::Slice& value,
+                        std::string* new_value, bool* value_changed) const override {
+      ParsedStringsSegmentKey parsed_segment_key(key);
+      Trace("==========================START==========================");
+      Trace("[StringsSegmentFilter], key: %s, index = %u, version = %lu",
+            parsed_segment_key.key().ToString().c_str(),
+            parsed_segment_key.index(),
+            parsed_segment_key.version());
+
+      Slice user_key = parsed_segment_key.key();
+      if (user_key != cur_key_) {
+        cur_key_.assign(user_key.data(), user_key.size());
+        std::string meta_value;
+        // destroyed when close the database, Reserve Current key value
+        if (cf_handles_ptr_->size() == 0) {
+          return false;
+        }
+        rocksdb::Status s = db_->Get(default_read_options_,
+            (*cf_handles_ptr_)[0], cur_key_, &meta_value);
+        if (s.ok()) {
+          ParsedStringsValue parsed_strings_value(&meta_value);
+          if (StringsSegmentsMeta::IsSegmentsMeta(
+                parsed_strings_value.value())) {
+            meta_not_found_ = false;
+            StringsSegmentsMeta meta(parsed_strings_value.value());
+            cur_meta_version_ = meta.version();
+            cur_meta_timestamp_ = parsed_strings_value.timestamp();
+          } else {
+            meta_not_found_ = true;
+          }
+        } else if (s.IsNotFound()) {
+          meta_not_found_ = true;
+        } else {
+          cur_key_ = "";
+          Trace("Reserve[Get meta_key faild]");
+          return false;
+        }
+      }
+
+      if (meta_not_found_) {
+        Trace("Drop[Meta key not exist]");
+        return true;
+      }
+
+      int64_t unix_time;
+      rocksdb::Env::Default()->GetCurrentTime(&unix_time);
+      if (cur_meta_timestamp_ != 0
+        && cur_meta_timestamp_ < static_cast<int32_t>(unix_time)) {
+        Trace("Drop[Timeout]");
+        return true;
+      }
+
+      if (cur_meta_version_ != parsed_segment_key.version()) {
+        Trace("Drop[segment_version != cur_meta_version]");
+        return true;
+      } else {
+        Trace("Reserve[segment_version == cur_meta_version]");
+        return false;
+      }
+    }
+    // Like BaseDataFilter, segments in blob files are dropped by key
+    virtual Decision FilterBlobByKey(int level, const Slice& key,
+                                     std::string* new_value,
+                                     std::string* skip_until) const override {
+      bool value_changed = false;
+      return Filter(level, key, Slice(), new_value, &value_changed) ?
+        Decision::kRemove : Decision::kKeep;
+    }
+    virtual const char* Name() const override { return "StringsSegmentFilter"; }
+
+  private:
+    rocksdb::DB* db_;
+    std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr_;
+    rocksdb::ReadOptions default_read_options_;
+    mutable std::string cur_key_;
+    mutable bool meta_not_found_;
+    mutable uint64_t cur_meta_version_;
+    mutable int32_t cur_meta_timestamp_;
+};
+
+class StringsSegmentFilterFactory : public rocksdb::CompactionFilterFactory {
+  public:
+    StringsSegmentFilterFactory(rocksdb::DB** db_ptr,
+                                std::vector<rocksdb::ColumnFamilyHandle*>* handles_ptr)
+      : db_ptr_(db_ptr), cf_handles_ptr_(handles_ptr) {
+    }
+    virtual std::unique_ptr<rocksdb::CompactionFilter> CreateCompactionFilter(
+      const rocksdb::CompactionFilter::Context& context) override {
+      return std::unique_ptr<rocksdb::CompactionFilter>(
+             new StringsSegmentFilter(*db_ptr_, cf_handles_ptr_));
+    }
+    virtual const char* Name() const override {
+      return "StringsSegmentFilterFactory";
+    }
+
+  private:
+    rocksdb::DB** db_ptr_;
+    std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr_;
+};
+
 }  //  namespace blackwidow
 #endif  // SRC_STRINGS_FILTER_H_
@@ -0,0 +1,159 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_STRINGS_SEGMENT_FORMAT_H_
+#define SRC_STRINGS_SEGMENT_FORMAT_H_
+
+#include <string>
+
+#include "src/coding.h"
+#include "rocksdb/slice.h"
+
+namespace blackwidow {
+
+using Slice = rocksdb::Slice;
+
+// A large strings value is split in segments of segment_size bytes which
+// are stored in the data column family, the strings value in the default
+// column family is then replaced by this meta:
+//
+// | magic | length | version | segment_size |
+//  8 Bytes  8 Bytes  8 Bytes     4 Bytes
+//
+// A missing segment reads as zero bytes, so does the part of a segment
+// beyond its stored size, this way a sparse bitmap only stores the
+// segments which have a bit set.
+//
+// The version is taken from the sequence number of the db when the value
+// is created, it is unique for a given key and the compaction filter drops
+// the segments whose version does not match the meta any more.
+static const char kSegmentsMagic[] = "\xff" "BWSEGS" "\x01";
+static const size_t kSegmentsMagicLength = 8;
+
+// Values larger than kSegmentsThreshold bytes are stored in segments
+static const uint32_t kSegmentSize = 16 * 1024;
+static const uint64_t kSegmentsThreshold = 64 * 1024;
+
+class StringsSegmentsMeta {
+ public:
+  static const size_t kEncodedLength =
+    kSegmentsMagicLength + sizeof(uint64_t) * 2 + sizeof(uint32_t);
+
+  StringsSegmentsMeta(uint64_t length, uint64_t version,
+                      uint32_t segment_size) :
+    length_(length), version_(version), segment_size_(segment_size) {
+  }
+
+  // user_value must be a meta, see IsSegmentsMeta()
+  explicit StringsSegmentsMeta(const Slice& user_value) {
+    const char* ptr = user_value.data() + kSegmentsMagicLength;
+    length_ = DecodeFixed64(ptr);
+    ptr += sizeof(uint64_t);
+    version_ = DecodeFixed64(ptr);
+    ptr += sizeof(uint64_t);
+    segment_size_ = DecodeFixed32(ptr);
+  }
+
+  static bool IsSegmentsMeta(const Slice& user_value) {
+    return user_value.size() == kEncodedLength
+      && !memcmp(user_value.data(), kSegmentsMagic, kSegmentsMagicLength);
+  }
+
+  std::string Encode() const {
+    std::string dst(kEncodedLength, 0);
+    char* ptr = &dst[0];
+    memcpy(ptr, kSegmentsMagic, kSegmentsMagicLength);
+    ptr += kSegmentsMagicLength;
+    EncodeFixed64(ptr, length_);
+    ptr += sizeof(uint64_t);
+    EncodeFixed64(ptr, version_);
+    ptr += sizeof(uint64_t);
+    EncodeFixed32(ptr, segment_size_);
+    return dst;
+  }
+
+  uint64_t length() const { return length_; }
+  void set_length(uint64_t length) { length_ = length; }
+  uint64_t version() const { return version_; }
+  uint32_t segment_size() const { return segment_size_; }
+  uint64_t segment_num() const {
+    return (length_ + segment_size_ - 1) / segment_size_;
+  }
+
+ private:
+  uint64_t length_;
+  uint64_t version_;
+  uint32_t segment_size_;
+};
+
+// | key_size | key | version | index |
+//   4 Bytes          8 Bytes   4 Bytes
+//
+// The index is stored big endian so that the segments of a value are
+// sorted by their position
+class StringsSegmentKey {
+ public:
+  StringsSegmentKey(const Slice& key, uint64_t version, uint32_t index) :
+    key_(key), version_(version), index_(index) {
+  }
+
+  // Every segment key of the value starts with this prefix
+  std::string EncodePrefix() const {
+    std::string dst(sizeof(int32_t) + key_.size() + sizeof(uint64_t), 0);
+    char* ptr = &dst[0];
+    EncodeFixed32(ptr, key_.size());
+    ptr += sizeof(int32_t);
+    memcpy(ptr, key_.data(), key_.size());
+    ptr += key_.size();
+    EncodeFixed64(ptr, version_);
+    return dst;
+  }
+
+  std::string Encode() const {
+    std::string dst = EncodePrefix();
+    char buf[sizeof(uint32_t)];
+    buf[0] = static_cast<char>(index_ >> 24);
+    buf[1] = static_cast<char>(index_ >> 16);
+    buf[2] = static_cast<char>(index_ >> 8);
+    buf[3] = static_cast<char>(index_);
+    dst.append(buf, sizeof(buf));
+    return dst;
+  }
+
+ private:
+  Slice key_;
+  uint64_t version_;
+  uint32_t index_;
+};
+
+class ParsedStringsSegmentKey {
+ public:
+  explicit ParsedStringsSegmentKey(const Slice& key) {
+    const char* ptr = key.data();
+    int32_t key_len = DecodeFixed32(ptr);
+    ptr += sizeof(int32_t);
+    key_ = Slice(ptr, key_len);
+    ptr += key_len;
+    version_ = DecodeFixed64(ptr);
+    ptr += sizeof(uint64_t);
+    const unsigned char* index = reinterpret_cast<const unsigned char*>(ptr);
+    index_ = static_cast<uint32_t>(index[0]) << 24
+      | static_cast<uint32_t>(index[1]) << 16
+      | static_cast<uint32_t>(index[2]) << 8
+      | static_cast<uint32_t>(index[3]);
+  }
+
+  Slice key() const { return key_; }
+  uint64_t version() const { return version_; }
+  uint32_t index() const { return index_; }
+
+ private:
+  Slice key_;
+  uint64_t version_;
+  uint32_t index_;
+};
+
+}  //  namespace blackwidow
+#endif  //  SRC_STRINGS_SEGMENT_FORMAT_H_
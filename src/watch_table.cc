@@ -0,0 +1,134 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/watch_table.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "src/murmurhash.h"
+
+namespace blackwidow {
+
+// The stripes held by this thread, and the table it runs a transaction on
+static thread_local std::vector<std::pair<const WatchTable*, uint32_t>>
+  held_stripes;
+static thread_local const WatchTable* transaction_owner = nullptr;
+
+WatchTable::WatchTable() {
+  epochs_ = new std::atomic<uint64_t>[kSlotNum];
+  for (uint32_t idx = 0; idx < kSlotNum; ++idx) {
+    epochs_[idx] = 0;
+  }
+  stripes_ = new std::mutex[kStripeNum];
+}
+
+WatchTable::~WatchTable() {
+  delete[] stripes_;
+  delete[] epochs_;
+}
+
+uint32_t WatchTable::Slot(const Slice& key) const {
+  return static_cast<uint32_t>(murmur_hash()(key) % kSlotNum);
+}
+
+uint64_t WatchTable::Epoch(const Slice& key) const {
+  return epochs_[Slot(key)].load(std::memory_order_acquire);
+}
+
+void WatchTable::Touch(const Slice& key) {
+  epochs_[Slot(key)].fetch_add(1, std::memory_order_acq_rel);
+}
+
+static bool HeldByCurrentThread(const WatchTable* table, uint32_t stripe) {
+  return std::find(held_stripes.begin(), held_stripes.end(),
+                   std::make_pair(table, stripe)) != held_stripes.end();
+}
+
+static void ForgetHeld(const WatchTable* table, uint32_t stripe) {
+  held_stripes.erase(std::find(held_stripes.begin(), held_stripes.end(),
+                               std::make_pair(table, stripe)));
+}
+
+bool WatchTable::Lock(const Slice& key, uint32_t* stripe) {
+  *stripe = Slot(key) % kStripeNum;
+  if (HeldByCurrentThread(this, *stripe)) {
+    return false;
+  }
+  stripes_[*stripe].lock();
+  held_stripes.push_back(std::make_pair(this, *stripe));
+  return true;
+}
+
+void WatchTable::Unlock(uint32_t stripe) {
+  ForgetHeld(this, stripe);
+  stripes_[stripe].unlock();
+}
+
+void WatchTable::Lock(const std::vector<std::string>& keys,
+                      std::vector<uint32_t>* stripes) {
+  stripes->clear();
+  for (const auto& key : keys) {
+    uint32_t stripe = Slot(key) % kStripeNum;
+    if (!HeldByCurrentThread(this, stripe)) {
+      stripes->push_back(stripe);
+    }
+  }
+  std::sort(stripes->begin(), stripes->end());
+  stripes->erase(std::unique(stripes->begin(), stripes->end()),
+                 stripes->end());
+  if (stripes->empty()) {
+    return;
+  }
+
+  // Wait for one stripe with none held and only try the others, start over
+  // from the busy one if any of them is taken
+  size_t first = 0;
+  while (true) {
+    stripes_[(*stripes)[first]].lock();
+    size_t busy = stripes->size();
+    for (size_t idx = 0; idx < stripes->size(); ++idx) {
+      if (idx != first && !stripes_[(*stripes)[idx]].try_lock()) {
+        busy = idx;
+        break;
+      }
+    }
+    if (busy == stripes->size()) {
+      break;
+    }
+    for (size_t idx = 0; idx < busy; ++idx) {
+      if (idx != first) {
+        stripes_[(*stripes)[idx]].unlock();
+      }
+    }
+    stripes_[(*stripes)[first]].unlock();
+    first = busy;
+  }
+  for (const auto& stripe : *stripes) {
+    held_stripes.push_back(std::make_pair(this, stripe));
+  }
+}
+
+void WatchTable::Unlock(const std::vector<uint32_t>& stripes) {
+  for (const auto& stripe : stripes) {
+    Unlock(stripe);
+  }
+}
+
+void WatchTable::BeginTransaction() {
+  transaction_mutex_.lock();
+  transaction_owner = this;
+}
+
+void WatchTable::EndTransaction() {
+  transaction_owner = nullptr;
+  transaction_mutex_.unlock();
+}
+
+bool WatchTable::InTransaction() const {
+  return transaction_owner == this;
+}
+
+}  //  namespace blackwidow
@@ -0,0 +1,114 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_WATCH_TABLE_H_
+#define SRC_WATCH_TABLE_H_
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "rocksdb/slice.h"
+
+namespace blackwidow {
+
+using Slice = rocksdb::Slice;
+
+// WatchTable keeps a modification epoch for every key written through
+// BlackWidow, it is what WATCH/EXEC style optimistic transactions are
+// validated against.
+//
+// Epochs live in a fixed number of hashed slots, so two different keys may
+// share one slot, the only effect is a spurious conflict, never a missed one.
+// Slots are guarded by striped mutexes: a write holds the stripes of the keys
+// it writes while it runs, and a transaction holds the stripes of its
+// watched keys from the validation to the end of the transaction, so that
+// only writers of the watched keys ever wait for it.
+//
+// Writers take all their stripes at once and back off rather than wait while
+// holding one. Transactions run one at a time and are the only ones to wait
+// for a stripe while holding others, which keeps the locking deadlock free.
+class WatchTable {
+ public:
+  WatchTable();
+  ~WatchTable();
+
+  uint64_t Epoch(const Slice& key) const;
+  void Touch(const Slice& key);
+
+  // Locks the stripe of key unless the calling thread holds it already,
+  // returns whether it was locked
+  bool Lock(const Slice& key, uint32_t* stripe);
+  void Unlock(uint32_t stripe);
+  // Locks the stripes of keys not held by the calling thread yet, the ones
+  // locked are stored in stripes and have to be handed back to Unlock()
+  void Lock(const std::vector<std::string>& keys,
+            std::vector<uint32_t>* stripes);
+  void Unlock(const std::vector<uint32_t>& stripes);
+
+  // Marks the calling thread as running a transaction, other transactions
+  // wait until EndTransaction()
+  void BeginTransaction();
+  void EndTransaction();
+  bool InTransaction() const;
+
+ private:
+  enum {
+    kSlotNum = 1 << 16,
+    kStripeNum = 1 << 10
+  };
+
+  uint32_t Slot(const Slice& key) const;
+
+  std::atomic<uint64_t>* epochs_;
+  std::mutex* stripes_;
+  std::mutex transaction_mutex_;
+
+  // No copying allowed
+  WatchTable(const WatchTable&);
+  void operator=(const WatchTable&);
+};
+
+// Keep the transactions watching the written keys out while the write is
+// in progress and bump the epochs of the written keys once it is done, so a
+// Watch() which races with the write still sees the key change.
+class ScopeWatchWrite {
+ public:
+  ScopeWatchWrite(WatchTable* watch_table, const Slice& key) :
+    watch_table_(watch_table), key_(key), keys_(nullptr) {
+    locked_ = watch_table_->Lock(key_, &stripe_);
+  }
+  ScopeWatchWrite(WatchTable* watch_table,
+                  const std::vector<std::string>& keys) :
+    watch_table_(watch_table), keys_(&keys), locked_(false) {
+    watch_table_->Lock(keys, &stripes_);
+  }
+  ~ScopeWatchWrite() {
+    if (keys_ == nullptr) {
+      watch_table_->Touch(key_);
+      if (locked_) {
+        watch_table_->Unlock(stripe_);
+      }
+    } else {
+      for (const auto& key : *keys_) {
+        watch_table_->Touch(key);
+      }
+      watch_table_->Unlock(stripes_);
+    }
+  }
+ private:
+  WatchTable* const watch_table_;
+  Slice key_;
+  const std::vector<std::string>* keys_;
+  bool locked_;
+  uint32_t stripe_;
+  std::vector<uint32_t> stripes_;
+  ScopeWatchWrite(const ScopeWatchWrite&);
+  void operator=(const ScopeWatchWrite&);
+};
+
+}  //  namespace blackwidow
+#endif  //  SRC_WATCH_TABLE_H_
@@ -6,6 +6,8 @@
 #ifndef SRC_ZSETS_DATA_KEY_FORMAT_H_
 #define SRC_ZSETS_DATA_KEY_FORMAT_H_
 
+#include "src/encode_arena.h"
+
 namespace blackwidow {
 
 /*
@@ -14,30 +16,17 @@ namespace blackwidow {
  */
 class ZSetsScoreKey {
  public:
-  ZSetsScoreKey(const Slice& key, int32_t version, double score, const Slice& member) :
-    start_(nullptr), key_(key), version_(version), score_(score), member_(member) {
-  }
+  // The key size, the version and the score
+  static const size_t kFixedLength = sizeof(int32_t) * 2 + sizeof(uint64_t);
 
-  ~ZSetsScoreKey() {
-    if (start_ != space_) {
-      delete[] start_;
-    }
+  ZSetsScoreKey(const Slice& key, int32_t version, double score, const Slice& member) :
+    key_(key), version_(version), score_(score), member_(member) {
   }
 
   const Slice Encode() {
-    size_t needed = key_.size() + member_.size() + sizeof(int32_t) * 2 + sizeof(uint64_t);
-    char* dst = nullptr;
-    if (needed <= sizeof(space_)) {
-      dst = space_;
-    } else {
-      dst = new char[needed];
-
-      // Need to allocate space, delete previous space
-      if (start_ != space_) {
-        delete[] start_;
-      }
-    }
-    start_ = dst;
+    size_t needed = key_.size() + member_.size() + kFixedLength;
+    char* dst = buffer_.Reserve(needed);
+    char* start = dst;
     EncodeFixed32(dst, key_.size());
     dst += sizeof(int32_t);
     memcpy(dst, key_.data(), key_.size());
@@ -48,12 +37,11 @@ class ZSetsScoreKey {
     EncodeFixed64(dst, *reinterpret_cast<const uint64_t*>(addr_score));
     dst += sizeof(uint64_t);
     memcpy(dst, member_.data(), member_.size());
-    return Slice(start_, needed);
+    return Slice(start, needed);
   }
 
  private:
-  char space_[200];
-  char* start_;
+  EncodeBuffer<200> buffer_;
   Slice key_;
   int32_t version_;
   double score_;
@@ -76,7 +64,7 @@ class ParsedZSetsScoreKey {
     const void* ptr_tmp = reinterpret_cast<const void*>(&tmp);
     score_ = *reinterpret_cast<const double*>(ptr_tmp);
     ptr += sizeof(uint64_t);
-    member_ = Slice(ptr, key->size() - key_len - 2 * sizeof(int32_t) - sizeof(uint64_t));
+    member_ = Slice(ptr, key->size() - key_len - ZSetsScoreKey::kFixedLength);
   }
 
   explicit ParsedZSetsScoreKey(const Slice& key) {
@@ -92,7 +80,7 @@ class ParsedZSetsScoreKey {
     const void* ptr_tmp = reinterpret_cast<const void*>(&tmp);
     score_ = *reinterpret_cast<const double*>(ptr_tmp);
     ptr += sizeof(uint64_t);
-    member_ = Slice(ptr, key.size() - key_len - 2 * sizeof(int32_t) - sizeof(uint64_t));
+    member_ = Slice(ptr, key.size() - key_len - ZSetsScoreKey::kFixedLength);
   }
 
   Slice key() {
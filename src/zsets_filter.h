@@ -32,8 +32,9 @@ class ZSetsScoreFilter : public rocksdb::CompactionFilter {
           parsed_zsets_score_key.member().ToString().c_str(),
           parsed_zsets_score_key.version());
 
-    if (parsed_zsets_score_key.key().ToString() != cur_key_) {
-      cur_key_ = parsed_zsets_score_key.key().ToString();
+    Slice user_key = parsed_zsets_score_key.key();
+    if (user_key != cur_key_) {
+      cur_key_.assign(user_key.data(), user_key.size());
       std::string meta_value;
       // destroyed when close the database, Reserve Current key value
       if (cf_handles_ptr_->size() == 0) {
@@ -0,0 +1,339 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <iostream>
+#include <random>
+#include <set>
+
+#include "blackwidow/blackwidow.h"
+
+using namespace blackwidow;
+
+class BitmapsTest : public ::testing::Test {
+ public:
+  BitmapsTest() {
+    std::string path = "./db/bitmaps";
+    if (access(path.c_str(), F_OK)) {
+      mkdir(path.c_str(), 0755);
+    }
+    options.create_if_missing = true;
+    s = db.Open(options, path);
+  }
+  virtual ~BitmapsTest() { }
+
+  static void SetUpTestCase() { }
+  static void TearDownTestCase() { }
+
+  blackwidow::Options options;
+  blackwidow::BlackWidow db;
+  blackwidow::Status s;
+};
+
+static bool make_expired(blackwidow::BlackWidow *const db,
+                         const Slice& key) {
+  std::map<blackwidow::DataType, rocksdb::Status> type_status;
+  int ret = db->Expire(key, 1, &type_status);
+  if (!ret || !type_status[blackwidow::DataType::kBitmaps].ok()) {
+    return false;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+  return true;
+}
+
+static bool bits_match(blackwidow::BlackWidow *const db,
+                       const Slice& key,
+                       const std::set<int64_t>& expect_bits) {
+  int64_t count = 0;
+  Status s = db->BmBitCount(key, 0, 0, &count, false);
+  if (!s.ok() && !s.IsNotFound()) {
+    return false;
+  }
+  if (count != static_cast<int64_t>(expect_bits.size())) {
+    return false;
+  }
+  int32_t ret;
+  for (const auto& offset : expect_bits) {
+    s = db->BmGetBit(key, offset, &ret);
+    if (!s.ok() || ret != 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// BmSetBit
+TEST_F(BitmapsTest, BmSetBitTest) {
+  int32_t ret;
+  s = db.BmSetBit("BMSETBIT_KEY", 7, 1, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+  s = db.BmSetBit("BMSETBIT_KEY", 7, 1, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+
+  // The whole offset range is available
+  s = db.BmSetBit("BMSETBIT_KEY", 4294967295LL, 1, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+  ASSERT_TRUE(bits_match(&db, "BMSETBIT_KEY", {7, 4294967295LL}));
+
+  s = db.BmSetBit("BMSETBIT_KEY", 4294967296LL, 1, &ret);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  s = db.BmSetBit("BMSETBIT_KEY", -1, 1, &ret);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  s = db.BmSetBit("BMSETBIT_KEY", 8, 2, &ret);
+  ASSERT_TRUE(s.IsInvalidArgument());
+
+  // Clearing the last bit removes the key
+  s = db.BmSetBit("BMSETBIT_KEY", 7, 0, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  s = db.BmSetBit("BMSETBIT_KEY", 4294967295LL, 0, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  std::string type;
+  s = db.Type("BMSETBIT_KEY", &type);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(type, "none");
+
+  // Clearing a bit of a missing key creates nothing
+  s = db.BmSetBit("BMSETBIT_KEY", 7, 0, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+  int64_t count;
+  s = db.BmBitCount("BMSETBIT_KEY", 0, 0, &count, false);
+  ASSERT_TRUE(s.IsNotFound());
+
+  // A container large enough to go from array to bitset and back
+  std::set<int64_t> bits;
+  for (int64_t offset = 65536; offset < 65536 * 2; offset += 3) {
+    s = db.BmSetBit("BMSETBIT_DENSE_KEY", offset, 1, &ret);
+    ASSERT_TRUE(s.ok());
+    bits.insert(offset);
+  }
+  ASSERT_TRUE(bits_match(&db, "BMSETBIT_DENSE_KEY", bits));
+  for (int64_t offset = 65536; offset < 65536 * 2; offset += 6) {
+    s = db.BmSetBit("BMSETBIT_DENSE_KEY", offset, 0, &ret);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(ret, 1);
+    bits.erase(offset);
+  }
+  ASSERT_TRUE(bits_match(&db, "BMSETBIT_DENSE_KEY", bits));
+
+  // Expired key starts over
+  s = db.BmSetBit("BMSETBIT_EXPIRED_KEY", 100, 1, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(make_expired(&db, "BMSETBIT_EXPIRED_KEY"));
+  s = db.BmGetBit("BMSETBIT_EXPIRED_KEY", 100, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+  s = db.BmSetBit("BMSETBIT_EXPIRED_KEY", 200, 1, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+  ASSERT_TRUE(bits_match(&db, "BMSETBIT_EXPIRED_KEY", {200}));
+}
+
+// BmGetBit
+TEST_F(BitmapsTest, BmGetBitTest) {
+  int32_t ret;
+  s = db.BmGetBit("BMGETBIT_KEY", 100, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+
+  s = db.BmSetBit("BMGETBIT_KEY", 100, 1, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.BmGetBit("BMGETBIT_KEY", 100, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  s = db.BmGetBit("BMGETBIT_KEY", 101, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+  s = db.BmGetBit("BMGETBIT_KEY", 100 + 65536, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+  s = db.BmGetBit("BMGETBIT_KEY", 4294967296LL, &ret);
+  ASSERT_TRUE(s.IsInvalidArgument());
+}
+
+// BmBitCount
+TEST_F(BitmapsTest, BmBitCountTest) {
+  int32_t ret;
+  int64_t count;
+  std::vector<int64_t> offsets {0, 1, 65535, 65536, 65537, 1000000,
+                                4294967295LL};
+  for (const auto& offset : offsets) {
+    s = db.BmSetBit("BMBITCOUNT_KEY", offset, 1, &ret);
+    ASSERT_TRUE(s.ok());
+  }
+  // A full chunk, stored as a single run
+  for (int64_t offset = 3 * 65536; offset < 4 * 65536; offset++) {
+    s = db.BmSetBit("BMBITCOUNT_KEY", offset, 1, &ret);
+    ASSERT_TRUE(s.ok());
+  }
+
+  s = db.BmBitCount("BMBITCOUNT_KEY", 0, 0, &count, false);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count, 7 + 65536);
+
+  s = db.BmBitCount("BMBITCOUNT_KEY", 0, 65535, &count, true);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count, 3);
+  s = db.BmBitCount("BMBITCOUNT_KEY", 1, 65536, &count, true);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count, 3);
+  s = db.BmBitCount("BMBITCOUNT_KEY", 65537, 4 * 65536 - 1, &count, true);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count, 1 + 65536);
+  s = db.BmBitCount("BMBITCOUNT_KEY", 3 * 65536 + 10, 3 * 65536 + 19,
+                    &count, true);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count, 10);
+  s = db.BmBitCount("BMBITCOUNT_KEY", -10, 10000000000LL, &count, true);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count, 7 + 65536);
+  s = db.BmBitCount("BMBITCOUNT_KEY", 10, 5, &count, true);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count, 0);
+
+  s = db.BmBitCount("BMBITCOUNT_NOT_EXIST_KEY", 0, 0, &count, false);
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_EQ(count, 0);
+}
+
+// BmBitOp
+TEST_F(BitmapsTest, BmBitOpTest) {
+  int32_t ret;
+  int64_t count;
+  std::mt19937 rng(7);
+  std::vector<std::string> keys {"BMBITOP_KEY1", "BMBITOP_KEY2",
+                                 "BMBITOP_KEY3"};
+  std::vector<std::set<int64_t>> bits(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    // Sparse bits over the whole range and a few denser chunks
+    for (int j = 0; j < 2000; j++) {
+      int64_t offset = rng() % (1LL << 32);
+      if (j % 2) {
+        offset = (rng() % 4) * 65536 + rng() % 65536;
+      }
+      s = db.BmSetBit(keys[i], offset, 1, &ret);
+      ASSERT_TRUE(s.ok());
+      bits[i].insert(offset);
+    }
+  }
+
+  std::set<int64_t> expect;
+  for (const auto& offset : bits[0]) {
+    if (bits[1].count(offset) && bits[2].count(offset)) {
+      expect.insert(offset);
+    }
+  }
+  s = db.BmBitOp(kBitOpAnd, "BMBITOP_DEST", keys, &count);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count, static_cast<int64_t>(expect.size()));
+  ASSERT_TRUE(bits_match(&db, "BMBITOP_DEST", expect));
+
+  expect.clear();
+  for (const auto& b : bits) {
+    expect.insert(b.begin(), b.end());
+  }
+  s = db.BmBitOp(kBitOpOr, "BMBITOP_DEST", keys, &count);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count, static_cast<int64_t>(expect.size()));
+  ASSERT_TRUE(bits_match(&db, "BMBITOP_DEST", expect));
+
+  expect.clear();
+  for (const auto& b : bits) {
+    for (const auto& offset : b) {
+      if (!expect.insert(offset).second) {
+        expect.erase(offset);
+      }
+    }
+  }
+  s = db.BmBitOp(kBitOpXor, "BMBITOP_DEST", keys, &count);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count, static_cast<int64_t>(expect.size()));
+  ASSERT_TRUE(bits_match(&db, "BMBITOP_DEST", expect));
+
+  // Difference
+  expect.clear();
+  for (const auto& offset : bits[0]) {
+    if (!bits[1].count(offset) && !bits[2].count(offset)) {
+      expect.insert(offset);
+    }
+  }
+  s = db.BmBitOp(kBitOpNot, "BMBITOP_DEST", keys, &count);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count, static_cast<int64_t>(expect.size()));
+  ASSERT_TRUE(bits_match(&db, "BMBITOP_DEST", expect));
+
+  // The destination may be a source
+  std::vector<std::string> self_keys {"BMBITOP_DEST", "BMBITOP_KEY1"};
+  s = db.BmBitOp(kBitOpOr, "BMBITOP_DEST", self_keys, &count);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count, static_cast<int64_t>(bits[0].size()));
+  ASSERT_TRUE(bits_match(&db, "BMBITOP_DEST", bits[0]));
+
+  // A missing source empties AND, the empty result removes the destination
+  std::vector<std::string> missing_keys {"BMBITOP_KEY1",
+                                         "BMBITOP_NOT_EXIST_KEY"};
+  s = db.BmBitOp(kBitOpAnd, "BMBITOP_DEST", missing_keys, &count);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count, 0);
+  s = db.BmBitCount("BMBITOP_DEST", 0, 0, &count, false);
+  ASSERT_TRUE(s.IsNotFound());
+
+  s = db.BmBitOp(kBitOpOr, "BMBITOP_DEST", missing_keys, &count);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count, static_cast<int64_t>(bits[0].size()));
+
+  std::vector<std::string> empty_keys;
+  s = db.BmBitOp(kBitOpOr, "BMBITOP_DEST", empty_keys, &count);
+  ASSERT_TRUE(s.IsInvalidArgument());
+}
+
+// Keys commands
+TEST_F(BitmapsTest, KeysTest) {
+  int32_t ret;
+  int64_t count;
+  std::map<DataType, Status> type_status;
+  s = db.BmSetBit("BMKEYS_KEY", 10, 1, &ret);
+  ASSERT_TRUE(s.ok());
+
+  std::string type;
+  s = db.Type("BMKEYS_KEY", &type);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(type, "bitmap");
+
+  std::vector<std::string> keys {"BMKEYS_KEY"};
+  ASSERT_EQ(db.Exists(keys, &type_status), 1);
+
+  std::vector<std::string> found;
+  s = db.Keys("bitmap", "BMKEYS_*", &found);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(found.size(), 1);
+  ASSERT_EQ(found[0], "BMKEYS_KEY");
+
+  ASSERT_EQ(db.Expire("BMKEYS_KEY", 100, &type_status), 1);
+  std::map<DataType, int64_t> ttl = db.TTL("BMKEYS_KEY", &type_status);
+  ASSERT_LE(ttl[kBitmaps], 100);
+  ASSERT_GE(ttl[kBitmaps], 90);
+  ASSERT_EQ(db.Persist("BMKEYS_KEY", &type_status), 1);
+  ttl = db.TTL("BMKEYS_KEY", &type_status);
+  ASSERT_EQ(ttl[kBitmaps], -1);
+
+  ASSERT_EQ(db.Del(keys, &type_status), 1);
+  s = db.BmBitCount("BMKEYS_KEY", 0, 0, &count, false);
+  ASSERT_TRUE(s.IsNotFound());
+  s = db.BmGetBit("BMKEYS_KEY", 10, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
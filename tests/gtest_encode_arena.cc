@@ -0,0 +1,113 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "src/encode_arena.h"
+
+using namespace blackwidow;
+
+typedef EncodeBuffer<8> Buffer;
+
+static char* Fill(Buffer* buffer, size_t size, char c) {
+  char* data = buffer->Reserve(size);
+  memset(data, c, size);
+  return data;
+}
+
+static bool Filled(const Buffer& buffer, size_t size, char c) {
+  for (size_t i = 0; i < size; i++) {
+    if (buffer.data()[i] != c) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// An encoder held for long does not keep the arena from reusing the memory
+// of the ones made and released meanwhile
+TEST(EncodeArenaTest, HeldAllocationTest) {
+  std::thread([]() {
+    EncodeArena* arena = EncodeArena::Current();
+    Buffer held;
+    Fill(&held, 1000, 'h');
+    size_t block_allocations = arena->block_allocations();
+    for (size_t i = 0; i < 100000; i++) {
+      Buffer buffer;
+      Fill(&buffer, 100 + i % 1000, 'b');
+      ASSERT_TRUE(Filled(buffer, 100 + i % 1000, 'b'));
+    }
+    ASSERT_LE(arena->block_allocations(), block_allocations + 1);
+    ASSERT_LE(arena->memory_usage(), 4 * 4096);
+    ASSERT_TRUE(Filled(held, 1000, 'h'));
+  }).join();
+}
+
+// Released out of order the allocations pile up, past the cap the encoders
+// go to the heap and the arena stops growing
+TEST(EncodeArenaTest, CapTest) {
+  std::thread([]() {
+    EncodeArena* arena = EncodeArena::Current();
+    Buffer held;
+    Fill(&held, 1000, 'h');
+    std::unique_ptr<Buffer> previous(new Buffer);
+    Fill(previous.get(), 10000, 'a');
+    for (size_t i = 0; i < 10000; i++) {
+      std::unique_ptr<Buffer> buffer(new Buffer);
+      char c = 'a' + (i + 1) % 26;
+      Fill(buffer.get(), 10000, c);
+      // The older one goes first
+      ASSERT_TRUE(Filled(*previous, 10000, 'a' + i % 26));
+      previous = std::move(buffer);
+      ASSERT_LE(arena->memory_usage(), 4 * EncodeArena::kMaxArenaSize);
+    }
+    ASSERT_TRUE(Filled(held, 1000, 'h'));
+
+    // Larger than the whole arena
+    Buffer large;
+    Fill(&large, 2 * EncodeArena::kMaxArenaSize, 'l');
+    ASSERT_TRUE(Filled(large, 2 * EncodeArena::kMaxArenaSize, 'l'));
+    ASSERT_LE(arena->memory_usage(), 4 * EncodeArena::kMaxArenaSize);
+  }).join();
+}
+
+// Once empty the arena frees the blocks it outgrew, and its block unless
+// small enough to keep
+TEST(EncodeArenaTest, ShrinkTest) {
+  std::thread([]() {
+    EncodeArena* arena = EncodeArena::Current();
+    {
+      std::vector<std::unique_ptr<Buffer>> buffers;
+      for (size_t i = 0; i < 50; i++) {
+        buffers.emplace_back(new Buffer);
+        Fill(buffers.back().get(), 10000, 'a');
+      }
+      ASSERT_GT(arena->memory_usage(), EncodeArena::kMaxKeptBlockSize);
+    }
+    ASSERT_EQ(arena->memory_usage(), 0);
+
+    {
+      Buffer buffer;
+      Fill(&buffer, 10000, 'a');
+    }
+    size_t block_allocations = arena->block_allocations();
+    ASSERT_GT(arena->memory_usage(), 0);
+    ASSERT_LE(arena->memory_usage(), EncodeArena::kMaxKeptBlockSize);
+    {
+      Buffer buffer;
+      Fill(&buffer, 10000, 'a');
+    }
+    ASSERT_EQ(arena->block_allocations(), block_allocations);
+  }).join();
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,272 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <iostream>
+
+#include "blackwidow/blackwidow.h"
+
+using namespace blackwidow;
+
+class FiltersTest : public ::testing::Test {
+ public:
+  FiltersTest() {
+    std::string path = "./db/filters";
+    if (access(path.c_str(), F_OK)) {
+      mkdir(path.c_str(), 0755);
+    }
+    options.create_if_missing = true;
+    s = db.Open(options, path);
+  }
+  virtual ~FiltersTest() { }
+
+  static void SetUpTestCase() { }
+  static void TearDownTestCase() { }
+
+  blackwidow::Options options;
+  blackwidow::BlackWidow db;
+  blackwidow::Status s;
+};
+
+static bool make_expired(blackwidow::BlackWidow *const db,
+                         const Slice& key) {
+  std::map<blackwidow::DataType, rocksdb::Status> type_status;
+  int ret = db->Expire(key, 1, &type_status);
+  if (!ret || !type_status[blackwidow::DataType::kFilters].ok()) {
+    return false;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+  return true;
+}
+
+static std::vector<std::string> make_items(const std::string& prefix,
+                                           int32_t begin, int32_t end) {
+  std::vector<std::string> items;
+  for (int32_t idx = begin; idx < end; idx++) {
+    items.push_back(prefix + std::to_string(idx));
+  }
+  return items;
+}
+
+static size_t count_true(const std::vector<bool>& flags) {
+  return std::count(flags.begin(), flags.end(), true);
+}
+
+// BFReserve
+TEST_F(FiltersTest, BFReserveTest) {
+  FilterInfo info;
+  s = db.BFReserve("BFRESERVE_KEY", 0, 100);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  s = db.BFReserve("BFRESERVE_KEY", 1, 100);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  s = db.BFReserve("BFRESERVE_KEY", 0.01, 0);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  s = db.BFReserve("BFRESERVE_KEY", 0.01, 100, 0);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  s = db.BFInfo("BFRESERVE_KEY", &info);
+  ASSERT_TRUE(s.IsNotFound());
+
+  s = db.BFReserve("BFRESERVE_KEY", 0.01, 100000, 4);
+  ASSERT_TRUE(s.ok());
+  s = db.BFReserve("BFRESERVE_KEY", 0.01, 100000, 4);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  s = db.BFInfo("BFRESERVE_KEY", &info);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(info.capacity, 100000);
+  ASSERT_EQ(info.items, 0);
+  ASSERT_EQ(info.filters, 1);
+  ASSERT_EQ(info.expansion, 4);
+  // About 1.2 bytes per item at 1%
+  ASSERT_GE(info.bytes, 119000);
+  ASSERT_LE(info.bytes, 125000);
+
+  std::string type;
+  s = db.Type("BFRESERVE_KEY", &type);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(type, "filter");
+
+  // A reserved filter is a key of its own
+  std::map<DataType, Status> type_status;
+  ASSERT_EQ(db.Exists({"BFRESERVE_KEY"}, &type_status), 1);
+  ASSERT_EQ(db.Del({"BFRESERVE_KEY"}, &type_status), 1);
+  s = db.BFInfo("BFRESERVE_KEY", &info);
+  ASSERT_TRUE(s.IsNotFound());
+  s = db.BFReserve("BFRESERVE_KEY", 0.001, 1000, 2);
+  ASSERT_TRUE(s.ok());
+}
+
+// BFAdd
+TEST_F(FiltersTest, BFAddTest) {
+  FilterInfo info;
+  std::vector<bool> added, exists;
+  s = db.BFExists("BFADD_KEY", {"a", "b"}, &exists);
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_EQ(exists, std::vector<bool>({false, false}));
+
+  // The filter is created with the defaults
+  s = db.BFAdd("BFADD_KEY", {"a", "b", "a"}, &added);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(added, std::vector<bool>({true, true, false}));
+  s = db.BFInfo("BFADD_KEY", &info);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(info.capacity, 100);
+  ASSERT_EQ(info.items, 2);
+  ASSERT_EQ(info.filters, 1);
+  ASSERT_EQ(info.expansion, 2);
+  ASSERT_DOUBLE_EQ(info.error_rate, 0.01);
+
+  s = db.BFAdd("BFADD_KEY", {"b", "c"}, &added);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(added, std::vector<bool>({false, true}));
+  s = db.BFExists("BFADD_KEY", {"a", "b", "c"}, &exists);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(exists, std::vector<bool>({true, true, true}));
+  s = db.BFInfo("BFADD_KEY", &info);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(info.items, 3);
+
+  s = db.BFAdd("BFADD_KEY", {}, &added);
+  ASSERT_TRUE(s.IsInvalidArgument());
+
+  // Cuckoo commands refuse a bloom filter
+  s = db.CFAdd("BFADD_KEY", {"d"}, &added);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  s = db.CFExists("BFADD_KEY", {"a"}, &exists);
+  ASSERT_TRUE(s.IsInvalidArgument());
+
+  // The filter of an expired key is dropped
+  ASSERT_TRUE(make_expired(&db, "BFADD_KEY"));
+  s = db.BFExists("BFADD_KEY", {"a"}, &exists);
+  ASSERT_TRUE(s.IsNotFound());
+  s = db.BFAdd("BFADD_KEY", {"d"}, &added);
+  ASSERT_TRUE(s.ok());
+  s = db.BFExists("BFADD_KEY", {"a", "b", "c", "d"}, &exists);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(exists, std::vector<bool>({false, false, false, true}));
+}
+
+// A full layer is followed by a larger one, nothing added is ever missed
+// and the error rate stays bounded
+TEST_F(FiltersTest, BFScaleTest) {
+  FilterInfo info;
+  std::vector<bool> added, exists;
+  s = db.BFReserve("BFSCALE_KEY", 0.01, 1000, 2);
+  ASSERT_TRUE(s.ok());
+
+  std::vector<std::string> items = make_items("item_", 0, 20000);
+  for (size_t idx = 0; idx < items.size(); idx += 500) {
+    std::vector<std::string> batch(items.begin() + idx,
+                                   items.begin() + idx + 500);
+    s = db.BFAdd("BFSCALE_KEY", batch, &added);
+    ASSERT_TRUE(s.ok());
+  }
+  s = db.BFInfo("BFSCALE_KEY", &info);
+  ASSERT_TRUE(s.ok());
+  // 1000 + 2000 + 4000 + 8000 + 16000
+  ASSERT_EQ(info.filters, 5);
+  ASSERT_EQ(info.capacity, 31000);
+  // The false positives met while adding are not counted
+  ASSERT_GE(info.items, 19500);
+  ASSERT_LE(info.items, 20000);
+
+  s = db.BFExists("BFSCALE_KEY", items, &exists);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count_true(exists), items.size());
+
+  std::vector<std::string> others = make_items("other_", 0, 20000);
+  s = db.BFExists("BFSCALE_KEY", others, &exists);
+  ASSERT_TRUE(s.ok());
+  ASSERT_LT(count_true(exists), 400);
+}
+
+// CFReserve, CFAdd, CFExists and CFDel
+TEST_F(FiltersTest, CFAddTest) {
+  FilterInfo info;
+  std::vector<bool> added, exists;
+  int32_t ret = 0;
+  s = db.CFReserve("CFADD_KEY", 0);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  s = db.CFReserve("CFADD_KEY", 1000);
+  ASSERT_TRUE(s.ok());
+  s = db.CFReserve("CFADD_KEY", 1000);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  s = db.CFInfo("CFADD_KEY", &info);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(info.capacity, 1024);
+  ASSERT_EQ(info.bytes, 1024);
+  ASSERT_EQ(info.items, 0);
+  s = db.BFInfo("CFADD_KEY", &info);
+  ASSERT_TRUE(s.IsInvalidArgument());
+
+  s = db.CFAdd("CFADD_KEY", {"a", "b", "a"}, &added);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(added, std::vector<bool>({true, true, false}));
+  s = db.CFExists("CFADD_KEY", {"a", "b", "c"}, &exists);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(exists, std::vector<bool>({true, true, false}));
+
+  s = db.CFDel("CFADD_KEY", {"a", "c"}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  s = db.CFExists("CFADD_KEY", {"a", "b"}, &exists);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(exists, std::vector<bool>({false, true}));
+  s = db.CFInfo("CFADD_KEY", &info);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(info.items, 1);
+
+  // An emptied cuckoo filter is still there
+  s = db.CFDel("CFADD_KEY", {"b"}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  std::map<DataType, Status> type_status;
+  ASSERT_EQ(db.Exists({"CFADD_KEY"}, &type_status), 1);
+
+  s = db.CFDel("CFADD_NOT_EXIST_KEY", {"a"}, &ret);
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_EQ(ret, 0);
+}
+
+// A cuckoo filter fills up to most of its capacity, the items which find
+// no room are reported
+TEST_F(FiltersTest, CFFullTest) {
+  FilterInfo info;
+  std::vector<bool> added, exists;
+  s = db.CFReserve("CFFULL_KEY", 4096);
+  ASSERT_TRUE(s.ok());
+
+  std::vector<std::string> items = make_items("item_", 0, 3800);
+  s = db.CFAdd("CFFULL_KEY", items, &added);
+  ASSERT_TRUE(s.ok());
+  s = db.CFInfo("CFFULL_KEY", &info);
+  ASSERT_TRUE(s.ok());
+  // Items sharing a fingerprint and a bucket are taken for each other
+  ASSERT_GE(info.items, 3700);
+  ASSERT_EQ(info.items, count_true(added));
+  s = db.CFExists("CFFULL_KEY", items, &exists);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count_true(exists), items.size());
+
+  std::vector<std::string> others = make_items("other_", 0, 10000);
+  s = db.CFExists("CFFULL_KEY", others, &exists);
+  ASSERT_TRUE(s.ok());
+  ASSERT_LT(count_true(exists), 400);
+
+  s = db.CFAdd("CFFULL_KEY", others, &added);
+  ASSERT_TRUE(s.IsIncomplete());
+  s = db.CFInfo("CFFULL_KEY", &info);
+  ASSERT_TRUE(s.ok());
+  ASSERT_LE(info.items, 4096);
+  // The relocations of the items which found no room were undone
+  s = db.CFExists("CFFULL_KEY", items, &exists);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count_true(exists), items.size());
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -167,6 +167,14 @@ TEST_F(HashesTest, HGetTest) {
   // If field is not present in the hash
   s = db.HGet("HGET_KEY", "HGET_NOT_EXIST_FIELD", &value);
   ASSERT_TRUE(s.IsNotFound());
+
+  // Pinned reads
+  blackwidow::PinnableValue pinned;
+  s = db.HGet("HGET_KEY", "HGET_TEST_FIELD", &pinned);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(pinned.ToString(), "HGET_TEST_VALUE");
+  s = db.HGet("HGET_KEY", "HGET_NOT_EXIST_FIELD", &pinned);
+  ASSERT_TRUE(s.IsNotFound());
 }
 
 // HGetall
@@ -1305,6 +1313,42 @@ TEST_F(HashesTest, HScanTest) {
   ASSERT_TRUE(field_value_match(field_value_out, {}));
 }
 
+// HGetall steps over the fields deleted by HDel, once enough of them have
+// been skipped the range of the hash is compacted in the background
+TEST_F(HashesTest, SkippedKeysCompactionTest) {
+  blackwidow::BlackwidowOptions bw_options;
+  bw_options.options.create_if_missing = true;
+  bw_options.compact_key_skipped_threshold = 100;
+  blackwidow::BlackWidow skip_db;
+  s = skip_db.Open(bw_options, "./db/hashes_skipped_keys");
+  ASSERT_TRUE(s.ok());
+
+  int32_t ret = 0;
+  std::vector<FieldValue> fvs_in;
+  std::vector<std::string> del_fields;
+  std::vector<FieldValue> expect;
+  for (int32_t i = 0; i < 1000; i++) {
+    std::string field = "FIELD_" + std::to_string(i);
+    std::string value = "VALUE_" + std::to_string(i);
+    fvs_in.push_back({field, value});
+    if (i % 100 == 0) {
+      expect.push_back({field, value});
+    } else {
+      del_fields.push_back(field);
+    }
+  }
+  s = skip_db.HMSet("SKIPPED_KEYS_KEY", fvs_in);
+  ASSERT_TRUE(s.ok());
+  s = skip_db.HDel("SKIPPED_KEYS_KEY", del_fields, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 990);
+
+  for (int32_t i = 0; i < 10; i++) {
+    ASSERT_TRUE(field_value_match(&skip_db, "SKIPPED_KEYS_KEY", expect));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -5,9 +5,13 @@
 
 #include <gtest/gtest.h>
 #include <thread>
+#include <cmath>
+#include <random>
 #include <iostream>
+#include <algorithm>
 
 #include "blackwidow/blackwidow.h"
+#include "src/redis_hyperloglog.h"
 
 using namespace blackwidow;
 
@@ -173,6 +177,240 @@ TEST_F(HyperLogLogTest, MultipleKeysTest) {
   ASSERT_LT(ratio_nums, static_cast<double>(result/100)*5);
 }
 
+TEST_F(HyperLogLogTest, EncodingTest) {
+  // Small values stay sparse, large ones are promoted to dense registers
+  bool update;
+  std::string value;
+  std::vector<std::string> values;
+  for (int32_t i = 1; i <= 100; i++) {
+    values.push_back("FOO" + std::to_string(i));
+  }
+  s = db.PfAdd("HLL", values, &update);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(update);
+  s = db.Get("HLL", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_LT(value.size(), 3000);
+
+  for (int32_t i = 101; i <= 20000; i += values.size()) {
+    values.clear();
+    for (int32_t j = i; j < i + 100; j++) {
+      values.push_back("FOO" + std::to_string(j));
+    }
+    s = db.PfAdd("HLL", values, &update);
+    ASSERT_TRUE(s.ok());
+  }
+  s = db.Get("HLL", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_LT(value.size(), 16 * 1024);
+
+  std::vector<std::string> keys {"HLL"};
+  int64_t result;
+  s = db.PfCount(keys, &result);
+  ASSERT_TRUE(s.ok());
+  ASSERT_LT(abs(20000 - result), 20000 / 100 * 5);
+
+  // Values which are not HyperLogLog values are refused
+  s = db.Set("HLL_STRING", "not a hyperloglog");
+  ASSERT_TRUE(s.ok());
+  s = db.PfAdd("HLL_STRING", values, &update);
+  ASSERT_TRUE(s.IsInvalidArgument());
+
+  std::map<blackwidow::DataType, Status> type_status;
+  keys.push_back("HLL_STRING");
+  db.Del(keys, &type_status);
+}
+
+TEST_F(HyperLogLogTest, CachedCountTest) {
+  // PFCOUNT caches the cardinality and PFADD drops it
+  bool update;
+  bool added = false;
+  std::vector<std::string> values;
+  // PfAdd takes fewer than kMaxKeys values at a time
+  for (int32_t i = 1; i <= 10000; i++) {
+    values.push_back("FOO" + std::to_string(i));
+    if (values.size() == 200) {
+      s = db.PfAdd("HLL", values, &update);
+      ASSERT_TRUE(s.ok());
+      values.clear();
+    }
+  }
+  std::map<blackwidow::DataType, Status> type_status;
+  ASSERT_EQ(db.Expire("HLL", 100, &type_status), 1);
+
+  std::vector<std::string> keys {"HLL"};
+  int64_t first, second;
+  s = db.PfCount(keys, &first);
+  ASSERT_TRUE(s.ok());
+  s = db.PfCount(keys, &second);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(first, second);
+
+  // Caching the cardinality keeps the ttl
+  std::map<blackwidow::DataType, int64_t> ttl = db.TTL("HLL", &type_status);
+  ASSERT_GT(ttl[kStrings], 0);
+
+  for (int32_t i = 10001; i <= 20000; i++) {
+    values.push_back("FOO" + std::to_string(i));
+    if (values.size() == 200) {
+      s = db.PfAdd("HLL", values, &update);
+      ASSERT_TRUE(s.ok());
+      added = added || update;
+      values.clear();
+    }
+  }
+  ASSERT_TRUE(added);
+  s = db.PfCount(keys, &second);
+  ASSERT_TRUE(s.ok());
+  ASSERT_GT(second, first);
+  ASSERT_LT(abs(20000 - second), 20000 / 100 * 5);
+
+  db.Del(keys, &type_status);
+}
+
+// A dense value with 1 << precision 6 bits registers
+static std::string make_dense_hll(uint8_t precision,
+                                  const std::vector<uint8_t>& registers) {
+  std::string value(16, 0);
+  value.replace(0, 4, "HYLL");
+  value[5] = static_cast<char>(precision);
+  std::string packed(((1 << precision) * 6 + 7) / 8 + 1, 0);
+  for (size_t idx = 0; idx < registers.size(); idx++) {
+    uint32_t bit = idx * 6;
+    uint32_t reg = registers[idx] << (bit & 7);
+    packed[bit / 8] |= static_cast<char>(reg & 0xff);
+    packed[bit / 8 + 1] |= static_cast<char>(reg >> 8);
+  }
+  return value + packed;
+}
+
+TEST_F(HyperLogLogTest, SmallPrecisionMergeTest) {
+  // Sketches of fewer registers than a vector register merge correctly
+  std::vector<uint8_t> registers1, registers2, merged;
+  for (uint8_t idx = 0; idx < 16; idx++) {
+    registers1.push_back(idx % 5 + 1);
+    registers2.push_back(idx * 3 % 7 + 1);
+    merged.push_back(std::max(registers1.back(), registers2.back()));
+  }
+  s = db.Set("HLL_P4_1", make_dense_hll(4, registers1));
+  ASSERT_TRUE(s.ok());
+  s = db.Set("HLL_P4_2", make_dense_hll(4, registers2));
+  ASSERT_TRUE(s.ok());
+
+  std::vector<std::string> keys {"HLL_P4_1", "HLL_P4_2"};
+  s = db.PfMerge(keys);
+  ASSERT_TRUE(s.ok());
+  std::string value;
+  s = db.Get("HLL_P4_1", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, make_dense_hll(4, merged));
+
+  int64_t result;
+  s = db.PfCount(keys, &result);
+  ASSERT_TRUE(s.ok());
+  ASSERT_GT(result, 0);
+
+  // A sketch of the default precision is folded down to 16 registers
+  bool update;
+  std::vector<std::string> values {"A", "B", "C"};
+  s = db.PfAdd("HLL_P14", values, &update);
+  ASSERT_TRUE(s.ok());
+  keys.push_back("HLL_P14");
+  s = db.PfCount(keys, &result);
+  ASSERT_TRUE(s.ok());
+  ASSERT_GT(result, 0);
+
+  std::map<blackwidow::DataType, Status> type_status;
+  db.Del(keys, &type_status);
+}
+
+// Every merge kernel the cpu runs against a plain max, with register
+// counts around and between the vector widths
+TEST(HyperLogLogKernelTest, MergeMaxTest) {
+  typedef void (*MergeMaxFunc)(uint8_t*, const uint8_t*, uint32_t);
+  std::vector<MergeMaxFunc> kernels {MergeMax, MergeMaxScalar};
+#ifdef __SSE4_2__
+  kernels.push_back(MergeMaxSSE);
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.push_back(MergeMaxAVX2);
+  }
+#endif
+  std::mt19937 engine(1);
+  std::uniform_int_distribution<int32_t> distribution(0, 63);
+  for (uint32_t m : {1, 15, 16, 17, 31, 32, 33, 47, 48, 63, 64, 65, 100,
+                     1000, (1 << 14) + 7}) {
+    std::vector<uint8_t> dst(m), src(m), expected(m);
+    for (uint32_t idx = 0; idx < m; idx++) {
+      dst[idx] = distribution(engine);
+      src[idx] = distribution(engine);
+      expected[idx] = std::max(dst[idx], src[idx]);
+    }
+    for (auto kernel : kernels) {
+      // One sentinel past the end, which no kernel may touch
+      std::vector<uint8_t> merged(dst);
+      merged.push_back(0xff);
+      std::vector<uint8_t> source(src);
+      source.push_back(0);
+      kernel(&merged[0], &source[0], m);
+      ASSERT_EQ(merged[m], 0xff);
+      merged.pop_back();
+      ASSERT_EQ(merged, expected);
+    }
+  }
+}
+
+// A value promoted from sparse to dense keeps its registers, however the
+// promotion happened
+TEST(HyperLogLogKernelTest, SparseToDenseTest) {
+  const uint8_t precision = 14;
+  HyperLogLog direct(precision, "");
+  HyperLogLog small(precision, "");
+  HyperLogLog large(precision, "");
+  for (int32_t i = 0; i < 20000; i++) {
+    std::string element = "ELEMENT" + std::to_string(i);
+    direct.Add(element.data(), element.size());
+    HyperLogLog& part = i < 50 ? small : large;
+    part.Add(element.data(), element.size());
+  }
+  ASSERT_FALSE(direct.IsSparse());
+  ASSERT_TRUE(small.IsSparse());
+  ASSERT_FALSE(large.IsSparse());
+
+  // Dense merged into sparse, and sparse merged into dense
+  HyperLogLog promoted(precision, small.Encode());
+  promoted.Merge(large);
+  ASSERT_FALSE(promoted.IsSparse());
+  ASSERT_EQ(promoted.Encode(), direct.Encode());
+  HyperLogLog dense(precision, large.Encode());
+  dense.Merge(small);
+  ASSERT_EQ(dense.Encode(), direct.Encode());
+
+  // Decoding the promoted value gives the same estimate
+  HyperLogLog decoded(precision, direct.Encode());
+  ASSERT_EQ(decoded.Estimate(), direct.Estimate());
+}
+
+// The estimate stays within a few standard errors, 1.04 / sqrt(2^14),
+// from a handful of elements up to millions
+TEST(HyperLogLogKernelTest, EstimatorAccuracyTest) {
+  const uint8_t precision = 14;
+  HyperLogLog hll(precision, "");
+  int64_t added = 0;
+  for (int64_t cardinality : {1, 10, 100, 1000, 10000, 100000, 1000000}) {
+    for (; added < cardinality; added++) {
+      std::string element = "ELEMENT" + std::to_string(added);
+      hll.Add(element.data(), element.size());
+    }
+    double estimate = hll.Estimate();
+    double error = std::abs(estimate - cardinality);
+    if (cardinality <= 1000) {
+      // Barely any registers collide, the estimate is about exact
+      ASSERT_LE(error, std::max(1.0, cardinality * 0.01));
+    } else {
+      ASSERT_LE(error, cardinality * 0.03);
+    }
+  }
+}
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -4,10 +4,12 @@
 //  of patent rights can be found in the PATENTS file in the same directory.
 
 #include <gtest/gtest.h>
+#include <atomic>
 #include <thread>
 #include <iostream>
 
 #include "blackwidow/blackwidow.h"
+#include "src/compact_key_tracker.h"
 
 using namespace blackwidow;
 
@@ -367,18 +369,32 @@ TEST_F(KeysTest, PersistTest) {
   s = db.ZAdd("PERSIST_KEY", {{1, "MEMBER"}}, &ret);
   ASSERT_TRUE(s.ok());
 
+  // Bitmaps
+  s = db.BmSetBit("PERSIST_KEY", 1, 1, &ret);
+  ASSERT_TRUE(s.ok());
+
+  // Streams
+  blackwidow::StreamID id;
+  s = db.XAdd("PERSIST_KEY", {{"FIELD", "VALUE"}}, &id);
+  ASSERT_TRUE(s.ok());
+
+  // Filters
+  std::vector<bool> added;
+  s = db.BFAdd("PERSIST_KEY", {"ITEM"}, &added);
+  ASSERT_TRUE(s.ok());
+
   ret = db.Persist("PERSIST_KEY", &type_status);
   ASSERT_EQ(ret, 0);
 
   // If the timeout was set
   ret = db.Expire("PERSIST_KEY", 1000, &type_status);
-  ASSERT_EQ(ret, 5);
+  ASSERT_EQ(ret, 8);
   ret = db.Persist("PERSIST_KEY", &type_status);
-  ASSERT_EQ(ret, 5);
+  ASSERT_EQ(ret, 8);
 
   std::map<blackwidow::DataType, int64_t> ttl_ret;
   ttl_ret = db.TTL("PERSIST_KEY", &type_status);
-  ASSERT_EQ(ttl_ret.size(), 5);
+  ASSERT_EQ(ttl_ret.size(), 8);
   for (auto it = ttl_ret.begin(); it != ttl_ret.end(); it++) {
     ASSERT_EQ(it->second, -1);
   }
@@ -390,7 +406,7 @@ TEST_F(KeysTest, TTLTest) {
   std::map<blackwidow::DataType, Status> type_status;
   std::map<blackwidow::DataType, int64_t> ttl_ret;
   ttl_ret = db.TTL("TTL_KEY", &type_status);
-  ASSERT_EQ(ttl_ret.size(), 5);
+  ASSERT_EQ(ttl_ret.size(), 8);
   for (auto it = ttl_ret.begin(); it != ttl_ret.end(); it++) {
     ASSERT_EQ(it->second, -2);
   }
@@ -419,23 +435,380 @@ TEST_F(KeysTest, TTLTest) {
   s = db.ZAdd("TTL_KEY", {{1, "SCORE"}}, &ret);
   ASSERT_TRUE(s.ok());
 
+  // Bitmaps
+  s = db.BmSetBit("TTL_KEY", 1, 1, &ret);
+  ASSERT_TRUE(s.ok());
+
+  // Streams
+  blackwidow::StreamID id;
+  s = db.XAdd("TTL_KEY", {{"FIELD", "VALUE"}}, &id);
+  ASSERT_TRUE(s.ok());
+
+  // Filters
+  std::vector<bool> added;
+  s = db.BFAdd("TTL_KEY", {"ITEM"}, &added);
+  ASSERT_TRUE(s.ok());
+
   ttl_ret = db.TTL("TTL_KEY", &type_status);
-  ASSERT_EQ(ttl_ret.size(), 5);
+  ASSERT_EQ(ttl_ret.size(), 8);
   for (auto it = ttl_ret.begin(); it != ttl_ret.end(); it++) {
     ASSERT_EQ(it->second, -1);
   }
 
   // If the timeout was set
   ret = db.Expire("TTL_KEY", 10, &type_status);
-  ASSERT_EQ(ret, 5);
+  ASSERT_EQ(ret, 8);
   ttl_ret = db.TTL("TTL_KEY", &type_status);
-  ASSERT_EQ(ttl_ret.size(), 5);
+  ASSERT_EQ(ttl_ret.size(), 8);
   for (auto it = ttl_ret.begin(); it != ttl_ret.end(); it++) {
     ASSERT_GT(it->second, 0);
     ASSERT_LE(it->second, 10);
   }
 }
 
+// Watch and ExecIfUnchanged
+TEST_F(KeysTest, WatchTest) {
+  int32_t ret = 0;
+  std::string value;
+  std::vector<blackwidow::KeyEpoch> watched;
+
+  // The transaction runs if the watched keys were not modified
+  s = db.Set("WATCH_KEY", "VALUE");
+  ASSERT_TRUE(s.ok());
+  s = db.Watch({"WATCH_KEY", "WATCH_HASH_KEY"}, &watched);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(watched.size(), 2);
+  s = db.ExecIfUnchanged(watched, [&]() {
+    return db.Set("WATCH_KEY", "NEW_VALUE");
+  });
+  ASSERT_TRUE(s.ok());
+  s = db.Get("WATCH_KEY", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "NEW_VALUE");
+
+  // The transaction's own writes invalidate the watch
+  s = db.ExecIfUnchanged(watched, [&]() {
+    return db.Set("WATCH_KEY", "OTHER_VALUE");
+  });
+  ASSERT_TRUE(s.IsBusy());
+  s = db.Get("WATCH_KEY", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "NEW_VALUE");
+
+  // A write of any type between Watch and ExecIfUnchanged aborts it
+  s = db.Watch({"WATCH_KEY", "WATCH_HASH_KEY"}, &watched);
+  ASSERT_TRUE(s.ok());
+  s = db.HSet("WATCH_HASH_KEY", "FIELD", "VALUE", &ret);
+  ASSERT_TRUE(s.ok());
+  bool executed = false;
+  s = db.ExecIfUnchanged(watched, [&]() {
+    executed = true;
+    return db.Set("WATCH_KEY", "OTHER_VALUE");
+  });
+  ASSERT_TRUE(s.IsBusy());
+  ASSERT_FALSE(executed);
+
+  // Overwriting an existing hash field is a modification as well
+  s = db.Watch({"WATCH_HASH_KEY"}, &watched);
+  ASSERT_TRUE(s.ok());
+  s = db.HSet("WATCH_HASH_KEY", "FIELD", "VALUE", &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.ExecIfUnchanged(watched, [&]() {
+    return db.HSet("WATCH_HASH_KEY", "FIELD", "OTHER_VALUE", &ret);
+  });
+  ASSERT_TRUE(s.IsBusy());
+  s = db.HGet("WATCH_HASH_KEY", "FIELD", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "VALUE");
+
+  // Writes to other keys don't abort the transaction
+  s = db.Watch({"WATCH_KEY"}, &watched);
+  ASSERT_TRUE(s.ok());
+  s = db.Set("WATCH_OTHER_KEY", "VALUE");
+  ASSERT_TRUE(s.ok());
+  s = db.ExecIfUnchanged(watched, [&]() {
+    return db.Set("WATCH_KEY", "LAST_VALUE");
+  });
+  ASSERT_TRUE(s.ok());
+  s = db.Get("WATCH_KEY", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "LAST_VALUE");
+}
+
+// A transaction only holds off the writers of its watched keys
+TEST_F(KeysTest, WatchConcurrencyTest) {
+  std::string value;
+  std::vector<blackwidow::KeyEpoch> watched;
+  s = db.Watch({"WATCH_CONCURRENT_KEY"}, &watched);
+  ASSERT_TRUE(s.ok());
+
+  std::atomic<bool> other_written(false);
+  std::atomic<bool> watched_written(false);
+  std::thread watched_writer;
+  s = db.ExecIfUnchanged(watched, [&]() {
+    std::thread other_writer([&]() {
+      db.Set("WATCH_CONCURRENT_OTHER_KEY", "VALUE");
+      other_written = true;
+    });
+    other_writer.join();
+    watched_writer = std::thread([&]() {
+      db.Set("WATCH_CONCURRENT_KEY", "OUTSIDE_VALUE");
+      watched_written = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    bool waited = !watched_written;
+    // Blocking pops don't wait inside a transaction
+    std::string key, element;
+    Status pop_status = db.BLPop({"WATCH_CONCURRENT_LIST"}, 0, &key, &element);
+    if (!waited || !pop_status.IsTimedOut()) {
+      return Status::Corruption("Not isolated");
+    }
+    return db.Set("WATCH_CONCURRENT_KEY", "TRANSACTION_VALUE");
+  });
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(other_written);
+
+  // The writer of the watched key went on once the transaction returned
+  watched_writer.join();
+  ASSERT_TRUE(watched_written);
+  s = db.Get("WATCH_CONCURRENT_KEY", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "OUTSIDE_VALUE");
+}
+
+TEST_F(KeysTest, BGTasksTest) {
+  std::vector<blackwidow::BGTaskStatus> tasks;
+
+  // Identical pending tasks are queued once
+  s = db.AddBGTask({kSets, kCompactKey, "BGTASK_KEY"});
+  ASSERT_TRUE(s.ok());
+  s = db.AddBGTask({kSets, kCompactKey, "BGTASK_KEY"});
+  ASSERT_TRUE(s.ok());
+  s = db.GetBGTasks(&tasks);
+  ASSERT_TRUE(s.ok());
+  int32_t pending = 0;
+  for (const auto& task : tasks) {
+    if (!task.running && task.task.argv == "BGTASK_KEY") {
+      pending++;
+    }
+  }
+  ASSERT_LE(pending, 1);
+
+  // Only pending tasks can be cancelled
+  s = db.CancelBGTask({kHashes, kCompactKey, "BGTASK_NOT_QUEUED_KEY"});
+  ASSERT_TRUE(s.IsNotFound());
+
+  // Every data type is compacted, and the queue drains
+  s = db.Compact(kAll, true);
+  ASSERT_TRUE(s.ok());
+  s = db.Compact(kAll, false);
+  ASSERT_TRUE(s.ok());
+  for (int32_t i = 0; i < 100; i++) {
+    s = db.GetBGTasks(&tasks);
+    ASSERT_TRUE(s.ok());
+    for (const auto& task : tasks) {
+      ASSERT_GE(task.progress, 0);
+      ASSERT_LE(task.progress, 1);
+    }
+    if (tasks.empty()) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  ASSERT_TRUE(tasks.empty());
+  ASSERT_EQ(db.GetCurrentTaskType(), "No");
+}
+
+TEST_F(KeysTest, BGTaskWindowsTest) {
+  std::vector<blackwidow::BGTaskStatus> tasks;
+  s = db.SetBGTaskWindows({{-1, 60}});
+  ASSERT_TRUE(s.IsInvalidArgument());
+
+  // A window starting two hours from now
+  time_t now = time(nullptr);
+  struct tm local;
+  localtime_r(&now, &local);
+  int32_t minute = local.tm_hour * 60 + local.tm_min;
+  s = db.SetBGTaskWindows({{(minute + 120) % 1440, (minute + 180) % 1440}});
+  ASSERT_TRUE(s.ok());
+
+  // Full compactions wait for the window, key compactions do not
+  s = db.Compact(kStrings, false);
+  ASSERT_TRUE(s.ok());
+  s = db.AddBGTask({kStrings, kCompactKey, "BGTASK_WINDOW_KEY"});
+  ASSERT_TRUE(s.ok());
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  s = db.GetBGTasks(&tasks);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(tasks.size(), 1);
+  ASSERT_FALSE(tasks[0].running);
+  ASSERT_EQ(tasks[0].task.operation, kCleanAll);
+
+  s = db.SetBGTaskWindows({});
+  ASSERT_TRUE(s.ok());
+  for (int32_t i = 0; i < 100; i++) {
+    s = db.GetBGTasks(&tasks);
+    ASSERT_TRUE(s.ok());
+    if (tasks.empty()) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  ASSERT_TRUE(tasks.empty());
+}
+
+TEST_F(KeysTest, ScanRateLimitTest) {
+  blackwidow::BlackwidowOptions bw_options;
+  bw_options.options.create_if_missing = true;
+  bw_options.compaction_bytes_per_sec = 64 << 20;
+  bw_options.scan_bytes_per_sec = 64 << 20;
+  blackwidow::BlackWidow limited_db;
+  s = limited_db.Open(bw_options, "./db/keys_rate_limit");
+  ASSERT_TRUE(s.ok());
+
+  s = limited_db.Set("RATE_LIMIT_KEY", "VALUE");
+  ASSERT_TRUE(s.ok());
+  std::vector<std::string> keys;
+  s = limited_db.Keys("all", "RATE_LIMIT_*", &keys);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(keys, std::vector<std::string>({"RATE_LIMIT_KEY"}));
+  std::vector<uint64_t> nums;
+  s = limited_db.GetKeyNum(&nums);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(nums[0], 1);
+}
+
+TEST_F(KeysTest, CompactKeyTest) {
+  int32_t ret = 0;
+  uint64_t len = 0;
+  std::string value;
+  s = db.Set("COMPACT_KEY", "VALUE");
+  ASSERT_TRUE(s.ok());
+  s = db.HMSet("COMPACT_KEY", {{"F1", "V1"}, {"F2", "V2"}});
+  ASSERT_TRUE(s.ok());
+  s = db.HDel("COMPACT_KEY", {"F1"}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.SAdd("COMPACT_KEY", {"M1", "M2"}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.SRem("COMPACT_KEY", {"M1"}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.RPush("COMPACT_KEY", {"E1", "E2", "E3", "E4"}, &len);
+  ASSERT_TRUE(s.ok());
+  s = db.LTrim("COMPACT_KEY", 1, 2);
+  ASSERT_TRUE(s.ok());
+  s = db.ZAdd("COMPACT_KEY", {{1, "M1"}, {2, "M2"}, {3, "M3"}}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.ZRemrangebyscore("COMPACT_KEY", 1, 2, true, true, &ret);
+  ASSERT_TRUE(s.ok());
+  for (uint64_t ms = 1; ms <= 3; ms++) {
+    blackwidow::StreamID id(ms, 0);
+    s = db.XAdd("COMPACT_KEY", {{"F", "V"}}, &id);
+    ASSERT_TRUE(s.ok());
+  }
+  s = db.XTrim("COMPACT_KEY", 1, &ret);
+  ASSERT_TRUE(s.ok());
+  std::vector<bool> added;
+  s = db.BFAdd("COMPACT_KEY", {"ITEM"}, &added);
+  ASSERT_TRUE(s.ok());
+
+  for (const auto& type : {kStrings, kHashes, kSets, kLists, kZSets,
+                           kBitmaps, kStreams, kFilters, kAll}) {
+    s = db.CompactKey(type, "COMPACT_KEY");
+    ASSERT_TRUE(s.ok());
+  }
+
+  s = db.Get("COMPACT_KEY", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "VALUE");
+  s = db.HGet("COMPACT_KEY", "F2", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "V2");
+  s = db.SIsmember("COMPACT_KEY", "M2", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  std::vector<std::string> elements;
+  s = db.LRange("COMPACT_KEY", 0, -1, &elements);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(elements, std::vector<std::string>({"E2", "E3"}));
+  std::vector<ScoreMember> score_members;
+  s = db.ZRange("COMPACT_KEY", 0, -1, &score_members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(score_members.size(), 1);
+  ASSERT_EQ(score_members[0].member, "M3");
+  std::vector<blackwidow::StreamEntry> entries;
+  s = db.XRange("COMPACT_KEY", blackwidow::StreamID(),
+                blackwidow::StreamID(UINT64_MAX, UINT64_MAX), -1, &entries);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(entries.size(), 1);
+  ASSERT_EQ(entries[0].id, blackwidow::StreamID(3, 0));
+  std::vector<bool> exists;
+  s = db.BFExists("COMPACT_KEY", {"ITEM"}, &exists);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(exists, std::vector<bool>({true}));
+}
+
+// A cancelled key compaction does not keep the key from being queued again,
+// the background threads of a db which is not open never run the tasks
+TEST(CompactKeyTrackerTest, CancelTest) {
+  blackwidow::BlackWidow idle_db;
+  blackwidow::CompactKeyTracker tracker(&idle_db, 0, 10);
+  std::vector<blackwidow::BGTaskStatus> tasks;
+
+  tracker.AddChurn(kHashes, "TRACKED_KEY", 9);
+  Status s = idle_db.GetBGTasks(&tasks);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(tasks.empty());
+  tracker.AddChurn(kHashes, "TRACKED_KEY", 1);
+  s = idle_db.GetBGTasks(&tasks);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(tasks.size(), 1);
+  ASSERT_EQ(tasks[0].task.operation, kCompactKey);
+  ASSERT_EQ(tasks[0].task.argv, "TRACKED_KEY");
+
+  s = idle_db.CancelBGTask({kHashes, kCompactKey, "TRACKED_KEY"});
+  ASSERT_TRUE(s.ok());
+  s = idle_db.GetBGTasks(&tasks);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(tasks.empty());
+
+  // The queued compactions are spread 100ms apart
+  std::this_thread::sleep_for(std::chrono::milliseconds(150));
+  tracker.AddChurn(kHashes, "TRACKED_KEY", 10);
+  s = idle_db.GetBGTasks(&tasks);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(tasks.size(), 1);
+  ASSERT_EQ(tasks[0].task.argv, "TRACKED_KEY");
+
+  // Queued again while pending, the task is kept once
+  std::this_thread::sleep_for(std::chrono::milliseconds(150));
+  tracker.AddChurn(kHashes, "TRACKED_KEY", 10);
+  s = idle_db.GetBGTasks(&tasks);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(tasks.size(), 1);
+}
+
+// GetStaleRatio
+TEST_F(KeysTest, GetStaleRatioTest) {
+  int32_t ret = 0;
+  s = db.HMSet("STALE_RATIO_KEY", {{"F1", "V1"}, {"F2", "V2"}});
+  ASSERT_TRUE(s.ok());
+  s = db.HDel("STALE_RATIO_KEY", {"F1"}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.SAdd("STALE_RATIO_KEY", {"M1", "M2"}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.Compact(kAll, true);
+  ASSERT_TRUE(s.ok());
+
+  for (const auto& type : {kStrings, kHashes, kSets, kLists, kZSets,
+                           kBitmaps, kStreams, kFilters, kAll}) {
+    double ratio = -1;
+    s = db.GetStaleRatio(type, &ratio);
+    ASSERT_TRUE(s.ok());
+    ASSERT_GE(ratio, 0);
+    ASSERT_LE(ratio, 1);
+  }
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -123,6 +123,13 @@ TEST_F(ListsTest, LIndexTest) {
   ASSERT_TRUE(s.ok());
   ASSERT_EQ(element, "n");
 
+  blackwidow::PinnableValue pinned;
+  s = db.LIndex("GP1_LINDEX_KEY", 4, &pinned);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(pinned.ToString(), "l");
+  s = db.LIndex("GP1_LINDEX_KEY", 10, &pinned);
+  ASSERT_TRUE(s.IsNotFound());
+
   s = db.LIndex("GP1_LINDEX_KEY", 10, &element);
   ASSERT_TRUE(s.IsNotFound());
 
@@ -2545,6 +2552,143 @@ TEST_F(ListsTest, RPushxTest) {
   ASSERT_TRUE(elements_match(&db, "GP4_RPUSHX_KEY", {}));
 }
 
+// BLPop
+TEST_F(ListsTest, BLPopTest) {
+  uint64_t num;
+  std::string key, element;
+
+  // ***************** Group 1 Test *****************
+  // The first non empty list is popped right away
+  s = db.RPush("GP1_BLPOP_KEY2", {"a", "b"}, &num);
+  ASSERT_TRUE(s.ok());
+  s = db.BLPop({"GP1_BLPOP_KEY1", "GP1_BLPOP_KEY2"}, 0, &key, &element);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(key, "GP1_BLPOP_KEY2");
+  ASSERT_EQ(element, "a");
+  s = db.BRPop({"GP1_BLPOP_KEY1", "GP1_BLPOP_KEY2"}, 0, &key, &element);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(element, "b");
+
+  // ***************** Group 2 Test *****************
+  // Empty lists time out
+  auto start = std::chrono::steady_clock::now();
+  s = db.BLPop({"GP2_BLPOP_KEY1", "GP2_BLPOP_KEY2"}, 100, &key, &element);
+  ASSERT_TRUE(s.IsTimedOut());
+  ASSERT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(100));
+  s = db.BLPop({"GP2_BLPOP_KEY1"}, -1, &key, &element);
+  ASSERT_TRUE(s.IsInvalidArgument());
+
+  // ***************** Group 3 Test *****************
+  // A push to any of the keys wakes the waiter
+  Status gp3_s;
+  std::string gp3_key, gp3_element;
+  std::thread gp3_waiter([&]() {
+    gp3_s = db.BLPop({"GP3_BLPOP_KEY1", "GP3_BLPOP_KEY2"}, 0,
+                     &gp3_key, &gp3_element);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  s = db.LPush("GP3_BLPOP_KEY2", {"a"}, &num);
+  ASSERT_TRUE(s.ok());
+  gp3_waiter.join();
+  ASSERT_TRUE(gp3_s.ok());
+  ASSERT_EQ(gp3_key, "GP3_BLPOP_KEY2");
+  ASSERT_EQ(gp3_element, "a");
+  ASSERT_TRUE(len_match(&db, "GP3_BLPOP_KEY2", 0));
+
+  // ***************** Group 4 Test *****************
+  // The waiters blocked first are served first
+  std::vector<std::string> gp4_elements(2);
+  std::vector<std::thread> gp4_waiters;
+  for (size_t idx = 0; idx < 2; idx++) {
+    gp4_waiters.emplace_back([&, idx]() {
+      std::string waiter_key;
+      db.BRPop({"GP4_BLPOP_KEY"}, 5000, &waiter_key, &gp4_elements[idx]);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  s = db.RPush("GP4_BLPOP_KEY", {"first"}, &num);
+  ASSERT_TRUE(s.ok());
+  gp4_waiters[0].join();
+  s = db.RPush("GP4_BLPOP_KEY", {"second"}, &num);
+  ASSERT_TRUE(s.ok());
+  gp4_waiters[1].join();
+  ASSERT_EQ(gp4_elements[0], "first");
+  ASSERT_EQ(gp4_elements[1], "second");
+
+  // ***************** Group 5 Test *****************
+  // A waiter woken for a key but served by an earlier one hands the
+  // wakeup over to the next waiter of that key
+  Status gp5_s1, gp5_s2;
+  std::string gp5_key1, gp5_key2, gp5_element1, gp5_element2;
+  std::thread gp5_waiter1([&]() {
+    gp5_s1 = db.BLPop({"GP5_BLPOP_KEY1", "GP5_BLPOP_KEY2"}, 5000,
+                      &gp5_key1, &gp5_element1);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  std::thread gp5_waiter2([&]() {
+    gp5_s2 = db.BLPop({"GP5_BLPOP_KEY2"}, 5000, &gp5_key2, &gp5_element2);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  // The pops of the first waiter wait for the transaction, by then both
+  // lists have an element
+  std::vector<blackwidow::KeyEpoch> watched;
+  s = db.Watch({"GP5_BLPOP_KEY1", "GP5_BLPOP_KEY2"}, &watched);
+  ASSERT_TRUE(s.ok());
+  s = db.ExecIfUnchanged(watched, [&]() {
+    uint64_t len;
+    Status push_status = db.RPush("GP5_BLPOP_KEY2", {"b"}, &len);
+    if (!push_status.ok()) {
+      return push_status;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    return db.RPush("GP5_BLPOP_KEY1", {"a"}, &len);
+  });
+  ASSERT_TRUE(s.ok());
+  gp5_waiter1.join();
+  gp5_waiter2.join();
+  ASSERT_TRUE(gp5_s1.ok());
+  ASSERT_EQ(gp5_key1, "GP5_BLPOP_KEY1");
+  ASSERT_EQ(gp5_element1, "a");
+  ASSERT_TRUE(gp5_s2.ok());
+  ASSERT_EQ(gp5_key2, "GP5_BLPOP_KEY2");
+  ASSERT_EQ(gp5_element2, "b");
+}
+
+// BRPoplpush
+TEST_F(ListsTest, BRPoplpushTest) {
+  uint64_t num;
+  std::string element;
+
+  s = db.BRPoplpush("GP1_BRPOPLPUSH_SOURCE", "GP1_BRPOPLPUSH_DESTINATION",
+                    50, &element);
+  ASSERT_TRUE(s.IsTimedOut());
+
+  // The element moved to the destination wakes the waiters of the
+  // destination in turn
+  Status gp1_s, gp1_dest_s;
+  std::string gp1_element, gp1_dest_key, gp1_dest_element;
+  std::thread gp1_dest_waiter([&]() {
+    gp1_dest_s = db.BLPop({"GP1_BRPOPLPUSH_DESTINATION"}, 5000,
+                          &gp1_dest_key, &gp1_dest_element);
+  });
+  std::thread gp1_waiter([&]() {
+    gp1_s = db.BRPoplpush("GP1_BRPOPLPUSH_SOURCE",
+                          "GP1_BRPOPLPUSH_DESTINATION", 5000, &gp1_element);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  s = db.RPush("GP1_BRPOPLPUSH_SOURCE", {"a"}, &num);
+  ASSERT_TRUE(s.ok());
+  gp1_waiter.join();
+  gp1_dest_waiter.join();
+  ASSERT_TRUE(gp1_s.ok());
+  ASSERT_EQ(gp1_element, "a");
+  ASSERT_TRUE(gp1_dest_s.ok());
+  ASSERT_EQ(gp1_dest_element, "a");
+  ASSERT_TRUE(len_match(&db, "GP1_BRPOPLPUSH_SOURCE", 0));
+  ASSERT_TRUE(len_match(&db, "GP1_BRPOPLPUSH_DESTINATION", 0));
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -4,6 +4,8 @@
 //  of patent rights can be found in the PATENTS file in the same directory.
 
 #include <gtest/gtest.h>
+#include <cmath>
+#include <random>
 #include <thread>
 #include <iostream>
 
@@ -102,6 +104,41 @@ static bool size_match(blackwidow::BlackWidow *const db,
   return size == expect_size;
 }
 
+// Whether calls of SRandmember for count members, repeated or not, only
+// return members of the set and pick them evenly, the chi-square of the
+// picks staying within six deviations of its mean
+static bool picks_uniform(blackwidow::BlackWidow *const db,
+                          const Slice& key,
+                          const std::vector<std::string>& total_members,
+                          int32_t calls, int32_t count) {
+  std::map<std::string, int32_t> picks;
+  for (const auto& member : total_members) {
+    picks[member] = 0;
+  }
+  std::vector<std::string> members;
+  for (int32_t i = 0; i < calls; i++) {
+    Status s = db->SRandmember(key, -count, &members);
+    if (!s.ok() || members.size() != count) {
+      return false;
+    }
+    for (const auto& member : members) {
+      auto iter = picks.find(member);
+      if (iter == picks.end()) {
+        return false;
+      }
+      iter->second++;
+    }
+  }
+  double expected = static_cast<double>(calls) * count / picks.size();
+  double chi_square = 0;
+  for (const auto& pick : picks) {
+    chi_square += (pick.second - expected) * (pick.second - expected)
+      / expected;
+  }
+  double freedom = picks.size() - 1;
+  return chi_square < freedom + 6 * std::sqrt(2 * freedom);
+}
+
 static bool make_expired(blackwidow::BlackWidow *const db,
                          const Slice& key) {
   std::map<blackwidow::DataType, rocksdb::Status> type_status;
@@ -1462,6 +1499,201 @@ TEST_F(SetsTest, SPopTest) {
 
 }
 
+// SPop with a count
+TEST_F(SetsTest, SPopCountTest) {
+  int32_t ret = 0;
+  std::vector<std::string> members;
+
+  // ***************** Group 1 Test *****************
+  // A small set, sampled by a scan
+  s = db.SAdd("GP1_SPOP_COUNT_KEY", {"a", "b", "c", "d", "e"}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.SPop("GP1_SPOP_COUNT_KEY", 3, &members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(members.size(), 3);
+  ASSERT_TRUE(members_uniquen(members));
+  ASSERT_TRUE(size_match(&db, "GP1_SPOP_COUNT_KEY", 2));
+  std::vector<std::string> popped = members;
+  s = db.SPop("GP1_SPOP_COUNT_KEY", 10, &members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(members.size(), 2);
+  popped.insert(popped.end(), members.begin(), members.end());
+  ASSERT_TRUE(members_match(popped, {"a", "b", "c", "d", "e"}));
+  ASSERT_TRUE(size_match(&db, "GP1_SPOP_COUNT_KEY", 0));
+
+  // ***************** Group 2 Test *****************
+  // A large set, sampled by seeks
+  std::vector<std::string> gp2_members;
+  char buf[8];
+  for (int32_t i = 0; i < 1000; i++) {
+    snprintf(buf, sizeof(buf), "%04d", i);
+    gp2_members.push_back(buf);
+  }
+  s = db.SAdd("GP2_SPOP_COUNT_KEY", gp2_members, &ret);
+  ASSERT_TRUE(s.ok());
+  popped.clear();
+  for (int32_t i = 0; i < 10; i++) {
+    s = db.SPop("GP2_SPOP_COUNT_KEY", 100, &members);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(members.size(), 100);
+    popped.insert(popped.end(), members.begin(), members.end());
+    ASSERT_TRUE(size_match(&db, "GP2_SPOP_COUNT_KEY", 900 - i * 100));
+  }
+  ASSERT_TRUE(members_match(popped, gp2_members));
+
+  // ***************** Group 3 Test *****************
+  s = db.SPop("GP3_SPOP_COUNT_KEY", 3, &members);
+  ASSERT_TRUE(s.IsNotFound());
+  s = db.SAdd("GP3_SPOP_COUNT_KEY", {"a"}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.SPop("GP3_SPOP_COUNT_KEY", -1, &members);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  ASSERT_TRUE(size_match(&db, "GP3_SPOP_COUNT_KEY", 1));
+}
+
+// SRandmember on a large set
+TEST_F(SetsTest, SRandmemberLargeSetTest) {
+  int32_t ret = 0;
+  std::vector<std::string> gp1_members;
+  char buf[8];
+  for (int32_t i = 0; i < 1000; i++) {
+    snprintf(buf, sizeof(buf), "%04d", i);
+    gp1_members.push_back(buf);
+  }
+  s = db.SAdd("GP1_SRANDMEMBER_LARGE_KEY", gp1_members, &ret);
+  ASSERT_TRUE(s.ok());
+
+  std::vector<std::string> members;
+  s = db.SRandmember("GP1_SRANDMEMBER_LARGE_KEY", 100, &members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(members.size(), 100);
+  ASSERT_TRUE(members_uniquen(members));
+  ASSERT_TRUE(members_contains(members, gp1_members));
+
+  // Every member comes up, the head of the set is not favored
+  s = db.SRandmember("GP1_SRANDMEMBER_LARGE_KEY", -20000, &members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(members.size(), 20000);
+  std::map<std::string, int32_t> picks;
+  for (const auto& member : members) {
+    picks[member]++;
+  }
+  ASSERT_EQ(picks.size(), 1000);
+  for (const auto& pick : picks) {
+    ASSERT_LT(pick.second, 60);
+  }
+  ASSERT_TRUE(size_match(&db, "GP1_SRANDMEMBER_LARGE_KEY", 1000));
+
+  // The digits of the last member are not all 9, the members which are
+  // above it digit by digit, like 1433 to 1999, come up as well
+  std::vector<std::string> gp2_members;
+  for (int32_t i = 1000; i <= 5432; i++) {
+    gp2_members.push_back(std::to_string(i));
+  }
+  s = db.SAdd("GP2_SRANDMEMBER_LARGE_KEY", gp2_members, &ret);
+  ASSERT_TRUE(s.ok());
+
+  s = db.SRandmember("GP2_SRANDMEMBER_LARGE_KEY", -100000, &members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(members.size(), 100000);
+  picks.clear();
+  for (const auto& member : members) {
+    picks[member]++;
+  }
+  ASSERT_EQ(picks.size(), 4433);
+  for (const auto& pick : picks) {
+    ASSERT_LT(pick.second, 60);
+  }
+
+  s = db.SRandmember("GP2_SRANDMEMBER_LARGE_KEY", 2000, &members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(members.size(), 2000);
+  ASSERT_TRUE(members_uniquen(members));
+  ASSERT_TRUE(members_contains(members, gp2_members));
+  int32_t gap_members = 0;
+  for (const auto& member : members) {
+    if (member >= "1433" && member <= "1999") {
+      gap_members++;
+    }
+  }
+  ASSERT_GT(gap_members, 0);
+  ASSERT_TRUE(size_match(&db, "GP2_SRANDMEMBER_LARGE_KEY", 4433));
+}
+
+// SRandmember and SPop on large sets of members which are not numbers or
+// are numbers of different widths
+TEST_F(SetsTest, SRandmemberShapesTest) {
+  int32_t ret = 0;
+  std::mt19937 engine(2017);
+  std::uniform_int_distribution<int32_t> letter('a', 'z');
+  std::uniform_int_distribution<int32_t> length(3, 12);
+  char buf[32];
+
+  // Hex ids
+  std::vector<std::string> gp1_members;
+  for (int32_t i = 0; i < 8000; i++) {
+    snprintf(buf, sizeof(buf), "%08x-%04x",
+             static_cast<uint32_t>(engine()),
+             static_cast<uint32_t>(engine() & 0xffff));
+    gp1_members.push_back(buf);
+  }
+  s = db.SAdd("GP1_SRANDMEMBER_SHAPES_KEY", gp1_members, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(picks_uniform(&db, "GP1_SRANDMEMBER_SHAPES_KEY",
+                            gp1_members, 1000, 50));
+
+  // Names of 3 to 12 letters
+  std::vector<std::string> gp2_members;
+  for (int32_t i = 0; i < 8000; i++) {
+    std::string name(length(engine), ' ');
+    for (auto& c : name) {
+      c = static_cast<char>(letter(engine));
+    }
+    gp2_members.push_back(name);
+  }
+  s = db.SAdd("GP2_SRANDMEMBER_SHAPES_KEY", gp2_members, &ret);
+  ASSERT_TRUE(s.ok());
+  int32_t gp2_size = 0;
+  s = db.SCard("GP2_SRANDMEMBER_SHAPES_KEY", &gp2_size);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(picks_uniform(&db, "GP2_SRANDMEMBER_SHAPES_KEY",
+                            gp2_members, 1000, 50));
+
+  std::vector<std::string> members;
+  s = db.SPop("GP2_SRANDMEMBER_SHAPES_KEY", 50, &members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(members.size(), 50);
+  ASSERT_TRUE(members_uniquen(members));
+  ASSERT_TRUE(members_contains(members, gp2_members));
+  ASSERT_TRUE(size_match(&db, "GP2_SRANDMEMBER_SHAPES_KEY", gp2_size - 50));
+
+  // Numbers from 1 to 8000, of one to four digits
+  std::vector<std::string> gp3_members;
+  for (int32_t i = 1; i <= 8000; i++) {
+    gp3_members.push_back(std::to_string(i));
+  }
+  s = db.SAdd("GP3_SRANDMEMBER_SHAPES_KEY", gp3_members, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(picks_uniform(&db, "GP3_SRANDMEMBER_SHAPES_KEY",
+                            gp3_members, 1000, 50));
+
+  s = db.SRandmember("GP3_SRANDMEMBER_SHAPES_KEY", 50, &members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(members.size(), 50);
+  ASSERT_TRUE(members_uniquen(members));
+  ASSERT_TRUE(members_contains(members, gp3_members));
+
+  // Numbers and names mixed, too uneven for the seeks
+  std::vector<std::string> gp4_members(gp3_members.begin(),
+                                       gp3_members.begin() + 6000);
+  gp4_members.insert(gp4_members.end(), gp2_members.begin(),
+                     gp2_members.begin() + 2000);
+  s = db.SAdd("GP4_SRANDMEMBER_SHAPES_KEY", gp4_members, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(picks_uniform(&db, "GP4_SRANDMEMBER_SHAPES_KEY",
+                            gp4_members, 1000, 50));
+}
+
 // SRandmember
 TEST_F(SetsTest, SRanmemberTest) {
   int32_t ret = 0;
@@ -0,0 +1,126 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <iostream>
+
+#include "blackwidow/blackwidow.h"
+#include "src/coding.h"
+#include "src/base_data_key_format.h"
+#include "src/base_meta_value_format.h"
+#include "src/strings_value_format.h"
+#include "src/stale_entries_collector.h"
+
+using namespace blackwidow;
+
+static int32_t Now() {
+  int64_t unix_time;
+  rocksdb::Env::Default()->GetCurrentTime(&unix_time);
+  return static_cast<int32_t>(unix_time);
+}
+
+static std::string MetaValue(int32_t count, int32_t timestamp) {
+  char str[4];
+  EncodeFixed32(str, count);
+  BaseMetaValue meta_value(std::string(str, sizeof(int32_t)));
+  meta_value.set_version(1);
+  meta_value.set_timestamp(timestamp);
+  return meta_value.Encode().ToString();
+}
+
+static std::string DataKey(const std::string& key, int32_t version,
+                           const std::string& field) {
+  BaseDataKey data_key(key, version, field);
+  return data_key.Encode().ToString();
+}
+
+static void ExpectEntries(const StaleEntriesCollector& collector,
+                          uint64_t stale, uint64_t total) {
+  rocksdb::UserCollectedProperties props =
+    collector.GetReadableProperties();
+  ASSERT_EQ(props[kStaleEntriesProperty], std::to_string(stale));
+  ASSERT_EQ(props[kTotalEntriesProperty], std::to_string(total));
+}
+
+// Strings values
+TEST(StaleEntriesCollectorTest, StringsValueTest) {
+  StaleEntriesCollector collector(kStringsValueFormat);
+  StringsValue alive("VALUE");
+  StringsValue persistent("VALUE");
+  StringsValue expired("VALUE");
+  alive.set_timestamp(Now() + 100);
+  expired.set_timestamp(Now() - 100);
+  collector.AddUserKey("A", alive.Encode(), rocksdb::kEntryPut, 0, 0);
+  collector.AddUserKey("B", persistent.Encode(), rocksdb::kEntryPut, 0, 0);
+  collector.AddUserKey("C", expired.Encode(), rocksdb::kEntryPut, 0, 0);
+  collector.AddUserKey("D", "", rocksdb::kEntryDelete, 0, 0);
+
+  rocksdb::UserCollectedProperties props;
+  ASSERT_TRUE(collector.Finish(&props).ok());
+  ExpectEntries(collector, 2, 4);
+  ASSERT_FALSE(collector.NeedCompact());
+}
+
+// Meta values
+TEST(StaleEntriesCollectorTest, MetaValueTest) {
+  StaleEntriesCollector collector(kBaseMetaFormat);
+  collector.AddUserKey("A", MetaValue(1, 0), rocksdb::kEntryPut, 0, 0);
+  collector.AddUserKey("B", MetaValue(1, Now() + 100),
+                       rocksdb::kEntryPut, 0, 0);
+  // Emptied
+  collector.AddUserKey("C", MetaValue(0, 0), rocksdb::kEntryPut, 0, 0);
+  // Expired
+  collector.AddUserKey("D", MetaValue(1, Now() - 100),
+                       rocksdb::kEntryPut, 0, 0);
+
+  rocksdb::UserCollectedProperties props;
+  ASSERT_TRUE(collector.Finish(&props).ok());
+  ExpectEntries(collector, 2, 4);
+}
+
+// Data keys
+TEST(StaleEntriesCollectorTest, VersionedKeyTest) {
+  StaleEntriesCollector collector(kVersionedKeyFormat);
+  // Two versions of A, the older one is stale
+  collector.AddUserKey(DataKey("A", 1, "F1"), "", rocksdb::kEntryPut, 0, 0);
+  collector.AddUserKey(DataKey("A", 1, "F2"), "", rocksdb::kEntryPut, 0, 0);
+  collector.AddUserKey(DataKey("A", 2, "F1"), "", rocksdb::kEntryPut, 0, 0);
+  collector.AddUserKey(DataKey("A", 2, "F2"), "",
+                       rocksdb::kEntryDelete, 0, 0);
+  // A single version of B
+  collector.AddUserKey(DataKey("B", 1, "F1"), "", rocksdb::kEntryPut, 0, 0);
+  collector.AddUserKey(DataKey("B", 1, "F2"), "", rocksdb::kEntryPut, 0, 0);
+
+  rocksdb::UserCollectedProperties props;
+  ASSERT_TRUE(collector.Finish(&props).ok());
+  ExpectEntries(collector, 3, 6);
+  // Too few entries to be worth a compaction
+  ASSERT_FALSE(collector.NeedCompact());
+}
+
+// NeedCompact
+TEST(StaleEntriesCollectorTest, NeedCompactTest) {
+  StaleEntriesCollector dense(kVersionedKeyFormat);
+  StaleEntriesCollector sparse(kVersionedKeyFormat);
+  uint64_t entries = StaleEntriesCollector::kMinEntries;
+  for (uint64_t i = 0; i < entries; i++) {
+    std::string field = "F" + std::to_string(i);
+    dense.AddUserKey(DataKey("A", i < entries / 2 ? 1 : 2, field), "",
+                     rocksdb::kEntryPut, 0, 0);
+    sparse.AddUserKey(DataKey("A", i < entries / 4 ? 1 : 2, field), "",
+                      rocksdb::kEntryPut, 0, 0);
+  }
+
+  rocksdb::UserCollectedProperties props;
+  ASSERT_TRUE(dense.Finish(&props).ok());
+  ASSERT_TRUE(dense.NeedCompact());
+  ASSERT_TRUE(sparse.Finish(&props).ok());
+  ASSERT_FALSE(sparse.NeedCompact());
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,366 @@
+//  Copyright (c) 2017-present The blackwidow Authors.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <iostream>
+#include <limits>
+
+#include "blackwidow/blackwidow.h"
+
+using namespace blackwidow;
+
+static const StreamID kMinID;
+static const StreamID kMaxID(std::numeric_limits<uint64_t>::max(),
+                             std::numeric_limits<uint64_t>::max());
+
+class StreamsTest : public ::testing::Test {
+ public:
+  StreamsTest() {
+    std::string path = "./db/streams";
+    if (access(path.c_str(), F_OK)) {
+      mkdir(path.c_str(), 0755);
+    }
+    options.create_if_missing = true;
+    s = db.Open(options, path);
+  }
+  virtual ~StreamsTest() { }
+
+  static void SetUpTestCase() { }
+  static void TearDownTestCase() { }
+
+  blackwidow::Options options;
+  blackwidow::BlackWidow db;
+  blackwidow::Status s;
+};
+
+static bool make_expired(blackwidow::BlackWidow *const db,
+                         const Slice& key) {
+  std::map<blackwidow::DataType, rocksdb::Status> type_status;
+  int ret = db->Expire(key, 1, &type_status);
+  if (!ret || !type_status[blackwidow::DataType::kStreams].ok()) {
+    return false;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+  return true;
+}
+
+// Adds the entries ms-0 for ms in [1, n] with the field F and the value ms
+static bool add_entries(blackwidow::BlackWidow *const db,
+                        const Slice& key, uint64_t n) {
+  for (uint64_t ms = 1; ms <= n; ms++) {
+    StreamID id(ms, 0);
+    Status s = db->XAdd(key, {{"F", std::to_string(ms)}}, &id);
+    if (!s.ok()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool ids_match(const std::vector<StreamEntry>& entries,
+                      const std::vector<uint64_t>& expect_ms) {
+  if (entries.size() != expect_ms.size()) {
+    return false;
+  }
+  for (size_t idx = 0; idx < entries.size(); idx++) {
+    if (!(entries[idx].id == StreamID(expect_ms[idx], 0))
+      || entries[idx].field_values.size() != 1
+      || entries[idx].field_values[0].value
+           != std::to_string(expect_ms[idx])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// XAdd
+TEST_F(StreamsTest, XAddTest) {
+  int32_t len;
+  std::vector<StreamEntry> entries;
+
+  // Generated ids grow, even within the same millisecond
+  StreamID id1, id2;
+  s = db.XAdd("XADD_KEY", {{"F1", "V1"}, {"F2", "V2"}}, &id1);
+  ASSERT_TRUE(s.ok());
+  ASSERT_GT(id1.ms, 0);
+  s = db.XAdd("XADD_KEY", {{"F3", "V3"}}, &id2);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(id1 < id2);
+  s = db.XLen("XADD_KEY", &len);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(len, 2);
+
+  s = db.XRange("XADD_KEY", kMinID, kMaxID, -1, &entries);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(entries.size(), 2);
+  ASSERT_EQ(entries[0].id, id1);
+  ASSERT_EQ(entries[0].field_values,
+            std::vector<FieldValue>({{"F1", "V1"}, {"F2", "V2"}}));
+  ASSERT_EQ(entries[1].id, id2);
+  ASSERT_EQ(entries[1].field_values, std::vector<FieldValue>({{"F3", "V3"}}));
+
+  // Explicit ids must be greater than the last one
+  StreamID id(id2.ms, id2.seq);
+  s = db.XAdd("XADD_KEY", {{"F", "V"}}, &id);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  id = StreamID(id2.ms, id2.seq + 1);
+  s = db.XAdd("XADD_KEY", {{"F", "V"}}, &id);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(id, StreamID(id2.ms, id2.seq + 1));
+
+  s = db.XAdd("XADD_KEY", {}, &id);
+  ASSERT_TRUE(s.IsInvalidArgument());
+
+  // An emptied stream keeps its last id
+  int32_t ret;
+  s = db.XTrim("XADD_KEY", 0, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 3);
+  s = db.XLen("XADD_KEY", &len);
+  ASSERT_TRUE(s.IsNotFound());
+  StreamID old_id(id.ms, id.seq);
+  s = db.XAdd("XADD_KEY", {{"F", "V"}}, &id);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  id = StreamID();
+  s = db.XAdd("XADD_KEY", {{"F", "V"}}, &id);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(old_id < id);
+
+  // Expired key starts over
+  ASSERT_TRUE(add_entries(&db, "XADD_EXPIRED_KEY", 3));
+  ASSERT_TRUE(make_expired(&db, "XADD_EXPIRED_KEY"));
+  s = db.XLen("XADD_EXPIRED_KEY", &len);
+  ASSERT_TRUE(s.IsNotFound());
+  id = StreamID(1, 0);
+  s = db.XAdd("XADD_EXPIRED_KEY", {{"F", "1"}}, &id);
+  ASSERT_TRUE(s.ok());
+  s = db.XRange("XADD_EXPIRED_KEY", kMinID, kMaxID, -1, &entries);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(ids_match(entries, {1}));
+
+  std::string type;
+  s = db.Type("XADD_KEY", &type);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(type, "stream");
+}
+
+// XRange and XRevRange
+TEST_F(StreamsTest, XRangeTest) {
+  std::vector<StreamEntry> entries;
+  s = db.XRange("XRANGE_KEY", kMinID, kMaxID, -1, &entries);
+  ASSERT_TRUE(s.IsNotFound());
+
+  ASSERT_TRUE(add_entries(&db, "XRANGE_KEY", 10));
+  // A neighbour key sharing the prefix is not read
+  ASSERT_TRUE(add_entries(&db, "XRANGE_KEY_2", 3));
+
+  s = db.XRange("XRANGE_KEY", kMinID, kMaxID, -1, &entries);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(ids_match(entries, {1, 2, 3, 4, 5, 6, 7, 8, 9, 10}));
+
+  s = db.XRange("XRANGE_KEY", StreamID(3, 0), StreamID(6, 0), -1, &entries);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(ids_match(entries, {3, 4, 5, 6}));
+
+  s = db.XRange("XRANGE_KEY", StreamID(2, 1), StreamID(5, 0), 2, &entries);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(ids_match(entries, {3, 4}));
+
+  s = db.XRange("XRANGE_KEY", StreamID(6, 0), StreamID(3, 0), -1, &entries);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(entries.empty());
+
+  s = db.XRevRange("XRANGE_KEY", kMaxID, kMinID, -1, &entries);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(ids_match(entries, {10, 9, 8, 7, 6, 5, 4, 3, 2, 1}));
+
+  s = db.XRevRange("XRANGE_KEY", StreamID(6, 0), StreamID(3, 0), -1, &entries);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(ids_match(entries, {6, 5, 4, 3}));
+
+  s = db.XRevRange("XRANGE_KEY", StreamID(5, 1), StreamID(1, 0), 3, &entries);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(ids_match(entries, {5, 4, 3}));
+
+  s = db.XRevRange("XRANGE_KEY", StreamID(0, 5), kMinID, -1, &entries);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(entries.empty());
+}
+
+// XDel
+TEST_F(StreamsTest, XDelTest) {
+  int32_t ret, len;
+  std::vector<StreamEntry> entries;
+  s = db.XDel("XDEL_KEY", {StreamID(1, 0)}, &ret);
+  ASSERT_TRUE(s.IsNotFound());
+
+  ASSERT_TRUE(add_entries(&db, "XDEL_KEY", 5));
+  s = db.XDel("XDEL_KEY", {StreamID(2, 0), StreamID(4, 0), StreamID(4, 0),
+                           StreamID(7, 0)}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 2);
+  s = db.XLen("XDEL_KEY", &len);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(len, 3);
+  s = db.XRange("XDEL_KEY", kMinID, kMaxID, -1, &entries);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(ids_match(entries, {1, 3, 5}));
+
+  s = db.XDel("XDEL_KEY", {StreamID(1, 0), StreamID(3, 0), StreamID(5, 0)},
+              &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 3);
+  s = db.XLen("XDEL_KEY", &len);
+  ASSERT_TRUE(s.IsNotFound());
+}
+
+// XTrim and XTrimMinID
+TEST_F(StreamsTest, XTrimTest) {
+  int32_t ret, len;
+  std::vector<StreamEntry> entries;
+  s = db.XTrim("XTRIM_KEY", 1, &ret);
+  ASSERT_TRUE(s.IsNotFound());
+
+  ASSERT_TRUE(add_entries(&db, "XTRIM_KEY", 10));
+  ASSERT_TRUE(add_entries(&db, "XTRIM_KEY_2", 3));
+  s = db.XTrim("XTRIM_KEY", -1, &ret);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  s = db.XTrim("XTRIM_KEY", 20, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+
+  s = db.XTrim("XTRIM_KEY", 7, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 3);
+  s = db.XLen("XTRIM_KEY", &len);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(len, 7);
+  s = db.XRange("XTRIM_KEY", kMinID, kMaxID, -1, &entries);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(ids_match(entries, {4, 5, 6, 7, 8, 9, 10}));
+
+  // Holes left by XDel are not counted
+  s = db.XDel("XTRIM_KEY", {StreamID(5, 0)}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.XTrim("XTRIM_KEY", 4, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 2);
+  s = db.XRange("XTRIM_KEY", kMinID, kMaxID, -1, &entries);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(ids_match(entries, {7, 8, 9, 10}));
+
+  s = db.XTrimMinID("XTRIM_KEY", StreamID(8, 1), &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 2);
+  s = db.XRange("XTRIM_KEY", kMinID, kMaxID, -1, &entries);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(ids_match(entries, {9, 10}));
+  s = db.XTrimMinID("XTRIM_KEY", StreamID(9, 0), &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+
+  // The neighbour key is untouched
+  s = db.XRange("XTRIM_KEY_2", kMinID, kMaxID, -1, &entries);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(ids_match(entries, {1, 2, 3}));
+
+  s = db.XTrimMinID("XTRIM_KEY", kMaxID, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 2);
+  s = db.XLen("XTRIM_KEY", &len);
+  ASSERT_TRUE(s.IsNotFound());
+}
+
+// XGroupCreate, XReadGroup, XAck, XPending and XGroupDestroy
+TEST_F(StreamsTest, ConsumerGroupTest) {
+  int32_t ret;
+  std::vector<StreamEntry> entries;
+  std::vector<StreamPendingEntry> pending;
+  s = db.XGroupCreate("XGROUP_KEY", "G1", kMinID);
+  ASSERT_TRUE(s.IsNotFound());
+
+  ASSERT_TRUE(add_entries(&db, "XGROUP_KEY", 5));
+  s = db.XGroupCreate("XGROUP_KEY", "G1", kMinID);
+  ASSERT_TRUE(s.ok());
+  s = db.XGroupCreate("XGROUP_KEY", "G1", kMinID);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  s = db.XGroupCreate("XGROUP_KEY", "G2", StreamID(3, 0));
+  ASSERT_TRUE(s.ok());
+
+  s = db.XReadGroup("XGROUP_KEY", "G0", "C1", 2, &entries);
+  ASSERT_TRUE(s.IsNotFound());
+
+  // Each entry is delivered once to a group
+  s = db.XReadGroup("XGROUP_KEY", "G1", "C1", 2, &entries);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(ids_match(entries, {1, 2}));
+  s = db.XReadGroup("XGROUP_KEY", "G1", "C2", -1, &entries);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(ids_match(entries, {3, 4, 5}));
+  s = db.XReadGroup("XGROUP_KEY", "G1", "C1", -1, &entries);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(entries.empty());
+  s = db.XReadGroup("XGROUP_KEY", "G2", "C1", -1, &entries);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(ids_match(entries, {4, 5}));
+
+  s = db.XPending("XGROUP_KEY", "G1", -1, &pending);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(pending.size(), 5);
+  for (size_t idx = 0; idx < pending.size(); idx++) {
+    ASSERT_EQ(pending[idx].id, StreamID(idx + 1, 0));
+    ASSERT_EQ(pending[idx].consumer, idx < 2 ? "C1" : "C2");
+    ASSERT_EQ(pending[idx].delivery_count, 1);
+    ASSERT_GT(pending[idx].delivery_time_ms, 0);
+  }
+  s = db.XPending("XGROUP_KEY", "G1", 2, &pending);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(pending.size(), 2);
+
+  s = db.XAck("XGROUP_KEY", "G1", {StreamID(1, 0), StreamID(3, 0),
+                                   StreamID(3, 0), StreamID(9, 0)}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 2);
+  s = db.XAck("XGROUP_KEY", "G1", {StreamID(1, 0)}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+  s = db.XPending("XGROUP_KEY", "G1", -1, &pending);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(pending.size(), 3);
+  ASSERT_EQ(pending[0].id, StreamID(2, 0));
+  ASSERT_EQ(pending[1].id, StreamID(4, 0));
+  ASSERT_EQ(pending[2].id, StreamID(5, 0));
+
+  // New entries are delivered after the last delivered one
+  StreamID id(6, 0);
+  s = db.XAdd("XGROUP_KEY", {{"F", "6"}}, &id);
+  ASSERT_TRUE(s.ok());
+  s = db.XReadGroup("XGROUP_KEY", "G1", "C1", -1, &entries);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(ids_match(entries, {6}));
+
+  s = db.XGroupDestroy("XGROUP_KEY", "G1");
+  ASSERT_TRUE(s.ok());
+  s = db.XGroupDestroy("XGROUP_KEY", "G1");
+  ASSERT_TRUE(s.IsNotFound());
+  s = db.XPending("XGROUP_KEY", "G1", -1, &pending);
+  ASSERT_TRUE(s.IsNotFound());
+  s = db.XPending("XGROUP_KEY", "G2", -1, &pending);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(pending.size(), 2);
+
+  // Groups go away with the stream
+  std::map<DataType, Status> type_status;
+  ASSERT_EQ(db.Del({"XGROUP_KEY"}, &type_status), 1);
+  ASSERT_TRUE(add_entries(&db, "XGROUP_KEY", 1));
+  s = db.XPending("XGROUP_KEY", "G2", -1, &pending);
+  ASSERT_TRUE(s.IsNotFound());
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
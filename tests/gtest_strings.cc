@@ -6,8 +6,10 @@
 #include <gtest/gtest.h>
 #include <thread>
 #include <iostream>
+#include <random>
 
 #include "blackwidow/blackwidow.h"
+#include "src/strings_bitops.h"
 
 using namespace blackwidow;
 
@@ -167,6 +169,21 @@ TEST_F(StringsTest, GetTest) {
   s = db.Get("GET_KEY", &value);
   ASSERT_TRUE(s.ok());
   ASSERT_STREQ(value.c_str(), "GET_VALUE_2");
+
+  // Pinned reads, of an inline and of a segmented value
+  blackwidow::PinnableValue pinned;
+  s = db.Get("GET_KEY", &pinned);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(pinned.ToString(), "GET_VALUE_2");
+  std::string large_value(200000, 'v');
+  s = db.Set("GET_KEY", large_value);
+  ASSERT_TRUE(s.ok());
+  s = db.Get("GET_KEY", &pinned);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(pinned.value() == large_value);
+  s = db.Get("GET_NOT_EXIST_KEY", &pinned);
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_EQ(pinned.size(), 0);
 }
 
 // GetBit
@@ -555,6 +572,489 @@ TEST_F(StringsTest, BitPosTest) {
   ASSERT_EQ(ret, -1);
 }
 
+// Row cache
+TEST_F(StringsTest, RowCacheTest) {
+  blackwidow::BlackwidowOptions bw_options;
+  bw_options.options.create_if_missing = true;
+  bw_options.row_cache_size = 1024 * 1024;
+  blackwidow::BlackWidow cache_db;
+  s = cache_db.Open(bw_options, "./db/strings_row_cache");
+  ASSERT_TRUE(s.ok());
+
+  std::string value;
+  blackwidow::RowCacheStatistics stats;
+  s = cache_db.Set("ROW_CACHE_KEY", "VALUE");
+  ASSERT_TRUE(s.ok());
+  for (int32_t i = 0; i < 3; i++) {
+    s = cache_db.Get("ROW_CACHE_KEY", &value);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(value, "VALUE");
+  }
+  s = cache_db.GetRowCacheStatistics(kStrings, &stats);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(stats.misses, 1);
+  ASSERT_EQ(stats.hits, 2);
+  ASSERT_GT(stats.usage, 0);
+
+  // Writes invalidate the cached value
+  s = cache_db.Set("ROW_CACHE_KEY", "NEW_VALUE");
+  ASSERT_TRUE(s.ok());
+  s = cache_db.Get("ROW_CACHE_KEY", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "NEW_VALUE");
+
+  int32_t ret = 0;
+  s = cache_db.Append("ROW_CACHE_KEY", "_APPEND", &ret);
+  ASSERT_TRUE(s.ok());
+  s = cache_db.Get("ROW_CACHE_KEY", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "NEW_VALUE_APPEND");
+
+  std::map<blackwidow::DataType, Status> type_status;
+  std::vector<std::string> keys {"ROW_CACHE_KEY"};
+  cache_db.Del(keys, &type_status);
+  s = cache_db.Get("ROW_CACHE_KEY", &value);
+  ASSERT_TRUE(s.IsNotFound());
+
+  // A cached value expires like the stored one
+  s = cache_db.Setex("ROW_CACHE_KEY", "VALUE", 1);
+  ASSERT_TRUE(s.ok());
+  s = cache_db.Get("ROW_CACHE_KEY", &value);
+  ASSERT_TRUE(s.ok());
+  std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+  s = cache_db.Get("ROW_CACHE_KEY", &value);
+  ASSERT_TRUE(s.IsNotFound());
+
+  // The meta values of the other data types are cached as well
+  s = cache_db.HSet("ROW_CACHE_HASH_KEY", "FIELD", "VALUE", &ret);
+  ASSERT_TRUE(s.ok());
+  s = cache_db.HGet("ROW_CACHE_HASH_KEY", "FIELD", &value);
+  ASSERT_TRUE(s.ok());
+  s = cache_db.HLen("ROW_CACHE_HASH_KEY", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  s = cache_db.HSet("ROW_CACHE_HASH_KEY", "FIELD_2", "VALUE", &ret);
+  ASSERT_TRUE(s.ok());
+  s = cache_db.HLen("ROW_CACHE_HASH_KEY", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 2);
+  s = cache_db.GetRowCacheStatistics(kHashes, &stats);
+  ASSERT_TRUE(s.ok());
+  ASSERT_GT(stats.hits, 0);
+
+  // Every list push invalidates the cached meta value
+  uint64_t len = 0;
+  s = cache_db.LPush("ROW_CACHE_LIST_KEY", {"a"}, &len);
+  ASSERT_TRUE(s.ok());
+  s = cache_db.LLen("ROW_CACHE_LIST_KEY", &len);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(len, 1);
+  s = cache_db.RPush("ROW_CACHE_LIST_KEY", {"b", "c"}, &len);
+  ASSERT_TRUE(s.ok());
+  s = cache_db.LLen("ROW_CACHE_LIST_KEY", &len);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(len, 3);
+  s = cache_db.LIndex("ROW_CACHE_LIST_KEY", -1, &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "c");
+}
+
+// Blob files
+TEST_F(StringsTest, BlobFilesTest) {
+  blackwidow::BlackwidowOptions bw_options;
+  bw_options.options.create_if_missing = true;
+  bw_options.strings_min_blob_size = 1024;
+  bw_options.hashes_min_blob_size = 1024;
+  blackwidow::BlackWidow blob_db;
+  s = blob_db.Open(bw_options, "./db/strings_blob_files");
+  ASSERT_TRUE(s.ok());
+
+  int32_t ret;
+  std::string value;
+  std::string large_value(4096, 'b');
+  s = blob_db.Set("BLOB_KEY", large_value);
+  ASSERT_TRUE(s.ok());
+  s = blob_db.Set("BLOB_SMALL_KEY", "VALUE");
+  ASSERT_TRUE(s.ok());
+  s = blob_db.HSet("BLOB_HASH_KEY", "FIELD", large_value, &ret);
+  ASSERT_TRUE(s.ok());
+
+  // The values are read back the same after a compaction
+  s = blob_db.Compact(kAll, true);
+  ASSERT_TRUE(s.ok());
+  s = blob_db.Get("BLOB_KEY", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(value == large_value);
+  s = blob_db.Get("BLOB_SMALL_KEY", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "VALUE");
+  s = blob_db.HGet("BLOB_HASH_KEY", "FIELD", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(value == large_value);
+
+  // So are the overwritten ones
+  s = blob_db.Set("BLOB_KEY", "VALUE");
+  ASSERT_TRUE(s.ok());
+  s = blob_db.Compact(kAll, true);
+  ASSERT_TRUE(s.ok());
+  s = blob_db.Get("BLOB_KEY", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "VALUE");
+}
+
+// Large bitmaps are stored in segments
+TEST_F(StringsTest, SegmentedBitmapTest) {
+  int32_t ret;
+  int64_t pos;
+  std::string value;
+  // Far beyond the inline size, only the two touched segments are stored
+  s = db.SetBit("SEGMENTED_BITMAP_KEY", 7, 1, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.SetBit("SEGMENTED_BITMAP_KEY", 8 * 1000000 + 3, 1, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+
+  s = db.GetBit("SEGMENTED_BITMAP_KEY", 8 * 1000000 + 3, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  s = db.GetBit("SEGMENTED_BITMAP_KEY", 8 * 500000, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+
+  s = db.BitCount("SEGMENTED_BITMAP_KEY", 0, -1, &ret, false);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 2);
+  s = db.BitCount("SEGMENTED_BITMAP_KEY", 1, -1, &ret, true);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+
+  s = db.BitPos("SEGMENTED_BITMAP_KEY", 1, 1, &pos);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(pos, 8 * 1000000 + 3);
+  s = db.BitPos("SEGMENTED_BITMAP_KEY", 0, &pos);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(pos, 0);
+  s = db.BitPos("SEGMENTED_BITMAP_KEY", 0, 1, 500000, &pos);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(pos, 8);
+
+  s = db.Strlen("SEGMENTED_BITMAP_KEY", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1000001);
+  s = db.Get("SEGMENTED_BITMAP_KEY", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value.size(), 1000001);
+  ASSERT_EQ(value[0], '\x01');
+  ASSERT_EQ(value[1000000], '\x10');
+  s = db.Getrange("SEGMENTED_BITMAP_KEY", 999999, -1, &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, std::string("\x00\x10", 2));
+
+  int64_t len;
+  std::vector<std::string> src_keys {"SEGMENTED_BITMAP_KEY"};
+  s = db.BitOp(kBitOpNot, "SEGMENTED_BITMAP_DEST_KEY", src_keys, &len);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(len, 1000001);
+  s = db.BitCount("SEGMENTED_BITMAP_DEST_KEY", 0, -1, &ret, false);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 8 * 1000001 - 2);
+
+  // An overwrite drops the segments
+  s = db.Set("SEGMENTED_BITMAP_KEY", "VALUE");
+  ASSERT_TRUE(s.ok());
+  s = db.GetBit("SEGMENTED_BITMAP_KEY", 8 * 1000000 + 3, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+}
+
+// A bit far past the end of a missing or short value only writes the
+// segment holding it
+TEST_F(StringsTest, SetBitLargeOffsetTest) {
+  int32_t ret;
+  int64_t pos;
+  std::string value;
+  int64_t offset = (1LL << 32) - 1;
+  s = db.SetBit("LARGE_OFFSET_MISSING_KEY", offset, 1, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+  s = db.GetBit("LARGE_OFFSET_MISSING_KEY", offset, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  s = db.Strlen("LARGE_OFFSET_MISSING_KEY", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1 << 29);
+  s = db.BitCount("LARGE_OFFSET_MISSING_KEY", 0, -1, &ret, false);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  s = db.BitPos("LARGE_OFFSET_MISSING_KEY", 1, &pos);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(pos, offset);
+
+  // Clearing a bit past the end leaves the value alone
+  s = db.SetBit("LARGE_OFFSET_CLEARED_KEY", offset, 0, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+  s = db.Strlen("LARGE_OFFSET_CLEARED_KEY", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+
+  // The bytes of a short value are kept, so is its ttl
+  s = db.Set("LARGE_OFFSET_SHORT_KEY", "VALUE");
+  ASSERT_TRUE(s.ok());
+  std::map<blackwidow::DataType, Status> type_status;
+  ASSERT_EQ(db.Expire("LARGE_OFFSET_SHORT_KEY", 100, &type_status), 1);
+  s = db.SetBit("LARGE_OFFSET_SHORT_KEY", 8 * 1000000 + 3, 1, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+  s = db.Getrange("LARGE_OFFSET_SHORT_KEY", 0, 4, &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "VALUE");
+  s = db.Getrange("LARGE_OFFSET_SHORT_KEY", 999999, -1, &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, std::string("\x00\x10", 2));
+  s = db.Strlen("LARGE_OFFSET_SHORT_KEY", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1000001);
+  std::map<blackwidow::DataType, int64_t> ttl =
+    db.TTL("LARGE_OFFSET_SHORT_KEY", &type_status);
+  ASSERT_GT(ttl[kStrings], 0);
+}
+
+// Large values are stored in segments, Append, Setrange, Getrange and
+// Strlen only touch the segments they need
+TEST_F(StringsTest, SegmentedValueTest) {
+  int32_t ret;
+  std::string value;
+  std::string expected;
+  for (int32_t i = 0; i < 100000; i++) {
+    expected.push_back('a' + i % 26);
+  }
+  s = db.Set("SEGMENTED_VALUE_KEY", expected);
+  ASSERT_TRUE(s.ok());
+  std::map<blackwidow::DataType, Status> type_status;
+  ASSERT_EQ(db.Expire("SEGMENTED_VALUE_KEY", 100, &type_status), 1);
+
+  // Appends across the segment boundaries
+  std::string tail(10000, 'x');
+  for (int32_t i = 0; i < 10; i++) {
+    s = db.Append("SEGMENTED_VALUE_KEY", tail, &ret);
+    ASSERT_TRUE(s.ok());
+    expected += tail;
+    ASSERT_EQ(ret, expected.size());
+  }
+
+  // Overwrite a range spanning several segments, then write past the end
+  std::string range(40000, 'y');
+  s = db.Setrange("SEGMENTED_VALUE_KEY", 10000, range, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, expected.size());
+  expected.replace(10000, range.size(), range);
+  s = db.Setrange("SEGMENTED_VALUE_KEY", expected.size() + 50000, "END", &ret);
+  ASSERT_TRUE(s.ok());
+  expected.resize(expected.size() + 50000, '\0');
+  expected += "END";
+  ASSERT_EQ(ret, expected.size());
+
+  s = db.Strlen("SEGMENTED_VALUE_KEY", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, expected.size());
+  s = db.Get("SEGMENTED_VALUE_KEY", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(value == expected);
+
+  s = db.Getrange("SEGMENTED_VALUE_KEY", 16380, 16390, &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, expected.substr(16380, 11));
+  s = db.Getrange("SEGMENTED_VALUE_KEY", 5000, 60000, &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(value == expected.substr(5000, 55001));
+  s = db.Getrange("SEGMENTED_VALUE_KEY", -10, -1, &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, expected.substr(expected.size() - 10));
+
+  // The ttl is kept
+  std::map<blackwidow::DataType, int64_t> ttl =
+    db.TTL("SEGMENTED_VALUE_KEY", &type_status);
+  ASSERT_GT(ttl[kStrings], 0);
+
+  // Appending to a small value makes it segmented once large enough
+  s = db.Set("SEGMENTED_VALUE_KEY", "HELLO");
+  ASSERT_TRUE(s.ok());
+  s = db.Append("SEGMENTED_VALUE_KEY", range, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.Append("SEGMENTED_VALUE_KEY", range, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 5 + 2 * range.size());
+  s = db.Getrange("SEGMENTED_VALUE_KEY", 0, 6, &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "HELLOyy");
+}
+
+// The bit kernels against a bit at a time reference, at lengths around the
+// 512 bytes blocks, the 64 bytes chunks, the vectors and the words
+static std::vector<int64_t> KernelLengths() {
+  std::vector<int64_t> lengths {0, 1, 3, 7, 1663, 4096 + 511};
+  for (int64_t boundary : {8, 16, 32, 64, 512, 1024}) {
+    for (int64_t delta : {-1, 0, 1}) {
+      lengths.push_back(boundary + delta);
+    }
+    lengths.push_back(2 * boundary + 3);
+  }
+  return lengths;
+}
+
+static std::vector<const blackwidow::BitKernels*> AllBitKernels() {
+  std::vector<const blackwidow::BitKernels*> all {
+    &blackwidow::WordBitKernels()};
+#ifdef __SSE4_2__
+  all.push_back(&blackwidow::SSEBitKernels());
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    all.push_back(&blackwidow::AVX2BitKernels());
+  }
+#endif
+  return all;
+}
+
+static int64_t ReferenceBitCount(const std::string& value) {
+  int64_t count = 0;
+  for (int64_t i = 0; i < static_cast<int64_t>(value.size()) * 8; i++) {
+    count += (value[i / 8] >> (7 - i % 8)) & 1;
+  }
+  return count;
+}
+
+static int64_t ReferenceBitPos(const std::string& value, int32_t bit) {
+  for (int64_t i = 0; i < static_cast<int64_t>(value.size()) * 8; i++) {
+    if (((value[i / 8] >> (7 - i % 8)) & 1) == bit) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static std::string RandomBytes(std::mt19937* gen, int64_t size) {
+  std::string value(size, '\0');
+  for (auto& c : value) {
+    c = static_cast<char>((*gen)());
+  }
+  return value;
+}
+
+static const unsigned char* Bytes(const std::string& value) {
+  return reinterpret_cast<const unsigned char*>(value.data());
+}
+
+TEST(BitKernelsTest, BitCountTest) {
+  std::mt19937 gen(1);
+  for (const auto* kernels : AllBitKernels()) {
+    for (int64_t len : KernelLengths()) {
+      std::string value = RandomBytes(&gen, len);
+      ASSERT_EQ(kernels->bit_count(Bytes(value), len),
+                ReferenceBitCount(value)) << len;
+      std::string ones(len, '\xff');
+      ASSERT_EQ(kernels->bit_count(Bytes(ones), len), len * 8) << len;
+      std::string zeros(len, '\0');
+      ASSERT_EQ(kernels->bit_count(Bytes(zeros), len), 0) << len;
+    }
+  }
+}
+
+TEST(BitKernelsTest, BitPosTest) {
+  std::mt19937 gen(2);
+  for (const auto* kernels : AllBitKernels()) {
+    for (int64_t len : KernelLengths()) {
+      for (int32_t bit : {0, 1}) {
+        // Nothing but the skipped value, bit=0 on all ones included
+        std::string skipped(len, bit ? '\0' : '\xff');
+        ASSERT_EQ(kernels->bit_pos(Bytes(skipped), len, bit), -1) << len;
+        // A single bit to find, in the first and last bytes and in between
+        for (int32_t n = 0; n < 8 && len > 0; n++) {
+          int64_t pos = n == 0 ? 0 :
+            n == 1 ? len * 8 - 1 : gen() % (len * 8);
+          std::string value = skipped;
+          value[pos / 8] ^= static_cast<char>(1 << (7 - pos % 8));
+          ASSERT_EQ(kernels->bit_pos(Bytes(value), len, bit), pos) << len;
+        }
+        std::string value = RandomBytes(&gen, len);
+        ASSERT_EQ(kernels->bit_pos(Bytes(value), len, bit),
+                  ReferenceBitPos(value, bit)) << len;
+      }
+    }
+  }
+}
+
+TEST(BitKernelsTest, ApplyTest) {
+  std::mt19937 gen(3);
+  for (const auto* kernels : AllBitKernels()) {
+    const std::vector<std::pair<blackwidow::ApplyFunc, int32_t>> funcs {
+      {kernels->and_func, kBitOpAnd}, {kernels->or_func, kBitOpOr},
+      {kernels->xor_func, kBitOpXor}, {kernels->not_func, kBitOpNot}};
+    for (int64_t len : KernelLengths()) {
+      for (const auto& func : funcs) {
+        std::string dest = RandomBytes(&gen, len);
+        std::string src = RandomBytes(&gen, len);
+        std::string expected(len, '\0');
+        std::string aliased_expected(len, '\0');
+        for (int64_t i = 0; i < len; i++) {
+          char d = dest[i];
+          char s = src[i];
+          switch (func.second) {
+            case kBitOpAnd:
+              expected[i] = d & s;
+              aliased_expected[i] = d;
+              break;
+            case kBitOpOr:
+              expected[i] = d | s;
+              aliased_expected[i] = d;
+              break;
+            case kBitOpXor:
+              expected[i] = d ^ s;
+              aliased_expected[i] = 0;
+              break;
+            default:
+              expected[i] = ~d;
+              aliased_expected[i] = ~d;
+              break;
+          }
+        }
+        std::string aliased = dest;
+        unsigned char* data = reinterpret_cast<unsigned char*>(&dest[0]);
+        func.first(data, Bytes(src), len);
+        ASSERT_EQ(dest, expected) << len << " " << func.second;
+
+        // dest is src too
+        data = reinterpret_cast<unsigned char*>(&aliased[0]);
+        func.first(data, data, len);
+        ASSERT_EQ(aliased, aliased_expected) << len << " " << func.second;
+      }
+    }
+  }
+}
+
+// NOT works in place, the other operations pad src with zeros
+TEST(BitKernelsTest, BitOpApplyTest) {
+  std::mt19937 gen(4);
+  for (int64_t len : KernelLengths()) {
+    std::string dest = RandomBytes(&gen, len);
+    std::string expected = dest;
+    for (auto& c : expected) {
+      c = ~c;
+    }
+    unsigned char* data = reinterpret_cast<unsigned char*>(&dest[0]);
+    blackwidow::BitOpApply(kBitOpNot, data, data, len, len);
+    ASSERT_EQ(dest, expected) << len;
+
+    std::string src = RandomBytes(&gen, len / 2);
+    expected = dest;
+    for (int64_t i = 0; i < len; i++) {
+      expected[i] = i < len / 2 ? dest[i] & src[i] : 0;
+    }
+    blackwidow::BitOpApply(kBitOpAnd, data, Bytes(src), len / 2, len);
+    ASSERT_EQ(dest, expected) << len;
+  }
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -5,7 +5,10 @@
 
 #include <gtest/gtest.h>
 #include <thread>
+#include <limits>
 #include <iostream>
+#include <random>
+#include <set>
 
 #include "blackwidow/blackwidow.h"
 
@@ -1059,6 +1062,28 @@ TEST_F(ZSetsTest, ZRangebyscoreTest) {
   s = db.ZRangebyscore("GP4_ZRANGEBYSCORE_KEY", std::numeric_limits<double>::lowest(), std::numeric_limits<double>::max(), false, true, &score_members);
   ASSERT_TRUE(s.ok());
   ASSERT_TRUE(score_members_match(score_members, {{0, "MM1"}, {std::numeric_limits<double>::max(), "MM2"}}));
+
+
+  // ***************** Group 5 Test *****************
+  // The scan starts at min, the members of the next key are not read
+  std::vector<blackwidow::ScoreMember> gp5_sm {{1, "MM1"}, {2, "MM2"}};
+  s = db.ZAdd("GP5_ZRANGEBYSCORE_KEY", gp5_sm, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.ZAdd("GP5_ZRANGEBYSCORE_KEY_2", {{5, "MM5"}, {6, "MM6"}}, &ret);
+  ASSERT_TRUE(s.ok());
+
+  s = db.ZRangebyscore("GP5_ZRANGEBYSCORE_KEY", 2, 10, true, true, &score_members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(score_members_match(score_members, {{2, "MM2"}}));
+
+  s = db.ZRangebyscore("GP5_ZRANGEBYSCORE_KEY", 3, 10, true, true, &score_members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(score_members_match(score_members, {}));
+
+  int32_t count;
+  s = db.ZCount("GP5_ZRANGEBYSCORE_KEY", 3, 10, true, true, &count);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count, 0);
 }
 
 // ZRank
@@ -4228,6 +4253,278 @@ TEST_F(ZSetsTest, ZScanTest) {
   ASSERT_TRUE(score_members_match(score_member_out, {}));
 }
 
+// ZPopMin and ZPopMax
+TEST_F(ZSetsTest, ZPopTest) {
+  int32_t ret;
+  std::vector<blackwidow::ScoreMember> score_members;
+  double inf = std::numeric_limits<double>::infinity();
+
+  // ***************** Group 1 Test *****************
+  s = db.ZAdd("GP1_ZPOP_KEY", {{3, "MM3"}, {1, "MM1"}, {2, "MM2"},
+                               {2, "MM0"}, {5, "MM5"}, {4, "MM4"}}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.ZPopMin("GP1_ZPOP_KEY", 3, &score_members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(score_members_match(score_members,
+                                  {{1, "MM1"}, {2, "MM0"}, {2, "MM2"}}));
+  s = db.ZPopMax("GP1_ZPOP_KEY", 2, &score_members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(score_members_match(score_members, {{5, "MM5"}, {4, "MM4"}}));
+  ASSERT_TRUE(size_match(&db, "GP1_ZPOP_KEY", 1));
+  ASSERT_TRUE(score_members_match(&db, "GP1_ZPOP_KEY", {{3, "MM3"}}));
+
+  // More than the members left
+  s = db.ZPopMax("GP1_ZPOP_KEY", 10, &score_members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(score_members_match(score_members, {{3, "MM3"}}));
+  ASSERT_TRUE(size_match(&db, "GP1_ZPOP_KEY", 0));
+  s = db.ZPopMin("GP1_ZPOP_KEY", 1, &score_members);
+  ASSERT_TRUE(s.IsNotFound());
+
+  // ***************** Group 2 Test *****************
+  // The infinite scores are at the ends
+  s = db.ZAdd("GP2_ZPOP_KEY", {{inf, "MM2"}, {inf, "MM1"}, {0, "MM0"},
+                               {-inf, "MM3"}}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.ZPopMax("GP2_ZPOP_KEY", 3, &score_members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(score_members_match(score_members,
+                                  {{inf, "MM2"}, {inf, "MM1"}, {0, "MM0"}}));
+  s = db.ZPopMin("GP2_ZPOP_KEY", 1, &score_members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(score_members_match(score_members, {{-inf, "MM3"}}));
+
+  // ***************** Group 3 Test *****************
+  // Only the current version is popped
+  s = db.ZAdd("GP3_ZPOP_KEY", {{1, "MM1"}, {2, "MM2"}}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(delete_key(&db, "GP3_ZPOP_KEY"));
+  s = db.ZPopMin("GP3_ZPOP_KEY", 1, &score_members);
+  ASSERT_TRUE(s.IsNotFound());
+  s = db.ZAdd("GP3_ZPOP_KEY", {{3, "MM3"}}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.ZPopMax("GP3_ZPOP_KEY", 2, &score_members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(score_members_match(score_members, {{3, "MM3"}}));
+  s = db.ZAdd("GP3_ZPOP_KEY", {{4, "MM4"}}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.ZPopMin("GP3_ZPOP_KEY", 2, &score_members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(score_members_match(score_members, {{4, "MM4"}}));
+
+  // ***************** Group 4 Test *****************
+  s = db.ZAdd("GP4_ZPOP_KEY", {{1, "MM1"}}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.ZPopMin("GP4_ZPOP_KEY", 0, &score_members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(score_members.empty());
+  s = db.ZPopMin("GP4_ZPOP_KEY", -1, &score_members);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  ASSERT_TRUE(make_expired(&db, "GP4_ZPOP_KEY"));
+  s = db.ZPopMax("GP4_ZPOP_KEY", 1, &score_members);
+  ASSERT_TRUE(s.IsNotFound());
+}
+
+// BZPopMin and BZPopMax
+TEST_F(ZSetsTest, BZPopTest) {
+  int32_t ret;
+  std::string key;
+  blackwidow::ScoreMember score_member;
+
+  // ***************** Group 1 Test *****************
+  s = db.ZAdd("GP1_BZPOP_KEY2", {{1, "MM1"}, {2, "MM2"}}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.BZPopMax({"GP1_BZPOP_KEY1", "GP1_BZPOP_KEY2"}, 0,
+                  &key, &score_member);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(key, "GP1_BZPOP_KEY2");
+  ASSERT_EQ(score_member.member, "MM2");
+  s = db.BZPopMin({"GP1_BZPOP_KEY1"}, 50, &key, &score_member);
+  ASSERT_TRUE(s.IsTimedOut());
+  s = db.BZPopMin({"GP1_BZPOP_KEY1"}, -1, &key, &score_member);
+  ASSERT_TRUE(s.IsInvalidArgument());
+
+  // ***************** Group 2 Test *****************
+  // An add to any of the keys wakes the waiter
+  Status gp2_s;
+  std::string gp2_key;
+  blackwidow::ScoreMember gp2_score_member;
+  std::thread gp2_waiter([&]() {
+    gp2_s = db.BZPopMin({"GP2_BZPOP_KEY1", "GP2_BZPOP_KEY2"}, 0,
+                        &gp2_key, &gp2_score_member);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  s = db.ZAdd("GP2_BZPOP_KEY2", {{2, "MM2"}, {1, "MM1"}}, &ret);
+  ASSERT_TRUE(s.ok());
+  gp2_waiter.join();
+  ASSERT_TRUE(gp2_s.ok());
+  ASSERT_EQ(gp2_key, "GP2_BZPOP_KEY2");
+  ASSERT_EQ(gp2_score_member.member, "MM1");
+  ASSERT_TRUE(score_members_match(&db, "GP2_BZPOP_KEY2", {{2, "MM2"}}));
+
+  // ***************** Group 3 Test *****************
+  // So does a ZIncrby
+  Status gp3_s;
+  std::string gp3_key;
+  blackwidow::ScoreMember gp3_score_member;
+  std::thread gp3_waiter([&]() {
+    gp3_s = db.BZPopMax({"GP3_BZPOP_KEY"}, 5000,
+                        &gp3_key, &gp3_score_member);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  double score;
+  s = db.ZIncrby("GP3_BZPOP_KEY", "MM1", 3, &score);
+  ASSERT_TRUE(s.ok());
+  gp3_waiter.join();
+  ASSERT_TRUE(gp3_s.ok());
+  ASSERT_EQ(gp3_score_member.score, 3);
+  ASSERT_EQ(gp3_score_member.member, "MM1");
+}
+
+
+static bool neighbours_match(const std::vector<GeoNeighbour>& neighbours,
+                             const std::vector<std::string>& members) {
+  if (neighbours.size() != members.size()) {
+    return false;
+  }
+  for (size_t idx = 0; idx < neighbours.size(); idx++) {
+    if (neighbours[idx].member != members[idx]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// GeoAdd and GeoDist
+TEST_F(ZSetsTest, GeoAddTest) {
+  int32_t ret;
+  double distance;
+  s = db.GeoAdd("GEOADD_KEY", {{13.361389, 38.115556, "Palermo"},
+                               {15.087269, 37.502669, "Catania"}}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 2);
+  s = db.GeoAdd("GEOADD_KEY", {{13.361389, 38.115556, "Palermo"}}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+
+  // The same geohash scores as redis
+  double score;
+  s = db.ZScore("GEOADD_KEY", "Palermo", &score);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(score, 3479099956230698.0);
+
+  s = db.GeoDist("GEOADD_KEY", "Palermo", "Catania", &distance);
+  ASSERT_TRUE(s.ok());
+  ASSERT_NEAR(distance, 166274.1516, 0.01);
+  s = db.GeoDist("GEOADD_KEY", "Palermo", "Rome", &distance);
+  ASSERT_TRUE(s.IsNotFound());
+
+  s = db.GeoAdd("GEOADD_KEY", {{181, 0, "Invalid"}}, &ret);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  s = db.GeoAdd("GEOADD_KEY", {{0, 85.06, "Invalid"}}, &ret);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  s = db.GeoAdd("GEOADD_KEY", {{180, -85.05112878, "Corner"}}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+}
+
+// GeoRadius, GeoRadiusByMember and GeoSearchBox
+TEST_F(ZSetsTest, GeoRadiusTest) {
+  int32_t ret;
+  std::vector<GeoNeighbour> neighbours;
+  s = db.GeoRadius("GEORADIUS_KEY", 15, 37, 200000, 0, &neighbours);
+  ASSERT_TRUE(s.IsNotFound());
+
+  s = db.GeoAdd("GEORADIUS_KEY", {{13.361389, 38.115556, "Palermo"},
+                                  {15.087269, 37.502669, "Catania"},
+                                  {12.758489, 38.788135, "edge1"},
+                                  {17.241510, 38.788135, "edge2"}}, &ret);
+  ASSERT_TRUE(s.ok());
+
+  s = db.GeoRadius("GEORADIUS_KEY", 15, 37, 200000, 0, &neighbours);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(neighbours_match(neighbours, {"Catania", "Palermo"}));
+  ASSERT_NEAR(neighbours[0].distance, 56441.2645, 0.01);
+  ASSERT_NEAR(neighbours[1].distance, 190442.4351, 0.01);
+  ASSERT_NEAR(neighbours[0].longitude, 15.087269, 0.00001);
+  ASSERT_NEAR(neighbours[0].latitude, 37.502669, 0.00001);
+
+  s = db.GeoRadius("GEORADIUS_KEY", 15, 37, 100000, 0, &neighbours);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(neighbours_match(neighbours, {"Catania"}));
+  s = db.GeoRadius("GEORADIUS_KEY", 15, 37, 200000, 1, &neighbours);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(neighbours_match(neighbours, {"Catania"}));
+  s = db.GeoRadius("GEORADIUS_KEY", 15, 37, -1, 0, &neighbours);
+  ASSERT_TRUE(s.IsInvalidArgument());
+
+  s = db.GeoRadiusByMember("GEORADIUS_KEY", "Palermo", 200000, 0,
+                           &neighbours);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(neighbours_match(neighbours, {"Palermo", "edge1", "Catania"}));
+  ASSERT_EQ(neighbours[0].distance, 0);
+  s = db.GeoRadiusByMember("GEORADIUS_KEY", "Rome", 200000, 0, &neighbours);
+  ASSERT_TRUE(s.IsNotFound());
+
+  s = db.GeoSearchBox("GEORADIUS_KEY", 15, 37, 400000, 400000, 0,
+                      &neighbours);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(neighbours_match(neighbours,
+                               {"Catania", "Palermo", "edge2", "edge1"}));
+  s = db.GeoSearchBox("GEORADIUS_KEY", 15, 37, 400000, 120000, 0,
+                      &neighbours);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(neighbours_match(neighbours, {"Catania"}));
+
+  // Across the antimeridian
+  s = db.GeoAdd("GEORADIUS_DATELINE_KEY", {{179.99, 0, "East"},
+                                           {-179.99, 0, "West"},
+                                           {0, 0, "Far"}}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.GeoRadius("GEORADIUS_DATELINE_KEY", 180, 0, 10000, 0, &neighbours);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(neighbours.size(), 2);
+}
+
+// The cells read by a search cover everything within the shape
+TEST_F(ZSetsTest, GeoRadiusCoverageTest) {
+  int32_t ret;
+  std::vector<GeoMember> members;
+  std::default_random_engine engine(7);
+  std::uniform_real_distribution<double> longitudes(-3, 3);
+  std::uniform_real_distribution<double> latitudes(-3, 3);
+  for (int idx = 0; idx < 2000; idx++) {
+    members.push_back({longitudes(engine), latitudes(engine),
+                       "M" + std::to_string(idx)});
+  }
+  s = db.GeoAdd("GEORADIUS_COVERAGE_KEY", members, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 2000);
+
+  // A search over the whole area gives every distance to the center
+  std::vector<GeoNeighbour> all, neighbours;
+  for (double radius : {1000.0, 20000.0, 75000.0, 300000.0}) {
+    for (int center = 0; center < 10; center++) {
+      double longitude = longitudes(engine);
+      double latitude = latitudes(engine);
+      s = db.GeoRadius("GEORADIUS_COVERAGE_KEY", longitude, latitude,
+                       2000000, 0, &all);
+      ASSERT_TRUE(s.ok());
+      ASSERT_EQ(all.size(), 2000);
+      std::vector<std::string> expected;
+      for (const auto& neighbour : all) {
+        if (neighbour.distance <= radius) {
+          expected.push_back(neighbour.member);
+        }
+      }
+
+      s = db.GeoRadius("GEORADIUS_COVERAGE_KEY", longitude, latitude,
+                       radius, 0, &neighbours);
+      ASSERT_TRUE(s.ok());
+      ASSERT_TRUE(neighbours_match(neighbours, expected));
+    }
+  }
+}
 
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);